@@ -0,0 +1,284 @@
+/*
+    Run the commands of the front-ends on a worker thread.
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#if HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
+#include "async.h"
+#include "commands.h"
+#include "scanmem.h"
+#include "show_message.h"
+
+/* The progress callback is called when the progress grows by this much */
+#define PROGRESS_STEP 0.001
+
+struct sm_async_cmd {
+    char *commandline;
+    sm_async_callbacks callbacks;
+    bool cancelled;
+    bool finished;
+    bool ret;
+    double reported;            /* the progress at the last progress callback */
+    unsigned long found;        /* matches found by the scans of the command */
+    struct sm_async_cmd *next;  /* in the queue */
+};
+
+static struct {
+#if HAVE_PTHREAD
+    pthread_mutex_t lock;
+    pthread_cond_t changed;     /* a command was queued or finished */
+    pthread_t thread;
+    bool started;
+    bool quit;
+#endif
+    sm_async_cmd *head, *tail;  /* the commands not started yet */
+    sm_async_cmd *running;
+} async = {
+#if HAVE_PTHREAD
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER
+#endif
+};
+
+void async_scan_progressed(double scan_progress, unsigned long found)
+{
+    sm_async_cmd *cmd;
+    unsigned long cmd_found = 0;
+    bool report = false;
+
+    /* called by the scan threads, the command is cancelled by another one */
+#if HAVE_PTHREAD
+    pthread_mutex_lock(&async.lock);
+#endif
+    if ((cmd = async.running) != NULL) {
+        if (cmd->cancelled)
+            sm_globals.stop_flag = true;
+
+        cmd->found += found;
+        /* a new scan of the command starts again from 0 */
+        if (scan_progress < cmd->reported)
+            cmd->reported = 0;
+        if (cmd->callbacks.progress && scan_progress - cmd->reported >= PROGRESS_STEP) {
+            cmd->reported = scan_progress;
+            cmd_found = cmd->found;
+            report = true;
+        }
+    }
+#if HAVE_PTHREAD
+    pthread_mutex_unlock(&async.lock);
+#endif
+
+    /* without the lock, the callback may cancel the command */
+    if (report)
+        cmd->callbacks.progress(scan_progress, cmd_found, cmd->callbacks.data);
+}
+
+/* Tells if `cmd` was cancelled, which another thread may be doing */
+static bool cmd_cancelled(sm_async_cmd *cmd)
+{
+    bool cancelled;
+
+#if HAVE_PTHREAD
+    pthread_mutex_lock(&async.lock);
+#endif
+    cancelled = cmd->cancelled;
+#if HAVE_PTHREAD
+    pthread_mutex_unlock(&async.lock);
+#endif
+    return cancelled;
+}
+
+/* Runs `cmd`, which is `async.running`, unless it was cancelled */
+static void run_cmd(sm_async_cmd *cmd)
+{
+    bool ret = false;
+
+    if (!cmd_cancelled(cmd)) {
+        ret = sm_execcommand(&sm_globals, cmd->commandline);
+        fflush(stdout);
+        fflush(stderr);
+    }
+    cmd->ret = ret && !cmd_cancelled(cmd);
+    if (cmd->callbacks.done)
+        cmd->callbacks.done(cmd->ret, sm_globals.num_matches, cmd->callbacks.data);
+}
+
+#if HAVE_PTHREAD
+static void *async_worker(void *arg)
+{
+    (void) arg;
+
+    pthread_mutex_lock(&async.lock);
+    for (;;) {
+        sm_async_cmd *cmd;
+
+        while (async.head == NULL && !async.quit)
+            pthread_cond_wait(&async.changed, &async.lock);
+        if ((cmd = async.head) == NULL)
+            break;
+        if ((async.head = cmd->next) == NULL)
+            async.tail = NULL;
+        async.running = cmd;
+        pthread_mutex_unlock(&async.lock);
+
+        run_cmd(cmd);
+
+        pthread_mutex_lock(&async.lock);
+        /* the stop flag may be left set by the cancel */
+        if (cmd->cancelled)
+            sm_globals.stop_flag = false;
+        async.running = NULL;
+        cmd->finished = true;
+        pthread_cond_broadcast(&async.changed);
+    }
+    pthread_mutex_unlock(&async.lock);
+    return NULL;
+}
+#endif
+
+sm_async_cmd *sm_submit_cmd(const char *commandline, const sm_async_callbacks *callbacks)
+{
+    sm_async_cmd *cmd = calloc(1, sizeof(sm_async_cmd));
+
+    if (cmd == NULL || (cmd->commandline = strdup(commandline)) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        free(cmd);
+        return NULL;
+    }
+    if (callbacks)
+        cmd->callbacks = *callbacks;
+
+#if HAVE_PTHREAD
+    pthread_mutex_lock(&async.lock);
+    /* async_stop() is waiting for the worker to finish the queue */
+    if (async.started && async.quit) {
+        pthread_mutex_unlock(&async.lock);
+        show_error("the worker of the commands is stopping.\n");
+        free(cmd->commandline);
+        free(cmd);
+        return NULL;
+    }
+    if (!async.started) {
+        async.quit = false;
+        if (pthread_create(&async.thread, NULL, async_worker, NULL) != 0) {
+            pthread_mutex_unlock(&async.lock);
+            show_error("failed to start the worker of the commands.\n");
+            free(cmd->commandline);
+            free(cmd);
+            return NULL;
+        }
+        async.started = true;
+    }
+    if (async.tail)
+        async.tail->next = cmd;
+    else
+        async.head = cmd;
+    async.tail = cmd;
+    pthread_cond_broadcast(&async.changed);
+    pthread_mutex_unlock(&async.lock);
+#else
+    /* without threads, the caller's thread is the worker */
+    async.running = cmd;
+    run_cmd(cmd);
+    if (cmd->cancelled)
+        sm_globals.stop_flag = false;
+    async.running = NULL;
+    cmd->finished = true;
+#endif
+    return cmd;
+}
+
+void sm_cancel_cmd(sm_async_cmd *cmd)
+{
+#if HAVE_PTHREAD
+    pthread_mutex_lock(&async.lock);
+#endif
+    if (!cmd->finished) {
+        cmd->cancelled = true;
+        /* for the commands that don't report their progress */
+        if (cmd == async.running)
+            sm_globals.stop_flag = true;
+    }
+#if HAVE_PTHREAD
+    pthread_mutex_unlock(&async.lock);
+#endif
+}
+
+bool sm_cmd_finished(sm_async_cmd *cmd)
+{
+    bool finished;
+
+#if HAVE_PTHREAD
+    pthread_mutex_lock(&async.lock);
+#endif
+    finished = cmd->finished;
+#if HAVE_PTHREAD
+    pthread_mutex_unlock(&async.lock);
+#endif
+    return finished;
+}
+
+bool sm_wait_cmd(sm_async_cmd *cmd)
+{
+    bool ret;
+
+#if HAVE_PTHREAD
+    pthread_mutex_lock(&async.lock);
+    while (!cmd->finished)
+        pthread_cond_wait(&async.changed, &async.lock);
+    pthread_mutex_unlock(&async.lock);
+#endif
+    ret = cmd->ret;
+    free(cmd->commandline);
+    free(cmd);
+    return ret;
+}
+
+void async_stop(void)
+{
+#if HAVE_PTHREAD
+    sm_async_cmd *cmd;
+
+    pthread_mutex_lock(&async.lock);
+    /* nothing to stop, or another thread is stopping it */
+    if (!async.started || async.quit) {
+        pthread_mutex_unlock(&async.lock);
+        return;
+    }
+    for (cmd = async.head; cmd; cmd = cmd->next)
+        cmd->cancelled = true;
+    if (async.running) {
+        async.running->cancelled = true;
+        sm_globals.stop_flag = true;
+    }
+    async.quit = true;
+    pthread_cond_broadcast(&async.changed);
+    pthread_mutex_unlock(&async.lock);
+
+    /* the worker finishes the queue, with the commands cancelled */
+    pthread_join(async.thread, NULL);
+    pthread_mutex_lock(&async.lock);
+    async.started = false;
+    pthread_mutex_unlock(&async.lock);
+#endif
+}
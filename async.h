@@ -0,0 +1,31 @@
+/*
+    Run the commands of the front-ends on a worker thread.
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ASYNC_H
+#define ASYNC_H
+
+/* Called by the scans as they progress, with the new `scan_progress` and
+ * the `found` matches since the last call, one thread at a time. It reports
+ * them to the command being run, and stops the scan if it was cancelled. */
+void async_scan_progressed(double scan_progress, unsigned long found);
+
+/* Cancels the commands submitted, waits for the worker and stops it */
+void async_stop(void);
+
+#endif /* ASYNC_H */
@@ -22,6 +22,8 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <sys/types.h>
 
 #include "common.h"
@@ -92,3 +94,39 @@ bool sm_process_is_dead(pid_t pid)
 {
     return (check_process(pid) != PROC_RUNNING);
 }
+
+bool parse_interval(const char *str, unsigned long *us)
+{
+    char *end = NULL;
+    double seconds;
+
+    seconds = strtod(str, &end);
+    if (end == str)
+        return false;
+    if (strcmp(end, "ms") == 0)
+        seconds /= 1000;
+    else if (strcmp(end, "us") == 0)
+        seconds /= 1000000;
+    else if (*end != '\0')
+        return false;
+
+    /* also refuses NaN */
+    if (!(seconds >= 0 && seconds * 1000000 < (double) ULONG_MAX))
+        return false;
+
+    /* nonzero intervals below a microsecond round up to one */
+    *us = (unsigned long) (seconds * 1000000 + 0.5);
+    if (*us == 0 && seconds > 0)
+        *us = 1;
+    return true;
+}
+
+void format_interval(unsigned long us, char *buf, size_t n)
+{
+    if (us % 1000000 == 0)
+        snprintf(buf, n, "%lu s", us / 1000000);
+    else if (us % 1000 == 0)
+        snprintf(buf, n, "%lu ms", us / 1000);
+    else
+        snprintf(buf, n, "%lu us", us);
+}
@@ -23,11 +23,16 @@
 #define COMMON_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
 #include <sys/types.h>
 
 #ifndef MIN
 # define MIN(a,b) ((a) < (b) ? (a) : (b))
 #endif
+#ifndef MAX
+# define MAX(a,b) ((a) > (b) ? (a) : (b))
+#endif
 
 /* From `include/linux/compiler.h`, in the linux kernel:
  * Offers a simple interface to the expect builtin */
@@ -75,4 +80,24 @@
 /* Function declarations */
 bool sm_process_is_dead(pid_t pid);
 
+/* Intervals of the background engines, in microseconds. They are given in
+ * seconds, possibly fractional, or with a `ms` or `us` suffix. */
+bool parse_interval(const char *str, unsigned long *us);
+void format_interval(unsigned long us, char *buf, size_t n);
+
+static inline void timespec_add_us(struct timespec *t, unsigned long us)
+{
+    t->tv_sec += us / 1000000;
+    t->tv_nsec += (long) (us % 1000000) * 1000;
+    if (t->tv_nsec >= 1000000000) {
+        t->tv_sec++;
+        t->tv_nsec -= 1000000000;
+    }
+}
+
+static inline bool timespec_before(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
 #endif /* COMMON_H */
@@ -0,0 +1,446 @@
+/*
+    Keep setting values in the background.
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#if HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
+#include "common.h"
+#include "freeze.h"
+#include "scanmem.h"
+#include "show_message.h"
+
+#if HAVE_PTHREAD
+
+/* A freeze, see freeze_start() */
+typedef struct freeze {
+    struct freeze *next;
+    char *description;
+    unsigned long interval_us;
+    struct timespec due;        /* of the next tick */
+    size_t num_values;
+    size_t num_runs;
+    struct iovec *runs;         /* the target memory written on each tick */
+    uint8_t *data;              /* the bytes of `runs`, back to back */
+} freeze_t;
+
+/* The thread writing the freezes, and the freezes, guarded by `lock` */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        /* signalled when the freezes change */
+    pthread_t thread;
+    bool running;               /* `thread` was started and isn't joined yet */
+    bool quit;                  /* asks `thread` to return, or it gave up */
+    pid_t target;
+    int procmem_fd;
+    bool vm_writev_usable;      /* false once `process_vm_writev()` was refused */
+    freeze_t *freezes;          /* in the order they were started */
+    size_t num_freezes;
+} engine = { .lock = PTHREAD_MUTEX_INITIALIZER, .procmem_fd = -1 };
+
+/* Orders values by address, and values at the same address as given */
+static int compare_values(const void *a, const void *b)
+{
+    const frozen_value *x = *(const frozen_value **) a;
+    const frozen_value *y = *(const frozen_value **) b;
+
+    if (x->address != y->address)
+        return x->address < y->address ? -1 : 1;
+    return x < y ? -1 : x > y;
+}
+
+static void free_freeze(freeze_t *f)
+{
+    free(f->description);
+    free(f->runs);
+    free(f->data);
+    free(f);
+}
+
+/* Merges `values` into runs of adjacent bytes, each run is a single write.
+ * Values are laid out in order, so of overlapping values the last one wins,
+ * as if they had been written one after the other. */
+static freeze_t *make_freeze(const frozen_value *values, size_t count,
+                             unsigned long interval_us, const char *description)
+{
+    const frozen_value **sorted = NULL;
+    size_t *offsets = NULL;
+    size_t i, size = 0;
+    freeze_t *f;
+
+    if ((f = calloc(1, sizeof(freeze_t))) == NULL)
+        return NULL;
+    f->interval_us = interval_us;
+    f->num_values = count;
+    if ((f->description = strdup(description)) == NULL)
+        goto error;
+    if ((sorted = malloc(count * sizeof(*sorted))) == NULL
+        || (f->runs = malloc(count * sizeof(struct iovec))) == NULL
+        || (offsets = malloc(count * sizeof(size_t))) == NULL)
+        goto error;
+
+    for (i = 0; i < count; i++)
+        sorted[i] = &values[i];
+    qsort(sorted, count, sizeof(*sorted), compare_values);
+
+    /* merge the values that touch into runs */
+    for (i = 0; i < count; i++) {
+        uint8_t *start = sorted[i]->address;
+        uint8_t *end = start + sorted[i]->length;
+        struct iovec *run = f->num_runs > 0 ? &f->runs[f->num_runs - 1] : NULL;
+
+        if (run && start <= (uint8_t *) run->iov_base + run->iov_len) {
+            if (end > (uint8_t *) run->iov_base + run->iov_len)
+                run->iov_len = end - (uint8_t *) run->iov_base;
+        } else {
+            f->runs[f->num_runs].iov_base = start;
+            f->runs[f->num_runs].iov_len = sorted[i]->length;
+            f->num_runs++;
+        }
+    }
+    for (i = 0; i < f->num_runs; i++) {
+        offsets[i] = size;
+        size += f->runs[i].iov_len;
+    }
+
+    /* lay out the values, in the order they were given */
+    if ((f->data = malloc(size)) == NULL)
+        goto error;
+    for (i = 0; i < count; i++) {
+        size_t lo = 0, hi = f->num_runs - 1;
+
+        /* the last run starting at or before the value */
+        while (lo < hi) {
+            size_t mid = (lo + hi + 1) / 2;
+            if ((uint8_t *) f->runs[mid].iov_base <= (uint8_t *) values[i].address)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        memcpy(f->data + offsets[lo] + ((uint8_t *) values[i].address - (uint8_t *) f->runs[lo].iov_base),
+               values[i].bytes, values[i].length);
+    }
+
+    free(offsets);
+    free(sorted);
+    return f;
+
+error:
+    free(offsets);
+    free(sorted);
+    free_freeze(f);
+    return NULL;
+}
+
+/* Writes the values of `f` into the target, false if some of them couldn't
+ * be written */
+static bool write_freeze(const freeze_t *f)
+{
+    return sm_write_runs(engine.target, engine.procmem_fd, &engine.vm_writev_usable,
+                         f->runs, f->num_runs, f->data) == 0;
+}
+
+/* The thread that writes each freeze when it is due */
+static void *run_freezes(void *arg)
+{
+    (void) arg;
+
+    pthread_mutex_lock(&engine.lock);
+    while (!engine.quit) {
+        freeze_t *next = NULL, *f;
+        struct timespec now;
+
+        for (f = engine.freezes; f; f = f->next)
+            if (next == NULL || timespec_before(&f->due, &next->due))
+                next = f;
+        if (next == NULL) {
+            pthread_cond_wait(&engine.wake, &engine.lock);
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (timespec_before(&now, &next->due)) {
+            pthread_cond_timedwait(&engine.wake, &engine.lock, &next->due);
+            continue;
+        }
+
+        if (!write_freeze(next)) {
+            freeze_t **link;
+
+            if (sm_process_is_dead(engine.target)) {
+                show_info("target process died, stopping the freezes.\n");
+                engine.quit = true;
+                break;
+            }
+
+            /* the others may still be written */
+            show_warn("couldn't write the target, stopping the freeze of %s.\n",
+                      next->description);
+            for (link = &engine.freezes; *link != next; link = &(*link)->next)
+                ;
+            *link = next->next;
+            engine.num_freezes--;
+            free_freeze(next);
+            continue;
+        }
+
+        /* ticks missed while the target was busy aren't caught up */
+        timespec_add_us(&next->due, next->interval_us);
+        if (timespec_before(&next->due, &now)) {
+            next->due = now;
+            timespec_add_us(&next->due, next->interval_us);
+        }
+    }
+    pthread_mutex_unlock(&engine.lock);
+
+    return NULL;
+}
+
+static bool start_engine(pid_t target)
+{
+    pthread_condattr_t attr;
+
+    engine.target = target;
+    engine.quit = false;
+#if HAVE_PROCESS_VM_WRITEV
+    engine.vm_writev_usable = true;
+#endif
+#if HAVE_PROCMEM
+    {
+        char mem[32];
+
+        snprintf(mem, sizeof(mem), "/proc/%d/mem", target);
+        engine.procmem_fd = open(mem, O_RDWR);
+# if !HAVE_PROCESS_VM_WRITEV
+        if (engine.procmem_fd == -1) {
+            show_error("unable to open %s.\n", mem);
+            return false;
+        }
+# endif
+    }
+#endif
+
+    /* ticks are timed on the monotonic clock, unmoved by clock changes */
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&engine.wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&engine.thread, NULL, run_freezes, NULL) != 0) {
+        show_error("failed to start the freeze thread.\n");
+        pthread_cond_destroy(&engine.wake);
+        if (engine.procmem_fd != -1)
+            close(engine.procmem_fd);
+        engine.procmem_fd = -1;
+        return false;
+    }
+    engine.running = true;
+    return true;
+}
+
+/* Joins the thread and frees all the freezes */
+static void stop_engine(void)
+{
+    if (engine.running) {
+        pthread_mutex_lock(&engine.lock);
+        engine.quit = true;
+        pthread_cond_signal(&engine.wake);
+        pthread_mutex_unlock(&engine.lock);
+
+        pthread_join(engine.thread, NULL);
+        pthread_cond_destroy(&engine.wake);
+        engine.running = false;
+    }
+
+    while (engine.freezes) {
+        freeze_t *f = engine.freezes;
+        engine.freezes = f->next;
+        free_freeze(f);
+    }
+    engine.num_freezes = 0;
+
+    if (engine.procmem_fd != -1)
+        close(engine.procmem_fd);
+    engine.procmem_fd = -1;
+}
+
+/* Cleans up after a thread that gave up on its own */
+static void reap_engine(void)
+{
+    bool quit;
+
+    if (!engine.running)
+        return;
+    pthread_mutex_lock(&engine.lock);
+    quit = engine.quit;
+    pthread_mutex_unlock(&engine.lock);
+    if (quit)
+        stop_engine();
+}
+
+bool freeze_start(pid_t target, const frozen_value *values, size_t count,
+                  unsigned long interval_us, const char *description)
+{
+    freeze_t *f, **tail;
+
+#if !HAVE_PROCESS_VM_WRITEV && !HAVE_PROCMEM
+    show_error("cannot write the target without process_vm_writev() or /proc/pid/mem.\n");
+    return false;
+#endif
+
+    reap_engine();
+    if (engine.running && engine.target != target)
+        stop_engine();
+
+    if (count == 0)
+        return true;
+    if ((f = make_freeze(values, count, interval_us, description)) == NULL) {
+        show_error("memory allocation error while starting a freeze.\n");
+        return false;
+    }
+    if (!engine.running && !start_engine(target)) {
+        free_freeze(f);
+        return false;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &f->due);
+    timespec_add_us(&f->due, interval_us);
+
+    pthread_mutex_lock(&engine.lock);
+    /* a freeze that can't be written now would never be */
+    if (!write_freeze(f)) {
+        pthread_mutex_unlock(&engine.lock);
+        show_error("couldn't write the target, the freeze of %s is not started.\n", description);
+        free_freeze(f);
+        if (engine.num_freezes == 0)
+            stop_engine();
+        return false;
+    }
+    for (tail = &engine.freezes; *tail; tail = &(*tail)->next)
+        ;
+    *tail = f;
+    engine.num_freezes++;
+    pthread_cond_signal(&engine.wake);
+    pthread_mutex_unlock(&engine.lock);
+
+    return true;
+}
+
+size_t freeze_count(void)
+{
+    reap_engine();
+    return engine.num_freezes;
+}
+
+void freeze_list(FILE *outfd)
+{
+    freeze_t *f;
+    size_t id = 0;
+
+    reap_engine();
+    pthread_mutex_lock(&engine.lock);
+    for (f = engine.freezes; f; f = f->next, id++) {
+        char interval[32];
+
+        format_interval(f->interval_us, interval, sizeof(interval));
+        fprintf(outfd, "[%2zu] every %s, %zu values in %zu writes, set %s\n",
+                id, interval, f->num_values, f->num_runs, f->description);
+    }
+    pthread_mutex_unlock(&engine.lock);
+}
+
+void freeze_stop(const struct set *ids)
+{
+    freeze_t **link = &engine.freezes, *stopped = NULL;
+    size_t id = 0, i = 0;
+
+    reap_engine();
+    pthread_mutex_lock(&engine.lock);
+    /* `ids` is sorted */
+    while (*link && i < ids->size) {
+        freeze_t *f = *link;
+
+        if (id++ == ids->buf[i]) {
+            *link = f->next;
+            f->next = stopped;
+            stopped = f;
+            engine.num_freezes--;
+            i++;
+        } else {
+            link = &f->next;
+        }
+    }
+    pthread_cond_signal(&engine.wake);
+    pthread_mutex_unlock(&engine.lock);
+
+    while (stopped) {
+        freeze_t *f = stopped;
+        stopped = f->next;
+        free_freeze(f);
+    }
+    if (engine.num_freezes == 0)
+        stop_engine();
+}
+
+void freeze_stop_all(void)
+{
+    stop_engine();
+}
+
+#else /* !HAVE_PTHREAD */
+
+bool freeze_start(pid_t target, const frozen_value *values, size_t count,
+                  unsigned long interval_us, const char *description)
+{
+    (void) target; (void) values; (void) count;
+    (void) interval_us; (void) description;
+
+    show_error("continuous `set` needs threads, which this build lacks.\n");
+    return false;
+}
+
+size_t freeze_count(void)
+{
+    return 0;
+}
+
+void freeze_list(FILE *outfd)
+{
+    (void) outfd;
+}
+
+void freeze_stop(const struct set *ids)
+{
+    (void) ids;
+}
+
+void freeze_stop_all(void)
+{
+}
+
+#endif /* HAVE_PTHREAD */
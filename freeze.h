@@ -0,0 +1,54 @@
+/*
+    Keep setting values in the background.
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FREEZE_H
+#define FREEZE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "sets.h"
+
+/* A value to keep in the target, already in target byte order */
+typedef struct {
+    void *address;
+    uint8_t bytes[sizeof(uint64_t)];
+    uint8_t length;
+} frozen_value;
+
+/*
+ * A freeze writes its values into `target` every `interval_us` microseconds,
+ * from a thread of its own so that commands keep running meanwhile. The
+ * values are sorted and adjacent ones merged, so that each tick takes a
+ * single `process_vm_writev()` (or a `pwrite()` per run of bytes). Writes
+ * don't stop the target, and don't need it attached.
+ * All freezes are stopped when the target changes or dies. A freeze is
+ * written once before it starts, and not started if that write fails; one
+ * that fails to be written later is stopped.
+ */
+bool freeze_start(pid_t target, const frozen_value *values, size_t count,
+                  unsigned long interval_us, const char *description);
+size_t freeze_count(void);
+void freeze_list(FILE *outfd);
+void freeze_stop(const struct set *ids);
+void freeze_stop_all(void);
+
+#endif /* FREEZE_H */
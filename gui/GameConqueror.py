@@ -26,6 +26,7 @@
 import sys
 import os
 import argparse
+import bisect
 import struct
 import platform
 import threading
@@ -57,7 +58,7 @@ WORK_DIR = os.path.dirname(sys.argv[0])
 PROGRESS_INTERVAL = 100 # for scan progress updates
 DATA_WORKER_INTERVAL = 500 # for read(update)/write(lock)
 HEXEDIT_SPAN = 1024 # hexview half-height
-SCAN_RESULT_LIST_LIMIT = 10000 # maximal number of entries that can be displayed
+SCAN_RESULT_LIST_LIMIT = 100000 # maximal number of entries that can be displayed
 
 SCAN_VALUE_TYPES = ['int', 'int8', 'int16', 'int32', 'int64', 'float', 'float32', 'float64', 'number', 'bytearray', 'string']
 
@@ -317,6 +318,7 @@ class GameConqueror():
         # init others (backend, flag...)
         self.pid = 0 # target pid
         self.maps = []
+        self.map_starts = []
         self.is_scanning = False
         self.exit_flag = False # currently for data_worker only, other 'threads' may also use this flag
 
@@ -832,10 +834,10 @@ class GameConqueror():
             return
         selected_region = None
         if addr is not None:
-            for m in self.maps:
-                if m['start_addr'] <= addr and addr < m['end_addr']:
-                    selected_region = m
-                    break
+            # the maps are sorted, the last one starting before addr may hold it
+            i = bisect.bisect_right(self.map_starts, addr) - 1
+            if i >= 0 and addr < self.maps[i]['end_addr']:
+                selected_region = self.maps[i]
             if selected_region:
                 if selected_region['flags'][0] != 'r': # not readable
                     self.show_error(_('Address %x is not readable') % (addr,))
@@ -953,6 +955,7 @@ class GameConqueror():
             else:
                 item['pathname'] = info[5].lstrip() # don't use strip
             self.maps.append(item)
+        self.map_starts = [m['start_addr'] for m in self.maps]
 
     def reset_scan(self):
         # reset search type and value type
@@ -1064,20 +1067,19 @@ class GameConqueror():
             if misc.PY3K:
                 addr = GObject.Value(GObject.TYPE_UINT64)
                 off = GObject.Value(GObject.TYPE_UINT64)
-            for (mid_str, addr_str, off_str, rt, val, t) in matches:
+            for (mid, match_addr, match_off, rt, val, t) in matches:
                 if t == 'unknown':
                     continue
-                mid = int(mid_str)
                 # `insert_with_valuesv` has the same function of `append`, but it's 7x faster
                 # PY3 has problems with int's, so we need a forced guint64 conversion
                 # See: https://bugzilla.gnome.org/show_bug.cgi?id=769532
                 # Still 5x faster even with the extra baggage
                 if misc.PY3K:
-                    addr.set_uint64(int(addr_str, 16))
-                    off.set_uint64(int(off_str, 16))
+                    addr.set_uint64(match_addr)
+                    off.set_uint64(match_off)
                 else:
-                    addr = long(addr_str, 16)
-                    off = long(off_str, 16)
+                    addr = long(match_addr)
+                    off = long(match_off)
                 self.scanresult_liststore.insert_with_valuesv(-1, [0, 1, 2, 3, 4, 5, 6], [addr, val, t, True, off, rt, mid])
                 # self.scanresult_liststore.append([addr, val, t, True, off, rt, mid])
             self.scanresult_tv.set_model(self.scanresult_liststore)
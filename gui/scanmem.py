@@ -22,13 +22,63 @@
 import ctypes
 import os
 import re
+import struct
 import sys
 import tempfile
 
 import misc
 
+class MatchRecord(ctypes.Structure):
+    """sm_match_record of libscanmem"""
+    _fields_ = [('address', ctypes.c_uint64),
+                ('offset', ctypes.c_uint64),
+                ('region_id', ctypes.c_uint32),
+                ('flags', ctypes.c_uint16),
+                ('region_type', ctypes.c_uint8),
+                ('kind', ctypes.c_uint8),
+                ('value', ctypes.c_uint8 * 8)]
+
+SM_MATCH_NUMBER = 0
+REGION_TYPE_NAMES = ('misc', 'code', 'exe', 'heap', 'stack')
+
+# the flags of each integer width, unsigned and signed, then the floats,
+# in the order the values are shown by `list`
+INTEGER_FLAGS = ((64, 1 << 6, 1 << 7, 'Q', 'q'),
+                 (32, 1 << 4, 1 << 5, 'I', 'i'),
+                 (16, 1 << 2, 1 << 3, 'H', 'h'),
+                 (8, 1 << 0, 1 << 1, 'B', 'b'))
+FLAG_F32 = 1 << 8
+FLAG_F64 = 1 << 9
+
+def format_number(flags, data):
+    """Returns (value, types) of a number match as `list` shows them"""
+    types = ''
+    for (bits, u, s, _, _) in INTEGER_FLAGS:
+        if flags & u and flags & s:
+            types += 'I%d ' % (bits,)
+        elif flags & u:
+            types += 'I%du ' % (bits,)
+        elif flags & s:
+            types += 'I%ds ' % (bits,)
+    if flags & FLAG_F64:
+        types += 'F64 '
+    if flags & FLAG_F32:
+        types += 'F32 '
+    for (bits, u, s, ufmt, sfmt) in INTEGER_FLAGS:
+        if flags & u:
+            return (str(struct.unpack_from(ufmt, data)[0]), types)
+        if flags & s:
+            return (str(struct.unpack_from(sfmt, data)[0]), types)
+    if flags & FLAG_F64:
+        return ('%g' % struct.unpack_from('d', data)[0], types)
+    if flags & FLAG_F32:
+        return ('%g' % struct.unpack_from('f', data)[0], types)
+    return ('unknown', 'unknown')
+
 class Scanmem():
     """Wrapper for libscanmem."""
+
+    MATCHES_PAGE = 4096
     
     LIBRARY_FUNCS = {
         'sm_init' : (ctypes.c_bool, ),
@@ -39,7 +89,9 @@ class Scanmem():
         'sm_get_version' : (ctypes.c_char_p, ),
         'sm_get_scan_progress' : (ctypes.c_double, ),
         'sm_set_stop_flag' : (None, ctypes.c_bool),
-        'sm_process_is_dead' : (ctypes.c_bool, ctypes.c_int32)
+        'sm_process_is_dead' : (ctypes.c_bool, ctypes.c_int32),
+        'sm_get_matches' : (ctypes.c_size_t, ctypes.POINTER(MatchRecord), ctypes.c_size_t,
+                            ctypes.POINTER(ctypes.c_ulong))
     }
 
     def __init__(self, libpath='libscanmem.so'):
@@ -101,13 +153,31 @@ class Scanmem():
     
     def matches(self):
         """
-        Returns a generator of (match_id_str, addr_str, off_str, region_type, value, types_str) for each match, all strings.
+        Returns a generator of (match_id, addr, off, region_type, value_str, types_str) for each match.
         The function executes commands internally, it is NOT thread safe
         """
+        records = (MatchRecord * Scanmem.MATCHES_PAGE)()
+        cursor = ctypes.c_ulong(0)
+        while True:
+            count = self._lib.sm_get_matches(records, Scanmem.MATCHES_PAGE, ctypes.byref(cursor))
+            for i in range(count):
+                r = records[i]
+                if r.kind != SM_MATCH_NUMBER:
+                    # the values of strings and bytearrays don't fit the records
+                    for match in self._listed_matches():
+                        yield match
+                    return
+                (value, types) = format_number(r.flags, bytes(bytearray(r.value)))
+                yield (cursor.value - count + i, r.address, r.offset,
+                       REGION_TYPE_NAMES[r.region_type], value, types)
+            if count < Scanmem.MATCHES_PAGE:
+                return
+
+    def _listed_matches(self):
         list_bytes = self.send_command('list', get_output=True)
         lines = filter(None, misc.decode(list_bytes).split('\n'))
         
         line_regex = re.compile(r'^\[ *(\d+)\] +([\da-f]+), +\d+ \+ +([\da-f]+), +(\w+), (.*), +\[([\w ]+)\]$')
         for line in lines:
-            yield line_regex.match(line).groups()
-        
+            (mid, addr, off, rt, val, t) = line_regex.match(line).groups()
+            yield (int(mid), int(addr, 16), int(off, 16), rt, val, t)
@@ -50,8 +50,11 @@
 #include "common.h"
 #include "commands.h"
 #include "endianness.h"
+#include "freeze.h"
+#include "watch.h"
 #include "handlers.h"
 #include "interrupt.h"
+#include "pointers.h"
 #include "scanmem.h"
 #include "scanroutines.h"
 #include "sets.h"
@@ -88,15 +91,57 @@
 #define POINTER_FMT "%12lx"
 #endif
 
+/* Puts the matches of a snapshot into swaths, for the commands that go
+ * through them */
+static bool materialize_matches(globals_t *vars)
+{
+    if (vars->matches && vars->matches->images && !materialize_snapshot(vars->matches)) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
+    return true;
+}
+
+/* Sets the `index`th element of `swath` to `userval`, and copies the value
+ * written to `frozen` if the setting continues in a freeze */
+static bool set_match(globals_t *vars, matches_and_old_values_swath *swath, size_t index,
+                      const uservalue_t *userval, frozen_value *frozen)
+{
+    void *address = remote_address_of_nth_element(swath, index);
+    value_t v;
+
+    v = data_to_val(swath, index);
+    /* copy userval onto v */
+    /* XXX: valcmp? make sure the sizes match */
+    uservalue2value(&v, userval);
+
+    show_info("setting *%p to %#"PRIx64"...\n", address, v.int64_value);
+
+    /* set the value specified */
+    fix_endianness(&v, vars->options.reverse_endianness);
+    if (sm_setaddr(vars->target, address, &v) == false) {
+        show_error("failed to set a value.\n");
+        return false;
+    }
+
+    if (frozen) {
+        frozen->address = address;
+        frozen->length = flags_to_memlength(ANYNUMBER, v.flags);
+        memcpy(frozen->bytes, v.bytes, sizeof(frozen->bytes));
+    }
+    return true;
+}
+
 bool handler__set(globals_t * vars, char **argv, unsigned argc)
 {
-    unsigned block, seconds = 1;
+    unsigned block;
     char *delay = NULL;
-    bool cont = false;
     struct setting {
         char *matchids;
         char *value;
-        unsigned seconds;
+        unsigned long interval; /* microseconds between sets, 0 to set once */
+        frozen_value *frozen;   /* the values the freeze keeps setting */
+        size_t num_frozen;
     } *settings = NULL;
 
     assert(argc != 0);
@@ -122,6 +167,8 @@ bool handler__set(globals_t * vars, char **argv, unsigned argc)
         show_error("no matches are known.\n");
         return false;
     }
+    if (!materialize_matches(vars))
+        return false;
 
     /* --- parse arguments into settings structs --- */
 
@@ -150,28 +197,18 @@ bool handler__set(globals_t * vars, char **argv, unsigned argc)
 
         /* now check for a delay suffix (meaning continuous mode), eg 0xff/10 */
         if ((delay = strchr(settings[block].value, '/')) != NULL) {
-            char *end = NULL;
-
-            /* parse delay count */
-            settings[block].seconds = strtoul(delay + 1, &end, 10);
 
             if (*(delay + 1) == '\0') {
                 /* empty delay count, eg: 12=32/ */
                 show_error("you specified an empty delay count, `%s`, see `help set`.\n", settings[block].value);
                 return false;
-            } else if (*end != '\0') {
-                /* parse failed before end, probably trailing garbage, eg 34=9/16foo */
-                show_error("trailing garbage after delay count, `%s`.\n", settings[block].value);
+            } else if (!parse_interval(delay + 1, &settings[block].interval)) {
+                /* probably trailing garbage, eg 34=9/16foo */
+                show_error("bad delay count, `%s`, see `help set`.\n", settings[block].value);
                 return false;
-            } else if (settings[block].seconds == 0) {
+            } else if (settings[block].interval == 0) {
                 /* 10=24/0 disables continuous mode */
                 show_info("you specified a zero delay, disabling continuous mode.\n");
-            } else {
-                /* valid delay count seen and understood */
-                show_info("setting %s every %u seconds until interrupted...\n", settings[block].matchids ? settings[block].  matchids : "all", settings[block].seconds);
-
-                /* continuous mode on */
-                cont = true;
             }
 
             /* remove any delay suffix from the value */
@@ -187,160 +224,215 @@ bool handler__set(globals_t * vars, char **argv, unsigned argc)
         /* control returns here when interrupted */
 // settings is allocated with alloca, do not free it
 //        free(settings);
-        sm_detach(vars->target);
+        for (block = 0; block < argc - 1; block++)
+            free(settings[block].frozen);
+        sm_end_session(vars->target);
         ENDINTERRUPTABLE();
         return true;
     }
 
     /* --- execute the parsed setting structs --- */
 
-    while (true) {
-        uservalue_t userval;
+    /* all the values are set in a single attach */
+    if (!sm_begin_session(vars->target))
+        goto fail;
 
-        /* for every settings struct */
-        for (block = 0; block < argc - 1; block++) {
+    /* for every settings struct */
+    for (block = 0; block < argc - 1; block++) {
+        uservalue_t userval;
+        frozen_value *frozen = NULL;
 
-            /* check if this block has anything to do in this iteration */
-            if (seconds != 1) {
-                /* not the first iteration (all blocks get executed first iteration) */
+        /* convert value */
+        if (!parse_uservalue_number(settings[block].value, &userval)) {
+            show_error("bad number `%s` provided\n", settings[block].value);
+            goto fail;
+        }
 
-                /* if settings.seconds is zero, then this block is only executed once */
-                /* if seconds % settings.seconds is zero, then this block must be executed */
-                if (settings[block].seconds == 0
-                    || (seconds % settings[block].seconds) != 0)
-                    continue;
-            }
+        /* check if specific match(s) were specified */
+        if (settings[block].matchids != NULL) {
+            struct set match_set;
+            match_location loc;
 
-            /* convert value */
-            if (!parse_uservalue_number(settings[block].value, &userval)) {
-                show_error("bad number `%s` provided\n", settings[block].value);
+            if (parse_uintset(settings[block].matchids, &match_set, vars->num_matches)
+                    == false) {
+                show_error("failed to parse the set, try `help set`.\n");
                 goto fail;
             }
 
-            /* check if specific match(s) were specified */
-            if (settings[block].matchids != NULL) {
-                struct set match_set;
-                match_location loc;
-
-                if (parse_uintset(settings[block].matchids, &match_set, vars->num_matches)
-                        == false) {
-                    show_error("failed to parse the set, try `help set`.\n");
+            /* continuous blocks keep what they set for their freeze */
+            if (settings[block].interval) {
+                settings[block].frozen = malloc(match_set.size * sizeof(frozen_value));
+                if (settings[block].frozen == NULL) {
+                    show_error("sorry, there was a memory allocation error.\n");
+                    set_cleanup(&match_set);
                     goto fail;
                 }
+            }
 
-                foreach_set_fw(i, &match_set) {
-                    loc = nth_match(vars->matches, match_set.buf[i]);
-                    if (loc.swath) {
-                        value_t v;
-                        void *address = remote_address_of_nth_element(loc.swath, loc.index);
-
-                        v = data_to_val(loc.swath, loc.index);
-                        /* copy userval onto v */
-                        /* XXX: valcmp? make sure the sizes match */
-                        uservalue2value(&v, &userval);
-                        
-                        show_info("setting *%p to %#"PRIx64"...\n", address, v.int64_value);
-
-                        /* set the value specified */
-                        fix_endianness(&v, vars->options.reverse_endianness);
-                        if (sm_setaddr(vars->target, address, &v) == false) {
-                            show_error("failed to set a value.\n");
-                            set_cleanup(&match_set);
-                            goto fail;
-                        }
-                    } else {
-                        show_error("BUG: set: id <%zu> match failure\n", match_set.buf[i]);
+            foreach_set_fw(i, &match_set) {
+                loc = nth_match(vars->matches, match_set.buf[i]);
+                if (loc.swath) {
+                    if (settings[block].frozen)
+                        frozen = &settings[block].frozen[settings[block].num_frozen++];
+                    if (!set_match(vars, loc.swath, loc.index, &userval, frozen)) {
                         set_cleanup(&match_set);
                         goto fail;
                     }
+                } else {
+                    show_error("BUG: set: id <%zu> match failure\n", match_set.buf[i]);
+                    set_cleanup(&match_set);
+                    goto fail;
                 }
-                set_cleanup(&match_set);
-            } else {
-                matches_and_old_values_swath *reading_swath_index = vars->matches->swaths;
-                size_t reading_iterator = 0;
-
-                /* user wants to set all matches */
-                while (reading_swath_index->first_byte_in_child) {
-
-                    /* only actual matches are considered */
-                    if (reading_swath_index->data[reading_iterator].match_info != flags_empty)
-                    {
-                        void *address = remote_address_of_nth_element(reading_swath_index, reading_iterator);
-                        value_t v;
+            }
+            set_cleanup(&match_set);
+        } else {
+            matches_and_old_values_swath *reading_swath_index = vars->matches->swaths;
+            size_t reading_iterator = 0;
 
-                        v = data_to_val(reading_swath_index, reading_iterator);
-                        /* XXX: as above : make sure the sizes match */
-                        uservalue2value(&v, &userval);
+            if (settings[block].interval) {
+                settings[block].frozen = malloc(vars->num_matches * sizeof(frozen_value));
+                if (settings[block].frozen == NULL) {
+                    show_error("sorry, there was a memory allocation error.\n");
+                    goto fail;
+                }
+            }
 
-                        show_info("setting *%p to %#"PRIx64"...\n", address, v.int64_value);
+            /* user wants to set all matches */
+            while (reading_swath_index->first_byte_in_child) {
 
-                        fix_endianness(&v, vars->options.reverse_endianness);
-                        if (sm_setaddr(vars->target, address, &v) == false) {
-                            show_error("failed to set a value.\n");
-                            goto fail;
-                        }
-                    }
-                     
-                     /* go on to the next one... */
-                    ++reading_iterator;
-                    if (reading_iterator >= reading_swath_index->number_of_bytes)
-                    {
-                        reading_swath_index = local_address_beyond_last_element(reading_swath_index);
-                        reading_iterator = 0;
-                    }
+                /* only actual matches are considered */
+                if (flags_of_nth_element(reading_swath_index, reading_iterator) != flags_empty)
+                {
+                    if (settings[block].frozen)
+                        frozen = &settings[block].frozen[settings[block].num_frozen++];
+                    if (!set_match(vars, reading_swath_index, reading_iterator, &userval, frozen))
+                        goto fail;
+                }
+                 
+                 /* go on to the next one... */
+                ++reading_iterator;
+                if (reading_iterator >= reading_swath_index->number_of_bytes)
+                {
+                    reading_swath_index = next_swath(reading_swath_index);
+                    reading_iterator = 0;
                 }
-            }                   /* if (matchid != NULL) else ... */
-        }                       /* for(block) */
-
-        if (cont) {
-            sleep(1);
-            if (sm_process_is_dead(vars->target)) {
-                vars->target = 0;
-                show_info("target process died, interrupting set operation.\n");
-                break;
             }
-        } else {
-            break;
-        }
-
-        seconds++;
-    }                           /* while(true) */
+        }                       /* if (matchid != NULL) else ... */
+    }                           /* for(block) */
 
+    sm_end_session(vars->target);
     ENDINTERRUPTABLE();
+
+    /* continuous blocks go on in the background, see `help freeze` */
+    for (block = 0; block < argc - 1; block++) {
+        char interval[32];
+
+        if (settings[block].interval == 0)
+            continue;
+        if (!freeze_start(vars->target, settings[block].frozen, settings[block].num_frozen,
+                          settings[block].interval, argv[block + 1])) {
+            while (block < argc - 1)
+                free(settings[block++].frozen);
+            return false;
+        }
+        format_interval(settings[block].interval, interval, sizeof(interval));
+        show_info("setting %s every %s as freeze %zu, stop it with `freeze stop`.\n",
+                  settings[block].matchids ? settings[block].matchids : "all",
+                  interval, freeze_count() - 1);
+        free(settings[block].frozen);
+    }
     return true;
 
 fail:
+    for (block = 0; block < argc - 1; block++)
+        free(settings[block].frozen);
+    sm_end_session(vars->target);
     ENDINTERRUPTABLE();
     return false;
     
 }
 
-/* Accepts a numerical argument to print up to N matches, defaults to 10k
+bool handler__freeze(globals_t *vars, char **argv, unsigned argc)
+{
+    struct set ids;
+
+    USEPARAMS();
+
+    if (argc == 1) {
+        if (freeze_count() == 0)
+            show_info("no freezes are running.\n");
+        freeze_list(stdout);
+        return true;
+    }
+
+    if (strcmp(argv[1], "stop") != 0 || argc > 3) {
+        show_error("bad arguments, see `help freeze`.\n");
+        return false;
+    }
+
+    if (argc == 2) {
+        freeze_stop_all();
+        return true;
+    }
+
+    if (!parse_uintset(argv[2], &ids, freeze_count())) {
+        show_error("failed to parse the set, try `help freeze`.\n");
+        return false;
+    }
+    freeze_stop(&ids);
+    set_cleanup(&ids);
+    return true;
+}
+
+/* Accepts a numerical argument to print up to N matches, defaults to 10k,
+ * or the first match to print and N. A page that starts where the previous
+ * one stopped resumes from there.
  * FORMAT (don't change, front-end depends on this):
  * [#no] addr, value, [possible types (separated by space)]
  */
 bool handler__list(globals_t *vars, char **argv, unsigned argc)
 {
     unsigned long num = 0;
+    unsigned long start = 0;
+    match_location loc;
     size_t buf_len = 128; /* will be realloc'd later if necessary */
-    element_t *np = NULL;
+    const region_index *index;
+    const region_t *region = NULL;
     char *v = NULL;
     const char *bytearray_suffix = ", [bytearray]";
     const char *string_suffix = ", [string]";
     FILE *pager = stdout;
 
     unsigned long max_to_print = 10000;
+    if (argc > 3) {
+        show_error("too many arguments, see `help list`.\n");
+        return false;
+    }
+    if (argc == 3) {
+        char *end;
+
+        start = strtoul(argv[1], &end, 0x00);
+        if (*argv[1] == '\0' || *end != '\0') {
+            show_error("`%s` is not a valid match-id.\n", argv[1]);
+            return false;
+        }
+    }
     if (argc > 1) {
-        max_to_print = strtoul(argv[1], NULL, 0x00);
+        max_to_print = strtoul(argv[argc - 1], NULL, 0x00);
 
         if (max_to_print == 0) {
-            show_error("`%s` is not a valid positive integer.\n", argv[1]);
+            show_error("`%s` is not a valid positive integer.\n", argv[argc - 1]);
             return false;
         }
     }
 
-    if (vars->num_matches == 0)
+    if (vars->num_matches == 0 || !materialize_matches(vars))
+        return false;
+
+    if (start >= vars->num_matches) {
+        show_error("there are only %ld matches.\n", vars->num_matches);
         return false;
+    }
 
     if ((v = malloc(buf_len)) == NULL)
     {
@@ -348,11 +440,12 @@ bool handler__list(globals_t *vars, char **argv, unsigned argc)
         return false;
     }
 
-    if (vars->regions)
-        np = vars->regions->head;
+    index = sm_get_regions_index(vars);
 
-    matches_and_old_values_swath *reading_swath_index = vars->matches->swaths;
-    size_t reading_iterator = 0;
+    loc = seek_match(vars->matches, start);
+    matches_and_old_values_swath *reading_swath_index = loc.swath;
+    size_t reading_iterator = loc.index;
+    num = start;
 
     if (isatty(STDOUT_FILENO)) {
         struct winsize w;
@@ -362,20 +455,20 @@ bool handler__list(globals_t *vars, char **argv, unsigned argc)
             pager = get_pager(stdout);
         } else {
             /* check if the output fits in the terminal window */
-            if (w.ws_row <= MIN(max_to_print, vars->num_matches))
+            if (w.ws_row <= MIN(max_to_print, vars->num_matches - start))
                 pager = get_pager(stdout);
         }
     }
 
     /* list all known matches */
     while (reading_swath_index->first_byte_in_child) {
-        if (num == max_to_print) {
+        if (num - start == max_to_print) {
             if (num < vars->num_matches && !vars->options.backend)
                 fprintf(pager, "[...]\n");
             break;
         }
 
-        match_flags flags = reading_swath_index->data[reading_iterator].match_info;
+        match_flags flags = flags_of_nth_element(reading_swath_index, reading_iterator);
 
         /* only actual matches are considered */
         if (flags != flags_empty)
@@ -420,20 +513,18 @@ bool handler__list(globals_t *vars, char **argv, unsigned argc)
             unsigned int region_id = 99;
             unsigned long match_off = 0;
             const char *region_type = "??";
-            /* get region info belonging to the match -
-             * note: we assume the regions list and matches are sorted
-             */
-            while (np) {
-                region_t *region = np->data;
-                unsigned long region_start = (unsigned long)region->start;
-                if (address_ul < region_start + region->size &&
-                  address_ul >= region_start) {
-                    region_id = region->id;
-                    match_off = address_ul - region->load_addr;
-                    region_type = region_type_names[region->type];
-                    break;
-                }
-                np = np->next;
+            /* get region info belonging to the match, the next matches
+             * are usually in the same region */
+            if (index && (region == NULL || address < region->start ||
+                          address >= region->start + region->size)) {
+                size_t pos = sm_find_region(index, address);
+
+                region = pos < index->count ? index->regions[pos] : NULL;
+            }
+            if (region) {
+                region_id = region->id;
+                match_off = address_ul - region->load_addr;
+                region_type = region_type_names[region->type];
             }
             fprintf(pager, "[%2lu] "POINTER_FMT", %2u + "POINTER_FMT", %5s, %s\n",
                    num++, address_ul, region_id, match_off, region_type, v);
@@ -443,11 +534,14 @@ bool handler__list(globals_t *vars, char **argv, unsigned argc)
         ++reading_iterator;
         if (reading_iterator >= reading_swath_index->number_of_bytes)
         {
-            reading_swath_index = local_address_beyond_last_element(reading_swath_index);
+            reading_swath_index = next_swath(reading_swath_index);
             reading_iterator = 0;
         }
     }
 
+    /* the next page starts here */
+    set_match_cursor(vars->matches, num, (match_location){ reading_swath_index, reading_iterator });
+
     free(v);
     close_pager(pager);
     return true;
@@ -475,6 +569,10 @@ bool handler__delete(globals_t * vars, char **argv, unsigned argc)
         show_error("failed to parse the set, try `help delete`.\n");
         return false;
     }
+    if (!materialize_matches(vars)) {
+        set_cleanup(&del_set);
+        return false;
+    }
 
     size_t match_counter = 0;
     size_t set_idx = 0;
@@ -483,15 +581,18 @@ bool handler__delete(globals_t * vars, char **argv, unsigned argc)
 
     size_t reading_iterator = 0;
 
+    /* the match ids after the first deleted one change */
+    invalidate_match_index(vars->matches);
+
     while (reading_swath_index->first_byte_in_child) {
         /* only actual matches are considered */
-        if (reading_swath_index->data[reading_iterator].match_info != flags_empty) {
+        if (flags_of_nth_element(reading_swath_index, reading_iterator) != flags_empty) {
 
             if (match_counter++ == del_set.buf[set_idx]) {
                 /* It is not reasonable to check if the matches array can be
                  * downsized after the deletion.
                  * So just zero its flags, to mark it as not a REAL match */
-                reading_swath_index->data[reading_iterator].match_info = flags_empty;
+                set_flags_of_nth_element(reading_swath_index, reading_iterator, flags_empty);
                 vars->num_matches--;
 
                 if (set_idx++ == del_set.size - 1) {
@@ -505,7 +606,7 @@ bool handler__delete(globals_t * vars, char **argv, unsigned argc)
         ++reading_iterator;
         if (reading_iterator >= reading_swath_index->number_of_bytes) {
             reading_swath_index =
-                local_address_beyond_last_element(reading_swath_index);
+                next_swath(reading_swath_index);
 
             reading_iterator = 0;
         }
@@ -516,16 +617,86 @@ bool handler__delete(globals_t * vars, char **argv, unsigned argc)
     return false;
 }
 
+/* Rereads the regions, the matches of the memory unmapped since are deleted
+ * and the memory mapped since joins them */
+static bool refresh_regions(globals_t *vars)
+{
+    list_t *unmapped, *mapped;
+    address_range *ranges = NULL;
+    element_t *n;
+    size_t count = 0;
+    bool ret = false;
+
+    if ((unmapped = l_init()) == NULL || (mapped = l_init()) == NULL) {
+        l_destroy(unmapped);
+        show_error("sorry, there was a problem allocating memory.\n");
+        return false;
+    }
+
+    sm_regions_changed(vars);
+    if (!sm_refreshmaps(vars->target, vars->regions, vars->options.region_scan_level,
+                        unmapped, mapped)) {
+        show_error("sorry, there was a problem getting a list of regions to search.\n");
+        show_warn("the pid may be invalid, or you don't have permission.\n");
+        goto out;
+    }
+    show_info("%lu parts of regions unmapped, %lu mapped.\n", unmapped->size, mapped->size);
+
+    if (vars->matches && unmapped->size > 0) {
+        if ((ranges = malloc(unmapped->size * sizeof(address_range))) == NULL) {
+            show_error("sorry, there was a problem allocating memory.\n");
+            goto out;
+        }
+        for (n = unmapped->head; n; n = n->next) {
+            region_t *r = n->data;
+
+            ranges[count].start = r->start;
+            ranges[count++].end = r->start + r->size;
+        }
+        vars->matches = delete_in_address_ranges(vars->matches, &vars->num_matches,
+                                                 ranges, count);
+        if (vars->matches == NULL) {
+            show_error("memory allocation error while deleting matches\n");
+            goto out;
+        }
+    }
+
+    ret = sm_add_regions(vars, mapped);
+    if (ret && vars->matches)
+        show_info("we currently have %ld matches.\n", vars->num_matches);
+
+out:
+    free(ranges);
+    l_destroy(unmapped);
+    l_destroy(mapped);
+    return ret;
+}
+
 bool handler__reset(globals_t * vars, char **argv, unsigned argc)
 {
-    USEPARAMS();
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "keep") != 0)) {
+        show_error("unknown argument, see `help reset`.\n");
+        return false;
+    }
+
+    if (argc == 2) {
+        if (vars->target == 0) {
+            show_error("no target specified, see `help pid`\n");
+            return false;
+        }
+        return refresh_regions(vars);
+    }
 
     /* reset scan progress */
     vars->scan_progress = 0;
 
-    if (vars->matches) { free(vars->matches); vars->matches = NULL; vars->num_matches = 0; }
+    if (vars->matches) { free_array(vars->matches); vars->matches = NULL; vars->num_matches = 0; }
+
+    /* the pointers of another target, or of the target long ago */
+    pointers_free();
 
     /* refresh list of regions */
+    sm_regions_changed(vars);
     l_destroy(vars->regions);
 
     /* create a new linked list of regions */
@@ -557,6 +728,10 @@ bool handler__pid(globals_t * vars, char **argv, unsigned argc)
             show_error("`%s` does not look like a valid pid.\n", argv[1]);
             return false;
         }
+        /* the addresses of the freezes are meaningless in another process */
+        freeze_stop_all();
+        watch_stop();
+        sm_set_scan_scope(vars, NULL, 0);
     } else if (vars->target) {
         /* print the pid of the target program */
         show_info("target pid is %u.\n", vars->target);
@@ -581,9 +756,9 @@ bool handler__snapshot(globals_t *vars, char **argv, unsigned argc)
     }
 
     /* remove any existing matches */
-    if (vars->matches) { free(vars->matches); vars->matches = NULL; vars->num_matches = 0; }
+    if (vars->matches) { free_array(vars->matches); vars->matches = NULL; vars->num_matches = 0; }
 
-    if (sm_searchregions(vars, MATCHANY, NULL) != true) {
+    if (sm_snapshot(vars) != true) {
         show_error("failed to save target address space.\n");
         return false;
     }
@@ -592,6 +767,13 @@ bool handler__snapshot(globals_t *vars, char **argv, unsigned argc)
 }
 
 /* dregion <region-id set> */
+static int compare_ranges(const void *a, const void *b)
+{
+    const address_range *x = a, *y = b;
+
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
 bool handler__dregion(globals_t *vars, char **argv, unsigned argc)
 {
     struct set reg_set;
@@ -621,50 +803,56 @@ bool handler__dregion(globals_t *vars, char **argv, unsigned argc)
         return false;
     }
 
-    /* loop for every reg_id in the set */
+    const region_index *index = sm_get_regions_index(vars);
+    address_range *ranges;
+    size_t count = 0;
+
+    if (index == NULL || (ranges = malloc(reg_set.size * sizeof(address_range))) == NULL) {
+        show_error("memory allocation error while deleting regions\n");
+        set_cleanup(&reg_set);
+        return false;
+    }
+
+    /* find the region of every reg_id in the set */
     for (size_t set_idx = 0; set_idx < reg_set.size; set_idx++) {
         size_t reg_id = reg_set.buf[set_idx];
-        
-        /* initialize list pointers */
-        element_t *np = vars->regions->head;
-        element_t *pp = NULL;
-        
-        /* find the correct region node */
-        while (np) {
-            region_t *r = np->data;
-            
-            /* compare the node id to the id the user specified */
-            if (r->id == reg_id)
-                break;
-            
-            pp = np; /* keep track of prev for l_remove() */
-            np = np->next;
-        }
+        size_t pos = sm_find_region_id(index, reg_id);
 
-        /* check if a match was found */
-        if (np == NULL) {
+        if (pos == index->count) {
             show_warn("no region matching %lu, or already removed.\n", reg_id);
             continue;
         }
-        
-        /* check for any affected matches before removing it */
-        if(vars->num_matches > 0)
-        {
-            region_t *reg_to_delete = np->data;
+        ranges[count].start = index->regions[pos]->start;
+        ranges[count++].end = index->regions[pos]->start + index->regions[pos]->size;
+    }
+    set_cleanup(&reg_set);
+    qsort(ranges, count, sizeof(address_range), compare_ranges);
 
-            void *start_address = reg_to_delete->start;
-            void *end_address = reg_to_delete->start + reg_to_delete->size;
-            vars->matches = delete_in_address_range(vars->matches, &vars->num_matches,
-                                                    start_address, end_address);
-            if (vars->matches == NULL)
-            {
-                show_error("memory allocation error while deleting matches\n");
-            }
-        }
+    /* check for any affected matches before removing them */
+    if (vars->num_matches > 0 && count > 0) {
+        vars->matches = delete_in_address_ranges(vars->matches, &vars->num_matches,
+                                                 ranges, count);
+        if (vars->matches == NULL)
+            show_error("memory allocation error while deleting matches\n");
+    }
 
-        l_remove(vars->regions, pp, NULL);
+    /* then remove the regions, in a single walk of the list */
+    element_t *np = vars->regions->head;
+    element_t *pp = NULL; /* keep track of prev for l_remove() */
+
+    while (np && count > 0) {
+        region_t *r = np->data;
+        address_range key = { r->start, r->start + r->size };
+
+        np = np->next;
+        if (bsearch(&key, ranges, count, sizeof(address_range), compare_ranges))
+            l_remove(vars->regions, pp, NULL);
+        else
+            pp = pp ? pp->next : vars->regions->head;
     }
+    sm_regions_changed(vars);
 
+    free(ranges);
     return true;
 }
 
@@ -897,13 +1085,42 @@ static inline bool parse_uservalue_default(const char *str, uservalue_t *val)
     return ret;
 }
 
+/* Parses a number, or a range `n..m` into both `vals`, and sets the
+ * `match_type` of a scan for it */
+static bool parse_uservalue_default_or_range(char *str, uservalue_t vals[2],
+                                             scan_match_type_t *match_type)
+{
+    char *pos = strstr(str, "..");
+
+    *match_type = MATCHEQUALTO;
+    if (pos == NULL)
+        return parse_uservalue_default(str, &vals[0]);
+
+    /* a range */
+    *pos = '\0';
+    if (!parse_uservalue_default(str, &vals[0]) ||
+        !parse_uservalue_default(pos + 2, &vals[1]))
+        return false;
+
+    /* Check that the range is nonempty */
+    if (vals[0].float64_value > vals[1].float64_value) {
+        show_error("Empty range\n");
+        return false;
+    }
+
+    /* Store the bitwise AND of both flags in the first value,
+     * so that range scanroutines need only one flag testing. */
+    vals[0].flags &= vals[1].flags;
+    *match_type = MATCHRANGE;
+    return true;
+}
+
 bool handler__default(globals_t * vars, char **argv, unsigned argc)
 {
     uservalue_t vals[2];
     uservalue_t *val = &vals[0];
     scan_match_type_t m = MATCHEQUALTO;
     char *ustr = argv[0];
-    char *pos;
     bool ret = false;
 
     zero_uservalue(val);
@@ -925,31 +1142,8 @@ bool handler__default(globals_t * vars, char **argv, unsigned argc)
             show_error("unknown command\n");
             goto retl;
         }
-        /* detect a range */
-        pos = strstr(ustr, "..");
-        if (pos) {
-            *pos = '\0';
-            if (!parse_uservalue_default(ustr, &vals[0]))
-                goto retl;
-            ustr = pos + 2;
-            if (!parse_uservalue_default(ustr, &vals[1]))
-                goto retl;
-
-            /* Check that the range is nonempty */
-            if (vals[0].float64_value > vals[1].float64_value) {
-                show_error("Empty range\n");
-                goto retl;
-            }
-
-            /* Store the bitwise AND of both flags in the first value,
-             * so that range scanroutines need only one flag testing. */
-            vals[0].flags &= vals[1].flags;
-            m = MATCHRANGE;
-        }
-        else {
-            if (!parse_uservalue_default(ustr, val))
-                goto retl;
-        }
+        if (!parse_uservalue_default_or_range(ustr, vals, &m))
+            goto retl;
         break;
     case BYTEARRAY:
         /* attempt to parse command as a bytearray */
@@ -1153,95 +1347,363 @@ bool handler__shell(globals_t * vars, char **argv, unsigned argc)
     return true;
 }
 
+/* Prints the latest `max` changes of the watch log, oldest first */
+static bool print_watch_log(globals_t *vars, size_t max, bool drain)
+{
+    watch_change *changes;
+    unsigned long dropped;
+    size_t n, i;
+
+    if ((changes = malloc(MIN(max, WATCH_LOG_SIZE) * sizeof(watch_change))) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
+
+    n = watch_read_log(changes, MIN(max, WATCH_LOG_SIZE), drain, &dropped);
+    for (i = 0; i < n; i++) {
+        char buf[128], timestamp[64];
+        struct tm tm;
+        value_t val = changes[i].value;
+
+        localtime_r(&changes[i].time.tv_sec, &tm);
+        strftime(timestamp, sizeof(timestamp), "%T", &tm);
+        fix_endianness(&val, vars->options.reverse_endianness);
+        valtostr(&val, buf, sizeof(buf));
+
+        printf("[%s.%06ld] %10p -> %s\n", timestamp,
+               changes[i].time.tv_nsec / 1000, changes[i].address, buf);
+    }
+    if (dropped)
+        show_warn("%lu older changes were dropped, the log keeps the last %d.\n",
+                  dropped, WATCH_LOG_SIZE);
+
+    free(changes);
+    return true;
+}
+
+/* The type the values at watched addresses are shown as */
+static match_flags scan_data_type_flags(scan_data_type_t data_type)
+{
+    switch (data_type) {
+    case INTEGER8:  return flags_i8b;
+    case INTEGER16: return flags_i16b;
+    case INTEGER32: return flags_i32b;
+    case INTEGER64: return flags_i64b;
+    case FLOAT32:   return flag_f32b;
+    case FLOAT64:   return flag_f64b;
+    default:        return flags_empty;
+    }
+}
+
 bool handler__watch(globals_t * vars, char **argv, unsigned argc)
 {
-    size_t id;
-    char *end = NULL, buf[128], timestamp[64];
-    time_t t;
-    match_location loc;
-    value_t val;
-    void *address;
+    char *what, *delay, interval[32];
+    unsigned long interval_us = 1000000;
+    watched_value *values = NULL;
+    size_t count = 0;
     scan_data_type_t data_type = vars->options.scan_data_type;
-    scan_routine_t valuecmp_routine;
+    bool ret;
 
-    if (argc != 2) {
+    if (argc == 1) {
+        watch_info info;
+
+        watch_get_info(&info);
+        if (info.running) {
+            format_interval(info.interval_us, interval, sizeof(interval));
+            show_info("watching %zu values every %s, %lu samples taken.\n",
+                      info.num_values, interval, info.samples);
+        } else {
+            show_info("nothing is being watched.\n");
+        }
+        show_info("%zu changes are logged, %lu were dropped.\n", info.logged, info.dropped);
+        return true;
+    }
+    if (argc > 3) {
+        show_error("too many arguments, see `help watch`.\n");
+        return false;
+    }
+
+    if (strcmp(argv[1], "stop") == 0 && argc == 2) {
+        watch_stop();
+        return true;
+    } else if (strcmp(argv[1], "drain") == 0 && argc == 2) {
+        return print_watch_log(vars, WATCH_LOG_SIZE, true);
+    } else if (strcmp(argv[1], "log") == 0) {
+        size_t max = WATCH_LOG_SIZE;
+
+        if (argc == 3) {
+            char *end = NULL;
+
+            max = strtoul(argv[2], &end, 0x00);
+            if (argv[2][0] == '\0' || *end != '\0') {
+                show_error("sorry, couldn't parse `%s`, try `help watch`\n", argv[2]);
+                return false;
+            }
+        }
+        return print_watch_log(vars, max, false);
+    } else if (argc != 2) {
         show_error("was expecting one argument, see `help watch`.\n");
         return false;
     }
+
     if ((data_type == BYTEARRAY) || (data_type == STRING)) {
         show_error("`watch` is not supported for bytearray or string.\n");
         return false;
     }
 
-    /* parse argument */
-    id = strtoul(argv[1], &end, 0x00);
+    /* separate the interval suffix, eg 0..9/10ms */
+    what = strdupa(argv[1]);
+    if ((delay = strchr(what, '/')) != NULL) {
+        *delay++ = '\0';
+        if (!parse_interval(delay, &interval_us) || interval_us == 0) {
+            show_error("bad interval `%s`, see `help watch`.\n", delay);
+            return false;
+        }
+    }
 
-    /* check that strtoul() worked */
-    if (argv[1][0] == '\0' || *end != '\0') {
-        show_error("sorry, couldn't parse `%s`, try `help watch`\n",
-                argv[1]);
-        return false;
+    if (what[0] == '*') {
+        /* a list of addresses, shown as the scan data type */
+        match_flags flags = scan_data_type_flags(data_type);
+        char *item, *saveptr = NULL;
+
+        if (flags == flags_empty) {
+            show_error("watching addresses needs a scan_data_type of a single width, e.g. int32.\n");
+            return false;
+        }
+        if ((values = malloc((strlen(what) / 2 + 1) * sizeof(watched_value))) == NULL) {
+            show_error("sorry, there was a memory allocation error.\n");
+            return false;
+        }
+        for (item = strtok_r(what, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+            char *end = NULL;
+
+            if (item[0] == '*')
+                item++;
+            values[count].address = (void *)(intptr_t) strtoull(item, &end, 0x00);
+            if (item[0] == '\0' || *end != '\0') {
+                show_error("sorry, couldn't parse the address `%s`, try `help watch`\n", item);
+                free(values);
+                return false;
+            }
+            values[count++].flags = flags;
+        }
+    } else {
+        /* a set of matches, shown as their possible types */
+        struct set match_set;
+
+        if (vars->num_matches == 0) {
+            show_error("no matches are known.\n");
+            return false;
+        }
+        if (!materialize_matches(vars))
+            return false;
+        if (!parse_uintset(what, &match_set, vars->num_matches)) {
+            show_error("failed to parse the set, try `help watch`.\n");
+            return false;
+        }
+        if ((values = malloc(match_set.size * sizeof(watched_value))) == NULL) {
+            show_error("sorry, there was a memory allocation error.\n");
+            set_cleanup(&match_set);
+            return false;
+        }
+        foreach_set_fw(i, &match_set) {
+            match_location loc = nth_match(vars->matches, match_set.buf[i]);
+
+            if (!loc.swath) {
+                show_error("BUG: watch: id <%zu> match failure\n", match_set.buf[i]);
+                set_cleanup(&match_set);
+                free(values);
+                return false;
+            }
+            values[count].address = remote_address_of_nth_element(loc.swath, loc.index);
+            values[count++].flags = flags_of_nth_element(loc.swath, loc.index);
+        }
+        set_cleanup(&match_set);
     }
-    
-    loc = nth_match(vars->matches, id);
 
-    /* check that this is a valid match-id */
-    if (!loc.swath) {
-        show_error("you specified a non-existent match `%lu`.\n", id);
-        show_info("use \"list\" to list matches, or \"help\" for other commands.\n");
+    ret = watch_start(vars->target, values, count, interval_us);
+    free(values);
+    if (ret) {
+        format_interval(interval_us, interval, sizeof(interval));
+        show_info("watching %zu values every %s, see the changes with `watch log`.\n",
+                  count, interval);
+    }
+    return ret;
+}
+
+#include "licence.h"
+
+bool handler__stats(globals_t * vars, char **argv, unsigned argc)
+{
+    static const char *phase_names[] = SM_PHASE_NAMES;
+    sm_scan_stats stats;
+    unsigned phase;
+
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "reset") != 0)) {
+        show_error("unknown argument, see `help stats`.\n");
         return false;
     }
-    
-    address = remote_address_of_nth_element(loc.swath, loc.index);
-    
-    val = data_to_val(loc.swath, loc.index);
+    if (argc == 2) {
+        sm_reset_scan_stats();
+        return true;
+    }
 
-    if (INTERRUPTABLE()) {
-        (void) sm_detach(vars->target);
-        ENDINTERRUPTABLE();
+    sm_get_scan_stats(&stats);
+
+    /* one counter per line for the front-ends */
+    if (vars->options.backend) {
+        printf("bytes_read %lu\n", stats.bytes_read);
+        printf("read_syscalls %lu\n", stats.read_syscalls);
+        printf("short_reads %lu\n", stats.short_reads);
+        printf("peek_hits %lu\n", stats.peek.hits);
+        printf("peek_misses %lu\n", stats.peek.misses);
+        printf("peek_pages_read %lu\n", stats.peek.pages_read);
+        printf("allocations %lu\n", stats.allocations);
+        printf("allocated_bytes %lu\n", stats.allocated_bytes);
+        printf("bytes_copied %lu\n", stats.bytes_copied);
+        for (phase = 0; phase < SM_PHASES; phase++) {
+            const sm_phase_stats *p = &stats.phases[phase];
+
+            printf("%s_runs %lu\n", phase_names[phase], p->runs);
+            printf("%s_wall_seconds %.6f\n", phase_names[phase], p->wall_seconds);
+            printf("%s_cpu_seconds %.6f\n", phase_names[phase], p->cpu_seconds);
+            printf("%s_last_wall_seconds %.6f\n", phase_names[phase], p->last_wall_seconds);
+            printf("%s_last_matches_in %lu\n", phase_names[phase], p->last_matches_in);
+            printf("%s_last_matches_out %lu\n", phase_names[phase], p->last_matches_out);
+        }
         return true;
     }
 
-    /* every entry is timestamped */
-    t = time(NULL);
-    strftime(timestamp, sizeof(timestamp), "[%T]", localtime(&t));
+    printf("reads:     %lu bytes in %lu syscalls, %lu short\n",
+           stats.bytes_read, stats.read_syscalls, stats.short_reads);
+    printf("peeks:     %lu hits, %lu misses, %lu pages read\n",
+           stats.peek.hits, stats.peek.misses, stats.peek.pages_read);
+    printf("matches:   %lu allocations of %lu bytes, %lu bytes copied\n",
+           stats.allocations, stats.allocated_bytes, stats.bytes_copied);
+    for (phase = 0; phase < SM_PHASES; phase++) {
+        const sm_phase_stats *p = &stats.phases[phase];
 
-    show_info("%s monitoring %10p for changes until interrupted...\n", timestamp, address);
+        if (p->runs == 0)
+            continue;
+        printf("%-10s %lu runs in %.3f s, %.3f s of cpu, "
+               "the last one in %.3f s, from %lu to %lu matches\n",
+               phase_names[phase], p->runs, p->wall_seconds, p->cpu_seconds,
+               p->last_wall_seconds, p->last_matches_in, p->last_matches_out);
+    }
+    return true;
+}
 
-    valuecmp_routine = sm_get_scanroutine(ANYNUMBER, MATCHCHANGED, flags_empty, vars->options.reverse_endianness);
-    while (true) {
-        const mem64_t *memory_ptr;
-        size_t memlength;
+/* Prints a chain found by `pointers`, `data` counts them */
+static void print_chain(const pointer_chain *chain, void *data)
+{
+    unsigned long *num = data;
+    const region_t *r = chain->base_region;
+    unsigned i;
 
-        if (sm_attach(vars->target) == false)
-            return false;
+    printf("[%2lu] "POINTER_FMT", %2u + "POINTER_FMT", %5s,", (*num)++,
+           (unsigned long)chain->base, r->id, (unsigned long)(chain->base - r->load_addr),
+           region_type_names[r->type]);
+    for (i = 0; i < chain->depth; i++)
+        printf(" +%lx", (unsigned long)chain->offsets[i]);
+    printf("\n");
+}
 
-        if (sm_peekdata(address, sizeof(uint64_t), &memory_ptr, &memlength) == false)
-            return false;
+static bool parse_ulong(const char *str, int base, unsigned long *value)
+{
+    char *end;
 
-        /* check if the new value is different */
-        match_flags tmpflags = flags_empty;
-        if ((*valuecmp_routine)(memory_ptr, memlength, &val, NULL, &tmpflags)) {
+    errno = 0;
+    *value = strtoul(str, &end, base);
+    return *str != '\0' && *end == '\0' && errno == 0;
+}
+
+bool handler__pointers(globals_t *vars, char **argv, unsigned argc)
+{
+    unsigned long address, depth = 3, max_offset = 0x1000, max_chains = 100, num = 0;
+    const region_index *index;
+    pointer_map_info info;
+
+    if (argc == 1) {
+        if (!pointers_get_info(&info)) {
+            show_info("no pointer map, see `help pointers`.\n");
+            return true;
+        }
+        show_info("%zu pointers aligned to %zu, from %lu bytes of %lu regions.\n",
+                  info.count, info.alignment, info.bytes_read, info.num_regions);
+        return true;
+    }
 
-            memcpy(val.bytes, memory_ptr, memlength);
+    if (strcmp(argv[1], "clear") == 0 && argc == 2) {
+        pointers_free();
+        return true;
+    }
 
-            valtostr(&val, buf, sizeof(buf));
+    if (vars->target == 0) {
+        show_error("no target specified, see `help pid`\n");
+        return false;
+    }
+    if ((index = sm_get_regions_index(vars)) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
 
-            /* fetch new timestamp */
-            t = time(NULL);
-            strftime(timestamp, sizeof(timestamp), "[%T]", localtime(&t));
+    if (strcmp(argv[1], "map") == 0) {
+        unsigned long alignment = sizeof(void *);
 
-            show_info("%s %10p -> %s\n", timestamp, address, buf);
+        if (argc > 3 || (argc == 3 && (!parse_ulong(argv[2], 0, &alignment) || alignment == 0 ||
+                                       (alignment & (alignment - 1)) != 0))) {
+            show_error("bad alignment, see `help pointers`.\n");
+            return false;
         }
+        vars->stop_flag = false;
+        if (!pointers_map(vars->target, vars->regions, index, alignment, &vars->stop_flag))
+            return false;
+        pointers_get_info(&info);
+        show_info("%zu pointers aligned to %zu, from %lu bytes of %lu regions.\n",
+                  info.count, info.alignment, info.bytes_read, info.num_regions);
+        return true;
+    }
 
-        /* detach after valuecmp_routine, since it may read more data (e.g. bytearray) */
-        sm_detach(vars->target);
+    if (argc > 5 || !parse_ulong(argv[1], 16, &address) ||
+        (argc > 2 && (!parse_ulong(argv[2], 10, &depth) || depth == 0 ||
+                      depth > POINTER_MAX_DEPTH)) ||
+        (argc > 3 && !parse_ulong(argv[3], 0, &max_offset)) ||
+        (argc > 4 && !parse_ulong(argv[4], 0, &max_chains))) {
+        show_error("bad arguments, see `help pointers`.\n");
+        return false;
+    }
 
-        (void) sleep(1);
+    /* the map is made once, the chains are only looked up in it */
+    if (!pointers_get_info(&info)) {
+        vars->stop_flag = false;
+        if (!pointers_map(vars->target, vars->regions, index, sizeof(void *), &vars->stop_flag))
+            return false;
     }
+    vars->stop_flag = false;
+    pointers_find_chains(index, address, depth, max_offset, max_chains, &vars->stop_flag,
+                         print_chain, &num);
+    fflush(stdout);
+    show_info("found %lu pointer chains to %lx.\n", num, address);
+    return true;
 }
 
-#include "licence.h"
+bool handler__save(globals_t *vars, char **argv, unsigned argc)
+{
+    if (argc != 2) {
+        show_error("bad arguments, see `help save`.\n");
+        return false;
+    }
+    return sm_save_session(vars, argv[1]);
+}
+
+bool handler__load(globals_t *vars, char **argv, unsigned argc)
+{
+    if (argc != 2) {
+        show_error("bad arguments, see `help load`.\n");
+        return false;
+    }
+    return sm_load_session(vars, argv[1]);
+}
 
 bool handler__show(globals_t * vars, char **argv, unsigned argc)
 {
@@ -1438,6 +1900,135 @@ static inline scan_data_type_t parse_scan_data_type(const char *str)
     return (scan_data_type_t)(-1);
 }
 
+/* Parses the members of a group, from "TYPE VALUE", the anchor, then
+ * "+OFFSET TYPE VALUE" or "~DISTANCE TYPE VALUE" for each of the others */
+static bool parse_group(char **argv, unsigned argc, bool reverse_endianness,
+                        struct scan_group *group)
+{
+    unsigned i = 0;
+
+    memset(group, 0, sizeof(*group));
+
+    while (i < argc) {
+        scan_group_member *member = &group->members[group->num_members];
+        unsigned long offset = 0;
+        char placement = '+';
+        size_t end;
+
+        if (group->num_members == MAX_GROUP_MEMBERS) {
+            show_error("a group has at most %u members.\n", MAX_GROUP_MEMBERS);
+            return false;
+        }
+
+        /* the place of the member, from the anchor */
+        if (group->num_members > 0) {
+            char *endptr;
+
+            placement = argv[i][0];
+            errno = 0;
+            offset = strtoul(&argv[i][1], &endptr, 0);
+            if ((placement != '+' && placement != '~') || argv[i][1] == '\0' ||
+                *endptr != '\0' || errno != 0 || offset == 0 || offset > UINT16_MAX) {
+                show_error("bad offset `%s`, see `help group`.\n", argv[i]);
+                return false;
+            }
+            i++;
+        }
+
+        if (i + 2 > argc) {
+            show_error("please specify the type and the value of each member, see `help group`.\n");
+            return false;
+        }
+        member->data_type = parse_scan_data_type(argv[i]);
+        if (member->data_type == (scan_data_type_t)(-1) ||
+            member->data_type == BYTEARRAY || member->data_type == STRING) {
+            show_error("bad type `%s` of a member, see `help group`.\n", argv[i]);
+            return false;
+        }
+
+        zero_uservalue(&member->values[0]);
+        zero_uservalue(&member->values[1]);
+        if (!parse_uservalue_default_or_range(argv[i + 1], member->values, &member->match_type))
+            return false;
+        if ((member->values[0].flags & sm_get_possible_flags(member->data_type)) == flags_empty) {
+            show_error("member %u can't be of type %s.\n", group->num_members + 1, argv[i]);
+            return false;
+        }
+        member->routine = sm_get_scanroutine(member->data_type, member->match_type,
+                                             member->values[0].flags, reverse_endianness);
+        assert(member->routine);
+
+        member->min_offset = placement == '~' ? 1 : offset;
+        member->max_offset = offset;
+        end = offset + flags_to_memlength(member->data_type,
+                                          sm_get_possible_flags(member->data_type));
+        if (end > UINT16_MAX) {
+            show_error("a group is limited to %u bytes.\n", UINT16_MAX);
+            return false;
+        }
+        group->length = MAX(group->length, end);
+        group->num_members++;
+        i += 2;
+    }
+
+    return true;
+}
+
+bool handler__group(globals_t *vars, char **argv, unsigned argc)
+{
+    struct scan_group group;
+    uservalue_t val;
+
+    /* test scan_data_type */
+    if (vars->options.scan_data_type != BYTEARRAY)
+    {
+        show_error("scan_data_type is not bytearray, see `help option`.\n");
+        return false;
+    }
+
+    if (argc < 3) {
+        show_error("please specify a group, see `help group`.\n");
+        return false;
+    }
+    if (!parse_group(argv + 1, argc - 1, vars->options.reverse_endianness, &group))
+        return false;
+
+    zero_uservalue(&val);
+    val.group_value = &group;
+    val.flags = group.length;
+
+    /* need a pid for the rest of this to work */
+    if (vars->target == 0) {
+        return false;
+    }
+
+    if (vars->matches) {
+        if (vars->num_matches == 0) {
+            show_error("there are currently no matches.\n");
+            return false;
+        }
+        /* already know some matches */
+        if (sm_checkmatches(vars, MATCHGROUP, &val) != true) {
+            show_error("failed to search target address space.\n");
+            return false;
+        }
+    } else {
+        /* initial search */
+        if (sm_searchregions(vars, MATCHGROUP, &val) != true) {
+            show_error("failed to search target address space.\n");
+            return false;
+        }
+    }
+
+    /* check if we now know the only possible candidate */
+    if (vars->num_matches == 1) {
+        show_info("match identified, use \"set\" to modify value.\n");
+        show_info("enter \"help\" for other commands.\n");
+    }
+
+    return true;
+}
+
 /* write value_type address value */
 bool handler__write(globals_t * vars, char **argv, unsigned argc)
 {
@@ -1448,6 +2039,7 @@ bool handler__write(globals_t * vars, char **argv, unsigned argc)
     char *endptr;
     int datatype; /* 0 for numbers, 1 for bytearray, 2 for string */
     bool ret;
+    bool in_session = false;
     const char *string_parameter = NULL; /* used by string type */
 
     if (argc < 4)
@@ -1591,7 +2183,9 @@ bool handler__write(globals_t * vars, char **argv, unsigned argc)
             }
             if (wildcard_used)
             {
-                if(!sm_read_array(vars->target, addr, buf, data_width))
+                /* the target must not change the bytes before they are written back */
+                in_session = sm_begin_session(vars->target);
+                if(!in_session || !sm_read_array(vars->target, addr, buf, data_width))
                 {
                     show_error("read memory failed.\n");
                     free_uservalue(&val_buf);
@@ -1621,11 +2215,88 @@ bool handler__write(globals_t * vars, char **argv, unsigned argc)
     ret = sm_write_array(vars->target, addr, buf, data_width);
 
 retl:
+    if (in_session)
+        sm_end_session(vars->target);
     if(buf)
         free(buf);
     return ret;
 }
 
+/* option scan_regions <region-id set> */
+static bool scope_regions(globals_t *vars, const char *set_str)
+{
+    const region_index *index;
+    address_range *ranges;
+    struct set reg_set;
+    size_t count = 0;
+    bool ret;
+
+    if (vars->target == 0 || vars->regions == NULL || vars->regions->size == 0) {
+        show_error("no regions are known, see `help pid`.\n");
+        return false;
+    }
+    if (!parse_uintset(set_str, &reg_set, ((region_t *)vars->regions->tail->data)->id + 1)) {
+        show_error("bad value for scan_regions, see `help option`.\n");
+        return false;
+    }
+    if ((index = sm_get_regions_index(vars)) == NULL ||
+        (ranges = malloc(reg_set.size * sizeof(address_range))) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        set_cleanup(&reg_set);
+        return false;
+    }
+
+    for (size_t set_idx = 0; set_idx < reg_set.size; set_idx++) {
+        size_t pos = sm_find_region_id(index, reg_set.buf[set_idx]);
+
+        if (pos == index->count) {
+            show_warn("no region matching %lu.\n", reg_set.buf[set_idx]);
+            continue;
+        }
+        ranges[count].start = index->regions[pos]->start;
+        ranges[count++].end = index->regions[pos]->start + index->regions[pos]->size;
+    }
+    set_cleanup(&reg_set);
+    qsort(ranges, count, sizeof(address_range), compare_ranges);
+
+    if (count == 0) {
+        show_error("none of the regions are known.\n");
+        ret = false;
+    } else if (!(ret = sm_set_scan_scope(vars, ranges, count))) {
+        show_error("sorry, there was a memory allocation error.\n");
+    }
+    free(ranges);
+    return ret;
+}
+
+/* option scan_window <start>..<end> */
+static bool scope_window(globals_t *vars, const char *window)
+{
+    unsigned long start, end;
+    const char *dots = strstr(window, "..");
+    char start_str[32];
+    address_range range;
+
+    if (dots == NULL || (size_t)(dots - window) >= sizeof(start_str)) {
+        show_error("bad value for scan_window, see `help option`.\n");
+        return false;
+    }
+    memcpy(start_str, window, dots - window);
+    start_str[dots - window] = '\0';
+    if (!parse_ulong(start_str, 16, &start) || !parse_ulong(dots + 2, 16, &end) || start >= end) {
+        show_error("bad value for scan_window, see `help option`.\n");
+        return false;
+    }
+
+    range.start = (void *)start;
+    range.end = (void *)end;
+    if (!sm_set_scan_scope(vars, &range, 1)) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
+    return true;
+}
+
 bool handler__option(globals_t * vars, char **argv, unsigned argc)
 {
     /* this might need to change */
@@ -1699,6 +2370,90 @@ bool handler__option(globals_t * vars, char **argv, unsigned argc)
         return false;
 #endif
     }
+    else if (strcasecmp(argv[1], "alignment") == 0)
+    {
+        if (strcmp(argv[2], "1") == 0) {vars->options.alignment = 1; }
+        else if (strcmp(argv[2], "2") == 0) {vars->options.alignment = 2; }
+        else if (strcmp(argv[2], "4") == 0) {vars->options.alignment = 4; }
+        else if (strcmp(argv[2], "8") == 0) {vars->options.alignment = 8; }
+        else
+        {
+            show_error("bad value for alignment, see `help option`.\n");
+            return false;
+        }
+    }
+    else if (strcasecmp(argv[1], "scan_threads") == 0)
+    {
+#if HAVE_PTHREAD
+        char *end;
+        unsigned long threads = strtoul(argv[2], &end, 10);
+
+        if (*argv[2] == '\0' || *end != '\0' || threads > MAX_SCAN_THREADS)
+        {
+            show_error("bad value for scan_threads, see `help option`.\n");
+            return false;
+        }
+        vars->options.scan_threads = threads;
+#else
+        show_error("\nThe option scan_threads is not supported on your system.\n"
+                   "scanmem was built without POSIX threads.\n");
+        return false;
+#endif
+    }
+    else if (strcasecmp(argv[1], "matches_in_file") == 0)
+    {
+        if (strcmp(argv[2], "0") == 0) {vars->options.matches_in_file = 0; }
+        else if (strcmp(argv[2], "1") == 0) {vars->options.matches_in_file = 1; }
+        else
+        {
+            show_error("bad value for matches_in_file, see `help option`.\n");
+            return false;
+        }
+    }
+    else if (strcasecmp(argv[1], "soft_dirty") == 0)
+    {
+        if (strcmp(argv[2], "0") == 0) {vars->options.soft_dirty = 0; }
+        else if (strcmp(argv[2], "1") == 0)
+        {
+            if (!sm_soft_dirty_supported())
+            {
+                show_error("the kernel doesn't track soft-dirty pages (CONFIG_MEM_SOFT_DIRTY).\n");
+                return false;
+            }
+            vars->options.soft_dirty = 1;
+        }
+        else
+        {
+            show_error("bad value for soft_dirty, see `help option`.\n");
+            return false;
+        }
+    }
+    else if (strcasecmp(argv[1], "read_ahead") == 0)
+    {
+#if HAVE_PTHREAD
+        if (strcmp(argv[2], "0") == 0) {vars->options.read_ahead = 0; }
+        else if (strcmp(argv[2], "1") == 0) {vars->options.read_ahead = 1; }
+        else
+        {
+            show_error("bad value for read_ahead, see `help option`.\n");
+            return false;
+        }
+#else
+        show_error("\nThe option read_ahead is not supported on your system.\n"
+                   "scanmem was built without POSIX threads.\n");
+        return false;
+#endif
+    }
+    else if (strcasecmp(argv[1], "scan_regions") == 0 || strcasecmp(argv[1], "scan_window") == 0)
+    {
+        /* both set the same scope */
+        if (strcmp(argv[2], "all") == 0)
+            sm_set_scan_scope(vars, NULL, 0);
+        else if (strcasecmp(argv[1], "scan_regions") == 0)
+            return scope_regions(vars, argv[2]);
+        else
+            return scope_window(vars, argv[2]);
+    }
     else
     {
         show_error("unknown option specified, see `help option`.\n");
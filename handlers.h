@@ -66,7 +66,9 @@
                "the set data-type.\n" \
                "To set a value continually, for example to prevent a counter from decreasing,\n" \
                "suffix the command with '/', followed by the number of seconds to wait between\n" \
-               "sets. Interrupt scanmem with ^C to stop the setting.\n\n" \
+               "sets, or of milliseconds or microseconds with a `ms` or `us` suffix. The\n" \
+               "setting then goes on in the background as a freeze, see `help freeze` to list\n" \
+               "and stop freezes.\n\n" \
                "Note that this command cannot work for bytearray or string.\n\n" \
                SET_FORMAT_DOC \
                "Examples:\n" \
@@ -74,19 +76,38 @@
                "\tset 0=0x03 - set match 0 to 0x03.\n" \
                "\tset ..7=0x32 - set matches 0 through 7 to 0x32\n" \
                "\tset 0,3=42/8 - set matches 0 and 3 to 42 every 8 seconds\n" \
+               "\tset 5=100/0.05 - set match 5 to 100 twenty times a second\n" \
+               "\tset 5=100/50ms - the same\n" \
                "\tset !4..12=5 - set all matches except 4 through 12 to 5\n" \
                "\tset 12,13,14=0x23/2 19..23=0/8 6=4 0 - complex example, can be combined" \
 
 bool handler__set(globals_t *vars, char **argv, unsigned argc);
 
+#define FREEZE_SHRTDOC "list or stop the values `set` keeps setting"
+#define FREEZE_LONGDOC "usage: freeze [stop [freeze-id set]]\n" \
+               "Without arguments, list the freezes started by continuous `set` commands,\n" \
+               "along with their freeze-id, interval and the number of values they write.\n" \
+               "With `stop`, stop the freezes in `freeze-id set`, or all of them. Freezes\n" \
+               "write without stopping the target, and go on while other commands run.\n" \
+               "Changing the pid, or the target dying, stops all freezes.\n" \
+               "Examples:\n" \
+               "\tfreeze - list the freezes\n" \
+               "\tfreeze stop 0 - stop freeze 0\n" \
+               "\tfreeze stop - stop all freezes\n"
+
+bool handler__freeze(globals_t *vars, char **argv, unsigned argc);
+
 #define LIST_SHRTDOC "list currently known matches"
-#define LIST_LONGDOC "usage: list [max_to_print]\n" \
+#define LIST_LONGDOC "usage: list [[first_match] max_to_print]\n" \
                "Print currently known matches, along with details about the\n" \
                "match, such as its type, location, and last known value. The number in\n" \
                "the left column is the `match-id`, this can be passed to other commands\n" \
                "such as `set`, `delete`, etc.\n" \
                "By default `list` prints up to 10k matches, a numerical parameter" \
                "can be given to change this limit.\n" \
+               "With two numbers, prints up to max_to_print matches from first_match on,\n" \
+               "so that the matches can be listed a page at a time: a page that starts\n" \
+               "where the previous one stopped doesn't look for its first match again.\n" \
                "The flags displayed indicate the possible types of the variable.\n" \
                "Also the region id, an offset and the region type belonging to a match\n" \
                "are displayed. The offset is used from the code load address or region start.\n" \
@@ -114,10 +135,14 @@ bool handler__list(globals_t *vars, char **argv, unsigned argc);
 bool handler__delete(globals_t *vars, char **argv, unsigned argc);
 
 #define RESET_SHRTDOC "forget all matches, and reinitialise regions"
-#define RESET_LONGDOC "usage: reset\n" \
+#define RESET_LONGDOC "usage: reset [keep]\n" \
                 "Forget all matches and regions, and reread regions from the relevant\n" \
                 "maps file. Useful if you have made an error, or want to find a new\n" \
-                "variable.\n"
+                "variable.\n" \
+                "With `keep`, reread the regions but only forget the matches in the\n" \
+                "memory that was unmapped, for a target whose mappings changed since\n" \
+                "the search started. The memory that was mapped meanwhile joins the\n" \
+                "matches as after a `snapshot`. Regions removed with `dregion` come back.\n"
 
 bool handler__reset(globals_t *vars, char **argv, unsigned argc);
 
@@ -135,7 +160,7 @@ bool handler__pid(globals_t *vars, char **argv, unsigned argc);
                 "if you don't know the exact value of the variable you are searching for, but\n" \
                 "can describe it in terms of higher, lower or equal (see commands `>`,`<` and\n" \
                 "`=`).\n\n" \
-                "NOTE: This can use a lot of memory with large processes."
+                "NOTE: This keeps a copy of the memory of the process, until the next scan."
 
 bool handler__snapshot(globals_t *vars, char **argv, unsigned argc);
 
@@ -261,6 +286,64 @@ bool handler__default(globals_t *vars, char **argv, unsigned argc);
 
 bool handler__string(globals_t *vars, char **argv, unsigned argc);
 
+#define GROUP_SHRTDOC "match several values at once, at given offsets of each other"
+#define GROUP_LONGDOC "usage: group <type> <value> [+<offset>|~<distance> <type> <value>]...\n" \
+                "Matches the addresses where a value of <type> is followed by all the other\n" \
+                "values: `+<offset>` puts the next one <offset> bytes after the first, and\n" \
+                "`~<distance>` anywhere from 1 to <distance> bytes after it. The <type>s are\n" \
+                "those of scan_data_type, the <value>s numbers or ranges of the default command.\n" \
+                "The memory is searched once for all the values, and the following `group`\n" \
+                "commands check the matches again.\n" \
+                "Each match covers the bytes from the first value to the end of the last one\n" \
+                "at its furthest offset, like a bytearray.\n" \
+                "This can only be used when scan_data_type is set to be bytearray\n" \
+                "Example:\n" \
+                "\tgroup int32 100 ~16 float32 1.5 +24 int16 0..10\n"
+
+bool handler__group(globals_t *vars, char **argv, unsigned argc);
+
+#define POINTERS_SHRTDOC "map the pointers of the target and find pointer chains to an address"
+#define POINTERS_LONGDOC "usage: pointers map [alignment]\n" \
+                "       pointers <address> [depth [max_offset [max_chains]]]\n" \
+                "       pointers [clear]\n" \
+                "`pointers map` reads the regions once and keeps an index of their words that\n" \
+                "point into one of them, at the multiples of `alignment` (default: the size of\n" \
+                "a pointer). The index is not updated when the target changes its memory.\n" \
+                "`pointers <address>` looks up in the index the chains of pointers from the\n" \
+                "regions of type exe or code to <address> (hex), through at most <depth>\n" \
+                "pointers (default: 3, at most 8), each one at most <max_offset> bytes\n" \
+                "(default: 0x1000) before the address it leads to. The index is made first\n" \
+                "if there is none. At most <max_chains> (default: 100) are shown, the shortest\n" \
+                "first, as the address of the first pointer, its region id + offset, its\n" \
+                "region type and the offsets: add the first offset to the pointer read there,\n" \
+                "then the next one to the pointer read there, the last one gives <address>.\n" \
+                "`pointers` alone tells the size of the index, `pointers clear` drops it,\n" \
+                "and so does `reset`.\n"
+
+bool handler__pointers(globals_t *vars, char **argv, unsigned argc);
+
+#define SAVE_SHRTDOC "save the matches and the regions to a file"
+#define SAVE_LONGDOC "usage: save <filename>\n" \
+                "Saves the matches, with the regions and the scan_data_type, to <filename>.\n" \
+                "`load` takes them back, also after scanmem or the target were started\n" \
+                "again, instead of the scans that found them.\n" \
+                "The matches of a snapshot are saved as the matches of a scan, which\n" \
+                "can take more room.\n"
+
+bool handler__save(globals_t *vars, char **argv, unsigned argc);
+
+#define LOAD_SHRTDOC "load the matches and the regions saved to a file"
+#define LOAD_LONGDOC "usage: load <filename>\n" \
+                "Replaces the matches, the regions and the scan_data_type by the ones\n" \
+                "saved to <filename> by `save`. The matches are mapped from the file, they\n" \
+                "are not read: keep the file until the next scan.\n" \
+                "If the target was started again, the matches move with their regions,\n" \
+                "e.g. to where the library they are in is loaded now. The matches of the\n" \
+                "regions that are not mapped anymore are dropped. The file is saved by\n" \
+                "and for the same build of scanmem on the same host.\n"
+
+bool handler__load(globals_t *vars, char **argv, unsigned argc);
+
 #define UPDATE_SHRTDOC "update match values without culling list"
 #define UPDATE_LONGDOC "usage: update\n" \
                 "Scans the current process, getting the current values of all matches.\n" \
@@ -283,16 +366,37 @@ bool handler__eof(globals_t *vars, char **argv, unsigned argc);
 
 bool handler__shell(globals_t *vars, char **argv, unsigned argc);
 
-#define WATCH_SHRTDOC "monitor the value of a memory location as it changes"
-#define WATCH_LONGDOC "usage: watch [match-id]\n" \
-                "Monitors the match `match-id`, by testing its value every second. When the\n" \
-                "value changes, its new value is printed along with an timestamp. Interrupt\n" \
-                "with ^C to stop monitoring.\n" \
+#define WATCH_SHRTDOC "log the changes of matches or addresses in the background"
+#define WATCH_LONGDOC "usage: watch [match-id set | *address[,address...]][/interval]\n" \
+                "       watch log [n] | drain | stop\n" \
+                "Watches the matches in `match-id set`, or the addresses of the list as the\n" \
+                "scan_data_type, by reading them every `interval` (default 1 second) in the\n" \
+                "background. The interval is in seconds, possibly fractional, or in\n" \
+                "milliseconds or microseconds with a `ms` or `us` suffix. Reading doesn't stop\n" \
+                "the target, and values next to each other are read together.\n" \
+                "Every change is kept in a log of the last 8192 changes, along with its\n" \
+                "timestamp, instead of being printed. Starting a watch replaces the\n" \
+                "previous one and clears the log.\n" \
+                "Without arguments, show the watch and how many changes are logged.\n" \
+                "`watch log` prints the last `n` (default all) changes, oldest first.\n" \
+                "`watch drain` prints all changes and removes them from the log.\n" \
+                "`watch stop` stops watching, the log stays until the next watch.\n" \
                 "Examples:\n" \
-                "\twatch 12 - watch match 12 for any changes.\n"
+                "\twatch 12 - watch match 12 every second.\n" \
+                "\twatch 0..9/1ms - watch matches 0 through 9 a thousand times a second.\n" \
+                "\twatch *0x601040,0x601048/100us - watch two addresses.\n"
 
 bool handler__watch(globals_t *vars, char **argv, unsigned argc);
 
+#define STATS_SHRTDOC "show counters of the work of the scans"
+#define STATS_LONGDOC "usage: stats [reset]\n" \
+                "Show how much the scans read from the target and with how many syscalls,\n" \
+                "the hits and misses of the cache of single reads, the memory allocated\n" \
+                "for the matches, and the time and matches of the searches, checks and\n" \
+                "snapshots. The counters start with scanmem, or with `stats reset`.\n"
+
+bool handler__stats(globals_t *vars, char **argv, unsigned argc);
+
 /*XXX: improve this */
 #define SHOW_COMPLETE "copying,warranty,version"
 #define SHOW_SHRTDOC "display information about scanmem."
@@ -332,7 +436,8 @@ bool handler__write(globals_t *vars, char **argv, unsigned argc);
 
 #define OPTION_COMPLETE "scan_data_type{number,int,float," VALUE_TYPES \
     "},region_scan_level{1,2,3},dump_with_ascii{0,1},endianness{0,1,2}," \
-    "noptrace{0,1}"
+    "noptrace{0,1},alignment{1,2,4,8},scan_threads{0,1,2,4,8},matches_in_file{0,1}," \
+    "soft_dirty{0,1},read_ahead{0,1},scan_regions{all},scan_window{all}"
 #define OPTION_SHRTDOC "set runtime options of scanmem, see `help option`"
 #define OPTION_LONGDOC "usage: option <option_name> <option_value>\n" \
                  "\n" \
@@ -377,8 +482,57 @@ bool handler__write(globals_t *vars, char **argv, unsigned argc);
                  "noptrace\tread/write without ptrace using /proc/pid/mem or using ptrace\n" \
                  "\t\t\tDefault:0\n" \
                  "\tpossibles values:\n"\
-                 "\t0:\tuse ptrace\n" \
-                 "\t1:\tno ptrace\n" \
+                 "\t0:\tuse ptrace, the target is stopped during each command\n" \
+                 "\t1:\tno ptrace, live mode: the target keeps running\n" \
+                 "\tA live scan may read values while they are written, see soft_dirty\n" \
+                 "\n" \
+                 "alignment\tonly match addresses that are multiples of this (used by: first scans)\n" \
+                 "\t\t\tDefault:1\n" \
+                 "\tpossibles values:\n"\
+                 "\t1, 2, 4, 8\n" \
+                 "\tLater scans only narrow down the matches of the first scan\n" \
+                 "\n" \
+                 "scan_threads\tnumber of threads sharing the first scan\n" \
+                 "\t\t\tDefault:1\n" \
+                 "\tpossibles values:\n"\
+                 "\t0:\tone thread per CPU\n" \
+                 "\t1-64:\tthat many threads\n" \
+                 "\tThreads are only used if the memory can be read without ptrace()\n" \
+                 "\n" \
+                 "matches_in_file\twhether to keep the matches in a temporary file, in $TMPDIR\n" \
+                 "\t\t\tDefault:0\n" \
+                 "\tpossibles values:\n"\
+                 "\t0:\tin memory\n" \
+                 "\t1:\tin a file, which the kernel can write them to under memory pressure\n" \
+                 "\tUsed by the scans started after setting it\n" \
+                 "\n" \
+                 "soft_dirty\twhether later scans skip the pages that the target didn't write\n" \
+                 "\t\t\tDefault:0\n" \
+                 "\tpossibles values:\n"\
+                 "\t0:\tread all the memory of the matches\n" \
+                 "\t1:\ttake the old values of the pages the kernel saw no write to\n" \
+                 "\tNeeds a kernel with soft-dirty tracking. With noptrace, it counts\n" \
+                 "\tthe pages of the matches that the target wrote during each scan\n" \
+                 "\n" \
+                 "read_ahead\twhether a first scan with one thread reads the memory on another\n" \
+                 "\t\t\tDefault:1\n" \
+                 "\tpossibles values:\n"\
+                 "\t0:\tread each block, then search it\n" \
+                 "\t1:\tread the next block while searching one\n" \
+                 "\tOnly if the memory can be read without ptrace()\n" \
+                 "\n" \
+                 "scan_regions\tonly scan these regions, the other matches are kept as they are\n" \
+                 "\t\t\tDefault:all\n" \
+                 "\tpossibles values:\n"\
+                 "\tall:\tscan all the regions\n" \
+                 "\t<set>:\tthe ids of the regions, see `help delete` and `lregions`\n" \
+                 "\n" \
+                 "scan_window\tonly scan the addresses in a window, like scan_regions\n" \
+                 "\t\t\tDefault:all\n" \
+                 "\tpossibles values:\n"\
+                 "\tall:\t\tscan everywhere\n" \
+                 "\t<start>..<end>:\tthe hex addresses from start, before end\n" \
+                 "\tBoth set the same scope, which `pid` clears\n" \
                  "\n" \
                  "Example:\n" \
                  "\toption scan_data_type int32\n"
@@ -262,3 +262,163 @@ error:
 
     return false;
 }
+
+/* whether two regions at the same addresses map the same memory */
+static bool same_mapping(const region_t *a, const region_t *b)
+{
+    return strcmp(a->filename, b->filename) == 0;
+}
+
+/* appends a copy of `r` for its bytes in [start, end) to `pieces` */
+static bool add_piece(list_t *pieces, const region_t *r, void *start, void *end)
+{
+    size_t size = sizeof(region_t) + strlen(r->filename);
+    region_t *piece;
+
+    if ((piece = malloc(size)) == NULL)
+        return false;
+    memcpy(piece, r, size);
+    piece->start = start;
+    piece->size = (unsigned long) (end - start);
+    piece->id = pieces->size;
+
+    if (l_append(pieces, pieces->tail, piece) == -1) {
+        free(piece);
+        return false;
+    }
+    return true;
+}
+
+/* puts the bytes of the regions of `from` that no region of `other` maps
+ * the same way into `rest`, both lists are sorted by address */
+static bool subtract_regions(const list_t *from, const list_t *other, list_t *rest)
+{
+    element_t *first = other->head;
+    element_t *n, *o;
+
+    for (n = from->head; n; n = n->next) {
+        region_t *r = n->data;
+        void *start = r->start, *end = r->start + r->size;
+
+        /* the regions before this one are before the next ones too */
+        while (first && ((region_t *) first->data)->start +
+                        ((region_t *) first->data)->size <= start)
+            first = first->next;
+
+        for (o = first; o && start < end; o = o->next) {
+            region_t *covering = o->data;
+
+            if (covering->start >= end)
+                break;
+            if (!same_mapping(r, covering))
+                continue;
+            if (covering->start > start && !add_piece(rest, r, start, covering->start))
+                return false;
+            if (covering->start + covering->size > start)
+                start = covering->start + covering->size;
+        }
+        if (start < end && !add_piece(rest, r, start, end))
+            return false;
+    }
+    return true;
+}
+
+bool sm_refreshmaps(pid_t target, list_t *regions, region_scan_level_t region_scan_level,
+                    list_t *unmapped, list_t *mapped)
+{
+    list_t *fresh;
+
+    if ((fresh = l_init()) == NULL) {
+        show_error("failed to allocate memory for region.\n");
+        return false;
+    }
+    if (!sm_readmaps(target, fresh, region_scan_level))
+        goto error;
+
+    if (!subtract_regions(regions, fresh, unmapped) || !subtract_regions(fresh, regions, mapped)) {
+        show_error("failed to allocate memory for region.\n");
+        goto error;
+    }
+
+    /* the new regions replace the old ones */
+    while (regions->size)
+        l_remove(regions, NULL, NULL);
+    *regions = *fresh;
+    free(fresh);
+    return true;
+
+error:
+    l_destroy(fresh);
+    return false;
+}
+
+static int compare_regions(const void *a, const void *b)
+{
+    const region_t *x = *(region_t * const *) a, *y = *(region_t * const *) b;
+
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+region_index *sm_index_regions(const list_t *regions)
+{
+    region_index *index;
+    element_t *n;
+    size_t i;
+
+    if ((index = malloc(sizeof(region_index) + regions->size * sizeof(region_t *))) == NULL)
+        return NULL;
+
+    index->count = 0;
+    for (n = regions->head; n; n = n->next)
+        index->regions[index->count++] = n->data;
+
+    /* the maps file is sorted, but the lists don't have to be */
+    qsort(index->regions, index->count, sizeof(region_t *), compare_regions);
+
+    index->ids_sorted = true;
+    for (i = 1; i < index->count; i++)
+        if (index->regions[i]->id <= index->regions[i - 1]->id)
+            index->ids_sorted = false;
+
+    return index;
+}
+
+size_t sm_find_region(const region_index *index, const void *address)
+{
+    size_t low = 0, high = index->count;
+
+    /* the last region starting at `address` or before */
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+
+        if (index->regions[mid]->start <= address)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low > 0 && address < index->regions[low - 1]->start + index->regions[low - 1]->size)
+        return low - 1;
+    return index->count;
+}
+
+size_t sm_find_region_id(const region_index *index, unsigned id)
+{
+    size_t low = 0, high = index->count;
+
+    if (!index->ids_sorted) {
+        for (low = 0; low < index->count; low++)
+            if (index->regions[low]->id == id)
+                break;
+        return low;
+    }
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+
+        if (index->regions[mid]->id < id)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low < index->count && index->regions[low]->id == id ? low : index->count;
+}
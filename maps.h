@@ -65,6 +65,30 @@ typedef struct {
     char filename[1];           /* associated file, must be last */
 } region_t;
 
+/* The regions of a list sorted by address, to find the region of an
+ * address or of an id by binary search. It points to the regions of the
+ * list, so it has to be built again once they change. */
+typedef struct {
+    size_t count;
+    bool ids_sorted;            /* the ids grow with the addresses */
+    region_t *regions[0];
+} region_index;
+
 bool sm_readmaps(pid_t target, list_t *regions, region_scan_level_t region_scan_level);
 
+/* Rereads the regions of `target` into `regions`, which has the regions read
+ * before, and appends the parts of the regions that were unmapped since to
+ * `unmapped`, and the parts of the ones that were mapped since to `mapped`.
+ * A region that maps another file at the same addresses counts as both. */
+bool sm_refreshmaps(pid_t target, list_t *regions, region_scan_level_t region_scan_level,
+                    list_t *unmapped, list_t *mapped);
+
+/* returns NULL if there is not enough memory, free it with free() */
+region_index *sm_index_regions(const list_t *regions);
+
+/* the position in `index` of the region holding `address`, or of the
+ * region `id`, or index->count if there is none */
+size_t sm_find_region(const region_index *index, const void *address);
+size_t sm_find_region_id(const region_index *index, unsigned id);
+
 #endif /* MAPS_H */
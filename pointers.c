@@ -0,0 +1,398 @@
+/*
+    Map the pointers of the target, and find pointer chains.
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "pointers.h"
+#include "scanmem.h"
+#include "show_message.h"
+
+/* Bytes of a region read at once */
+#define POINTERS_CHUNK (1 << 20)
+
+static struct {
+    pointer_ref *refs;          /* sorted by target, then by referrer */
+    size_t count;
+    size_t size;                /* room in `refs` */
+    size_t alignment;
+    unsigned long bytes_read;
+    unsigned long num_regions;
+} map;
+
+static int compare_refs(const void *a, const void *b)
+{
+    const pointer_ref *x = a, *y = b;
+
+    if (x->target != y->target)
+        return x->target < y->target ? -1 : 1;
+    if (x->referrer != y->referrer)
+        return x->referrer < y->referrer ? -1 : 1;
+    return 0;
+}
+
+static bool add_ref(uintptr_t target, uintptr_t referrer)
+{
+    if (map.count == map.size) {
+        size_t size = map.size ? 2 * map.size : 4096;
+        pointer_ref *refs = realloc(map.refs, size * sizeof(pointer_ref));
+
+        if (refs == NULL)
+            return false;
+        map.refs = refs;
+        map.size = size;
+    }
+    map.refs[map.count].target = target;
+    map.refs[map.count].referrer = referrer;
+    map.count++;
+    return true;
+}
+
+/* Reads `size` bytes at `addr` into `buf`, the pages that can't be read
+ * as zeros, which point nowhere. Returns the number of bytes read. */
+static size_t read_chunk(pid_t target, const char *addr, uint8_t *buf, size_t size)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t done, nread = 0;
+
+    if (sm_read_array(target, addr, buf, size))
+        return size;
+
+    for (done = 0; done < size; ) {
+        size_t n = MIN(size - done, page_size - ((uintptr_t)(addr + done) & (page_size - 1)));
+
+        if (sm_read_array(target, addr + done, buf + done, n))
+            nread += n;
+        else
+            memset(buf + done, 0, n);
+        done += n;
+    }
+    return nread;
+}
+
+/* Adds the pointers of `size` bytes of `buf`, read at `addr`, at the
+ * offsets below `count` that are multiples of the alignment */
+static bool map_chunk(const region_index *index, const uint8_t *buf, const char *addr,
+                      size_t count, size_t size)
+{
+    uintptr_t low = (uintptr_t)index->regions[0]->start;
+    uintptr_t high = (uintptr_t)index->regions[index->count - 1]->start +
+                     index->regions[index->count - 1]->size;
+    const region_t *last = index->regions[0];
+    size_t offset;
+
+    for (offset = 0; offset < count && offset + sizeof(uintptr_t) <= size;
+         offset += map.alignment) {
+        uintptr_t value;
+
+        memcpy(&value, buf + offset, sizeof(value));
+        if (value < low || value >= high)
+            continue;
+        /* the pointers of a region often point into the same one */
+        if (value - (uintptr_t)last->start >= last->size) {
+            size_t pos = sm_find_region(index, (void *)value);
+
+            if (pos == index->count)
+                continue;
+            last = index->regions[pos];
+        }
+        if (!add_ref(value, (uintptr_t)addr + offset))
+            return false;
+    }
+    return true;
+}
+
+bool pointers_map(pid_t target, const list_t *regions, const region_index *index,
+                  size_t alignment, volatile bool *stop_flag)
+{
+    const element_t *n;
+    uint8_t *buf;
+    bool ret = true;
+
+    pointers_free();
+    map.alignment = alignment;
+    if (index->count == 0)
+        return true;
+
+    if ((buf = malloc(POINTERS_CHUNK + sizeof(uintptr_t))) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
+    if (!sm_begin_session(target)) {
+        free(buf);
+        return false;
+    }
+
+    for (n = regions->head; n && ret && !*stop_flag; n = n->next) {
+        const region_t *r = n->data;
+        /* the first word at a multiple of the alignment */
+        size_t first = -(uintptr_t)r->start & (alignment - 1);
+        size_t pos;
+
+        map.num_regions++;
+        for (pos = first; pos < r->size && !*stop_flag; pos += POINTERS_CHUNK) {
+            /* a word may run over the end of the chunk */
+            size_t count = MIN(r->size - pos, POINTERS_CHUNK);
+            size_t size = MIN(r->size - pos, POINTERS_CHUNK + sizeof(uintptr_t) - 1);
+
+            map.bytes_read += read_chunk(target, (char *)r->start + pos, buf, size);
+            if (!map_chunk(index, buf, (char *)r->start + pos, count, size)) {
+                show_error("sorry, there was a memory allocation error.\n");
+                ret = false;
+                break;
+            }
+        }
+    }
+
+    free(buf);
+    if (!sm_end_session(target))
+        ret = false;
+    if (!ret) {
+        pointers_free();
+        return false;
+    }
+
+    qsort(map.refs, map.count, sizeof(pointer_ref), compare_refs);
+    return true;
+}
+
+void pointers_free(void)
+{
+    free(map.refs);
+    memset(&map, 0, sizeof(map));
+}
+
+bool pointers_get_info(pointer_map_info *info)
+{
+    if (map.alignment == 0)
+        return false;
+    info->count = map.count;
+    info->alignment = map.alignment;
+    info->bytes_read = map.bytes_read;
+    info->num_regions = map.num_regions;
+    return true;
+}
+
+/* The first pointer of the map holding `target` or more */
+static size_t lower_bound(uintptr_t target)
+{
+    size_t low = 0, high = map.count;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+
+        if (map.refs[mid].target < target)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+size_t pointers_to(uintptr_t low, uintptr_t high, const pointer_ref **refs)
+{
+    size_t first = lower_bound(low);
+    size_t last = high == UINTPTR_MAX ? map.count : lower_bound(high + 1);
+
+    *refs = map.refs + first;
+    return last - first;
+}
+
+/* An address the search went back to, see pointers_find_chains() */
+typedef struct {
+    uintptr_t address;
+    size_t parent;              /* the node the word at `address` leads to */
+    uintptr_t offset;           /* added to the word to get there */
+} chain_node;
+
+typedef struct {
+    const region_index *index;
+    uintptr_t max_offset;
+    size_t max_chains;
+    size_t num_chains;
+    chain_node *nodes;          /* level after level, from the address */
+    size_t num_nodes;
+    size_t size;                /* room in `nodes` */
+    uintptr_t *visited;         /* a hash set of the addresses of the nodes */
+    size_t visited_size;        /* a power of 2, twice the nodes at least */
+    void (*found)(const pointer_chain *chain, void *data);
+    void *data;
+} chain_search;
+
+static inline bool is_static(const region_t *r)
+{
+    return r->type == REGION_TYPE_EXE || r->type == REGION_TYPE_CODE;
+}
+
+static inline size_t hash_address(uintptr_t address, size_t size)
+{
+    return (size_t)((address >> 3) * 0x9e3779b97f4a7c15ull) & (size - 1);
+}
+
+/* Adds `address` to the visited set, returns false if it was there */
+static bool visit(chain_search *search, uintptr_t address)
+{
+    size_t i = hash_address(address, search->visited_size);
+
+    while (search->visited[i] != 0) {
+        if (search->visited[i] == address)
+            return false;
+        i = (i + 1) & (search->visited_size - 1);
+    }
+    search->visited[i] = address;
+    return true;
+}
+
+/* Makes room for one more node, returns false if there is not enough memory */
+static bool grow_search(chain_search *search)
+{
+    if (search->num_nodes == search->size) {
+        size_t size = search->size ? 2 * search->size : 1024;
+        chain_node *nodes = realloc(search->nodes, size * sizeof(chain_node));
+
+        if (nodes == NULL)
+            return false;
+        search->nodes = nodes;
+        search->size = size;
+    }
+    if (2 * (search->num_nodes + 1) > search->visited_size) {
+        size_t size = search->visited_size ? 2 * search->visited_size : 4096, i;
+        uintptr_t *old = search->visited, *visited = calloc(size, sizeof(uintptr_t));
+
+        if (visited == NULL)
+            return false;
+        search->visited = visited;
+        for (i = 0; i < search->visited_size; i++)
+            if (old[i] != 0)
+                visit(search, old[i]);
+        search->visited_size = size;
+        free(old);
+    }
+    return true;
+}
+
+/* Reports the chain from the static word `base`, holding `value`, through
+ * the node `n` back to the address */
+static void found_chain(chain_search *search, const region_t *r, uintptr_t base,
+                        uintptr_t value, size_t n)
+{
+    pointer_chain chain;
+
+    chain.base_region = r;
+    chain.base = base;
+    chain.depth = 0;
+    chain.offsets[chain.depth++] = search->nodes[n].address - value;
+    for ( ; n != 0; n = search->nodes[n].parent)
+        chain.offsets[chain.depth++] = search->nodes[n].offset;
+    search->num_chains++;
+    (*search->found)(&chain, search->data);
+}
+
+/* Goes back one level from the nodes [first, last), adding the words that
+ * lead to them as the next level, unless `last_level`. Returns false once
+ * the search has to stop. */
+static bool search_level(chain_search *search, size_t first, size_t last, bool last_level,
+                         volatile bool *stop_flag)
+{
+    size_t n;
+
+    for (n = first; n < last; n++) {
+        uintptr_t address = search->nodes[n].address;
+        const pointer_ref *refs;
+        size_t count = pointers_to(address - MIN(address, search->max_offset), address, &refs);
+        size_t i;
+
+        if (*stop_flag)
+            return false;
+
+        /* the closest pointers first */
+        for (i = count; i-- > 0; ) {
+            size_t pos = sm_find_region(search->index, (void *)refs[i].referrer);
+            const region_t *r;
+            chain_node *node;
+
+            if (search->num_chains == search->max_chains)
+                return false;
+            if (pos == search->index->count)
+                continue;
+            r = search->index->regions[pos];
+
+            /* the chains from a static word end there */
+            if (is_static(r)) {
+                found_chain(search, r, refs[i].referrer, refs[i].target, n);
+                continue;
+            }
+            if (last_level || !visit(search, refs[i].referrer))
+                continue;
+
+            /* the word is reached by a shorter chain than any other one */
+            if (search->num_nodes == POINTER_MAX_NODES) {
+                show_warn("stopped after %u addresses, try a smaller depth or max_offset.\n",
+                          POINTER_MAX_NODES);
+                return false;
+            }
+            if (!grow_search(search)) {
+                show_error("sorry, there was a memory allocation error.\n");
+                return false;
+            }
+            node = &search->nodes[search->num_nodes++];
+            node->address = refs[i].referrer;
+            node->parent = n;
+            node->offset = address - refs[i].target;
+        }
+    }
+    return true;
+}
+
+size_t pointers_find_chains(const region_index *index, uintptr_t address,
+                            unsigned max_depth, uintptr_t max_offset, size_t max_chains,
+                            volatile bool *stop_flag,
+                            void (*found)(const pointer_chain *chain, void *data), void *data)
+{
+    chain_search search = { .index = index, .max_offset = max_offset, .max_chains = max_chains,
+                            .found = found, .data = data };
+    size_t first = 0, last;
+    unsigned depth;
+
+    max_depth = MIN(max_depth, POINTER_MAX_DEPTH);
+    if (max_chains == 0 || address == 0 || !grow_search(&search)) {
+        free(search.nodes);
+        free(search.visited);
+        return 0;
+    }
+    search.nodes[0].address = address;
+    search.num_nodes = 1;
+    visit(&search, address);
+
+    /* a level further back for each pointer more, the shortest chains first */
+    for (depth = 1; depth <= max_depth && first < search.num_nodes; depth++) {
+        last = search.num_nodes;
+        if (!search_level(&search, first, last, depth == max_depth, stop_flag))
+            break;
+        first = last;
+    }
+
+    free(search.nodes);
+    free(search.visited);
+    return search.num_chains;
+}
@@ -0,0 +1,91 @@
+/*
+    Map the pointers of the target, and find pointer chains.
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef POINTERS_H
+#define POINTERS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "list.h"
+#include "maps.h"
+
+/* The most pointers a chain goes through */
+#define POINTER_MAX_DEPTH 8
+
+/* The most addresses a search for chains goes back to */
+#define POINTER_MAX_NODES (1 << 20)
+
+/* A word of the target holding an address of one of the regions */
+typedef struct {
+    uintptr_t target;           /* the address held */
+    uintptr_t referrer;         /* the address of the word */
+} pointer_ref;
+
+typedef struct {
+    size_t count;               /* pointers in the map */
+    size_t alignment;           /* of the words read */
+    unsigned long bytes_read;
+    unsigned long num_regions;
+} pointer_map_info;
+
+/* The word at `base`, in a region of the executable or of a library, is
+ * read, `offsets[0]` is added to it, the word there is read, and so on:
+ * the last offset gives the address the chain leads to */
+typedef struct {
+    const region_t *base_region;
+    uintptr_t base;
+    unsigned depth;             /* pointers read, and offsets */
+    uintptr_t offsets[POINTER_MAX_DEPTH];
+} pointer_chain;
+
+/*
+ * The map holds the words at the multiples of `alignment` of `regions` that
+ * point into one of them, indexed by the address they hold. It is built from
+ * a single read of the regions, and not updated when the target changes its
+ * memory. There is a single map, building one drops the previous one.
+ * `index` is the index of `regions`; `stop_flag` ends the reads early.
+ */
+bool pointers_map(pid_t target, const list_t *regions, const region_index *index,
+                  size_t alignment, volatile bool *stop_flag);
+void pointers_free(void);
+
+/* Returns false when there is no map */
+bool pointers_get_info(pointer_map_info *info);
+
+/* Points `*refs` to the pointers of the map that hold an address from `low`
+ * to `high` included, sorted by that address, and returns their number */
+size_t pointers_to(uintptr_t low, uintptr_t high, const pointer_ref **refs);
+
+/* Calls `found` for each chain of at most `max_depth` pointers leading to
+ * `address`, each one holding an address at most `max_offset` bytes before
+ * the word or the address it leads to, and stops after `max_chains` chains.
+ * The chains start at the regions of `index` of type exe or code, the
+ * shortest ones are found first. The search goes back level by level, and
+ * each address only once, by the shortest chain to it: at most
+ * POINTER_MAX_NODES of them. `stop_flag` ends it early. Returns the number
+ * of chains found. */
+size_t pointers_find_chains(const region_index *index, uintptr_t address,
+                            unsigned max_depth, uintptr_t max_offset, size_t max_chains,
+                            volatile bool *stop_flag,
+                            void (*found)(const pointer_chain *chain, void *data), void *data);
+
+#endif /* POINTERS_H */
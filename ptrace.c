@@ -46,6 +46,11 @@
 #include <stdbool.h>
 #include <limits.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#if HAVE_PTHREAD
+# include <pthread.h>
+#endif
 
 // dirty hack for FreeBSD
 #if defined(__FreeBSD__) || defined(__FreeBSD_kernel__)
@@ -53,6 +58,13 @@
 #define PTRACE_DETACH PT_DETACH
 #define PTRACE_PEEKDATA PT_READ_D
 #define PTRACE_POKEDATA PT_WRITE_D
+/* PT_IO moves any number of bytes in one call, instead of a word */
+# ifdef PT_IO
+#  define HAVE_PT_IO 1
+# endif
+#endif
+#ifndef HAVE_PT_IO
+# define HAVE_PT_IO 0
 #endif
 
 #include "common.h"
@@ -62,6 +74,8 @@
 #include "show_message.h"
 #include "targetmem.h"
 #include "interrupt.h"
+#include "stats.h"
+#include "async.h"
 
 /* progress handling */
 #define NUM_DOTS (10)
@@ -73,28 +87,98 @@
 #define SAMPLES_PER_DOT (NUM_SAMPLES / NUM_DOTS)
 #define PROGRESS_PER_SAMPLE (MAX_PROGRESS / NUM_SAMPLES)
 
-/* ptrace peek buffer, used by peekdata() as a mirror of the process memory.
- * Max size is the maximum allowed rounded VLT scan length, aka UINT16_MAX,
- * plus a `PEEKDATA_CHUNK`, to store a full extra chunk for maneuverability */
-#if HAVE_PROCMEM
-# define PEEKDATA_CHUNK 2048
-#else
-# define PEEKDATA_CHUNK sizeof(long)
-#endif
-#define MAX_PEEKBUF_SIZE ((1<<16) + PEEKDATA_CHUNK)
+/* The peek cache of sm_peekdata(), pages of the target kept in a small
+ * set-associative cache. A miss right after the pages of the previous one
+ * also reads ahead the next pages, in the same read. */
+#define PEEK_PAGE_SIZE 4096
+#define PEEK_SETS 16
+#define PEEK_WAYS 4
+#define PEEK_READ_AHEAD 8       /* less than PEEK_SETS, so the pages of a fill don't collide */
+
+/* Requests across pages are gathered into a buffer of this size: the
+ * maximum VLT length, aka UINT16_MAX, plus the page it starts on */
+#define MAX_PEEKBUF_SIZE ((1<<16) + PEEK_PAGE_SIZE)
+
+typedef struct {
+    const char *base;           /* page cached by the line, NULL if none */
+    size_t size;                /* bytes read, less than a page at the end of a mapping */
+    unsigned long used;         /* last use, the least recently used way is replaced */
+    uint8_t data[PEEK_PAGE_SIZE];
+} peek_line;
+
+/* A run of pages of the target, see page_set */
+typedef struct {
+    uintptr_t first_page;
+    size_t num_pages;
+    size_t first_bit;           /* of its pages in `page_set.bits` */
+} page_run;
+
+/* Some pages of the target around the matches, with a bit for each page of
+ * the runs: the clean pages that were not written since the last scan, found
+ * with the `soft_dirty` option, whose bytes are still the old values of the
+ * matches, or the pages written during a live scan. */
+typedef struct {
+    size_t page_size;
+    page_run *runs;
+    size_t num_runs;
+    size_t num_pages;
+    uint8_t *bits;
+} page_set;
+
 static struct {
-    uint8_t cache[MAX_PEEKBUF_SIZE];  /* read from ptrace()  */
-    unsigned size;              /* amount of valid memory stored (in bytes) */
-    const char *base;           /* base address of cached region */
+    peek_line lines[PEEK_SETS][PEEK_WAYS];
+    unsigned long clock;        /* ticks on each use of a line */
+    const char *next_page;      /* the page after the previous fill */
+    uint8_t joined[MAX_PEEKBUF_SIZE];  /* a request across pages */
+    uint8_t fill[(1 + PEEK_READ_AHEAD) * PEEK_PAGE_SIZE];
+    sm_peek_stats stats;
 #if HAVE_PROCMEM
     int procmem_fd;             /* file descriptor of the opened `/proc/<pid>/mem` file */
-#else
+#endif
     pid_t pid;                  /* pid of scanned process */
+#if HAVE_PROCESS_VM_READV
+    bool vm_readv_usable;       /* false once `process_vm_readv()` was refused */
 #endif
-} peekbuf;
+    page_set *clean;            /* during a check with the `soft_dirty` option */
+    int pagemap_fd;             /* `/proc/<pid>/pagemap`, or -1 */
+} peekbuf = { .pagemap_fd = -1 };
 
+/* The maximum logical size is a comfortable 1MiB (increasing it does not help).
+ * The actual allocation is that plus the rounded size of the maximum possible VLT.
+ * This is needed because the last byte might be scanned as max size VLT,
+ * thus need (2^16 - 2) extra bytes after it */
+#define MAX_BUFFER_SIZE (1<<20)
+#define MAX_ALLOC_SIZE  (MAX_BUFFER_SIZE + (1<<16))
 
-bool sm_attach(pid_t target)
+/* Maximum number of pieces of target memory gathered into a single
+ * vectored read or write, this is the `IOV_MAX` of Linux */
+#define MAX_READ_BATCH 1024
+
+/* Bits of the entries of `/proc/<pid>/pagemap` */
+#define PAGEMAP_SOFT_DIRTY (1ULL << 55)
+#define PAGEMAP_SWAPPED    (1ULL << 62)
+#define PAGEMAP_PRESENT    (1ULL << 63)
+
+/* Number of pagemap entries read at once */
+#define PAGEMAP_BATCH 4096
+
+/* Number of pagemap entries read at once by `readmemory_region()`,
+ * enough for a buffer of 4KiB pages */
+#define PAGEMAP_BUFFER_PAGES ((MAX_ALLOC_SIZE >> 12) + 2)
+
+/* The pages between two runs of a page_set are looked up as well if
+ * there are fewer than this, for fewer reads of the pagemap */
+#define PAGE_RUN_GAP 512
+
+static void free_page_set(page_set *clean);
+static void reset_peek_cache(void);
+
+/* Number of sessions begun and not ended yet, the target stays attached
+ * during them */
+static unsigned session_depth;
+
+
+static bool attach_target(pid_t target)
 {
     if (!sm_globals.options.no_ptrace)
     {
@@ -114,9 +198,21 @@ bool sm_attach(pid_t target)
         }
     }
 
-    /* reset the peek buffer */
-    peekbuf.size = 0;
-    peekbuf.base = NULL;
+    /* reset the peek cache */
+    reset_peek_cache();
+    peekbuf.pid = target;
+    peekbuf.clean = NULL;
+#if HAVE_PROCESS_VM_READV
+    /* try the fast path first, it is disabled again on the first refusal */
+    peekbuf.vm_readv_usable = true;
+#endif
+
+    { /* the pages of the target are looked up in its pagemap, if it can be read */
+        char pagemap[32];
+
+        snprintf(pagemap, sizeof(pagemap), "/proc/%d/pagemap", target);
+        peekbuf.pagemap_fd = open(pagemap, O_RDONLY);
+    }
 
 #if HAVE_PROCMEM
     { /* open the `/proc/<pid>/mem` file */
@@ -133,8 +229,6 @@ bool sm_attach(pid_t target)
         }
         peekbuf.procmem_fd = fd;
     }
-#else
-    peekbuf.pid = target;
 #endif
 
     /* everything looks okay */
@@ -142,8 +236,12 @@ bool sm_attach(pid_t target)
 
 }
 
-bool sm_detach(pid_t target)
+static bool detach_target(pid_t target)
 {
+    if (peekbuf.pagemap_fd != -1)
+        close(peekbuf.pagemap_fd);
+    peekbuf.pagemap_fd = -1;
+
 #if HAVE_PROCMEM
     /* close the mem file before detaching */
     close(peekbuf.procmem_fd);
@@ -161,28 +259,177 @@ bool sm_detach(pid_t target)
     }
 }
 
+bool sm_attach(pid_t target)
+{
+    /* the target is already attached, what was peeked stays valid while it is
+     * stopped, since our writes go through the cache */
+    if (session_depth) {
+        if (sm_globals.options.no_ptrace)
+            reset_peek_cache();
+        return true;
+    }
+    return attach_target(target);
+}
+
+bool sm_detach(pid_t target)
+{
+    /* the clean pages only hold for the check that found them */
+    free_page_set(peekbuf.clean);
+    peekbuf.clean = NULL;
+
+    if (session_depth) {
+        if (sm_globals.options.no_ptrace)
+            reset_peek_cache();
+        return true;
+    }
+    return detach_target(target);
+}
+
+bool sm_begin_session(pid_t target)
+{
+    if (session_depth == 0 && !attach_target(target))
+        return false;
+    ++session_depth;
+    return true;
+}
+
+bool sm_end_session(pid_t target)
+{
+    if (session_depth == 0 || --session_depth > 0)
+        return true;
+    return detach_target(target);
+}
+
+
+#if HAVE_PROCESS_VM_READV
+/* Reads data with `process_vm_readv()`, which copies straight from the target
+ * without going through a file or one syscall per word.
+ * Returns the number of bytes read, or -1 if the syscall is not usable on
+ * this system/target, so that the caller can fall back to the other paths. */
+static inline ssize_t readmemory_vm(uint8_t *dest_buffer, const char *target_address, size_t size)
+{
+    size_t nread = 0;
+    unsigned long syscalls = 0;
+
+    do {
+        struct iovec local = { dest_buffer + nread, size - nread };
+        struct iovec remote = { (void *)(target_address + nread), size - nread };
+        ssize_t ret = process_vm_readv(peekbuf.pid, &local, 1, &remote, 1, 0);
+
+        syscalls++;
+        if (ret == -1) {
+            if (nread == 0 && (errno == ENOSYS || errno == EPERM)) {
+                /* kernel without support or a restricted target */
+                show_debug("process_vm_readv() unusable: %s\n", strerror(errno));
+                peekbuf.vm_readv_usable = false;
+                STATS_ADD(read_syscalls, syscalls);
+                return -1;
+            }
+            /* we can't read further, report what was read */
+            break;
+        }
+        if (ret == 0)
+            break;
+        nread += ret;
+    } while (nread < size);
+
+    /* all the calls but the last one were short */
+    STATS_ADD(read_syscalls, syscalls);
+    STATS_ADD(short_reads, nread < size ? syscalls : syscalls - 1);
+    STATS_ADD(bytes_read, nread);
+    return nread;
+}
+#endif
+
+#if HAVE_PT_IO
+/* Largest transfer of a single PT_IO call, the kernel moves it page by page */
+#define MAX_IO_SIZE (1<<20)
+
+/* Copies `size` bytes between `local` and `target_address` of the attached
+ * `target` with PT_IO, `op` being PIOD_READ_D or PIOD_WRITE_D. A transfer that
+ * faults moves nothing, so it is tried again a page at a time to find where
+ * the memory stops. Returns the number of bytes copied, and adds the calls
+ * made to `*syscalls` if it isn't NULL. */
+static size_t transfer_io(pid_t target, int op, void *local, const char *target_address,
+                          size_t size, unsigned long *syscalls)
+{
+    size_t done = 0, step = MAX_IO_SIZE;
+
+    while (done < size) {
+        struct ptrace_io_desc io;
+        size_t len = MIN(size - done, step);
+
+        /* stay within a page, so that a fault is at its start */
+        if (step == PEEK_PAGE_SIZE)
+            len = MIN(len, PEEK_PAGE_SIZE - (uintptr_t)(target_address + done) % PEEK_PAGE_SIZE);
+
+        io.piod_op = op;
+        io.piod_offs = (void *)(target_address + done);
+        io.piod_addr = (uint8_t *)local + done;
+        io.piod_len = len;
+
+        if (syscalls)
+            (*syscalls)++;
+        if (ptrace(PT_IO, target, (caddr_t)&io, 0) == -1 || io.piod_len == 0) {
+            if (step == PEEK_PAGE_SIZE || len <= PEEK_PAGE_SIZE)
+                break;
+            step = PEEK_PAGE_SIZE;
+            continue;
+        }
+        done += io.piod_len;
+    }
+    return done;
+}
+#endif
 
 /* Reads data from the target process, and places it on the `dest_buffer`
- * using either `ptrace` or `pread` on `/proc/pid/mem`.
+ * using either `process_vm_readv()`, `ptrace` or `pread` on `/proc/pid/mem`.
  * The target process is not passed, but read from the static peekbuf.
  * `sm_attach()` MUST be called before this function. */
 static inline size_t readmemory(uint8_t *dest_buffer, const char *target_address, size_t size)
 {
     size_t nread = 0;
 
+#if HAVE_PROCESS_VM_READV
+    if (peekbuf.vm_readv_usable) {
+        ssize_t ret = readmemory_vm(dest_buffer, target_address, size);
+        if (ret >= 0)
+            return ret;
+    }
+#endif
+
+#if HAVE_PT_IO
+    /* whole buffers, when attached; /proc/pid/mem is read otherwise */
+    if (!sm_globals.options.no_ptrace) {
+        unsigned long syscalls = 0;
+
+        nread = transfer_io(peekbuf.pid, PIOD_READ_D, dest_buffer, target_address, size, &syscalls);
+        STATS_ADD(read_syscalls, syscalls);
+        STATS_ADD(short_reads, nread < size);
+        STATS_ADD(bytes_read, nread);
+        return nread;
+    }
+#endif
+
 #if HAVE_PROCMEM
     do {
         ssize_t ret = pread(peekbuf.procmem_fd, dest_buffer + nread,
                             size - nread, (unsigned long)(target_address + nread));
+
+        STATS_ADD(read_syscalls, 1);
         if (ret == -1) {
             /* we can't read further, report what was read */
-            return nread;
+            STATS_ADD(short_reads, 1);
+            break;
         }
         else {
             /* some data was read */
+            if ((size_t)ret < size - nread)
+                STATS_ADD(short_reads, 1);
             nread += ret;
         }
     } while (nread < size);
+    STATS_ADD(bytes_read, nread);
 #else
     /* Read the memory with `ptrace()`: the API specifies that `ptrace()` returns a `long`, which
      * is the size of a word for the current architecture, so this section will deal in `long`s */
@@ -216,288 +463,2307 @@ static inline size_t readmemory(uint8_t *dest_buffer, const char *target_address
             /* interrupt the gathering process */
             break;
         }
-        /* otherwise, ptrace() worked - store the data */
-        memcpy(dest_buffer + nread, &ptraced_long, sizeof(long));
+        /* otherwise, ptrace() worked - store the data */
+        memcpy(dest_buffer + nread, &ptraced_long, sizeof(long));
+    }
+    /* a word per call, as asked, until the one that failed */
+    STATS_ADD(read_syscalls, (nread + sizeof(long) - 1) / sizeof(long) + (nread < size));
+    STATS_ADD(short_reads, nread < size);
+    STATS_ADD(bytes_read, nread);
+#endif
+    return nread;
+}
+
+/* Same as `readmemory()`, but `size` doesn't need to be a multiple of a word:
+ * the ptrace path rounds it up, so `dest_buffer` needs `sizeof(long)` extra bytes */
+static inline size_t readmemory_span(uint8_t *dest_buffer, const char *target_address, size_t size)
+{
+#if HAVE_PROCMEM || HAVE_PT_IO
+    return readmemory(dest_buffer, target_address, size);
+#else
+    size_t rounded_size = sizeof(long) * (1 + (size - 1) / sizeof(long));
+    return MIN(readmemory(dest_buffer, target_address, rounded_size), size);
+#endif
+}
+
+/* A piece of target memory read by `readmemory_batch()` */
+typedef struct {
+    const char *target_address; /* first byte to read */
+    size_t size;                /* number of bytes requested */
+    size_t nread;               /* number of bytes actually read */
+    uint8_t *dest;              /* where to store them locally */
+} read_span;
+
+#if HAVE_PROCESS_VM_READV || HAVE_PROCESS_VM_WRITEV
+/* Reads or writes (`write`) at most MAX_READ_BATCH of the `count` pieces
+ * `remote` of the memory of `target` with a single process_vm_readv() or
+ * process_vm_writev(), from or to the `num_local` pieces `local`. Clears
+ * `*usable` if the syscall is refused. Returns the number of pieces moved
+ * whole, the kernel stops at the first fault, or -1 with `errno` set. */
+static ssize_t transfer_vectored(pid_t target, bool write, const struct iovec *local,
+                                 size_t num_local, const struct iovec *remote, size_t count,
+                                 bool *usable)
+{
+    size_t batch = MIN(count, MAX_READ_BATCH), moved;
+    ssize_t ret = -1;
+
+    errno = ENOSYS;
+#if HAVE_PROCESS_VM_READV
+    if (!write)
+        ret = process_vm_readv(target, local, num_local, remote, batch, 0);
+#endif
+#if HAVE_PROCESS_VM_WRITEV
+    if (write)
+        ret = process_vm_writev(target, local, num_local, remote, batch, 0);
+#endif
+    if (ret == -1) {
+        if (errno == ENOSYS || errno == EPERM) {
+            show_debug("process_vm_%sv() unusable: %s\n", write ? "write" : "read",
+                       strerror(errno));
+            *usable = false;
+        }
+        return -1;
+    }
+
+    for (moved = 0; moved < batch && (size_t)ret >= remote[moved].iov_len; moved++)
+        ret -= remote[moved].iov_len;
+    return moved;
+}
+#endif
+
+/* Reads `count` scattered spans of target memory, gathering them into as few
+ * syscalls as possible with `process_vm_readv()`. The spans are independent:
+ * a failing or short span is reported through its `nread` and the others are
+ * still read. Every `dest` needs `sizeof(long)` extra bytes, like above. */
+static void readmemory_batch(read_span *spans, size_t count)
+{
+    size_t i = 0;
+
+#if HAVE_PROCESS_VM_READV
+    struct iovec local[MAX_READ_BATCH];
+    struct iovec remote[MAX_READ_BATCH];
+
+    while (i < count && peekbuf.vm_readv_usable) {
+        size_t batch = MIN(count - i, MAX_READ_BATCH);
+        size_t j;
+        ssize_t moved;
+
+        for (j = 0; j < batch; j++) {
+            local[j].iov_base = spans[i+j].dest;
+            local[j].iov_len = spans[i+j].size;
+            remote[j].iov_base = (void *)spans[i+j].target_address;
+            remote[j].iov_len = spans[i+j].size;
+        }
+
+        moved = transfer_vectored(peekbuf.pid, false, local, batch, remote, batch,
+                                  &peekbuf.vm_readv_usable);
+        STATS_ADD(read_syscalls, 1);
+        if (moved == -1) {
+            if (!peekbuf.vm_readv_usable)
+                break;
+            /* the very first span is not readable */
+            moved = 0;
+        }
+
+        /* all spans before the fault are complete */
+        for (j = 0; j < (size_t)moved; j++) {
+            spans[i+j].nread = spans[i+j].size;
+            STATS_ADD(bytes_read, spans[i+j].size);
+        }
+        i += j;
+
+        /* retry the faulting span alone, to know how much of it is readable */
+        if (j < batch) {
+            STATS_ADD(short_reads, 1);
+            spans[i].nread = readmemory_span(spans[i].dest, spans[i].target_address, spans[i].size);
+            i++;
+        }
+    }
+#endif
+
+    /* one read per span with the fallback paths */
+    for ( ; i < count; i++)
+        spans[i].nread = readmemory_span(spans[i].dest, spans[i].target_address, spans[i].size);
+}
+
+/* Moves the `count` pieces `runs` of the memory of `target` from or to
+ * `data`, see sm_read_runs() */
+static size_t transfer_runs(pid_t target, int procmem_fd, bool *vectored, bool write,
+                            const struct iovec *runs, size_t count, uint8_t *data)
+{
+    size_t done = 0, failed = 0;
+
+    while (done < count) {
+        size_t len = runs[done].iov_len;
+        bool moved = false;
+
+#if HAVE_PROCESS_VM_READV || HAVE_PROCESS_VM_WRITEV
+        /* as many runs as possible per syscall */
+        if (*vectored) {
+            size_t batch = MIN(count - done, MAX_READ_BATCH), i;
+            struct iovec local = { data, 0 };
+            ssize_t whole;
+
+            for (i = 0; i < batch; i++)
+                local.iov_len += runs[done + i].iov_len;
+            whole = transfer_vectored(target, write, &local, 1, runs + done, count - done, vectored);
+            if (whole == -1 && errno == ESRCH)
+                return failed + count - done;
+
+            /* skip the runs moved whole, the one it stopped at is retried below */
+            for (i = 0; i < (size_t)MAX(whole, 0); i++)
+                data += runs[done++].iov_len;
+            if (whole == (ssize_t)batch)
+                continue;
+            len = runs[done].iov_len;
+        }
+#endif
+        /* a run the fast path couldn't move, or all of them without it */
+#if HAVE_PROCMEM
+        if (procmem_fd != -1)
+            moved = (write ? pwrite(procmem_fd, data, len, (off_t)runs[done].iov_base)
+                           : pread(procmem_fd, data, len, (off_t)runs[done].iov_base)) == (ssize_t)len;
+#endif
+#if HAVE_PT_IO
+        if (procmem_fd == -1)
+            moved = transfer_io(target, write ? PIOD_WRITE_D : PIOD_READ_D, data,
+                                runs[done].iov_base, len, NULL) == len;
+#endif
+        if (!moved)
+            failed++;
+        data += len;
+        done++;
+    }
+    return failed;
+}
+
+size_t sm_read_runs(pid_t target, int procmem_fd, bool *vectored,
+                    const struct iovec *runs, size_t count, void *data)
+{
+    return transfer_runs(target, procmem_fd, vectored, false, runs, count, data);
+}
+
+size_t sm_write_runs(pid_t target, int procmem_fd, bool *vectored,
+                     const struct iovec *runs, size_t count, const void *data)
+{
+    return transfer_runs(target, procmem_fd, vectored, true, runs, count, (uint8_t *)data);
+}
+
+/* Restarts the soft-dirty tracking of the pages of `pid`, returns false if
+ * the kernel refuses */
+static bool clear_soft_dirty(pid_t pid)
+{
+    char path[32];
+    bool ret;
+    int fd;
+
+    snprintf(path, sizeof(path), "/proc/%d/clear_refs", pid);
+    if ((fd = open(path, O_WRONLY)) == -1)
+        return false;
+    ret = write(fd, "4", 1) == 1;
+    close(fd);
+    return ret;
+}
+
+/* Reads the pagemap entry of `addr` in our own process */
+static uint64_t own_pagemap_entry(const void *addr)
+{
+    uint64_t entry = 0;
+    int fd = open("/proc/self/pagemap", O_RDONLY);
+
+    if (fd != -1) {
+        if (pread(fd, &entry, sizeof(entry),
+                  (uintptr_t)addr / sysconf(_SC_PAGESIZE) * sizeof(entry)) != sizeof(entry))
+            entry = 0;
+        close(fd);
+    }
+    return entry;
+}
+
+bool sm_soft_dirty_supported(void)
+{
+    static int supported = -1;
+
+    /* a page of ours must be clean after the bits are cleared,
+     * and dirty once written */
+    if (supported == -1) {
+        long page_size = sysconf(_SC_PAGESIZE);
+        volatile uint8_t *page = mmap(NULL, page_size, PROT_READ | PROT_WRITE,
+                                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (page == MAP_FAILED)
+            return false;
+        page[0] = 1;
+        supported = clear_soft_dirty(getpid()) &&
+                    !(own_pagemap_entry((void *)page) & PAGEMAP_SOFT_DIRTY);
+        page[0] = 2;
+        supported = supported && (own_pagemap_entry((void *)page) & PAGEMAP_SOFT_DIRTY);
+        munmap((void *)page, page_size);
+    }
+    return supported;
+}
+
+/* Adds the pages of [start, start + size) to the runs of `clean` */
+static bool add_page_range(page_set *clean, const void *start, size_t size)
+{
+    uintptr_t first = (uintptr_t)start / clean->page_size;
+    uintptr_t last = ((uintptr_t)start + size - 1) / clean->page_size;
+    page_run *run = clean->num_runs ? &clean->runs[clean->num_runs - 1] : NULL;
+
+    if (size == 0)
+        return true;
+
+    /* the ranges come in address order */
+    if (run && first < run->first_page + run->num_pages + PAGE_RUN_GAP) {
+        if (last >= run->first_page + run->num_pages) {
+            clean->num_pages += last + 1 - (run->first_page + run->num_pages);
+            run->num_pages = last + 1 - run->first_page;
+        }
+        return true;
+    }
+
+    if (clean->num_runs % 64 == 0) {
+        page_run *runs = realloc(clean->runs, (clean->num_runs + 64) * sizeof(page_run));
+
+        if (runs == NULL)
+            return false;
+        clean->runs = runs;
+    }
+    run = &clean->runs[clean->num_runs++];
+    run->first_page = first;
+    run->num_pages = last + 1 - first;
+    run->first_bit = clean->num_pages;
+    clean->num_pages += run->num_pages;
+    return true;
+}
+
+/* Looks up the pages of `matches` that are in memory or swapped, and that
+ * were written since the soft-dirty bits were last cleared if `written`, or
+ * that were not otherwise. Returns NULL if they can't be found. */
+static page_set *lookup_pages(const matches_and_old_values_array *matches, bool written)
+{
+    uint64_t *entries = NULL;
+    page_set *clean;
+    size_t i;
+
+    if (peekbuf.pagemap_fd == -1)
+        return NULL;
+    if ((clean = calloc(1, sizeof(page_set))) == NULL)
+        return NULL;
+    clean->page_size = sysconf(_SC_PAGESIZE);
+
+    if (matches->images) {
+        for (i = 0; i < matches->num_images; i++)
+            if (!add_page_range(clean, matches->images[i].start, matches->images[i].size))
+                goto fail;
+    } else {
+        matches_and_old_values_swath *swath;
+
+        for (swath = matches->swaths; swath->number_of_bytes; swath = next_swath(swath))
+            if (!add_page_range(clean, swath->first_byte_in_child, swath->number_of_bytes))
+                goto fail;
+    }
+
+    if ((clean->bits = calloc(clean->num_pages / 8 + 1, 1)) == NULL ||
+        (entries = malloc(PAGEMAP_BATCH * sizeof(uint64_t))) == NULL)
+        goto fail;
+
+    for (i = 0; i < clean->num_runs; i++) {
+        page_run *run = &clean->runs[i];
+        size_t done;
+
+        for (done = 0; done < run->num_pages; ) {
+            size_t count = MIN(run->num_pages - done, PAGEMAP_BATCH);
+            ssize_t ret = pread(peekbuf.pagemap_fd, entries, count * sizeof(uint64_t),
+                                (run->first_page + done) * sizeof(uint64_t));
+            size_t j;
+
+            if (ret <= 0)
+                break;
+            count = ret / sizeof(uint64_t);
+            for (j = 0; j < count; j++) {
+                size_t bit = run->first_bit + done + j;
+
+                if ((entries[j] & (PAGEMAP_PRESENT | PAGEMAP_SWAPPED)) &&
+                    !(entries[j] & PAGEMAP_SOFT_DIRTY) == !written)
+                    clean->bits[bit / 8] |= 1 << (bit % 8);
+            }
+            done += count;
+        }
+    }
+    free(entries);
+    return clean;
+
+fail:
+    show_debug("could not look up the pages of the matches.\n");
+    free(entries);
+    free_page_set(clean);
+    return NULL;
+}
+
+/* With the `soft_dirty` option, finds the pages of the matches that the
+ * target didn't write since the soft-dirty bits were last cleared, the others
+ * have to be read. Returns NULL without the option. */
+static page_set *find_clean_pages(globals_t *vars)
+{
+    /* a running target could write a page after it is looked up */
+    if (!vars->options.soft_dirty || vars->options.no_ptrace)
+        return NULL;
+    return lookup_pages(vars->matches, false);
+}
+
+static void free_page_set(page_set *clean)
+{
+    if (clean) {
+        free(clean->runs);
+        free(clean->bits);
+    }
+    free(clean);
+}
+
+/* With the `soft_dirty` option, starts tracking the pages that the target
+ * writes from now on, for the next check, or for the end of a live scan */
+static void track_writes(globals_t *vars)
+{
+    if (vars->options.soft_dirty && !clear_soft_dirty(vars->target))
+        show_warn("could not clear the soft-dirty bits of the target: %s\n", strerror(errno));
+}
+
+/* Tells if the page of `addr` is in `clean`, see page_set */
+static bool page_in_set(const page_set *clean, const void *addr)
+{
+    uintptr_t page = (uintptr_t)addr / clean->page_size;
+    size_t low = 0, high = clean->num_runs;
+
+    /* the last run starting at or before the page */
+    while (high - low > 1) {
+        size_t mid = (low + high) / 2;
+
+        if (clean->runs[mid].first_page <= page)
+            low = mid;
+        else
+            high = mid;
+    }
+    if (high == 0 || page < clean->runs[low].first_page ||
+        page >= clean->runs[low].first_page + clean->runs[low].num_pages)
+        return false;
+
+    page = clean->runs[low].first_bit + (page - clean->runs[low].first_page);
+    return clean->bits[page / 8] & (1 << (page % 8));
+}
+
+/* Tells if all the pages of [addr, addr + size) are in `clean` */
+static bool pages_in_set(const page_set *clean, const void *addr, size_t size)
+{
+    uintptr_t page_size = clean->page_size;
+    uintptr_t pos;
+
+    for (pos = (uintptr_t)addr & ~(page_size - 1); pos < (uintptr_t)addr + size; pos += page_size)
+        if (!page_in_set(clean, (void *)pos))
+            return false;
+    return true;
+}
+
+/* Counts the pages of [start, start + size) that are in `written` */
+static unsigned long count_pages_in_set(const page_set *written, const void *start, size_t size)
+{
+    uintptr_t page_size = written->page_size;
+    unsigned long count = 0;
+    uintptr_t pos;
+
+    for (pos = (uintptr_t)start & ~(page_size - 1); pos < (uintptr_t)start + size; pos += page_size)
+        count += page_in_set(written, (void *)pos);
+    return count;
+}
+
+/* With the `soft_dirty` option in live mode (`noptrace`), warns about the
+ * pages of the matches that the target wrote during the scan: their values
+ * were read at some point of the writes, they may be torn or already old */
+static void report_written_pages(globals_t *vars)
+{
+    const matches_and_old_values_array *matches = vars->matches;
+    page_set *written;
+    unsigned long count = 0;
+    size_t i;
+
+    if (!vars->options.soft_dirty || !vars->options.no_ptrace || matches == NULL ||
+        (written = lookup_pages(matches, true)) == NULL)
+        return;
+
+    if (matches->images) {
+        for (i = 0; i < matches->num_images; i++)
+            count += count_pages_in_set(written, matches->images[i].start,
+                                        matches->images[i].size);
+    } else {
+        matches_and_old_values_swath *swath;
+
+        for (swath = matches->swaths; swath->number_of_bytes; swath = next_swath(swath))
+            count += count_pages_in_set(written, swath->first_byte_in_child,
+                                        swath->number_of_bytes);
+    }
+    free_page_set(written);
+
+    if (count)
+        show_warn("the target wrote %lu pages of the matches during the scan, "
+                  "their values may be torn.\n", count);
+}
+
+/* Reads `size` bytes of the snapshot `image` from `addr` like `readmemory()`,
+ * but the bytes of the clean pages are taken from the image */
+static size_t readmemory_image(const snapshot_image *image, uint8_t *dest,
+                               const char *addr, size_t size)
+{
+    const page_set *clean = peekbuf.clean;
+    size_t done = 0;
+
+    if (clean == NULL)
+        return readmemory(dest, addr, size);
+
+    while (done < size) {
+        const char *pos = addr + done;
+        bool is_clean = page_in_set(clean, pos);
+        size_t run = MIN(size - done, clean->page_size - (uintptr_t)pos % clean->page_size);
+        size_t got;
+
+        /* the pages after it that are the same */
+        while (done + run < size && page_in_set(clean, pos + run) == is_clean)
+            run += MIN(size - done - run, clean->page_size);
+
+        if (is_clean) {
+            const uint8_t *old = image->data + (pos - (const char *)image->start);
+
+            /* an image can be read into itself */
+            if (old != dest + done)
+                memcpy(dest + done, old, run);
+            got = run;
+        } else {
+            got = readmemory(dest + done, pos, run);
+        }
+        done += got;
+        if (got < run)
+            break;
+    }
+    return done;
+}
+
+/* Tells if the pages of `r` that the target never touched are zeros:
+ * they are if no file or other process can have written them */
+static bool is_private_anonymous(const region_t *r)
+{
+    return r->flags.private && (r->filename[0] == '\0' || r->type == REGION_TYPE_HEAP ||
+                                r->type == REGION_TYPE_STACK ||
+                                strncmp(r->filename, "[anon:", 6) == 0);
+}
+
+/* Reads `size` bytes of the region `r` from `addr` like `readmemory()`, but
+ * the pages of a private anonymous region that are neither in memory nor
+ * swapped are filled with zeros, as reading them would fault them in */
+static size_t readmemory_region(const region_t *r, uint8_t *dest, const char *addr, size_t size)
+{
+    uint64_t entries[PAGEMAP_BUFFER_PAGES];
+    uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    size_t done = 0;
+
+    if (peekbuf.pagemap_fd == -1 || !is_private_anonymous(r))
+        return readmemory(dest, addr, size);
+
+    while (done < size) {
+        uintptr_t first = (uintptr_t)(addr + done) / page_size;
+        size_t count = MIN(((uintptr_t)addr + size - 1) / page_size + 1 - first,
+                           PAGEMAP_BUFFER_PAGES);
+        ssize_t ret = pread(peekbuf.pagemap_fd, entries, count * sizeof(uint64_t),
+                            first * sizeof(uint64_t));
+        size_t i = 0;
+
+        if (ret < (ssize_t)sizeof(uint64_t))
+            return done + readmemory(dest + done, addr + done, size - done);
+        count = ret / sizeof(uint64_t);
+
+        /* the runs of pages that are all empty or all not */
+        while (i < count && done < size) {
+            bool empty = !(entries[i] & (PAGEMAP_PRESENT | PAGEMAP_SWAPPED));
+            size_t j = i + 1;
+            size_t run, got;
+
+            while (j < count && !(entries[j] & (PAGEMAP_PRESENT | PAGEMAP_SWAPPED)) == empty)
+                j++;
+            run = MIN((first + j) * page_size - (uintptr_t)(addr + done), size - done);
+            if (empty) {
+                memset(dest + done, 0, run);
+                got = run;
+            } else {
+                got = readmemory(dest + done, addr + done, run);
+            }
+            done += got;
+            if (got < run)
+                return done;
+            i = j;
+        }
+    }
+    return done;
+}
+
+static void reset_peek_cache(void)
+{
+    size_t set, way;
+
+    for (set = 0; set < PEEK_SETS; set++)
+        for (way = 0; way < PEEK_WAYS; way++)
+            peekbuf.lines[set][way].base = NULL;
+    peekbuf.next_page = NULL;
+}
+
+static inline peek_line *find_line(const char *page)
+{
+    peek_line *set = peekbuf.lines[((uintptr_t) page / PEEK_PAGE_SIZE) % PEEK_SETS];
+    size_t way;
+
+    for (way = 0; way < PEEK_WAYS; way++)
+        if (set[way].base == page)
+            return &set[way];
+    return NULL;
+}
+
+/* The line to store `page` in, an empty or the least recently used one */
+static peek_line *replace_line(const char *page)
+{
+    peek_line *set = peekbuf.lines[((uintptr_t) page / PEEK_PAGE_SIZE) % PEEK_SETS];
+    peek_line *victim = &set[0];
+    size_t way;
+
+    for (way = 0; way < PEEK_WAYS; way++) {
+        if (set[way].base == NULL)
+            return &set[way];
+        if (set[way].used < victim->used)
+            victim = &set[way];
+    }
+    return victim;
+}
+
+/* Reads up to `count` pages from `page` in a single read, stopping at the
+ * first one that can't be read, and caches them.
+ * Returns the line of `page`, or NULL if it can't be read. */
+static peek_line *fill_lines(const char *page, size_t count)
+{
+    peek_line *first = NULL;
+    size_t nread, i;
+
+    nread = readmemory(peekbuf.fill, page, count * PEEK_PAGE_SIZE);
+    for (i = 0; i * PEEK_PAGE_SIZE < nread; i++) {
+        const char *p = page + i * PEEK_PAGE_SIZE;
+        peek_line *line = find_line(p);
+
+        if (line == NULL)
+            line = replace_line(p);
+        line->base = p;
+        line->size = MIN(PEEK_PAGE_SIZE, nread - i * PEEK_PAGE_SIZE);
+        line->used = ++peekbuf.clock;
+        memcpy(line->data, &peekbuf.fill[i * PEEK_PAGE_SIZE], line->size);
+        if (i == 0)
+            first = line;
+    }
+    peekbuf.stats.pages_read += i;
+    peekbuf.next_page = page + i * PEEK_PAGE_SIZE;
+    return first;
+}
+
+/* The line of `page`, read on a miss */
+static peek_line *peek_line_of(const char *page)
+{
+    peek_line *line = find_line(page);
+    size_t count = 1;
+
+    if (LIKELY(line != NULL)) {
+        peekbuf.stats.hits++;
+        line->used = ++peekbuf.clock;
+        return line;
+    }
+
+    /* read ahead the pages of sequential misses, but not those already cached */
+    peekbuf.stats.misses++;
+    if (page == peekbuf.next_page) {
+        while (count < 1 + PEEK_READ_AHEAD && find_line(page + count * PEEK_PAGE_SIZE) == NULL)
+            count++;
+    }
+    return fill_lines(page, count);
+}
+
+/* Updates the cached pages that `data`, just written at `addr`, overlaps */
+static void update_peek_cache(const void *addr, const void *data, size_t len)
+{
+    const char *start = addr, *end = start + len;
+    const char *page = start - (uintptr_t) start % PEEK_PAGE_SIZE;
+
+    for ( ; page < end; page += PEEK_PAGE_SIZE) {
+        peek_line *line = find_line(page);
+        const char *from, *to;
+
+        if (line == NULL)
+            continue;
+        from = MAX(start, page);
+        to = MIN(end, page + line->size);
+        if (from < to)
+            memcpy(&line->data[from - page], (const uint8_t *) data + (from - start), to - from);
+    }
+}
+
+/*
+ * sm_peekdata - reads memory of the process through the peek cache
+ *
+ * The result holds `length` bytes, or fewer at the end of readable memory,
+ * and stays valid until the next call. `*memlength` tells how many bytes are
+ * valid there, at least `length` unless the readable memory ends.
+ * Calls either `process_vm_readv()`, `pread(...)` or `ptrace(PEEKDATA, ...)`.
+ * `sm_attach()` MUST be called before this function.
+ */
+
+extern inline bool sm_peekdata(const void *addr, uint16_t length, const mem64_t **result_ptr, size_t *memlength)
+{
+    const char *reqaddr = addr;
+    const char *page = reqaddr - (uintptr_t) reqaddr % PEEK_PAGE_SIZE;
+    size_t offset = reqaddr - page, copied;
+    peek_line *line;
+
+    assert(result_ptr != NULL);
+    assert(memlength != NULL);
+
+#if !HAVE_PROCMEM && !HAVE_PT_IO
+    /* whole pages with ptrace() would take hundreds of syscalls, read only the request */
+# if HAVE_PROCESS_VM_READV
+    if (!peekbuf.vm_readv_usable)
+# endif
+    {
+        size_t rounded = sizeof(long) * (1 + (MAX(length, 1) - 1) / sizeof(long));
+
+        *memlength = readmemory(peekbuf.joined, reqaddr, rounded);
+        *result_ptr = (mem64_t *) peekbuf.joined;
+        return *memlength > 0;
+    }
+#endif
+
+    line = peek_line_of(page);
+    if (UNLIKELY(line == NULL || offset >= line->size)) {
+        /* hard failure to retrieve memory */
+        *result_ptr = NULL;
+        *memlength = 0;
+        return false;
+    }
+
+    /* within a page, or the last readable one */
+    if (offset + length <= line->size || line->size < PEEK_PAGE_SIZE) {
+        *result_ptr = (mem64_t *) &line->data[offset];
+        *memlength = line->size - offset;
+        return true;
+    }
+
+    /* across pages, gather them */
+    copied = line->size - offset;
+    memcpy(peekbuf.joined, &line->data[offset], copied);
+    while (copied < length) {
+        page += PEEK_PAGE_SIZE;
+        if ((line = peek_line_of(page)) == NULL)
+            break;
+        memcpy(&peekbuf.joined[copied], line->data, line->size);
+        copied += line->size;
+        if (line->size < PEEK_PAGE_SIZE)
+            break;
+    }
+
+    *result_ptr = (mem64_t *) peekbuf.joined;
+    *memlength = copied;
+    return true;
+}
+
+void sm_get_peek_stats(sm_peek_stats *stats)
+{
+    *stats = peekbuf.stats;
+}
+
+static inline void print_a_dot(void)
+{
+    fprintf(stderr, ".");
+    fflush(stderr);
+}
+
+/* Progress of a scan, possibly shared by the workers of a threaded scan */
+typedef struct {
+#if HAVE_PTHREAD
+    pthread_mutex_t lock;       /* only taken if `shared` */
+#endif
+    bool shared;
+    size_t dot_bytes;           /* bytes that the current line of dots covers */
+    size_t done_bytes;          /* bytes already scanned of those */
+    unsigned dots;              /* dots already printed on the current line */
+    unsigned long total_scan_bytes;
+    double *scan_progress;      /* percentage for the front-end */
+} progress_meter;
+
+/* Accounts for `bytes` more scanned bytes, and `found` more matches, and
+ * prints the dots they earned */
+static void progress_meter_add(progress_meter *progress, size_t bytes, unsigned long found)
+{
+    unsigned dots_due;
+
+    if (bytes == 0 && found == 0)
+        return;
+#if HAVE_PTHREAD
+    if (progress->shared)
+        pthread_mutex_lock(&progress->lock);
+#endif
+    progress->done_bytes += bytes;
+    dots_due = progress->done_bytes >= progress->dot_bytes ? NUM_DOTS :
+               (unsigned)((double)progress->done_bytes / progress->dot_bytes * NUM_DOTS);
+    for ( ; progress->dots < dots_due; progress->dots++) {
+        /* for user, just print a dot */
+        print_a_dot();
+    }
+    /* for front-end, update percentage */
+    *progress->scan_progress += (double)bytes / progress->total_scan_bytes;
+    async_scan_progressed(*progress->scan_progress, found);
+#if HAVE_PTHREAD
+    if (progress->shared)
+        pthread_mutex_unlock(&progress->lock);
+#endif
+}
+
+/* State of a scan writing into one matches array */
+typedef struct {
+    matches_and_old_values_array *matches;
+    matches_and_old_values_swath *writing_swath;
+    unsigned long num_matches;
+    int required_extra_bytes_to_record;
+    uint8_t *data;              /* read buffer */
+    matches_and_old_values_swath *merged_from;  /* where the last merged matches start */
+    bool release_image;         /* the image of a snapshot is released as it is checked */
+    struct read_ahead *ahead;   /* reads the next block of a region, or NULL */
+} scan_state;
+
+/* Starts an empty matches array in `state`, sized for at most `max_bytes` */
+static bool scan_state_start(scan_state *state, size_t max_bytes, flags_encoding encoding,
+                             bool in_file)
+{
+    if (!(state->matches = allocate_array(NULL, max_bytes, encoding, in_file)))
+        return false;
+    state->writing_swath = state->matches->swaths;
+    state->writing_swath->first_byte_in_child = NULL;
+    state->writing_swath->number_of_bytes = 0;
+    return true;
+}
+
+#if HAVE_PTHREAD
+/* Appends the matches of `from` to the ones of `state`, giving the same
+ * result as if `from` had been scanned right after them. */
+static bool merge_matches(scan_state *state, const scan_state *from)
+{
+    matches_and_old_values_swath *first = from->matches->swaths;
+    matches_and_old_values_swath *writing_swath = state->writing_swath;
+    matches_and_old_values_swath *swath;
+
+    state->num_matches += from->num_matches;
+    if (first->number_of_bytes == 0)
+        return true;
+
+    /* The extra bytes recorded after the previous part are replaced by the
+     * ones of this part, once this part has started matching on its own.
+     * They can be in several swaths, after the start of the previous part. */
+    if (writing_swath->number_of_bytes > 0 &&
+        remote_address_of_last_element(writing_swath) >= first->first_byte_in_child) {
+        assert(state->merged_from);
+        writing_swath = truncate_from_address(state->matches, state->merged_from,
+                                              first->first_byte_in_child);
+    }
+    state->merged_from = writing_swath;
+
+    /* the first swath may continue the last one, the others are copied as they are */
+    for (swath = first; ; swath = next_swath(swath)) {
+        writing_swath = append_swath(&state->matches, writing_swath, swath);
+        if (state->matches == NULL)
+            return false;
+        STATS_ADD(bytes_copied, (uint8_t *)local_address_beyond_last_element(swath) -
+                                (uint8_t *)swath);
+        if (swath == from->writing_swath)
+            break;
+    }
+
+    state->writing_swath = writing_swath;
+    return true;
+}
+
+/* Tells if `readmemory()` can be called from any thread, so not with
+ * `ptrace()`. Settles the backend with a read of `addr` before. */
+static bool readmemory_threadsafe(const void *addr)
+{
+#if HAVE_PROCESS_VM_READV
+    uint8_t probe[sizeof(long)];
+
+    if (peekbuf.vm_readv_usable)
+        readmemory_vm(probe, addr, 1);
+    if (peekbuf.vm_readv_usable)
+        return true;
+#endif
+    return HAVE_PROCMEM;
+}
+
+/* Number of threads to use for scanning at `addr`, according to the
+ * `scan_threads` option and to how the memory can be read */
+static unsigned scan_threads(globals_t *vars, const void *addr)
+{
+    unsigned threads = vars->options.scan_threads;
+
+    if (threads == 0) {
+        /* as many as the system has */
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? MIN(cpus, MAX_SCAN_THREADS) : 1;
+    }
+    if (threads > 1 && !readmemory_threadsafe(addr)) {
+        show_debug("memory is read with ptrace(), scanning with a single thread.\n");
+        threads = 1;
+    }
+    return threads;
+}
+
+/* Runs `worker(work)` on `num_threads` threads and waits for them */
+static void run_workers(void *(*worker)(void *), void *work, unsigned num_threads)
+{
+    pthread_t threads[MAX_SCAN_THREADS];
+    unsigned started, i;
+
+    for (started = 0; started < num_threads; started++) {
+        if (pthread_create(&threads[started], NULL, worker, work) != 0)
+            break;
+    }
+    if (started == 0) {
+        /* the calling thread takes it all */
+        worker(work);
+    }
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+}
+
+/* A thread that reads the next block of a region into a buffer of its own
+ * while the scanning thread searches the current one, so that the reads and
+ * the comparisons overlap. The two buffers are swapped at each block. */
+typedef struct read_ahead {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;        /* a read was asked, or is done */
+    uint8_t *buffer;            /* the block being read, or read */
+    const region_t *region;     /* of the block, NULL if none was asked */
+    const char *addr;
+    size_t size;
+    size_t nread;
+    bool busy;                  /* the block is being read */
+    bool quit;
+} read_ahead;
+
+static void *read_ahead_worker(void *arg)
+{
+    read_ahead *ahead = arg;
+
+    pthread_mutex_lock(&ahead->lock);
+    for (;;) {
+        size_t nread;
+
+        while (!ahead->busy && !ahead->quit)
+            pthread_cond_wait(&ahead->cond, &ahead->lock);
+        if (ahead->quit)
+            break;
+
+        pthread_mutex_unlock(&ahead->lock);
+        nread = readmemory_region(ahead->region, ahead->buffer, ahead->addr, ahead->size);
+        pthread_mutex_lock(&ahead->lock);
+
+        ahead->nread = nread;
+        ahead->busy = false;
+        pthread_cond_signal(&ahead->cond);
+    }
+    pthread_mutex_unlock(&ahead->lock);
+    return NULL;
+}
+
+static bool read_ahead_start(read_ahead *ahead)
+{
+    memset(ahead, 0, sizeof(*ahead));
+    if ((ahead->buffer = malloc(MAX_ALLOC_SIZE)) == NULL)
+        return false;
+    pthread_mutex_init(&ahead->lock, NULL);
+    pthread_cond_init(&ahead->cond, NULL);
+    if (pthread_create(&ahead->thread, NULL, read_ahead_worker, ahead) != 0) {
+        pthread_cond_destroy(&ahead->cond);
+        pthread_mutex_destroy(&ahead->lock);
+        free(ahead->buffer);
+        return false;
+    }
+    return true;
+}
+
+static void read_ahead_stop(read_ahead *ahead)
+{
+    pthread_mutex_lock(&ahead->lock);
+    /* a read still going finishes first */
+    ahead->quit = true;
+    pthread_cond_signal(&ahead->cond);
+    pthread_mutex_unlock(&ahead->lock);
+    pthread_join(ahead->thread, NULL);
+
+    pthread_cond_destroy(&ahead->cond);
+    pthread_mutex_destroy(&ahead->lock);
+    free(ahead->buffer);
+}
+
+/* Starts reading `size` bytes of `r` from `addr`, see read_ahead_take() */
+static void read_ahead_ask(read_ahead *ahead, const region_t *r, const char *addr, size_t size)
+{
+    pthread_mutex_lock(&ahead->lock);
+    ahead->region = r;
+    ahead->addr = addr;
+    ahead->size = size;
+    ahead->busy = true;
+    pthread_cond_signal(&ahead->cond);
+    pthread_mutex_unlock(&ahead->lock);
+}
+
+/* Waits for the block asked last, and swaps its buffer with `*data` if it is
+ * the `size` bytes of `r` from `addr`. Returns the number of bytes read, or
+ * SIZE_MAX if another block was asked, or none. */
+static size_t read_ahead_take(read_ahead *ahead, const region_t *r, const char *addr,
+                              size_t size, uint8_t **data)
+{
+    size_t nread = SIZE_MAX;
+
+    pthread_mutex_lock(&ahead->lock);
+    while (ahead->busy)
+        pthread_cond_wait(&ahead->cond, &ahead->lock);
+    pthread_mutex_unlock(&ahead->lock);
+
+    if (ahead->region == r && ahead->addr == addr && ahead->size == size) {
+        uint8_t *buffer = *data;
+
+        *data = ahead->buffer;
+        ahead->buffer = buffer;
+        nread = ahead->nread;
+    }
+    ahead->region = NULL;
+    return nread;
+}
+#endif
+
+/* A part of a swath scanned by `sm_checkmatches()`, with its memory read in a batch */
+typedef struct {
+    matches_and_old_values_swath *swath;    /* swath the elements belong to */
+    size_t first_index;                     /* first element of the swath to scan */
+    size_t num_elements;                    /* number of elements to scan */
+} swath_span;
+
+/* Position of `read_swath_batch()` in the swaths */
+typedef struct {
+    matches_and_old_values_swath *swath;
+    size_t index;
+    size_t elements_left;       /* elements left to collect */
+} swath_reader;
+
+/* Size of the data buffer given to `read_swath_batch()` */
+#define SWATH_BATCH_DATA_SIZE (MAX_ALLOC_SIZE + MAX_READ_BATCH * sizeof(long))
+
+/* Reads the spans collected by `read_swath_batch()` that are on pages written
+ * since the last scan, and copies the old values of the others */
+static void read_dirty_spans(const swath_span *spans, read_span *reads, size_t count)
+{
+    read_span dirty[MAX_READ_BATCH];
+    size_t dirty_index[MAX_READ_BATCH];
+    size_t num_dirty = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        if (pages_in_set(peekbuf.clean, reads[i].target_address, reads[i].size)) {
+            reads[i].nread = old_values_of_elements(spans[i].swath, spans[i].first_index,
+                                                    reads[i].dest, reads[i].size);
+        } else {
+            dirty[num_dirty] = reads[i];
+            dirty_index[num_dirty++] = i;
+        }
+    }
+
+    readmemory_batch(dirty, num_dirty);
+    for (i = 0; i < num_dirty; i++)
+        reads[dirty_index[i]].nread = dirty[i].nread;
+}
+
+/* Collects the next spans to scan from the position of `reader`,
+ * and reads the target memory of all of them with `readmemory_batch()`.
+ * A span covers at most `MAX_BUFFER_SIZE` elements, but its memory is read up
+ * to `MAX_ALLOC_SIZE` bytes further so that its last element can be a full VLT.
+ * Returns the number of spans collected, 0 at the end of the swaths. */
+static size_t read_swath_batch(swath_reader *reader, swath_span *spans,
+                               read_span *reads, uint8_t *data)
+{
+    size_t count = 0;
+    size_t data_used = 0;
+
+    while (reader->swath->number_of_bytes && reader->elements_left && count < MAX_READ_BATCH) {
+        size_t remaining = reader->swath->number_of_bytes - reader->index;
+        size_t elements = MIN(MIN(remaining, MAX_BUFFER_SIZE), reader->elements_left);
+        /* the swaths continuing this one are read as well */
+        size_t read_size = elements_to_end_of_run(reader->swath, reader->index, MAX_ALLOC_SIZE);
+
+        /* the buffer is full, keep the rest for the next batch */
+        if (data_used + read_size + sizeof(long) > SWATH_BATCH_DATA_SIZE)
+            break;
+
+        spans[count].swath = reader->swath;
+        spans[count].first_index = reader->index;
+        spans[count].num_elements = elements;
+
+        reads[count].target_address = (char *)reader->swath->first_byte_in_child + reader->index;
+        reads[count].size = read_size;
+        reads[count].nread = 0;
+        reads[count].dest = data + data_used;
+
+        data_used += read_size + sizeof(long);
+        count++;
+
+        /* go on to the next piece of memory */
+        reader->elements_left -= elements;
+        reader->index += elements;
+        if (reader->index >= reader->swath->number_of_bytes) {
+            reader->swath = next_swath(reader->swath);
+            reader->index = 0;
+        }
+    }
+
+    if (peekbuf.clean)
+        read_dirty_spans(spans, reads, count);
+    else
+        readmemory_batch(reads, count);
+    return count;
+}
+
+/* Checks the elements of the `count` spans read by `read_swath_batch()`
+ * and records the ones still matching into `state`.
+ * With `finish_tail`, the extra bytes needed by the last match are recorded
+ * even if they are after the last span, as long as they are in its swath. */
+static void check_spans(globals_t *vars, const uservalue_t *uservalue, scan_state *state,
+                        const swath_span *spans, const read_span *reads, size_t count,
+                        bool finish_tail)
+{
+    size_t span_idx;
+
+    for (span_idx = 0; span_idx < count; span_idx++) {
+        const swath_span *span = &spans[span_idx];
+        const read_span *read = &reads[span_idx];
+        size_t i;
+
+        for (i = 0; i < span->num_elements; i++) {
+            unsigned int match_length = 0;
+            size_t reading_iterator = span->first_index + i;
+            const mem64_t *memory_ptr = (mem64_t *)&read->dest[i];
+            size_t memlength = read->nread > i ? read->nread - i : 0;
+            match_flags checkflags;
+
+            match_flags old_flags = flags_of_nth_element(span->swath, reading_iterator);
+            uint old_length = flags_to_memlength(vars->options.scan_data_type, old_flags);
+            void *address = remote_address_of_nth_element(span->swath, reading_iterator);
+
+            /* check the value at this address */
+            if (UNLIKELY(memlength == 0))
+            {
+                /* If we can't look at the data here, just abort the whole recording, something bad happened */
+                state->required_extra_bytes_to_record = 0;
+            }
+            else if (old_flags != flags_empty) /* Test only valid old matches */
+            {
+                value_t old_val = data_to_val(span->swath, reading_iterator);
+                memlength = old_length < memlength ? old_length : memlength;
+
+                checkflags = flags_empty;
+
+                match_length = (*sm_scan_routine)(memory_ptr, memlength, &old_val, uservalue, &checkflags);
+            }
+
+            if (match_length > 0)
+            {
+                assert(match_length <= memlength);
+
+                /* Still a candidate. Write data. */
+                state->writing_swath = add_element(&state->matches, state->writing_swath, address,
+                                                   get_u8b(memory_ptr), checkflags);
+
+                ++state->num_matches;
+
+                /* the bytes owed to a wider match before are still recorded */
+                state->required_extra_bytes_to_record = MAX(state->required_extra_bytes_to_record - 1,
+                                                            (int)match_length - 1);
+            }
+            else if (state->required_extra_bytes_to_record)
+            {
+                state->writing_swath = add_element(&state->matches, state->writing_swath, address,
+                                                   get_u8b(memory_ptr), flags_empty);
+                --state->required_extra_bytes_to_record;
+            }
+        }
+
+        /* the next span may start a new swath */
+        if (span->first_index + span->num_elements >= span->swath->number_of_bytes &&
+            !swath_is_continued(span->swath))
+            state->required_extra_bytes_to_record = 0; /* just in case */
+    }
+
+    if (finish_tail && count > 0) {
+        const swath_span *span = &spans[count - 1];
+        const read_span *read = &reads[count - 1];
+        size_t i;
+
+        /* the memory was read far enough for a full VLT, and no further
+         * than the swath and the ones continuing it */
+        for (i = span->num_elements;
+             state->required_extra_bytes_to_record && i < read->nread;
+             i++, --state->required_extra_bytes_to_record) {
+            state->writing_swath = add_element(&state->matches, state->writing_swath,
+                                               remote_address_of_nth_element(span->swath,
+                                                                             span->first_index + i),
+                                               read->dest[i], flags_empty);
+        }
+        state->required_extra_bytes_to_record = 0;
+    }
+}
+
+/* Number of elements collected by a batch */
+static size_t batch_elements(const swath_span *spans, size_t count)
+{
+    size_t elements = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        elements += spans[i].num_elements;
+    return elements;
+}
+
+#if HAVE_PTHREAD
+/* The swaths are split into ranges of this number of elements (at most)
+ * for threaded checks, like regions for threaded searches */
+#define CHECK_RANGE_SIZE (4 * MAX_BUFFER_SIZE)
+
+/* A range of elements checked by a single worker of a threaded check */
+typedef struct {
+    matches_and_old_values_swath *swath;    /* first swath of the range */
+    size_t index;                           /* first element in it */
+    size_t num_elements;
+    scan_state state;                       /* matches still matching */
+} check_range;
+
+/* Work shared by the workers of a threaded check */
+typedef struct {
+    globals_t *vars;
+    const uservalue_t *uservalue;
+    check_range *ranges;
+    size_t num_ranges;
+    size_t next_range;          /* protected by `progress.lock` */
+    size_t max_bytes;           /* bound of every range's matches array */
+    flags_encoding encoding;    /* encoding of the checked matches */
+    progress_meter progress;
+    bool failed;
+} check_work;
+
+static void *check_worker(void *arg)
+{
+    check_work *work = arg;
+    swath_span *spans = malloc(MAX_READ_BATCH * sizeof(swath_span));
+    read_span *reads = malloc(MAX_READ_BATCH * sizeof(read_span));
+    uint8_t *data = malloc(SWATH_BATCH_DATA_SIZE);
+
+    if (spans == NULL || reads == NULL || data == NULL) {
+        work->failed = true;
+        goto out;
+    }
+
+    for (;;) {
+        check_range *range;
+        swath_reader reader;
+        size_t num_spans;
+        unsigned long reported_matches = 0;
+
+        pthread_mutex_lock(&work->progress.lock);
+        range = work->next_range < work->num_ranges ? &work->ranges[work->next_range++] : NULL;
+        pthread_mutex_unlock(&work->progress.lock);
+        if (range == NULL || work->vars->stop_flag)
+            break;
+
+        /* every worker writes its own array, the input stays untouched */
+        if (!scan_state_start(&range->state, work->max_bytes, work->encoding,
+                              work->vars->options.matches_in_file)) {
+            work->failed = true;
+            break;
+        }
+
+        reader.swath = range->swath;
+        reader.index = range->index;
+        reader.elements_left = range->num_elements;
+
+        while ((num_spans = read_swath_batch(&reader, spans, reads, data)) > 0) {
+            check_spans(work->vars, work->uservalue, &range->state, spans, reads, num_spans,
+                        reader.elements_left == 0);
+            progress_meter_add(&work->progress, batch_elements(spans, num_spans),
+                               range->state.num_matches - reported_matches);
+            reported_matches = range->state.num_matches;
+            if (work->vars->stop_flag)
+                break;
+        }
+    }
+
+out:
+    free(spans);
+    free(reads);
+    free(data);
+    return NULL;
+}
+
+/* Checks all matches using `num_threads` workers, and replaces them by the
+ * merge of what the workers found */
+static bool check_threaded(globals_t *vars, const uservalue_t *uservalue,
+                           unsigned num_threads, unsigned long total_scan_bytes,
+                           size_t max_bytes, flags_encoding encoding)
+{
+    check_work work = { .vars = vars, .uservalue = uservalue };
+    scan_state state = { .matches = NULL };
+    matches_and_old_values_swath *swath;
+    size_t range_elements = 0;
+    size_t i;
+    bool ret = true;
+
+    work.max_bytes = max_bytes;
+    work.encoding = encoding;
+    if (!scan_state_start(&state, work.max_bytes, work.encoding, vars->options.matches_in_file)) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
+
+    /* split the swaths into ranges */
+    work.num_ranges = 1 + total_scan_bytes / CHECK_RANGE_SIZE;
+    if ((work.ranges = calloc(work.num_ranges, sizeof(check_range))) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        free_array(state.matches);
+        return false;
+    }
+    work.num_ranges = 0;
+    for (swath = vars->matches->swaths; swath->number_of_bytes;
+         swath = next_swath(swath)) {
+        size_t index = 0;
+
+        while (index < swath->number_of_bytes) {
+            size_t elements;
+
+            if (range_elements == 0) {
+                work.ranges[work.num_ranges].swath = swath;
+                work.ranges[work.num_ranges].index = index;
+                work.num_ranges++;
+            }
+            elements = MIN(swath->number_of_bytes - index, CHECK_RANGE_SIZE - range_elements);
+            work.ranges[work.num_ranges - 1].num_elements += elements;
+            range_elements = (range_elements + elements) % CHECK_RANGE_SIZE;
+            index += elements;
+        }
+    }
+
+    pthread_mutex_init(&work.progress.lock, NULL);
+    work.progress.shared = true;
+    work.progress.dot_bytes = total_scan_bytes;
+    work.progress.total_scan_bytes = total_scan_bytes;
+    work.progress.scan_progress = &vars->scan_progress;
+
+    run_workers(check_worker, &work, MIN(num_threads, work.num_ranges));
+    pthread_mutex_destroy(&work.progress.lock);
+
+    if (work.failed) {
+        show_error("sorry, there was a memory allocation error.\n");
+        ret = false;
+    }
+
+    /* compact what survived, in address order */
+    for (i = 0; i < work.num_ranges; i++) {
+        if (work.ranges[i].state.matches == NULL)
+            continue;
+        if (ret && !merge_matches(&state, &work.ranges[i].state)) {
+            show_error("memory allocation error while merging matches\n");
+            ret = false;
+        }
+        free_array(work.ranges[i].state.matches);
+    }
+    free(work.ranges);
+
+    if (ret && vars->stop_flag)
+        printf("\n");
+
+    if (ret && (state.matches = null_terminate(state.matches, state.writing_swath))) {
+        free_array(vars->matches);
+        vars->matches = state.matches;
+        vars->num_matches = state.num_matches;
+    } else {
+        /* keep the old matches */
+        free_array(state.matches);
+        ret = false;
+    }
+    return ret;
+}
+#endif
+
+static bool check_snapshot(globals_t *vars, scan_match_type_t match_type,
+                           const uservalue_t *uservalue);
+
+/* This is the function that handles when you enter a value (or >, <, =) for the second or later time (i.e. when there's already a list of matches);
+ * it reduces the list to those that still match. It returns false on failure to attach, detach, or reallocate memory, otherwise true.
+ * The `other_matches` kept out of the check are counted in the matches shown. */
+static bool check_matches(globals_t *vars,
+                          scan_match_type_t match_type,
+                          const uservalue_t *uservalue,
+                          unsigned long other_matches)
+{
+    matches_and_old_values_swath *reading_swath_index;
+    swath_reader reader = { .elements_left = SIZE_MAX };
+    scan_state state = { .matches = NULL };
+    progress_meter progress = { .scan_progress = &vars->scan_progress };
+    flags_encoding encoding = flags_encoding_for(sm_get_possible_flags(vars->options.scan_data_type));
+
+    unsigned long total_scan_bytes = 0;
+    size_t max_bytes = sizeof(matches_and_old_values_array) + sizeof(matches_and_old_values_swath);
+    matches_and_old_values_swath *tmp_swath_index;
+    swath_span *spans = NULL;
+    read_span *reads = NULL;
+    size_t num_spans;
+    unsigned long reported_matches = 0;
+
+    if (sm_choose_scanroutine(vars->options.scan_data_type, match_type, uservalue, vars->options.reverse_endianness) == false)
+    {
+        show_error("unsupported scan for current data type.\n");
+        return false;
+    }
+
+    assert(sm_scan_routine);
+
+    /* a snapshot is checked with its images, unless the data type changed
+     * since: then the flags of its matches have to be checked */
+    if (vars->matches->images &&
+        sm_get_possible_flags(vars->options.scan_data_type) != vars->matches->image_flags &&
+        !materialize_snapshot(vars->matches)) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
+
+    reader.swath = reading_swath_index = tmp_swath_index = vars->matches->swaths;
+
+    /* the matches still matching are written in a new array, that can't
+     * take more room than with all the old elements kept */
+    while(tmp_swath_index->number_of_bytes)
+    {
+        total_scan_bytes += tmp_swath_index->number_of_bytes;
+        max_bytes += swath_bytes_bound(tmp_swath_index->number_of_bytes, encoding);
+        tmp_swath_index = next_swath(tmp_swath_index);
+    }
+    progress.dot_bytes = total_scan_bytes;
+    progress.total_scan_bytes = total_scan_bytes;
+
+    vars->scan_progress = 0.0;
+    vars->stop_flag = false;
+
+    /* stop and attach to the target */
+    if (sm_attach(vars->target) == false)
+        return false;
+
+    /* the pages not written since the last scan don't have to be read */
+    peekbuf.clean = find_clean_pages(vars);
+    track_writes(vars);
+
+    INTERRUPTABLESCAN();
+
+    if (vars->matches->images) {
+        bool ret = check_snapshot(vars, match_type, uservalue);
+
+        ENDINTERRUPTABLE();
+        if (!ret) {
+            sm_detach(vars->target);
+            return false;
+        }
+        goto done;
+    }
+
+#if HAVE_PTHREAD
+    if (total_scan_bytes > 0) {
+        unsigned threads = scan_threads(vars, reading_swath_index->first_byte_in_child);
+
+        if (threads > 1) {
+            bool ret = check_threaded(vars, uservalue, threads, total_scan_bytes,
+                                      max_bytes, encoding);
+
+            ENDINTERRUPTABLE();
+            if (!ret) {
+                sm_detach(vars->target);
+                return false;
+            }
+            goto done;
+        }
+    }
+#endif
+
+    /* buffers for the batched reads, see `read_swath_batch()` */
+    spans = malloc(MAX_READ_BATCH * sizeof(swath_span));
+    reads = malloc(MAX_READ_BATCH * sizeof(read_span));
+    state.data = malloc(SWATH_BATCH_DATA_SIZE);
+    if (spans == NULL || reads == NULL || state.data == NULL ||
+        !scan_state_start(&state, max_bytes, encoding, vars->options.matches_in_file)) {
+        show_error("sorry, there was a memory allocation error.\n");
+        free(spans);
+        free(reads);
+        free(state.data);
+        ENDINTERRUPTABLE();
+        sm_detach(vars->target);
+        return false;
+    }
+
+    while ((num_spans = read_swath_batch(&reader, spans, reads, state.data)) > 0) {
+        check_spans(vars, uservalue, &state, spans, reads, num_spans, false);
+        progress_meter_add(&progress, batch_elements(spans, num_spans),
+                           state.num_matches - reported_matches);
+        reported_matches = state.num_matches;
+
+        /* the old matches are not needed up to here anymore */
+        release_swaths_before(vars->matches, reader.swath);
+
+        /* stop scanning if asked to */
+        if (vars->stop_flag) {
+            printf("\n");
+            break;
+        }
+    }
+
+    ENDINTERRUPTABLE();
+
+    free(spans);
+    free(reads);
+    free(state.data);
+
+    if (!(state.matches = null_terminate(state.matches, state.writing_swath)))
+    {
+        show_error("memory allocation error while reducing matches-array size\n");
+        return false;
+    }
+    free_array(vars->matches);
+    vars->matches = state.matches;
+    vars->num_matches = state.num_matches;
+
+done:
+    show_user("ok\n");
+
+    /* tell front-end we've done */
+    vars->scan_progress = MAX_PROGRESS;
+
+    show_info("we currently have %ld matches.\n", vars->num_matches + other_matches);
+    report_written_pages(vars);
+
+    /* okay, detach */
+    return sm_detach(vars->target);
+}
+
+/* Checks the matches in the scan scope, the others are kept as they are.
+ * They move out of the array of the matches for the check, and back in */
+static bool check_scope(globals_t *vars,
+                        scan_match_type_t match_type,
+                        const uservalue_t *uservalue)
+{
+    matches_and_old_values_array *outside = vars->matches, *merged;
+    unsigned long outside_matches = vars->num_matches, scoped_matches;
+    bool ret;
+
+    if (!(vars->matches = take_address_ranges(outside, &outside_matches, vars->scan_scope,
+                                              vars->scan_scope_count, &scoped_matches))) {
+        show_error("sorry, there was a memory allocation error.\n");
+        vars->matches = outside;
+        return false;
+    }
+    vars->num_matches = scoped_matches;
+
+    ret = check_matches(vars, match_type, uservalue, outside_matches);
+
+    if (!(merged = merge_arrays(outside, vars->matches))) {
+        show_error("memory allocation error while merging matches\n");
+        vars->num_matches = 0;
+        ret = false;
+    } else {
+        vars->num_matches += outside_matches;
+    }
+    vars->matches = merged;
+    return ret;
+}
+
+bool sm_checkmatches(globals_t *vars,
+                     scan_match_type_t match_type,
+                     const uservalue_t *uservalue)
+{
+    phase_timer timer;
+    bool ret;
+
+    phase_begin(&timer, vars->num_matches);
+    if (vars->scan_scope)
+        ret = check_scope(vars, match_type, uservalue);
+    else
+        ret = check_matches(vars, match_type, uservalue, 0);
+    phase_end(&timer, SM_PHASE_CHECK, vars->num_matches);
+    return ret;
+}
+
+/* Number of offsets given at once to `sm_scan_buffer_routine` */
+#define SCAN_BUFFER_CHUNK (4096)
+
+/* Records the extra bytes still needed by the last match, from `buf_pos[from]`
+ * and up to `buf_pos[to]` excluded */
+static inline void record_extra_bytes(scan_state *state, const uint8_t *buf_pos,
+                                      void *reg_pos, size_t from, size_t to)
+{
+    for ( ; state->required_extra_bytes_to_record && from < to; from++) {
+        state->writing_swath = add_element(&state->matches, state->writing_swath,
+                                           reg_pos + from, buf_pos[from], flags_empty);
+        --state->required_extra_bytes_to_record;
+    }
+}
+
+/* Matches the first `count` offsets of the buffer with `sm_scan_buffer_routine`,
+ * only the multiples of `stride`.
+ * The buffer holds `memlength` bytes of the region from `reg_pos` */
+static void search_buffer_bulk(globals_t *vars, const uservalue_t *uservalue, scan_state *state,
+                               const uint8_t *buf_pos, void *reg_pos, size_t count, size_t memlength,
+                               size_t stride)
+{
+    uint32_t offsets[SCAN_BUFFER_CHUNK];
+    match_flags flags[SCAN_BUFFER_CHUNK];
+    size_t chunk, recorded = 0;
+
+    for (chunk = 0; chunk < count; chunk += SCAN_BUFFER_CHUNK) {
+        size_t num_matches = (*sm_scan_buffer_routine)(buf_pos + chunk,
+                                                      MIN(count - chunk, SCAN_BUFFER_CHUNK),
+                                                      memlength - chunk, stride, uservalue,
+                                                      offsets, flags);
+        size_t i;
+
+        for (i = 0; i < num_matches; i++) {
+            size_t offset = chunk + offsets[i];
+            unsigned int match_length = flags_to_memlength(vars->options.scan_data_type, flags[i]);
+
+            assert(match_length > 0 && match_length <= memlength - offset);
+            record_extra_bytes(state, buf_pos, reg_pos, recorded, offset);
+            state->writing_swath = add_element(&state->matches, state->writing_swath,
+                                               reg_pos + offset, buf_pos[offset], flags[i]);
+
+            ++state->num_matches;
+
+            /* the bytes owed to a wider match before are still recorded */
+            state->required_extra_bytes_to_record = MAX(state->required_extra_bytes_to_record - 1,
+                                                        (int)match_length - 1);
+            recorded = offset + 1;
+        }
+    }
+    record_extra_bytes(state, buf_pos, reg_pos, recorded, count);
+}
+
+/* Matches the first `count` offsets of the buffer with `sm_scan_routine`, one at a time,
+ * only the multiples of `stride`.
+ * The buffer holds `memlength` bytes of the region from `reg_pos`.
+ * With an `image` of the `snapshot` array, the old values are the bytes of the image. */
+static void search_buffer_each(const matches_and_old_values_array *snapshot,
+                               const snapshot_image *image,
+                               const uservalue_t *uservalue, scan_state *state,
+                               const uint8_t *buf_pos, void *reg_pos, size_t count, size_t memlength,
+                               size_t stride)
+{
+    size_t i, recorded = 0;
+
+    /* For every offset, check if we have a match. */
+    for (i = 0; i < count; i += stride) {
+        const mem64_t* memory_ptr = (mem64_t*)(buf_pos + i);
+        const value_t *old_value = NULL;
+        size_t length = memlength - i;
+        unsigned int match_length;
+        match_flags checkflags;
+        value_t old_val;
+
+        if (image) {
+            size_t n = (reg_pos + i) - image->start;
+
+            /* the old value is only as long as its flags */
+            old_val.flags = flags_of_image_byte(snapshot, image, n);
+            if (old_val.flags == flags_empty)
+                continue;
+            memcpy(old_val.bytes, &image->data[n], MIN(image->size - n, sizeof(old_val.bytes)));
+            length = MIN(length, flags_to_memlength(ANYNUMBER, old_val.flags));
+            old_value = &old_val;
+        }
+
+        /* initialize checkflags */
+        checkflags = flags_empty;
+
+        /* check if we have a match */
+        match_length = (*sm_scan_routine)(memory_ptr, length, old_value, uservalue, &checkflags);
+        if (UNLIKELY(match_length > 0))
+        {
+            assert(match_length <= memlength - i);
+            record_extra_bytes(state, buf_pos, reg_pos, recorded, i);
+            state->writing_swath = add_element(&state->matches, state->writing_swath, reg_pos + i,
+                                               get_u8b(memory_ptr), checkflags);
+
+            ++state->num_matches;
+
+            /* the bytes owed to a wider match before are still recorded */
+            state->required_extra_bytes_to_record = MAX(state->required_extra_bytes_to_record - 1,
+                                                        (int)match_length - 1);
+            recorded = i + 1;
+        }
+    }
+    record_extra_bytes(state, buf_pos, reg_pos, recorded, count);
+}
+
+/* Matches the offsets [from, to) of the buffer of `state`, only the multiples
+ * of `stride`, see search_range() */
+static void search_buffer(globals_t *vars, const uservalue_t *uservalue, scan_state *state,
+                          const snapshot_image *image, void *reg_pos, size_t from, size_t to,
+                          size_t memlength, size_t stride)
+{
+    size_t skip = MIN(to - from, -(uintptr_t)(reg_pos + from) & (stride - 1));
+
+    record_extra_bytes(state, state->data, reg_pos, from, from + skip);
+    from += skip;
+    /* the scans by buffer don't use the old values */
+    if (sm_scan_buffer_routine)
+        search_buffer_bulk(vars, uservalue, state, state->data + from, reg_pos + from,
+                           to - from, memlength - from, stride);
+    else
+        search_buffer_each(vars->matches, image, uservalue, state, state->data + from,
+                           reg_pos + from, to - from, memlength - from, stride);
+}
+
+/* Tells if a number can match at some zeros, in a first scan */
+static bool zeros_can_match(globals_t *vars, const uservalue_t *uservalue)
+{
+    static const mem64_t zeros;
+    match_flags flags = flags_empty;
+
+    /* a VLT match can be longer than a number */
+    if (vars->options.scan_data_type == BYTEARRAY || vars->options.scan_data_type == STRING)
+        return true;
+    return (*sm_scan_routine)(&zeros, sizeof(zeros), NULL, uservalue, &flags) > 0;
+}
+
+static inline bool is_zeros(const uint8_t *data, size_t size)
+{
+    return data[0] == 0 && memcmp(data, data + 1, size - 1) == 0;
+}
+
+/* Same as search_buffer() from 0 to `scan_size`, for numbers that can't match
+ * at zeros: the offsets whose value would only be made of the zeros of whole
+ * pages are skipped. The buffer holds `data_size` bytes read. */
+static void search_buffer_nonzero(globals_t *vars, const uservalue_t *uservalue,
+                                  scan_state *state, void *reg_pos, size_t scan_size,
+                                  size_t data_size, size_t memlength, size_t stride)
+{
+    uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    /* the first page starting in the buffer */
+    size_t pos = -(uintptr_t)reg_pos & (page_size - 1);
+    size_t from = 0;
+
+    for ( ; pos < scan_size; pos += page_size) {
+        size_t end = pos;
+
+        while (end + page_size <= data_size && is_zeros(state->data + end, page_size))
+            end += page_size;
+        if (end > pos) {
+            size_t zeros_end = MIN(end - (sizeof(mem64_t) - 1), scan_size);
+
+            search_buffer(vars, uservalue, state, NULL, reg_pos, from, pos, memlength, stride);
+            record_extra_bytes(state, state->data, reg_pos, pos, zeros_end);
+            from = zeros_end;
+            pos = end;
+        }
+    }
+    search_buffer(vars, uservalue, state, NULL, reg_pos, from, scan_size, memlength, stride);
+}
+
+/* Reads `size` bytes of the region `r` from `addr` into `state->data`, or
+ * takes them from the read ahead of the state */
+static size_t read_block(scan_state *state, const region_t *r, const char *addr, size_t size)
+{
+#if HAVE_PTHREAD
+    if (state->ahead) {
+        size_t nread = read_ahead_take(state->ahead, r, addr, size, &state->data);
+
+        if (nread != SIZE_MAX)
+            return nread;
+    }
+#endif
+    return readmemory_region(r, state->data, addr, size);
+}
+
+/* Scans `size` bytes of the region `r` from `start` into `state`.
+ * Bytes after the range are still read, up to the end of the region, when
+ * a match in the range needs them, so that splitting a region doesn't change
+ * what is recorded in the range.
+ * Only the addresses that are multiples of the `alignment` option may match.
+ * To check a snapshot, the `image` of the snapshot in `vars->matches` is
+ * scanned instead of a region, with its bytes as the old values, and its
+ * alignment.
+ * The pages that the target never touched are not read, and when zeros can't
+ * match, the pages of zeros aren't searched. */
+static void search_range(globals_t *vars, const uservalue_t *uservalue, scan_state *state,
+                         const region_t *r, const snapshot_image *image, unsigned long regnum,
+                         void *start, size_t size, progress_meter *progress)
+{
+    void *area_start = image ? image->start : r->start;
+    /* `memlength` always counts until the end of the region for VLT matches */
+    size_t memlength = (image ? image->start + image->size : r->start + r->size) - start;
+    size_t stride = image ? vars->matches->image_alignment : vars->options.alignment;
+    bool skip_zeros = !image && !zeros_can_match(vars, uservalue);
+    size_t reported = 0;
+    unsigned long reported_matches = state->num_matches;
+    void *scan_end = start + size;
+    void *reg_pos = start;
+    void *released = start;
+
+    for (;;) {
+        size_t scanned = MIN(reg_pos, scan_end) - start;
+        size_t buffer_size, scan_size;
+
+        /* print a simple progress meter */
+        progress_meter_add(progress, scanned - reported, state->num_matches - reported_matches);
+        reported = scanned;
+        reported_matches = state->num_matches;
+
+        /* the whole region is finished */
+        if (memlength == 0) break;
+
+        /* past the range, nothing left to record */
+        if (reg_pos >= scan_end && !state->required_extra_bytes_to_record) break;
+
+        /* stop scanning if asked to */
+        if (vars->stop_flag) break;
+
+        /* load the next buffer block */
+        size_t read_size = MIN(memlength, MAX_ALLOC_SIZE);
+        size_t nread = image ? readmemory_image(image, state->data, reg_pos, read_size)
+                             : read_block(state, r, reg_pos, read_size);
+        if (nread < read_size) {
+            /* the region ends here, update `memlength` */
+            memlength = nread;
+            if ((nread == 0) && (reg_pos == area_start)) {
+                /* Failed on first read, which means region not exist. */
+                show_warn("reading region %02lu failed.\n", regnum);
+                break;
+            }
+        }
+        /* If less than `MAX_ALLOC_SIZE` bytes remain, we have all of them
+         * in the buffer, so go all the way.
+         * Otherwise we need to stop at `MAX_BUFFER_SIZE`, so that
+         * the last byte we look at has a full VLT after it */
+        buffer_size = memlength <= MAX_ALLOC_SIZE ? memlength : MAX_BUFFER_SIZE;
+#if HAVE_PTHREAD
+        /* the next block is read while this one is searched */
+        if (state->ahead && !image && memlength > buffer_size)
+            read_ahead_ask(state->ahead, r, reg_pos + buffer_size,
+                           MIN(memlength - buffer_size, MAX_ALLOC_SIZE));
+#endif
+
+        /* only the offsets in the range may match, and only the aligned ones */
+        scan_size = reg_pos < scan_end ? MIN(buffer_size, (size_t)(scan_end - reg_pos)) : 0;
+        if (skip_zeros)
+            search_buffer_nonzero(vars, uservalue, state, reg_pos, scan_size,
+                                  MIN(memlength, read_size), memlength, stride);
+        else
+            search_buffer(vars, uservalue, state, image, reg_pos, 0, scan_size, memlength, stride);
+        record_extra_bytes(state, state->data, reg_pos, scan_size, buffer_size);
+
+        memlength -= buffer_size;
+        reg_pos += buffer_size;
+
+        /* the old values are only needed from there on */
+        if (state->release_image)
+            released = release_image_bytes(image, released, MIN(reg_pos, scan_end));
+    }
+
+    /* the rest of the range can't be read, count it as done */
+    progress_meter_add(progress, size - reported, state->num_matches - reported_matches);
+}
+
+#if HAVE_PTHREAD
+/* Regions are split into units of this size (at most) for threaded scans.
+ * Units are small enough to balance the load, and big enough to make the
+ * per-unit costs (allocation, merge) negligible. */
+#define SEARCH_UNIT_SIZE (8 * MAX_BUFFER_SIZE)
+
+/* A part of the address space scanned by a single worker of a threaded scan */
+typedef struct {
+    const region_t *region;
+    const snapshot_image *image;    /* instead of `region`, see search_range() */
+    unsigned long regnum;
+    void *start;
+    size_t size;
+    scan_state state;         /* matches found in the unit */
+} search_unit;
+
+/* Work shared by the workers of a threaded scan */
+typedef struct {
+    globals_t *vars;
+    const uservalue_t *uservalue;
+    search_unit *units;
+    size_t num_units;
+    size_t next_unit;           /* protected by `progress.lock` */
+    flags_encoding encoding;    /* encoding of the matches found */
+    progress_meter progress;
+    bool failed;
+} search_work;
+
+static void *search_worker(void *arg)
+{
+    search_work *work = arg;
+    uint8_t *data;
+
+    if ((data = malloc(MAX_ALLOC_SIZE)) == NULL) {
+        work->failed = true;
+        return NULL;
+    }
+
+    for (;;) {
+        search_unit *unit;
+
+        pthread_mutex_lock(&work->progress.lock);
+        unit = work->next_unit < work->num_units ? &work->units[work->next_unit++] : NULL;
+        pthread_mutex_unlock(&work->progress.lock);
+        if (unit == NULL || work->vars->stop_flag)
+            break;
+
+        /* the unit may collect bytes up to the end of its region */
+        void *end = unit->image ? unit->image->start + unit->image->size :
+                                  unit->region->start + unit->region->size;
+        size_t max_bytes = sizeof(matches_and_old_values_array) +
+            swath_bytes_bound(end - unit->start, work->encoding) +
+            sizeof(matches_and_old_values_swath);
+        if (!scan_state_start(&unit->state, max_bytes, work->encoding,
+                              work->vars->options.matches_in_file)) {
+            work->failed = true;
+            break;
+        }
+        unit->state.data = data;
+
+        search_range(work->vars, work->uservalue, &unit->state, unit->region, unit->image,
+                     unit->regnum, unit->start, unit->size, &work->progress);
+    }
+
+    free(data);
+    return NULL;
+}
+
+/* Scans all regions using `num_threads` workers, then merges their matches
+ * in address order into `state`.
+ * With `images`, the check of a snapshot, their `num_images` are scanned instead. */
+static bool search_threaded(globals_t *vars, const uservalue_t *uservalue, scan_state *state,
+                            unsigned num_threads, unsigned long total_scan_bytes,
+                            const snapshot_image *images, size_t num_images)
+{
+    search_work work = { .vars = vars, .uservalue = uservalue,
+                         .encoding = state->matches->encoding };
+    unsigned long regnum = 0;
+    element_t *n;
+    size_t i, j;
+    bool ret = true;
+
+    /* split the regions into units */
+    for (n = vars->regions->head; n && !images; n = n->next)
+        work.num_units += 1 + (((region_t *)n->data)->size - 1) / SEARCH_UNIT_SIZE;
+    for (j = 0; j < num_images; j++)
+        work.num_units += (images[j].size + SEARCH_UNIT_SIZE - 1) / SEARCH_UNIT_SIZE;
+    if ((work.units = calloc(work.num_units, sizeof(search_unit))) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
+    for (i = 0, n = vars->regions->head; n && !images; n = n->next) {
+        region_t *r = n->data;
+        size_t offset;
+
+        ++regnum;
+        for (offset = 0; offset < r->size; offset += SEARCH_UNIT_SIZE, i++) {
+            work.units[i].region = r;
+            work.units[i].regnum = regnum;
+            work.units[i].start = r->start + offset;
+            work.units[i].size = MIN(r->size - offset, SEARCH_UNIT_SIZE);
+        }
+    }
+    for (j = 0; j < num_images; j++) {
+        size_t offset;
+
+        for (offset = 0; offset < images[j].size; offset += SEARCH_UNIT_SIZE, i++) {
+            work.units[i].image = &images[j];
+            work.units[i].regnum = j + 1;
+            work.units[i].start = images[j].start + offset;
+            work.units[i].size = MIN(images[j].size - offset, SEARCH_UNIT_SIZE);
+        }
+    }
+
+    pthread_mutex_init(&work.progress.lock, NULL);
+    work.progress.shared = true;
+    work.progress.dot_bytes = total_scan_bytes;
+    work.progress.total_scan_bytes = total_scan_bytes;
+    work.progress.scan_progress = &vars->scan_progress;
+
+    num_threads = MIN(num_threads, work.num_units);
+    if (!images) {
+        show_user("searching %lu regions with %u threads", vars->regions->size, num_threads);
+        fflush(stderr);
+    }
+
+    run_workers(search_worker, &work, num_threads);
+    pthread_mutex_destroy(&work.progress.lock);
+
+    if (work.failed) {
+        show_error("sorry, there was a memory allocation error.\n");
+        ret = false;
+    }
+
+    /* merge in address order, units are sorted like the regions */
+    for (i = 0; i < work.num_units; i++) {
+        if (work.units[i].state.matches == NULL)
+            continue;
+        if (ret && !merge_matches(state, &work.units[i].state)) {
+            show_error("memory allocation error while merging matches\n");
+            ret = false;
+        }
+        free_array(work.units[i].state.matches);
     }
-#endif
-    return nread;
-}
+    free(work.units);
 
-/*
- * sm_peekdata - fills the peekbuf cache with memory from the process
- * 
- * This routine calls either `ptrace(PEEKDATA, ...)` or `pread(...)`,
- * and fills the peekbuf cache, to make a local mirror of the process memory we're interested in.
- * `sm_attach()` MUST be called before this function.
- */
+    if (vars->stop_flag)
+        printf("\n");
+    else if (ret && !images)
+        show_user("ok\n");
+    return ret;
+}
+#endif
 
-extern inline bool sm_peekdata(const void *addr, uint16_t length, const mem64_t **result_ptr, size_t *memlength)
+/* Reads the memory of `image` again, from its start and for its size, or
+ * less if the memory can't be read further or if the scan is stopped.
+ * The first read of an image gives the region `r` it is taken from.
+ * Returns the number of bytes read. */
+static size_t read_image(globals_t *vars, snapshot_image *image, const region_t *r,
+                         progress_meter *progress)
 {
-    const char *reqaddr = addr;
-    unsigned int i;
-    unsigned int missing_bytes;
+    size_t nread = 0;
 
-    assert(peekbuf.size <= MAX_PEEKBUF_SIZE);
-    assert(result_ptr != NULL);
-    assert(memlength != NULL);
+    while (nread < image->size && !vars->stop_flag) {
+        size_t read_size = MIN(image->size - nread, MAX_ALLOC_SIZE);
+        size_t got = r ? readmemory_region(r, image->data + nread, image->start + nread, read_size)
+                       : readmemory_image(image, image->data + nread, image->start + nread,
+                                          read_size);
 
-    /* check if we have a full cache hit */
-    if (peekbuf.base != NULL &&
-        reqaddr >= peekbuf.base &&
-        (unsigned long) (reqaddr + length - peekbuf.base) <= peekbuf.size)
-    {
-        *result_ptr = (mem64_t*)&peekbuf.cache[reqaddr - peekbuf.base];
-        *memlength = peekbuf.base - reqaddr + peekbuf.size;
-        return true;
+        nread += got;
+        progress_meter_add(progress, got, 0);
+        if (got < read_size)
+            break;
     }
-    else if (peekbuf.base != NULL &&
-             reqaddr >= peekbuf.base &&
-             (unsigned long) (reqaddr - peekbuf.base) < peekbuf.size)
-    {
-        assert(peekbuf.size != 0);
-
-        /* partial hit, we have some of the data but not all, so remove old entries - shift the frame by as far as is necessary */
-        missing_bytes = (reqaddr + length) - (peekbuf.base + peekbuf.size);
-        /* round up to the nearest PEEKDATA_CHUNK multiple, that is what could
-         * potentially be read and we have to fit it all */
-        missing_bytes = PEEKDATA_CHUNK * (1 + (missing_bytes-1) / PEEKDATA_CHUNK);
 
-        /* head shift if necessary */
-        if (peekbuf.size + missing_bytes > MAX_PEEKBUF_SIZE)
-        {
-            unsigned int shift_size = reqaddr - peekbuf.base;
-            shift_size = PEEKDATA_CHUNK * (shift_size / PEEKDATA_CHUNK);
+    /* the rest can't be read, count it as done */
+    progress_meter_add(progress, image->size - nread, 0);
+    return nread;
+}
 
-            memmove(peekbuf.cache, &peekbuf.cache[shift_size], peekbuf.size-shift_size);
+/* Checks the matches of the snapshot in `vars->matches` from its images,
+ * which are searched like the regions they were read from, with their bytes
+ * as the old values. An update reads them again. */
+static bool check_snapshot(globals_t *vars, scan_match_type_t match_type,
+                           const uservalue_t *uservalue)
+{
+    matches_and_old_values_array *snapshot = vars->matches;
+    scan_state state = { .matches = NULL };
+    progress_meter progress = { .scan_progress = &vars->scan_progress };
+    unsigned long total_scan_bytes = 0;
+    size_t i;
+    bool ret = true;
+#if HAVE_PTHREAD
+    unsigned threads;
+#endif
 
-            peekbuf.size -= shift_size;
-            peekbuf.base += shift_size;
+    for (i = 0; i < snapshot->num_images; i++)
+        total_scan_bytes += snapshot->images[i].size;
+    progress.dot_bytes = total_scan_bytes;
+    progress.total_scan_bytes = total_scan_bytes;
+
+    if (match_type == MATCHUPDATE) {
+        /* the memory that can't be read anymore is not matched */
+        vars->num_matches = 0;
+        for (i = 0; i < snapshot->num_images && !vars->stop_flag; ) {
+            snapshot_image *image = &snapshot->images[i];
+            size_t size = read_image(vars, image, NULL, &progress);
+
+            trim_image(snapshot, image, size);
+            if (size > 0)
+                vars->num_matches += image_matches(snapshot, &snapshot->images[i++]);
         }
+        /* or not checked */
+        while (snapshot->num_images > i)
+            trim_image(snapshot, &snapshot->images[snapshot->num_images - 1], 0);
+        if (vars->stop_flag)
+            printf("\n");
+        return true;
     }
-    else {
-        /* cache miss, invalidate the cache */
-        missing_bytes = length;
-        peekbuf.size = 0;
-        peekbuf.base = reqaddr;
+
+    if (!scan_state_start(&state, snapshot->max_needed_bytes, snapshot->encoding,
+                          vars->options.matches_in_file)) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
     }
 
-    /* we need to retrieve memory to complete the request */
-    for (i = 0; i < missing_bytes; i += PEEKDATA_CHUNK)
-    {
-        const char *target_address = peekbuf.base + peekbuf.size;
-        size_t len = readmemory(&peekbuf.cache[peekbuf.size], target_address, PEEKDATA_CHUNK);
-
-        /* check if the read succeeded */
-        if (UNLIKELY(len < PEEKDATA_CHUNK)) {
-            if (len == 0) {
-                /* hard failure to retrieve memory */
-                *result_ptr = NULL;
-                *memlength = 0;
-                return false;
+#if HAVE_PTHREAD
+    threads = total_scan_bytes > 0 ? scan_threads(vars, snapshot->images[0].start) : 1;
+    if (threads > 1) {
+        ret = search_threaded(vars, uservalue, &state, threads, total_scan_bytes,
+                              snapshot->images, snapshot->num_images);
+    } else
+#endif
+    if ((state.data = malloc(MAX_ALLOC_SIZE)) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        ret = false;
+    } else {
+        /* the snapshot is dropped after the check */
+        state.release_image = true;
+        for (i = 0; i < snapshot->num_images; i++) {
+            snapshot_image *image = &snapshot->images[i];
+
+            search_range(vars, uservalue, &state, NULL, image, i + 1, image->start, image->size,
+                         &progress);
+
+            /* stop scanning if asked to */
+            if (vars->stop_flag) {
+                printf("\n");
+                break;
             }
-            /* go ahead with the partial read and stop the gathering process */
-            peekbuf.size += len;
-            break;
         }
-        
-        /* otherwise, the read worked */
-        peekbuf.size += PEEKDATA_CHUNK;
+        free(state.data);
     }
 
-    /* return result to caller */
-    *result_ptr = (mem64_t*)&peekbuf.cache[reqaddr - peekbuf.base];
-    *memlength = peekbuf.base - reqaddr + peekbuf.size;
+    if (!ret || !(state.matches = null_terminate(state.matches, state.writing_swath))) {
+        /* keep the snapshot */
+        free_array(state.matches);
+        return false;
+    }
+    free_array(snapshot);
+    vars->matches = state.matches;
+    vars->num_matches = state.num_matches;
     return true;
 }
 
-static inline void print_a_dot(void)
+/* Adds an image of each of the `regions` to the snapshot `snapshot`, and
+ * counts their matches into `num_matches`. Returns false if there is not
+ * enough memory for an image. */
+static bool read_images(globals_t *vars, matches_and_old_values_array *snapshot,
+                        const list_t *regions, unsigned long total_scan_bytes,
+                        unsigned long *num_matches)
 {
-    fprintf(stderr, ".");
-    fflush(stderr);
-}
+    unsigned long regnum = 0;
+    element_t *n;
 
-static inline uint16_t flags_to_memlength(scan_data_type_t scan_data_type, match_flags flags)
-{
-    switch(scan_data_type)
-    {
-        case BYTEARRAY:
-        case STRING:
-            return flags;
-            break;
-        default: /* numbers */
-                 if (flags & flags_64b) return 8;
-            else if (flags & flags_32b) return 4;
-            else if (flags & flags_16b) return 2;
-            else if (flags & flags_8b ) return 1;
-            else    /* it can't be a variable of any size */ return 0;
+    for (n = regions->head; n; n = n->next) {
+        region_t *r = n->data;
+        progress_meter progress = { .scan_progress = &vars->scan_progress,
+                                     .total_scan_bytes = total_scan_bytes,
+                                     .dot_bytes = r->size };
+        snapshot_image *image;
+        size_t size;
+
+        /* print a progress meter so user knows we haven't crashed */
+        show_user("%02lu/%02lu searching %#10lx - %#10lx", ++regnum,
+                regions->size, (unsigned long)r->start, (unsigned long)r->start + r->size);
+        fflush(stderr);
+
+        if (!add_image(snapshot, r->start, r->size))
+            return false;
+        image = &snapshot->images[snapshot->num_images - 1];
+
+        if ((size = read_image(vars, image, r, &progress)) == 0 && !vars->stop_flag)
+            show_warn("reading region %02lu failed.\n", regnum);
+        trim_image(snapshot, image, size);
+        if (size > 0)
+            *num_matches += image_matches(snapshot, image);
+
+        /* stop scanning if asked to */
+        if (vars->stop_flag) {
+            printf("\n");
             break;
+        }
+        show_user("ok\n");
     }
+    return true;
 }
 
-/* This is the function that handles when you enter a value (or >, <, =) for the second or later time (i.e. when there's already a list of matches);
- * it reduces the list to those that still match. It returns false on failure to attach, detach, or reallocate memory, otherwise true. */
-bool sm_checkmatches(globals_t *vars,
-                     scan_match_type_t match_type,
-                     const uservalue_t *uservalue)
+static bool snapshot_regions(globals_t *vars)
 {
-    matches_and_old_values_swath *reading_swath_index = vars->matches->swaths;
-    matches_and_old_values_swath reading_swath = *reading_swath_index;
-
-    unsigned long bytes_scanned = 0;
+    scan_data_type_t data_type = vars->options.scan_data_type;
+    match_flags possible_flags = sm_get_possible_flags(data_type);
+    flags_encoding encoding = flags_encoding_for(possible_flags);
+    unsigned long total_size = sizeof(matches_and_old_values_array) +
+                               sizeof(matches_and_old_values_swath);
     unsigned long total_scan_bytes = 0;
-    matches_and_old_values_swath *tmp_swath_index = reading_swath_index;
-    unsigned int samples_remaining = NUM_SAMPLES;
-    unsigned int samples_to_dot = SAMPLES_PER_DOT;
-    size_t bytes_at_next_sample;
-    size_t bytes_per_sample;
+    element_t *n;
 
-    if (sm_choose_scanroutine(vars->options.scan_data_type, match_type, uservalue, vars->options.reverse_endianness) == false)
-    {
-        show_error("unsupported scan for current data type.\n");
+    /* stop and attach to the target */
+    if (sm_attach(vars->target) == false)
         return false;
+
+    /* make sure we have some regions to save */
+    if (vars->regions->size == 0) {
+        show_warn("no regions defined, perhaps you deleted them all?\n");
+        show_info("use the \"reset\" command to refresh regions.\n");
+        return sm_detach(vars->target);
     }
+    track_writes(vars);
 
-    assert(sm_scan_routine);
+    /* the images are small, but their swaths could be needed */
+    for (n = vars->regions->head; n; n = n->next) {
+        total_size += swath_bytes_bound(((region_t *)n->data)->size, encoding);
+        total_scan_bytes += ((region_t *)n->data)->size;
+    }
 
-    while(tmp_swath_index->number_of_bytes)
+    if (!(vars->matches = allocate_array(vars->matches, 0, encoding,
+                                         vars->options.matches_in_file)))
     {
-        total_scan_bytes += tmp_swath_index->number_of_bytes;
-        tmp_swath_index = (matches_and_old_values_swath *)(&tmp_swath_index->data[tmp_swath_index->number_of_bytes]);
+        show_error("could not allocate match array\n");
+        sm_detach(vars->target);
+        return false;
     }
-    bytes_per_sample = total_scan_bytes / NUM_SAMPLES;
-    bytes_at_next_sample = bytes_per_sample;
-    /* for user, just print the first dot */
-    print_a_dot();
-
-    size_t reading_iterator = 0;
-    matches_and_old_values_swath *writing_swath_index = vars->matches->swaths;
-    writing_swath_index->first_byte_in_child = NULL;
-    writing_swath_index->number_of_bytes = 0;
-
-    int required_extra_bytes_to_record = 0;
+    vars->matches->max_needed_bytes = total_size;
+    vars->matches->image_flags = possible_flags;
+    vars->matches->image_alignment = vars->options.alignment;
     vars->num_matches = 0;
+
     vars->scan_progress = 0.0;
     vars->stop_flag = false;
 
-    /* stop and attach to the target */
-    if (sm_attach(vars->target) == false)
-        return false;
-
     INTERRUPTABLESCAN();
 
-    while (reading_swath.first_byte_in_child) {
-        unsigned int match_length = 0;
-        const mem64_t *memory_ptr;
-        size_t memlength;
-        match_flags checkflags;
-
-        match_flags old_flags = reading_swath_index->data[reading_iterator].match_info;
-        uint old_length = flags_to_memlength(vars->options.scan_data_type, old_flags);
-        void *address = reading_swath.first_byte_in_child + reading_iterator;
+    if (!read_images(vars, vars->matches, vars->regions, total_scan_bytes, &vars->num_matches)) {
+        show_error("sorry, there was a memory allocation error.\n");
+        ENDINTERRUPTABLE();
+        free_array(vars->matches);
+        vars->matches = NULL;
+        vars->num_matches = 0;
+        sm_detach(vars->target);
+        return false;
+    }
 
-        /* read value from this address */
-        if (UNLIKELY(sm_peekdata(address, old_length, &memory_ptr, &memlength) == false))
-        {
-            /* If we can't look at the data here, just abort the whole recording, something bad happened */
-            required_extra_bytes_to_record = 0;
-        }
-        else if (old_flags != flags_empty) /* Test only valid old matches */
-        {
-            value_t old_val = data_to_val_aux(reading_swath_index, reading_iterator, reading_swath.number_of_bytes);
-            memlength = old_length < memlength ? old_length : memlength;
+    ENDINTERRUPTABLE();
 
-            checkflags = flags_empty;
+    /* tell front-end we've finished */
+    vars->scan_progress = MAX_PROGRESS;
 
-            match_length = (*sm_scan_routine)(memory_ptr, memlength, &old_val, uservalue, &checkflags);
-        }
+    show_info("we currently have %ld matches.\n", vars->num_matches);
+    report_written_pages(vars);
 
-        if (match_length > 0)
-        {
-            assert(match_length <= memlength);
+    /* okay, detach */
+    return sm_detach(vars->target);
+}
 
-            /* Still a candidate. Write data.
-               - We can get away with overwriting in the same array because it is guaranteed to take up the same number of bytes or fewer,
-                 and because we copied out the reading swath metadata already.
-               - We can get away with assuming that the pointers will stay valid,
-                 because as we never add more data to the array than there was before, it will not reallocate. */
+bool sm_snapshot(globals_t *vars)
+{
+    scan_data_type_t data_type = vars->options.scan_data_type;
+    phase_timer timer;
+    bool ret;
+
+    /* the matches of strings and bytearrays have lengths, they need swaths */
+    if (data_type == BYTEARRAY || data_type == STRING)
+        return sm_searchregions(vars, MATCHANY, NULL);
+
+    phase_begin(&timer, 0);
+    ret = snapshot_regions(vars);
+    phase_end(&timer, SM_PHASE_SNAPSHOT, vars->num_matches);
+    return ret;
+}
 
-            writing_swath_index = add_element(&(vars->matches), writing_swath_index, address,
-                                              get_u8b(memory_ptr), checkflags);
+bool sm_add_regions(globals_t *vars, const list_t *regions)
+{
+    scan_data_type_t data_type = vars->options.scan_data_type;
+    match_flags possible_flags = sm_get_possible_flags(data_type);
+    flags_encoding encoding = flags_encoding_for(possible_flags);
+    matches_and_old_values_array *added;
+    unsigned long total_scan_bytes = 0;
+    unsigned long num_matches = 0;
+    element_t *n;
+    bool ret;
 
-            ++vars->num_matches;
+    /* without matches, the next scan searches all the regions */
+    if (vars->matches == NULL || regions->size == 0)
+        return true;
 
-            required_extra_bytes_to_record = match_length - 1;
-        }
-        else if (required_extra_bytes_to_record)
-        {
-            writing_swath_index = add_element(&(vars->matches), writing_swath_index, address,
-                                              get_u8b(memory_ptr), flags_empty);
-            --required_extra_bytes_to_record;
-        }
-
-        if (UNLIKELY(bytes_scanned >= bytes_at_next_sample)) {
-            bytes_at_next_sample += bytes_per_sample;
-            /* handle rounding */
-            if (LIKELY(--samples_remaining > 0)) {
-                /* for front-end, update percentage */
-                vars->scan_progress += PROGRESS_PER_SAMPLE;
-                if (UNLIKELY(--samples_to_dot == 0)) {
-                    samples_to_dot = SAMPLES_PER_DOT;
-                    /* for user, just print a dot */
-                    print_a_dot();
-                }
-                /* stop scanning if asked to */
-                if (vars->stop_flag) {
-                    printf("\n");
-                    break;
-                }
-            }
-        }
-        ++bytes_scanned;
-        
-        /* go on to the next one... */
-        ++reading_iterator;
-        if (reading_iterator >= reading_swath.number_of_bytes)
-        {
-            reading_swath_index = (matches_and_old_values_swath *)
-                (&reading_swath_index->data[reading_swath.number_of_bytes]);
-            reading_swath = *reading_swath_index;
-            reading_iterator = 0;
-            required_extra_bytes_to_record = 0; /* just in case */
-        }
+    /* the matches of strings and bytearrays have lengths, that the new
+     * memory couldn't have been checked for */
+    if (data_type == BYTEARRAY || data_type == STRING) {
+        show_warn("the new regions can't join the matches of a %s scan.\n",
+                  data_type == STRING ? "string" : "bytearray");
+        return true;
+    }
+    if (encoding.shift != vars->matches->encoding.shift ||
+        encoding.bits != vars->matches->encoding.bits) {
+        show_warn("scan_data_type was changed, the new regions can't join the matches.\n");
+        return true;
     }
 
-    ENDINTERRUPTABLE();
+    /* stop and attach to the target */
+    if (sm_attach(vars->target) == false)
+        return false;
 
-    if (!(vars->matches = null_terminate(vars->matches, writing_swath_index)))
-    {
-        show_error("memory allocation error while reducing matches-array size\n");
+    if (!(added = allocate_array(NULL, 0, encoding, vars->options.matches_in_file))) {
+        show_error("could not allocate match array\n");
+        sm_detach(vars->target);
         return false;
     }
+    added->max_needed_bytes = sizeof(matches_and_old_values_array) +
+                              sizeof(matches_and_old_values_swath);
+    for (n = regions->head; n; n = n->next) {
+        added->max_needed_bytes += swath_bytes_bound(((region_t *)n->data)->size, encoding);
+        total_scan_bytes += ((region_t *)n->data)->size;
+    }
+    added->image_flags = possible_flags;
+    added->image_alignment = vars->options.alignment;
 
-    show_user("ok\n");
+    vars->scan_progress = 0.0;
+    vars->stop_flag = false;
+
+    INTERRUPTABLESCAN();
+    ret = read_images(vars, added, regions, total_scan_bytes, &num_matches);
+    ENDINTERRUPTABLE();
 
-    /* tell front-end we've done */
     vars->scan_progress = MAX_PROGRESS;
 
-    show_info("we currently have %ld matches.\n", vars->num_matches);
+    if (!ret) {
+        show_error("sorry, there was a memory allocation error.\n");
+        free_array(added);
+        sm_detach(vars->target);
+        return false;
+    }
+    if (!(vars->matches = merge_arrays(vars->matches, added))) {
+        show_error("memory allocation error while adding the new regions.\n");
+        vars->num_matches = 0;
+        sm_detach(vars->target);
+        return false;
+    }
+    vars->num_matches += num_matches;
 
-    /* okay, detach */
     return sm_detach(vars->target);
 }
 
-
-/* sm_searchregions() performs an initial search of the process for values matching `uservalue` */
-bool sm_searchregions(globals_t *vars, scan_match_type_t match_type, const uservalue_t *uservalue)
+/* search_regions() performs an initial search of the process for values matching `uservalue` */
+static bool search_regions(globals_t *vars, scan_match_type_t match_type, const uservalue_t *uservalue)
 {
-    matches_and_old_values_swath *writing_swath_index;
-    int required_extra_bytes_to_record = 0;
+    scan_state state = { .matches = NULL };
     unsigned long total_size = 0;
     unsigned long regnum = 0;
     element_t *n = vars->regions->head;
     region_t *r;
     unsigned long total_scan_bytes = 0;
-    unsigned char *data = NULL;
+    flags_encoding encoding = flags_encoding_for(sm_get_possible_flags(vars->options.scan_data_type));
+#if HAVE_PTHREAD
+    unsigned threads;
+    read_ahead ahead;
+#endif
 
     if (sm_choose_scanroutine(vars->options.scan_data_type, match_type, uservalue, vars->options.reverse_endianness) == false)
     {
@@ -518,13 +2784,14 @@ bool sm_searchregions(globals_t *vars, scan_match_type_t match_type, const userv
         show_info("use the \"reset\" command to refresh regions.\n");
         return sm_detach(vars->target);
     }
+    track_writes(vars);
 
     INTERRUPTABLESCAN();
     
     total_size = sizeof(matches_and_old_values_array);
 
     while (n) {
-        total_size += ((region_t *)(n->data))->size * sizeof(old_value_and_match_info) + sizeof(matches_and_old_values_swath);
+        total_size += swath_bytes_bound(((region_t *)(n->data))->size, encoding);
         n = n->next;
     }
     
@@ -532,16 +2799,19 @@ bool sm_searchregions(globals_t *vars, scan_match_type_t match_type, const userv
     
     show_debug("allocate array, max size %ld\n", total_size);
 
-    if (!(vars->matches = allocate_array(vars->matches, total_size)))
+    if (!(vars->matches = allocate_array(vars->matches, total_size, encoding,
+                                         vars->options.matches_in_file)))
     {
         show_error("could not allocate match array\n");
         return false;
     }
     
-    writing_swath_index = vars->matches->swaths;
+    state.matches = vars->matches;
+    state.writing_swath = vars->matches->swaths;
     
-    writing_swath_index->first_byte_in_child = NULL;
-    writing_swath_index->number_of_bytes = 0;
+    state.writing_swath->first_byte_in_child = NULL;
+    state.writing_swath->number_of_bytes = 0;
+    state.num_matches = vars->num_matches;
     
     /* get total number of bytes */
     for(n = vars->regions->head; n; n = n->next)
@@ -551,110 +2821,53 @@ bool sm_searchregions(globals_t *vars, scan_match_type_t match_type, const userv
     vars->stop_flag = false;
     n = vars->regions->head;
 
+#if HAVE_PTHREAD
+    threads = scan_threads(vars, ((region_t *)n->data)->start);
+    if (threads > 1) {
+        bool ret = search_threaded(vars, uservalue, &state, threads, total_scan_bytes, NULL, 0);
+
+        vars->matches = state.matches;
+        vars->num_matches = state.num_matches;
+        if (!ret) {
+            ENDINTERRUPTABLE();
+            if (vars->matches)
+                vars->matches = null_terminate(vars->matches, state.writing_swath);
+            sm_detach(vars->target);
+            return false;
+        }
+        n = NULL;
+    }
+#endif
+    if (n) {
+        /* allocate data array */
+        if ((state.data = malloc(MAX_ALLOC_SIZE * sizeof(char))) == NULL) {
+            show_error("sorry, there was a memory allocation error.\n");
+            return false;
+        }
+#if HAVE_PTHREAD
+        /* a second thread reads while this one searches, if it can read,
+         * and if it has a CPU to do it */
+        if (vars->options.read_ahead && sysconf(_SC_NPROCESSORS_ONLN) > 1 &&
+            readmemory_threadsafe(((region_t *)n->data)->start) && read_ahead_start(&ahead))
+            state.ahead = &ahead;
+#endif
+    }
+
     /* check every memory region */
     while (n) {
-        size_t bytes_remaining;
-        size_t bytes_per_dot;
-        double progress_per_dot;
+        progress_meter progress = { .scan_progress = &vars->scan_progress,
+                                     .total_scan_bytes = total_scan_bytes };
 
         /* load the next region */
         r = n->data;
-        bytes_per_dot = r->size / NUM_DOTS;
-        bytes_remaining = bytes_per_dot * NUM_DOTS;
-        progress_per_dot = (double)bytes_per_dot / total_scan_bytes;
-
-/* The maximum logical size is a comfortable 1MiB (increasing it does not help).
- * The actual allocation is that plus the rounded size of the maximum possible VLT.
- * This is needed because the last byte might be scanned as max size VLT,
- * thus need (2^16 - 2) extra bytes after it */
-#define MAX_BUFFER_SIZE (1<<20)
-#define MAX_ALLOC_SIZE  (MAX_BUFFER_SIZE + (1<<16))
-
-        /* allocate data array */
-        size_t alloc_size = MIN(r->size, MAX_ALLOC_SIZE);
-        if ((data = malloc(alloc_size * sizeof(char))) == NULL) {
-            show_error("sorry, there was a memory allocation error.\n");
-            return false;
-        }
+        progress.dot_bytes = r->size;
 
         /* print a progress meter so user knows we haven't crashed */
         show_user("%02lu/%02lu searching %#10lx - %#10lx", ++regnum,
                 vars->regions->size, (unsigned long)r->start, (unsigned long)r->start + r->size);
         fflush(stderr);
 
-        /* For every offset, check if we have a match. */
-        size_t memlength = r->size;
-        size_t buffer_size = 0;
-        void *reg_pos = r->start;
-        const uint8_t *buf_pos = NULL;
-        for ( ; ; memlength--, buffer_size--, reg_pos++, buf_pos++) {
-
-            /* check if the buffer is finished (or we just started) */
-            if (UNLIKELY(buffer_size == 0)) {
-
-                /* print a simple progress meter */
-                for ( ; memlength < bytes_remaining; bytes_remaining -= bytes_per_dot) {
-                    /* for user, just print a dot */
-                    print_a_dot();
-                    /* for front-end, update percentage */
-                    vars->scan_progress += progress_per_dot;
-                }
-
-                /* the whole region is finished */
-                if (memlength == 0) break;
-
-                /* stop scanning if asked to */
-                if (vars->stop_flag) break;
-
-                /* load the next buffer block */
-                size_t read_size = MIN(memlength, MAX_ALLOC_SIZE);
-                size_t nread = readmemory(data, reg_pos, read_size);
-                if (nread < read_size) {
-                    /* the region ends here, update `memlength` */
-                    memlength = nread;
-                    if ((nread == 0) && (reg_pos == r->start)) {
-                        /* Failed on first read, which means region not exist. */
-                        show_warn("reading region %02u failed.\n", regnum);
-                        break;
-                    }
-                }
-                /* If less than `MAX_ALLOC_SIZE` bytes remain, we have all of them
-                 * in the buffer, so go all the way.
-                 * Otherwise we need to stop at `MAX_BUFFER_SIZE`, so that
-                 * the last byte we look at has a full VLT after it */
-                buffer_size = memlength <= MAX_ALLOC_SIZE ? memlength : MAX_BUFFER_SIZE;
-                buf_pos = data;
-            }
-
-            const mem64_t* memory_ptr = (mem64_t*)buf_pos;
-            unsigned int match_length;
-            match_flags checkflags;
-
-            /* initialize checkflags */
-            checkflags = flags_empty;
-
-            /* check if we have a match */
-            match_length = (*sm_scan_routine)(memory_ptr, memlength, NULL, uservalue, &checkflags);
-            if (UNLIKELY(match_length > 0))
-            {
-                assert(match_length <= memlength);
-                writing_swath_index = add_element(&(vars->matches), writing_swath_index, reg_pos,
-                                                  get_u8b(memory_ptr), checkflags);
-                
-                ++vars->num_matches;
-                
-                required_extra_bytes_to_record = match_length - 1;
-            }
-            else if (required_extra_bytes_to_record)
-            {
-                writing_swath_index = add_element(&(vars->matches), writing_swath_index, reg_pos,
-                                                  get_u8b(memory_ptr), flags_empty);
-                --required_extra_bytes_to_record;
-            }
-
-        }
-
-        free(data);
+        search_range(vars, uservalue, &state, r, NULL, regnum, r->start, r->size, &progress);
 
         /* stop scanning if asked to */
         if (vars->stop_flag) {
@@ -665,39 +2878,107 @@ bool sm_searchregions(globals_t *vars, scan_match_type_t match_type, const userv
         show_user("ok\n");
     }
 
+#if HAVE_PTHREAD
+    if (state.ahead)
+        read_ahead_stop(state.ahead);
+#endif
+    free(state.data);
+    vars->matches = state.matches;
+    vars->num_matches = state.num_matches;
+
     ENDINTERRUPTABLE();
 
     /* tell front-end we've finished */
     vars->scan_progress = MAX_PROGRESS;
     
-    if (!(vars->matches = null_terminate(vars->matches, writing_swath_index)))
+    if (!(vars->matches = null_terminate(vars->matches, state.writing_swath)))
     {
         show_error("memory allocation error while reducing matches-array size\n");
         return false;
     }
 
     show_info("we currently have %ld matches.\n", vars->num_matches);
+    report_written_pages(vars);
 
     /* okay, detach */
     return sm_detach(vars->target);
 }
 
-/* Needs to support only ANYNUMBER types */
-bool sm_setaddr(pid_t target, void *addr, const value_t *to)
+/* The parts of the regions in the scan scope, as regions, or NULL if there
+ * is not enough memory for them */
+static list_t *regions_in_scope(globals_t *vars)
+{
+    const address_range *ranges = vars->scan_scope;
+    size_t count = vars->scan_scope_count;
+    list_t *pieces = l_init();
+    element_t *n;
+    size_t i = 0;
+
+    for (n = vars->regions->head; n && pieces; n = n->next) {
+        region_t *r = n->data;
+        void *end = r->start + r->size;
+
+        while (i > 0 && ranges[i - 1].end > r->start)
+            i--;
+        for (; i < count && ranges[i].start < end; i++) {
+            size_t size = sizeof(region_t) + strlen(r->filename);
+            region_t *piece;
+
+            if (ranges[i].end <= r->start)
+                continue;
+            if ((piece = malloc(size)) == NULL || l_append(pieces, pieces->tail, piece) == -1) {
+                free(piece);
+                l_destroy(pieces);
+                return NULL;
+            }
+            memcpy(piece, r, size);
+            piece->start = MAX(r->start, ranges[i].start);
+            piece->size = (unsigned long)((char *)MIN(end, ranges[i].end) - (char *)piece->start);
+        }
+    }
+    return pieces;
+}
+
+bool sm_searchregions(globals_t *vars, scan_match_type_t match_type, const uservalue_t *uservalue)
+{
+    list_t *regions = vars->regions, *scoped = NULL;
+    phase_timer timer;
+    bool ret;
+
+    /* the search reads the regions of `vars` */
+    if (vars->scan_scope) {
+        if ((scoped = regions_in_scope(vars)) == NULL) {
+            show_error("sorry, there was a memory allocation error.\n");
+            return false;
+        }
+        vars->regions = scoped;
+    }
+
+    phase_begin(&timer, 0);
+    ret = search_regions(vars, match_type, uservalue);
+    phase_end(&timer, SM_PHASE_SEARCH, vars->num_matches);
+
+    vars->regions = regions;
+    l_destroy(scoped);
+    return ret;
+}
+
+/* Writes `to` at `addr` of the attached target, see sm_setaddr() */
+static bool setaddr(pid_t target, void *addr, const value_t *to)
 {
+#if !HAVE_PT_IO
     unsigned int i;
+#endif
     uint8_t memarray[sizeof(uint64_t)] = {0};
+    const mem64_t *mem;
     size_t memlength;
 
-    if (sm_attach(target) == false) {
-        return false;
-    }
-
-    memlength = readmemory(memarray, addr, sizeof(uint64_t));
-    if (memlength == 0) {
+    /* the neighbours of the value are written back as they are */
+    if (!sm_peekdata(addr, sizeof(uint64_t), &mem, &memlength)) {
         show_error("couldn't access the target address %10p\n", addr);
         return false;
     }
+    memcpy(memarray, mem, MIN(memlength, sizeof(uint64_t)));
 
     uint val_length = flags_to_memlength(ANYNUMBER, to->flags);
     if (val_length > 0) {
@@ -722,6 +3003,10 @@ bool sm_setaddr(pid_t target, void *addr, const value_t *to)
     }
     else
     {
+#if HAVE_PT_IO
+        if (transfer_io(target, PIOD_WRITE_D, memarray, addr, sizeof(uint64_t), NULL) < sizeof(uint64_t))
+            return false;
+#else
         /* Assume `sizeof(uint64_t)` is a multiple of `sizeof(long)` */
         for (i = 0; i < sizeof(uint64_t); i += sizeof(long))
         {
@@ -729,9 +3014,24 @@ bool sm_setaddr(pid_t target, void *addr, const value_t *to)
                 return false;
             }
         }
+#endif
     }
 
-    return sm_detach(target);
+    update_peek_cache(addr, memarray, sizeof(uint64_t));
+    return true;
+}
+
+/* Needs to support only ANYNUMBER types */
+bool sm_setaddr(pid_t target, void *addr, const value_t *to)
+{
+    bool ret;
+
+    if (sm_attach(target) == false) {
+        return false;
+    }
+
+    ret = setaddr(target, addr, to);
+    return sm_detach(target) && ret;
 }
 
 bool sm_read_array(pid_t target, const void *addr, void *buf, size_t len)
@@ -750,15 +3050,13 @@ bool sm_read_array(pid_t target, const void *addr, void *buf, size_t len)
     return sm_detach(target);
 }
 
-/* TODO: may use /proc/<pid>/mem here */
-bool sm_write_array(pid_t target, void *addr, const void *data, size_t len)
+/* Writes `len` bytes of `data` at `addr` of the attached target, see sm_write_array() */
+static bool write_array(pid_t target, void *addr, const void *data, size_t len)
 {
+#if !HAVE_PT_IO
     int i,j;
     long peek_value;
-
-    if (sm_attach(target) == false) {
-        return false;
-    }
+#endif
 
     if (sm_globals.options.no_ptrace)
     {
@@ -771,6 +3069,12 @@ bool sm_write_array(pid_t target, void *addr, const void *data, size_t len)
         return false;
 #endif
     }
+#if HAVE_PT_IO
+    else if (transfer_io(target, PIOD_WRITE_D, (void *)data, addr, len, NULL) < len)
+    {
+        return false;
+    }
+#else
     else
     {
         for (i = 0; i + sizeof(long) < len; i += sizeof(long))
@@ -821,6 +3125,22 @@ bool sm_write_array(pid_t target, void *addr, const void *data, size_t len)
             }
         }
     }
+#endif
 
-    return sm_detach(target);
+    update_peek_cache(addr, data, len);
+    return true;
+}
+
+/* Writes `len` bytes of `data` at `addr` of `target`, within a session if
+ * one was begun, see write_array() */
+bool sm_write_array(pid_t target, void *addr, const void *data, size_t len)
+{
+    bool ret;
+
+    if (sm_attach(target) == false) {
+        return false;
+    }
+
+    ret = write_array(target, addr, data, len);
+    return sm_detach(target) && ret;
 }
@@ -34,11 +34,16 @@
 #include <stdlib.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "scanmem.h"
+#include "async.h"
 #include "commands.h"
+#include "freeze.h"
 #include "handlers.h"
+#include "pointers.h"
 #include "show_message.h"
+#include "watch.h"
 
 
 void sm_printversion(FILE *outfd)
@@ -55,12 +60,14 @@ globals_t sm_globals = {
     0,                          /* scan progress */
     false,                      /* stop flag */
     NULL,                       /* regions */
+    NULL,                       /* regions_index */
+    NULL,                       /* scan_scope */
+    0,                          /* scan_scope_count */
     NULL,                       /* commands */
     NULL,                       /* current_cmdline */
     sm_printversion,            /* printversion() pointer */
     /* options */
     {
-        1,                      /* alignment */
         0,                      /* debug */
         0,                      /* backend */
         ANYINTEGER,             /* scan_data_type */
@@ -68,6 +75,11 @@ globals_t sm_globals = {
         1,                      /* dump_with_ascii */
         0,                      /* reverse_endianness */
         0,                      /* no_ptrace */
+        1,                      /* scan_threads */
+        1,                      /* alignment */
+        0,                      /* matches_in_file */
+        0,                      /* soft_dirty */
+        1,                      /* read_ahead */
     }
 };
 
@@ -130,6 +142,8 @@ bool sm_init(void)
     /* NULL shortdoc means don't display this command in `help` listing */
     sm_registercommand("set", handler__set, vars->commands, SET_SHRTDOC,
                        SET_LONGDOC, NULL);
+    sm_registercommand("freeze", handler__freeze, vars->commands, FREEZE_SHRTDOC,
+                       FREEZE_LONGDOC, NULL);
     sm_registercommand("list", handler__list, vars->commands, LIST_SHRTDOC,
                        LIST_LONGDOC, NULL);
     sm_registercommand("delete", handler__delete, vars->commands, DELETE_SHRTDOC,
@@ -162,6 +176,8 @@ bool sm_init(void)
                        DECREASED_LONGDOC, NULL);
     sm_registercommand("\"", handler__string, vars->commands, STRING_SHRTDOC,
                        STRING_LONGDOC, NULL);
+    sm_registercommand("group", handler__group, vars->commands, GROUP_SHRTDOC,
+                       GROUP_LONGDOC, NULL);
     sm_registercommand("update", handler__update, vars->commands, UPDATE_SHRTDOC,
                        UPDATE_LONGDOC, NULL);
     sm_registercommand("exit", handler__exit, vars->commands, EXIT_SHRTDOC,
@@ -178,6 +194,14 @@ bool sm_init(void)
                        NULL);
     sm_registercommand("watch", handler__watch, vars->commands, WATCH_SHRTDOC,
                        WATCH_LONGDOC, NULL);
+    sm_registercommand("stats", handler__stats, vars->commands, STATS_SHRTDOC,
+                       STATS_LONGDOC, NULL);
+    sm_registercommand("pointers", handler__pointers, vars->commands, POINTERS_SHRTDOC,
+                       POINTERS_LONGDOC, "map,clear");
+    sm_registercommand("save", handler__save, vars->commands, SAVE_SHRTDOC,
+                       SAVE_LONGDOC, NULL);
+    sm_registercommand("load", handler__load, vars->commands, LOAD_SHRTDOC,
+                       LOAD_LONGDOC, NULL);
     sm_registercommand("show", handler__show, vars->commands, SHOW_SHRTDOC,
                        SHOW_LONGDOC, SHOW_COMPLETE);
     sm_registercommand("dump", handler__dump, vars->commands, DUMP_SHRTDOC,
@@ -199,7 +223,11 @@ bool sm_init(void)
 
 void sm_cleanup(void)
 {
+    /* the worker uses all of the below */
+    async_stop();
+
     /* free any allocated memory used */
+    sm_regions_changed(&sm_globals);
     l_destroy(sm_globals.regions);
     if (sm_globals.commands)
         sm_free_all_completions(sm_globals.commands);
@@ -207,7 +235,13 @@ void sm_cleanup(void)
 
     /* free matches array */
     if (sm_globals.matches)
-        free(sm_globals.matches);
+        free_array(sm_globals.matches);
+    sm_set_scan_scope(&sm_globals, NULL, 0);
+
+    /* stop writing and reading the target before leaving it */
+    freeze_stop_all();
+    watch_stop();
+    pointers_free();
 
     /* attempt to detach just in case */
     sm_detach(sm_globals.target);
@@ -245,3 +279,96 @@ void sm_set_stop_flag(bool stop_flag)
 {
     sm_globals.stop_flag = stop_flag;
 }
+
+size_t sm_get_matches(sm_match_record *records, size_t max, unsigned long *cursor)
+{
+    globals_t *vars = &sm_globals;
+    scan_data_type_t data_type = vars->options.scan_data_type;
+    const region_index *index = sm_get_regions_index(vars);
+    const region_t *region = NULL;
+    matches_and_old_values_swath *swath;
+    match_location loc;
+    size_t i, n = 0;
+
+    if (vars->matches == NULL || *cursor >= vars->num_matches)
+        return 0;
+    if (vars->matches->images && !materialize_snapshot(vars->matches)) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return 0;
+    }
+
+    loc = seek_match(vars->matches, *cursor);
+    for (swath = loc.swath, i = loc.index; swath && swath->first_byte_in_child && n < max; ) {
+        match_flags flags = flags_of_nth_element(swath, i);
+
+        if (flags != flags_empty) {
+            sm_match_record *record = &records[n++];
+            const uint8_t *address = remote_address_of_nth_element(swath, i);
+
+            memset(record, 0, sizeof(*record));
+            record->address = (uintptr_t) address;
+            if (data_type == BYTEARRAY || data_type == STRING) {
+                record->kind = data_type == STRING ? SM_MATCH_STRING : SM_MATCH_BYTEARRAY;
+                record->flags = flags;
+                old_values_of_elements(swath, i, record->value,
+                                       elements_to_end_of_run(swath, i, MIN(flags, 8)));
+            } else {
+                value_t val = data_to_val(swath, i);
+
+                record->kind = SM_MATCH_NUMBER;
+                record->flags = val.flags;
+                /* the bytes of the widest type it can be */
+                memcpy(record->value, val.bytes, flags_to_memlength(ANYNUMBER, val.flags));
+            }
+
+            /* the next matches are usually in the same region */
+            if (index && (region == NULL || (void *) address < region->start ||
+                          (void *) address >= region->start + region->size)) {
+                size_t pos = sm_find_region(index, address);
+
+                region = pos < index->count ? index->regions[pos] : NULL;
+            }
+            record->region_id = region ? region->id : SM_NO_REGION;
+            record->region_type = region ? region->type : REGION_TYPE_MISC;
+            record->offset = region ? (uintptr_t) address - region->load_addr : 0;
+        }
+
+        if (++i >= swath->number_of_bytes) {
+            swath = next_swath(swath);
+            i = 0;
+        }
+    }
+
+    if (swath)
+        set_match_cursor(vars->matches, *cursor + n, (match_location){ swath, i });
+    *cursor += n;
+    return n;
+}
+
+const region_index *sm_get_regions_index(globals_t *vars)
+{
+    if (!vars->regions_index && vars->regions)
+        vars->regions_index = sm_index_regions(vars->regions);
+    return vars->regions_index;
+}
+
+void sm_regions_changed(globals_t *vars)
+{
+    free(vars->regions_index);
+    vars->regions_index = NULL;
+}
+
+bool sm_set_scan_scope(globals_t *vars, const address_range *ranges, size_t count)
+{
+    address_range *scope = NULL;
+
+    if (count > 0) {
+        if ((scope = malloc(count * sizeof(address_range))) == NULL)
+            return false;
+        memcpy(scope, ranges, count * sizeof(address_range));
+    }
+    free(vars->scan_scope);
+    vars->scan_scope = scope;
+    vars->scan_scope_count = count;
+    return true;
+}
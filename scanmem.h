@@ -29,6 +29,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "scanroutines.h"
 #include "list.h"
@@ -37,6 +38,9 @@
 #include "targetmem.h"
 
 
+/* upper limit of the `scan_threads` option */
+#define MAX_SCAN_THREADS (64)
+
 /* global settings */
 typedef struct {
     unsigned exit:1;
@@ -46,11 +50,13 @@ typedef struct {
     double scan_progress;
     volatile bool stop_flag;
     list_t *regions;
+    region_index *regions_index;   /* of `regions`, built when needed */
+    address_range *scan_scope;     /* the scans only look there, NULL for everywhere */
+    size_t scan_scope_count;       /* sorted and disjoint ranges in `scan_scope` */
     list_t *commands;              /* command handlers */
     const char *current_cmdline;   /* the command being executed */
     void (*printversion)(FILE *outfd);
     struct {
-        unsigned short alignment;
         unsigned short debug;
         unsigned short backend;    /* if 1, scanmem will work as a backend and
                                       output will be more machine-readable */
@@ -61,6 +67,11 @@ typedef struct {
         unsigned short dump_with_ascii;
         unsigned short reverse_endianness;
         unsigned short no_ptrace;
+        unsigned short scan_threads;  /* number of scanning threads, 0 for one per CPU */
+        unsigned short alignment;     /* first scans only match multiples of this */
+        unsigned short matches_in_file; /* keep the matches in a temporary file */
+        unsigned short soft_dirty;    /* checks don't read the pages the target didn't write */
+        unsigned short read_ahead;    /* a first scan reads a block while it searches the last */
     } options;
 } globals_t;
 
@@ -77,6 +88,44 @@ const char *sm_get_version(void);
 double sm_get_scan_progress(void);
 void sm_set_stop_flag(bool stop_flag);
 
+/* The kinds of sm_match_record */
+#define SM_MATCH_NUMBER    0
+#define SM_MATCH_BYTEARRAY 1
+#define SM_MATCH_STRING    2
+
+/* region_id of a match outside of the known regions */
+#define SM_NO_REGION UINT32_MAX
+
+/* A match as sm_get_matches() gives it, in a layout without padding, the
+ * same on all targets */
+typedef struct {
+    uint64_t address;
+    uint64_t offset;            /* from the load address of its region, or 0 */
+    uint32_t region_id;
+    uint16_t flags;             /* the match_flags, or the length of a bytearray or a string */
+    uint8_t region_type;        /* a region_type_t */
+    uint8_t kind;               /* SM_MATCH_* */
+    uint8_t value[8];           /* the first bytes of the old value, as `list` shows it */
+} sm_match_record;
+
+/* Copies the matches from the number `*cursor` on into `records`, at most
+ * `max` of them, and moves `*cursor` to the match after the last one copied.
+ * Returns the number of records, less than `max` at the end of the matches.
+ * Front-ends get all the matches, page by page, without the text of `list`. */
+size_t sm_get_matches(sm_match_record *records, size_t max, unsigned long *cursor);
+
+/* The index of vars->regions, built on the first call after they changed,
+ * or NULL if there is not enough memory for it. A change of the regions
+ * must be followed by sm_regions_changed(). */
+const region_index *sm_get_regions_index(globals_t *vars);
+void sm_regions_changed(globals_t *vars);
+
+/* Makes the scans only look at the `count` sorted and disjoint `ranges`, a
+ * copy of them, or at all the regions without ranges: a search only searches
+ * the parts of the regions in the ranges, and a check keeps the matches
+ * outside of them as they are. Returns false if there is not enough memory. */
+bool sm_set_scan_scope(globals_t *vars, const address_range *ranges, size_t count);
+
 /* ptrace.c */
 bool sm_detach(pid_t target);
 bool sm_setaddr(pid_t target, void *addr, const value_t *to);
@@ -84,9 +133,127 @@ bool sm_checkmatches(globals_t *vars, scan_match_type_t match_type,
                      const uservalue_t *uservalue);
 bool sm_searchregions(globals_t *vars, scan_match_type_t match_type,
                       const uservalue_t *uservalue);
+bool sm_snapshot(globals_t *vars);
+/* adds the memory of `regions`, none of which has matches, to the matches
+ * as a snapshot would */
+bool sm_add_regions(globals_t *vars, const list_t *regions);
 bool sm_peekdata(const void *addr, uint16_t length, const mem64_t **result_ptr, size_t *memlength);
 bool sm_attach(pid_t target);
 bool sm_read_array(pid_t target, const void *addr, void *buf, size_t len);
 bool sm_write_array(pid_t target, void *addr, const void *data, size_t len);
+/* Read the `count` pieces `runs` of the memory of `target` into `data`, or
+ * write them from it, their bytes back to back, in as few syscalls as
+ * possible: process_vm_readv() or process_vm_writev() while `*vectored`,
+ * which is cleared once they are refused, and for the runs they don't move
+ * pread() or pwrite() on `procmem_fd`, an open `/proc/<pid>/mem` or -1, or
+ * PT_IO when it is -1 and we trace `target`. They may run in another thread
+ * than the scans, and don't attach to `target`. Return the number of runs
+ * not moved whole, all the ones left once `target` is gone. */
+size_t sm_read_runs(pid_t target, int procmem_fd, bool *vectored,
+                    const struct iovec *runs, size_t count, void *data);
+size_t sm_write_runs(pid_t target, int procmem_fd, bool *vectored,
+                     const struct iovec *runs, size_t count, const void *data);
+bool sm_soft_dirty_supported(void);
+
+/* Counters of the page cache of sm_peekdata(), since the start */
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long pages_read;   /* by the misses, read-ahead included */
+} sm_peek_stats;
+
+void sm_get_peek_stats(sm_peek_stats *stats);
+
+/* stats.c */
+
+/* The scans timed by the statistics */
+typedef enum {
+    SM_PHASE_SEARCH,            /* sm_searchregions() */
+    SM_PHASE_CHECK,             /* sm_checkmatches() */
+    SM_PHASE_SNAPSHOT,          /* sm_snapshot() */
+    SM_PHASES
+} sm_scan_phase;
+
+#define SM_PHASE_NAMES { "search", "check", "snapshot" }
+
+typedef struct {
+    unsigned long runs;
+    double wall_seconds;        /* of all the runs */
+    double cpu_seconds;         /* of all the runs, on all the threads */
+    double last_wall_seconds;
+    unsigned long last_matches_in;
+    unsigned long last_matches_out;
+} sm_phase_stats;
+
+/* Counters of the work of the scans, since the start or the last reset */
+typedef struct {
+    unsigned long bytes_read;       /* from the target */
+    unsigned long read_syscalls;
+    unsigned long short_reads;      /* syscalls that read less than asked */
+    sm_peek_stats peek;
+    unsigned long allocations;      /* chunks of the matches, and snapshot images */
+    unsigned long allocated_bytes;
+    unsigned long bytes_copied;     /* merging the matches found by threads */
+    sm_phase_stats phases[SM_PHASES];
+} sm_scan_stats;
+
+void sm_get_scan_stats(sm_scan_stats *stats);
+void sm_reset_scan_stats(void);
+
+/* A session keeps the target attached, and its memory file open, from its
+ * beginning to its end. The functions above then share that attach instead
+ * of attaching and detaching on each call. Sessions nest, only the outermost
+ * one attaches and detaches. The target doesn't run during a session. */
+bool sm_begin_session(pid_t target);
+bool sm_end_session(pid_t target);
+
+/* session.c */
+
+/* Saves the matches, with the regions they are in, to the file `path`, in a
+ * format that sm_load_session() maps back without reading the matches. The
+ * matches of a snapshot are saved as the matches of a scan. */
+bool sm_save_session(globals_t *vars, const char *path);
+
+/* Replaces the matches and the regions by the ones saved to `path`, for the
+ * target, which may have been started again since. The matches follow the
+ * regions they were in, e.g. the library they belong to when it is loaded at
+ * another address, the ones of the regions that are gone are dropped. */
+bool sm_load_session(globals_t *vars, const char *path);
+
+/* async.c */
+
+/* A command submitted to the worker */
+typedef struct sm_async_cmd sm_async_cmd;
+
+/* The callbacks of a command, each one may be NULL */
+typedef struct {
+    /* The progress of the scan of the command, from 0 to 1, and the number
+     * of matches it found so far. Called from the threads of the scan, one
+     * at a time, each time the progress grows by 0.1%. */
+    void (*progress)(double scan_progress, unsigned long matches_found, void *data);
+    /* The command is finished, with its result and the number of matches.
+     * Called from the worker, once for each command, also when cancelled. */
+    void (*done)(bool ret, unsigned long num_matches, void *data);
+    void *data;
+} sm_async_callbacks;
+
+/* Queues `commandline` for the worker, which runs the commands one after
+ * the other, in the order they are submitted, as sm_backend_exec_cmd() does.
+ * Until they are finished, the front-end may only call the functions below
+ * and sm_get_scan_progress(). Without threads, the command is run before
+ * sm_submit_cmd() returns. Returns NULL if the command can't be queued,
+ * also while sm_cleanup() stops the worker. */
+sm_async_cmd *sm_submit_cmd(const char *commandline, const sm_async_callbacks *callbacks);
+
+/* A command not started yet won't run. The scan of a running command stops
+ * after the block of memory it is reading, like with sm_set_stop_flag(),
+ * keeping the matches found until there. Doesn't wait for the command. */
+void sm_cancel_cmd(sm_async_cmd *cmd);
+
+bool sm_cmd_finished(sm_async_cmd *cmd);
+
+/* Waits for the command to finish and frees it. Returns its result, false
+ * if it was cancelled. Each command submitted must be waited for. */
+bool sm_wait_cmd(sm_async_cmd *cmd);
 
 #endif /* SCANMEM_H */
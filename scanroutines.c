@@ -22,6 +22,7 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "scanroutines.h"
 #include "common.h"
@@ -327,23 +328,96 @@ DEFINE_FLOAT_RANGE_ROUTINE(64, 1, _REVENDIAN)
 DEFINE_ANYTYPE_ROUTINE(ANY, )
 DEFINE_ANYTYPE_ROUTINE(UPDATE, )
 
-DEFINE_ANYTYPE_ROUTINE(EQUALTO, )
-DEFINE_ANYTYPE_ROUTINE(NOTEQUALTO, )
-DEFINE_ANYTYPE_ROUTINE(CHANGED, )
-DEFINE_ANYTYPE_ROUTINE(NOTCHANGED, )
-DEFINE_ANYTYPE_ROUTINE(INCREASED, )
-DEFINE_ANYTYPE_ROUTINE(DECREASED, )
-DEFINE_ANYTYPE_ROUTINE(GREATERTHAN, )
-DEFINE_ANYTYPE_ROUTINE(LESSTHAN, )
-DEFINE_ANYTYPE_ROUTINE(INCREASEDBY, )
-DEFINE_ANYTYPE_ROUTINE(DECREASEDBY, )
-DEFINE_ANYTYPE_ROUTINE(RANGE, )
-
-DEFINE_ANYTYPE_ROUTINE(EQUALTO, _REVENDIAN)
-DEFINE_ANYTYPE_ROUTINE(NOTEQUALTO, _REVENDIAN)
-DEFINE_ANYTYPE_ROUTINE(GREATERTHAN, _REVENDIAN)
-DEFINE_ANYTYPE_ROUTINE(LESSTHAN, _REVENDIAN)
-DEFINE_ANYTYPE_ROUTINE(RANGE, _REVENDIAN)
+/* The comparisons of the any-xxx types are fused: the memory is loaded once,
+ * every width is compared from it without branches, and the flags word is
+ * made in a register and stored once. The routines above can't do it, as
+ * each store into `saveflags` could change the flags of the values. */
+
+/* the flags of the widths that fit in `memlength` bytes */
+static inline match_flags flags_of_length(size_t memlength)
+{
+    if (memlength >= 8) return flags_all;
+    if (memlength >= 4) return flags_all & ~flags_64b;
+    if (memlength >= 2) return flags_8b | flags_16b;
+    if (memlength >= 1) return flags_8b;
+    return flags_empty;
+}
+
+/* the comparisons, of the memory of a width with the same field of the values */
+#define FUSED_EQUALTO(mem, field)     ((mem).field == user_value->field)
+#define FUSED_NOTEQUALTO(mem, field)  ((mem).field != user_value->field)
+#define FUSED_GREATERTHAN(mem, field) ((mem).field > user_value->field)
+#define FUSED_LESSTHAN(mem, field)    ((mem).field < user_value->field)
+#define FUSED_RANGE(mem, field)       (((mem).field >= user_value[0].field) & ((mem).field <= user_value[1].field))
+#define FUSED_NOTCHANGED(mem, field)  ((mem).field == old_value->field)
+#define FUSED_CHANGED(mem, field)     ((mem).field != old_value->field)
+#define FUSED_INCREASED(mem, field)   ((mem).field > old_value->field)
+#define FUSED_DECREASED(mem, field)   ((mem).field < old_value->field)
+#define FUSED_INCREASEDBY(mem, field) ((mem).field == old_value->field + user_value->field)
+#define FUSED_DECREASEDBY(mem, field) ((mem).field == old_value->field - user_value->field)
+
+/* the flags the values allow for each comparison */
+#define FUSED_FLAGS_USER  (user_value->flags)
+#define FUSED_FLAGS_OLD   (old_value->flags)
+#define FUSED_FLAGS_BOTH  (old_value->flags & user_value->flags)
+
+/* `FLAG` if the type has it and the comparison holds, the type flags being a
+ * constant the widths of other types aren't even compared */
+#define FUSED_FLAG(TYPE_FLAGS, MATCHTYPENAME, mem, field, FLAG) \
+    ((((TYPE_FLAGS) & (FLAG)) && FUSED_##MATCHTYPENAME(mem, field)) ? (FLAG) : 0)
+
+#define DEFINE_FUSED_ANYTYPE_ROUTINE(DATATYPENAME, TYPE_FLAGS, MATCHTYPENAME, VALUE_FLAGS, REVENDIAN, REVEND_STR) \
+    extern inline unsigned int scan_routine_##DATATYPENAME##_##MATCHTYPENAME##REVEND_STR SCAN_ROUTINE_ARGUMENTS \
+    { \
+        match_flags allowed = (TYPE_FLAGS) & VALUE_FLAGS & flags_of_length(memlength); \
+        match_flags flags; \
+        mem64_t m, w16, w32, w64; \
+        if (memlength >= sizeof(m)) { \
+            m = *memory_ptr; \
+        } else { \
+            memset(&m, 0, sizeof(m)); \
+            memcpy(&m, memory_ptr, memlength); \
+        } \
+        w16 = w32 = w64 = m; \
+        if (REVENDIAN) { \
+            w16.uint16_value = swap_bytes16(m.uint16_value); \
+            w32.uint32_value = swap_bytes32(m.uint32_value); \
+            w64.uint64_value = swap_bytes64(m.uint64_value); \
+        } \
+        flags = allowed & (FUSED_FLAG(TYPE_FLAGS, MATCHTYPENAME, m, int8_value, flag_s8b) | \
+                           FUSED_FLAG(TYPE_FLAGS, MATCHTYPENAME, m, uint8_value, flag_u8b) | \
+                           FUSED_FLAG(TYPE_FLAGS, MATCHTYPENAME, w16, int16_value, flag_s16b) | \
+                           FUSED_FLAG(TYPE_FLAGS, MATCHTYPENAME, w16, uint16_value, flag_u16b) | \
+                           FUSED_FLAG(TYPE_FLAGS, MATCHTYPENAME, w32, int32_value, flag_s32b) | \
+                           FUSED_FLAG(TYPE_FLAGS, MATCHTYPENAME, w32, uint32_value, flag_u32b) | \
+                           FUSED_FLAG(TYPE_FLAGS, MATCHTYPENAME, w64, int64_value, flag_s64b) | \
+                           FUSED_FLAG(TYPE_FLAGS, MATCHTYPENAME, w64, uint64_value, flag_u64b) | \
+                           FUSED_FLAG(TYPE_FLAGS, MATCHTYPENAME, w32, float32_value, flag_f32b) | \
+                           FUSED_FLAG(TYPE_FLAGS, MATCHTYPENAME, w64, float64_value, flag_f64b)); \
+        *saveflags |= flags; \
+        return flags_to_memlength(ANYNUMBER, flags); \
+    }
+
+#define DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES(MATCHTYPENAME, VALUE_FLAGS, REVENDIAN, REVEND_STR) \
+    DEFINE_FUSED_ANYTYPE_ROUTINE(ANYINTEGER, flags_integer, MATCHTYPENAME, VALUE_FLAGS, REVENDIAN, REVEND_STR) \
+    DEFINE_FUSED_ANYTYPE_ROUTINE(ANYFLOAT, flags_float, MATCHTYPENAME, VALUE_FLAGS, REVENDIAN, REVEND_STR) \
+    DEFINE_FUSED_ANYTYPE_ROUTINE(ANYNUMBER, flags_all, MATCHTYPENAME, VALUE_FLAGS, REVENDIAN, REVEND_STR)
+
+#define DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES_AND_ENDIANS(MATCHTYPENAME, VALUE_FLAGS) \
+    DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES(MATCHTYPENAME, VALUE_FLAGS, 0, ) \
+    DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES(MATCHTYPENAME, VALUE_FLAGS, 1, _REVENDIAN)
+
+DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES_AND_ENDIANS(EQUALTO, FUSED_FLAGS_USER)
+DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES_AND_ENDIANS(NOTEQUALTO, FUSED_FLAGS_USER)
+DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES_AND_ENDIANS(GREATERTHAN, FUSED_FLAGS_USER)
+DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES_AND_ENDIANS(LESSTHAN, FUSED_FLAGS_USER)
+DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES_AND_ENDIANS(RANGE, FUSED_FLAGS_USER)
+DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES(NOTCHANGED, FUSED_FLAGS_OLD, 0, )
+DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES(CHANGED, FUSED_FLAGS_OLD, 0, )
+DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES(INCREASED, FUSED_FLAGS_OLD, 0, )
+DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES(DECREASED, FUSED_FLAGS_OLD, 0, )
+DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES(INCREASEDBY, FUSED_FLAGS_BOTH, 0, )
+DEFINE_FUSED_ROUTINE_FOR_ALL_ANYTYPES(DECREASEDBY, FUSED_FLAGS_BOTH, 0, )
 
 /*----------------------------------------*/
 /* for generic VLT (Variable Length Type) */
@@ -360,6 +434,39 @@ extern inline unsigned int scan_routine_VLT_UPDATE SCAN_ROUTINE_ARGUMENTS
    return *saveflags = memlength;
 }
 
+/* The members are matched in turn, the anchor first, each one at its
+ * offsets until it matches there. A member is only given the bytes up to
+ * the end of the group, so that a check of the recorded bytes matches the
+ * same as the search did. */
+extern inline unsigned int scan_routine_VLT_GROUP SCAN_ROUTINE_ARGUMENTS
+{
+    const struct scan_group *group = user_value->group_value;
+    unsigned int i;
+
+    if (memlength < group->length)
+        return 0;
+
+    for (i = 0; i < group->num_members; i++) {
+        const scan_group_member *member = &group->members[i];
+        size_t offset;
+
+        for (offset = member->min_offset; offset <= member->max_offset; offset++) {
+            match_flags flags = flags_empty;
+
+            if ((*member->routine)((const mem64_t *)(memory_ptr->bytes + offset),
+                                   group->length - offset, NULL, member->values, &flags))
+                break;
+        }
+        if (offset > member->max_offset)
+            return 0;
+    }
+
+    /* matched */
+    *saveflags = group->length;
+
+    return group->length;
+}
+
 /*---------------*/
 /* for BYTEARRAY */
 /*---------------*/
@@ -561,6 +668,468 @@ DEFINE_STRING_SMALLOOP_EQUALTO_ROUTINE(48)
 DEFINE_STRING_SMALLOOP_EQUALTO_ROUTINE(56)
 
 
+/*******************/
+/* Buffer routines */
+/*******************/
+
+/* These run the (inlined) routines above over a whole buffer, so that the
+ * scan loop pays a single indirect call per buffer instead of one per offset.
+ * Only the initial scans have them, the others have to look at old values,
+ * which aren't in a buffer. */
+
+#define SCAN_BUFFER_ROUTINE_ARGUMENTS (const uint8_t *buffer, size_t count, size_t memlength, size_t stride, const uservalue_t *user_value, uint32_t *match_offsets, match_flags *saveflags)
+size_t (*sm_scan_buffer_routine) SCAN_BUFFER_ROUTINE_ARGUMENTS;
+
+/* The routines compare with a copy of the `NUM_VALUES` user values, which
+ * the stores of the flags can't change: it stays in registers. */
+#define DEFINE_BUFFER_ROUTINE(ROUTINENAME, NUM_VALUES) \
+    static size_t scan_buffer_routine_##ROUTINENAME SCAN_BUFFER_ROUTINE_ARGUMENTS \
+    { \
+        size_t i, num_matches = 0; \
+        uservalue_t values[2]; \
+        if (NUM_VALUES > 0) { \
+            memcpy(values, user_value, (NUM_VALUES) * sizeof(uservalue_t)); \
+            user_value = values; \
+        } \
+        for (i = 0; i < count; i += stride) { \
+            match_flags flags = flags_empty; \
+            if (scan_routine_##ROUTINENAME((const mem64_t *)(buffer + i), memlength - i, \
+                                           NULL, user_value, &flags)) { \
+                match_offsets[num_matches] = i; \
+                saveflags[num_matches] = flags; \
+                ++num_matches; \
+            } \
+        } \
+        return num_matches; \
+    }
+
+#define DEFINE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES(MATCHTYPENAME, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(INTEGER8_##MATCHTYPENAME, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(INTEGER16_##MATCHTYPENAME, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(INTEGER32_##MATCHTYPENAME, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(INTEGER64_##MATCHTYPENAME, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(FLOAT32_##MATCHTYPENAME, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(FLOAT64_##MATCHTYPENAME, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(ANYINTEGER_##MATCHTYPENAME, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(ANYFLOAT_##MATCHTYPENAME, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(ANYNUMBER_##MATCHTYPENAME, NUM_VALUES)
+
+#define DEFINE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(MATCHTYPENAME, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES(MATCHTYPENAME, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(INTEGER16_##MATCHTYPENAME##_REVENDIAN, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(INTEGER32_##MATCHTYPENAME##_REVENDIAN, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(INTEGER64_##MATCHTYPENAME##_REVENDIAN, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(FLOAT32_##MATCHTYPENAME##_REVENDIAN, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(FLOAT64_##MATCHTYPENAME##_REVENDIAN, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(ANYINTEGER_##MATCHTYPENAME##_REVENDIAN, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(ANYFLOAT_##MATCHTYPENAME##_REVENDIAN, NUM_VALUES) \
+    DEFINE_BUFFER_ROUTINE(ANYNUMBER_##MATCHTYPENAME##_REVENDIAN, NUM_VALUES)
+
+DEFINE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES(ANY, 0)
+DEFINE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(EQUALTO, 1)
+DEFINE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(NOTEQUALTO, 1)
+DEFINE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(GREATERTHAN, 1)
+DEFINE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(LESSTHAN, 1)
+DEFINE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(RANGE, 2)
+
+/* The bytearrays and strings are looked for with Horspool's algorithm, on the
+ * longest run of fixed bytes of the pattern (a `needle` at `anchor`): a
+ * wildcard would match any byte and cut the shifts short. Where the needle
+ * is found, the whole pattern is compared. */
+
+static inline bool pattern_matches(const uint8_t *memory, const uint8_t *pattern,
+                                   const wildcard_t *wildcards, size_t length)
+{
+    size_t i;
+
+    if (wildcards == NULL)
+        return memcmp(memory, pattern, length) == 0;
+    for (i = 0; i < length; i++)
+        if ((memory[i] & wildcards[i]) != pattern[i])
+            return false;
+    return true;
+}
+
+static size_t search_pattern(const uint8_t *buffer, size_t count, size_t memlength, size_t stride,
+                             const uint8_t *pattern, const wildcard_t *wildcards, size_t length,
+                             size_t anchor, size_t needle_length,
+                             uint32_t *match_offsets, match_flags *saveflags)
+{
+    const uint8_t *needle = pattern + anchor;
+    size_t num_matches = 0;
+    size_t shift[256];
+    size_t last, offset, i;
+
+    if (count == 0 || memlength < length)
+        return 0;
+    /* the last offset where the whole pattern fits */
+    last = MIN(count - 1, memlength - length);
+
+    for (i = 0; i < 256; i++)
+        shift[i] = MAX(needle_length, 1);
+    for (i = 0; i + 1 < needle_length; i++)
+        shift[needle[i]] = needle_length - 1 - i;
+
+    for (offset = 0; offset <= last; ) {
+        const uint8_t *window = buffer + offset + anchor;
+
+        /* the shifts of short needles are too short, memchr() jumps further */
+        if (needle_length == 1 || needle_length == 2) {
+            if ((window = memchr(window, needle[0], last - offset + 1)) == NULL)
+                break;
+            offset = window - buffer - anchor;
+        }
+        if ((offset & (stride - 1)) == 0 &&
+            (needle_length == 0 || (window[needle_length - 1] == needle[needle_length - 1] &&
+                                    memcmp(window, needle, needle_length - 1) == 0)) &&
+            pattern_matches(buffer + offset, pattern, wildcards, length)) {
+            match_offsets[num_matches] = offset;
+            saveflags[num_matches] = length;
+            ++num_matches;
+        }
+        offset += needle_length ? shift[window[needle_length - 1]] : 1;
+    }
+    return num_matches;
+}
+
+static size_t scan_buffer_routine_BYTEARRAY_EQUALTO SCAN_BUFFER_ROUTINE_ARGUMENTS
+{
+    const wildcard_t *wildcards = user_value->wildcard_value;
+    size_t length = user_value->flags;
+    size_t anchor = 0, needle_length = 0;
+    size_t start, end;
+
+    /* the longest run of fixed bytes */
+    for (start = 0; start < length; start = end + 1) {
+        for (end = start; end < length && wildcards[end] == FIXED; end++)
+            ;
+        if (end - start > needle_length) {
+            anchor = start;
+            needle_length = end - start;
+        }
+    }
+    return search_pattern(buffer, count, memlength, stride, user_value->bytearray_value,
+                          wildcards, length, anchor, needle_length, match_offsets, saveflags);
+}
+
+static size_t scan_buffer_routine_STRING_EQUALTO SCAN_BUFFER_ROUTINE_ARGUMENTS
+{
+    size_t length = user_value->flags;
+
+    return search_pattern(buffer, count, memlength, stride,
+                          (const uint8_t *)user_value->string_value, NULL, length,
+                          0, length, match_offsets, saveflags);
+}
+
+/*-----------------------------*/
+/* SIMD buffer routines on x86 */
+/*-----------------------------*/
+
+/* The fixed width routines most used for initial scans get vectorized versions,
+ * chosen at runtime by what the CPU supports (see `sm_get_scanbufferroutine()`).
+ * SSE2 is always there on x86_64 but lacks 64-bit compares and byte shuffles,
+ * so it only has the native endian routines it can do, AVX2 has all of them.
+ *
+ * For a value of E bytes, a block of W bytes is compared with E unaligned
+ * loads: the load at offset k compares the values at offsets k, k+E, k+2E...
+ * The lane masks of the loads are then spread into a mask of the W offsets.
+ * With a stride, the loads that can't hold an aligned offset are skipped and
+ * the mask is reduced to the aligned offsets. */
+#if defined(__x86_64__) && defined(__GNUC__)
+# define SCAN_SIMD_X86 1
+#else
+# define SCAN_SIMD_X86 0
+#endif
+
+#if SCAN_SIMD_X86
+
+#include <immintrin.h>
+
+enum { SIMD_EQUALTO, SIMD_GREATERTHAN, SIMD_LESSTHAN, SIMD_RANGE };
+
+/* Puts the bits of `lanes`, coming from the load at `offset`, at their offsets */
+static inline uint32_t spread_lanes(unsigned lanes, unsigned offset, unsigned width)
+{
+    uint32_t mask = 0;
+
+    while (lanes) {
+        mask |= (uint32_t)1 << (offset + width * __builtin_ctz(lanes));
+        lanes &= lanes - 1;
+    }
+    return mask;
+}
+
+/* The bits of the offsets of a block that are multiples of `stride` */
+#define ALIGNED_OFFSETS_MASK(stride) (UINT32_MAX / (((uint32_t)1 << (stride)) - 1))
+
+/* Stores the matches of a block from the masks of both signednesses */
+static inline size_t store_block_matches(uint32_t signed_mask, uint32_t unsigned_mask,
+                                         match_flags signed_flag, match_flags unsigned_flag,
+                                         size_t block, uint32_t *match_offsets,
+                                         match_flags *saveflags)
+{
+    uint32_t mask = signed_mask | unsigned_mask;
+    size_t num_matches = 0;
+
+    while (mask) {
+        unsigned offset = __builtin_ctz(mask);
+        uint32_t bit = (uint32_t)1 << offset;
+
+        match_offsets[num_matches] = block + offset;
+        saveflags[num_matches] = ((signed_mask & bit) ? signed_flag : flags_empty) |
+                                 ((unsigned_mask & bit) ? unsigned_flag : flags_empty);
+        ++num_matches;
+        mask &= mask - 1;
+    }
+    return num_matches;
+}
+
+/* SSE2 */
+#define SSE2_TARGET
+#define SSE2_WIDTH              16
+#define SSE2_VEC                __m128i
+
+#define SSE2_LOAD(p)            _mm_loadu_si128((const __m128i *)(p))
+#define SSE2_XOR(a, b)          _mm_xor_si128(a, b)
+#define SSE2_SET1_32(v)         _mm_set1_epi32(v)
+#define SSE2_SET1_64(v)         _mm_set1_epi64x(v)
+#define SSE2_LANES_32(m)        _mm_movemask_ps(_mm_castsi128_ps(m))
+#define SSE2_LANES_64(m)        _mm_movemask_pd(_mm_castsi128_pd(m))
+#define SSE2_CMP_I32            sse2_cmp_i32
+#define SSE2_CMP_I64            sse2_cmp_i64
+#define SSE2_CMP_F32            sse2_cmp_f32
+#define SSE2_CMP_F64            sse2_cmp_f64
+/* no byte shuffle in SSE2, so there are no reverse endian SSE2 routines */
+#define SSE2_BSWAP_32(v)        (v)
+#define SSE2_BSWAP_64(v)        (v)
+
+static inline __m128i sse2_cmp_i32(int op, __m128i v, __m128i lo, __m128i hi)
+{
+    switch (op) {
+    case SIMD_EQUALTO:     return _mm_cmpeq_epi32(v, lo);
+    case SIMD_GREATERTHAN: return _mm_cmpgt_epi32(v, lo);
+    case SIMD_LESSTHAN:    return _mm_cmpgt_epi32(lo, v);
+    default:               return _mm_andnot_si128(_mm_or_si128(_mm_cmpgt_epi32(lo, v),
+                                                                _mm_cmpgt_epi32(v, hi)),
+                                                   _mm_set1_epi32(-1));
+    }
+}
+
+/* only equality, the 32-bit halves must match both: SSE2 has no 64-bit
+ * compare, so only the EQUALTO routine of INTEGER64 is defined below */
+static inline __m128i sse2_cmp_i64(int op, __m128i v, __m128i lo, __m128i hi)
+{
+    __m128i halves = _mm_cmpeq_epi32(v, lo);
+
+    assert(op == SIMD_EQUALTO);
+    (void) hi;
+    return _mm_and_si128(halves, _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+
+static inline int sse2_cmp_f32(int op, __m128i vi, float lo, float hi)
+{
+    __m128 v = _mm_castsi128_ps(vi);
+    switch (op) {
+    case SIMD_EQUALTO:     return _mm_movemask_ps(_mm_cmpeq_ps(v, _mm_set1_ps(lo)));
+    case SIMD_GREATERTHAN: return _mm_movemask_ps(_mm_cmpgt_ps(v, _mm_set1_ps(lo)));
+    case SIMD_LESSTHAN:    return _mm_movemask_ps(_mm_cmplt_ps(v, _mm_set1_ps(lo)));
+    default:               return _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(v, _mm_set1_ps(lo)),
+                                                             _mm_cmple_ps(v, _mm_set1_ps(hi))));
+    }
+}
+
+static inline int sse2_cmp_f64(int op, __m128i vi, double lo, double hi)
+{
+    __m128d v = _mm_castsi128_pd(vi);
+    switch (op) {
+    case SIMD_EQUALTO:     return _mm_movemask_pd(_mm_cmpeq_pd(v, _mm_set1_pd(lo)));
+    case SIMD_GREATERTHAN: return _mm_movemask_pd(_mm_cmpgt_pd(v, _mm_set1_pd(lo)));
+    case SIMD_LESSTHAN:    return _mm_movemask_pd(_mm_cmplt_pd(v, _mm_set1_pd(lo)));
+    default:               return _mm_movemask_pd(_mm_and_pd(_mm_cmpge_pd(v, _mm_set1_pd(lo)),
+                                                             _mm_cmple_pd(v, _mm_set1_pd(hi))));
+    }
+}
+
+/* AVX2 */
+#define AVX2_TARGET             __attribute__((target("avx2")))
+#define AVX2_WIDTH              32
+#define AVX2_VEC                __m256i
+
+#define AVX2_LOAD(p)            _mm256_loadu_si256((const __m256i *)(p))
+#define AVX2_XOR(a, b)          _mm256_xor_si256(a, b)
+#define AVX2_SET1_32(v)         _mm256_set1_epi32(v)
+#define AVX2_SET1_64(v)         _mm256_set1_epi64x(v)
+#define AVX2_LANES_32(m)        _mm256_movemask_ps(_mm256_castsi256_ps(m))
+#define AVX2_LANES_64(m)        _mm256_movemask_pd(_mm256_castsi256_pd(m))
+#define AVX2_BSWAP_32           avx2_bswap_32
+#define AVX2_BSWAP_64           avx2_bswap_64
+#define AVX2_CMP_I32            avx2_cmp_i32
+#define AVX2_CMP_I64            avx2_cmp_i64
+#define AVX2_CMP_F32            avx2_cmp_f32
+#define AVX2_CMP_F64            avx2_cmp_f64
+
+AVX2_TARGET static inline __m256i avx2_bswap_32(__m256i v)
+{
+    return _mm256_shuffle_epi8(v, _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                                   3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12));
+}
+
+AVX2_TARGET static inline __m256i avx2_bswap_64(__m256i v)
+{
+    return _mm256_shuffle_epi8(v, _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                                   7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8));
+}
+
+#define DEFINE_AVX2_INTEGER_COMPARE(DATAWIDTH) \
+    AVX2_TARGET static inline __m256i avx2_cmp_i##DATAWIDTH(int op, __m256i v, __m256i lo, __m256i hi) \
+    { \
+        switch (op) { \
+        case SIMD_EQUALTO:     return _mm256_cmpeq_epi##DATAWIDTH(v, lo); \
+        case SIMD_GREATERTHAN: return _mm256_cmpgt_epi##DATAWIDTH(v, lo); \
+        case SIMD_LESSTHAN:    return _mm256_cmpgt_epi##DATAWIDTH(lo, v); \
+        default:               return _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpgt_epi##DATAWIDTH(lo, v), \
+                                                                          _mm256_cmpgt_epi##DATAWIDTH(v, hi)), \
+                                                          _mm256_set1_epi32(-1)); \
+        } \
+    }
+
+DEFINE_AVX2_INTEGER_COMPARE(32)
+DEFINE_AVX2_INTEGER_COMPARE(64)
+
+#define DEFINE_AVX2_FLOAT_COMPARE(DATAWIDTH, CTYPE, VECTYPE, SUFFIX) \
+    AVX2_TARGET static inline int avx2_cmp_f##DATAWIDTH(int op, __m256i vi, CTYPE lo, CTYPE hi) \
+    { \
+        VECTYPE v = _mm256_castsi256_##SUFFIX(vi); \
+        switch (op) { \
+        case SIMD_EQUALTO:     return _mm256_movemask_##SUFFIX(_mm256_cmp_##SUFFIX(v, _mm256_set1_##SUFFIX(lo), _CMP_EQ_OQ)); \
+        case SIMD_GREATERTHAN: return _mm256_movemask_##SUFFIX(_mm256_cmp_##SUFFIX(v, _mm256_set1_##SUFFIX(lo), _CMP_GT_OQ)); \
+        case SIMD_LESSTHAN:    return _mm256_movemask_##SUFFIX(_mm256_cmp_##SUFFIX(v, _mm256_set1_##SUFFIX(lo), _CMP_LT_OQ)); \
+        default:               return _mm256_movemask_##SUFFIX(_mm256_and_##SUFFIX( \
+                                          _mm256_cmp_##SUFFIX(v, _mm256_set1_##SUFFIX(lo), _CMP_GE_OQ), \
+                                          _mm256_cmp_##SUFFIX(v, _mm256_set1_##SUFFIX(hi), _CMP_LE_OQ))); \
+        } \
+    }
+
+DEFINE_AVX2_FLOAT_COMPARE(32, float, __m256, ps)
+DEFINE_AVX2_FLOAT_COMPARE(64, double, __m256d, pd)
+
+/* The routines: vector blocks while whole values can be loaded,
+ * the per-offset routine for the rest */
+#define DEFINE_SIMD_INTEGER_ROUTINE(ISA, DATAWIDTH, MATCHTYPENAME, OP, REVENDIAN, REVEND_STR) \
+    ISA##_TARGET static size_t scan_buffer_routine_INTEGER##DATAWIDTH##_##MATCHTYPENAME##REVEND_STR##_##ISA SCAN_BUFFER_ROUTINE_ARGUMENTS \
+    { \
+        const uservalue_t *hi_value = ((OP) == SIMD_RANGE) ? &user_value[1] : user_value; \
+        const int##DATAWIDTH##_t bias = (int##DATAWIDTH##_t)((uint##DATAWIDTH##_t)1 << ((DATAWIDTH) - 1)); \
+        bool want_signed = user_value->flags & flag_s##DATAWIDTH##b; \
+        bool want_unsigned = user_value->flags & flag_u##DATAWIDTH##b; \
+        /* the same bits are equal both ways */ \
+        bool same_compare = (OP) == SIMD_EQUALTO && want_signed && want_unsigned && \
+            (uint##DATAWIDTH##_t)get_s##DATAWIDTH##b(user_value) == get_u##DATAWIDTH##b(user_value); \
+        ISA##_VEC signed_lo = ISA##_SET1_##DATAWIDTH(get_s##DATAWIDTH##b(user_value)); \
+        ISA##_VEC signed_hi = ISA##_SET1_##DATAWIDTH(get_s##DATAWIDTH##b(hi_value)); \
+        ISA##_VEC unsigned_lo = ISA##_SET1_##DATAWIDTH((int##DATAWIDTH##_t)get_u##DATAWIDTH##b(user_value) ^ bias); \
+        ISA##_VEC unsigned_hi = ISA##_SET1_##DATAWIDTH((int##DATAWIDTH##_t)get_u##DATAWIDTH##b(hi_value) ^ bias); \
+        ISA##_VEC unsigned_bias = ISA##_SET1_##DATAWIDTH(bias); \
+        uint32_t aligned = ALIGNED_OFFSETS_MASK(stride); \
+        size_t i = 0, num_matches = 0; \
+        if (!want_signed && !want_unsigned) \
+            return 0; \
+        for ( ; i + ISA##_WIDTH <= count && i + ISA##_WIDTH + (DATAWIDTH)/8 - 1 <= memlength; \
+              i += ISA##_WIDTH) { \
+            uint32_t signed_mask = 0, unsigned_mask = 0; \
+            unsigned k; \
+            for (k = 0; k < (DATAWIDTH)/8; k += MIN(stride, (DATAWIDTH)/8)) { \
+                ISA##_VEC v = ISA##_LOAD(buffer + i + k); \
+                if (REVENDIAN) \
+                    v = ISA##_BSWAP_##DATAWIDTH(v); \
+                if (want_signed) \
+                    signed_mask |= spread_lanes(ISA##_LANES_##DATAWIDTH(ISA##_CMP_I##DATAWIDTH( \
+                        (OP), v, signed_lo, signed_hi)), k, (DATAWIDTH)/8); \
+                if (want_unsigned && !same_compare) \
+                    unsigned_mask |= spread_lanes(ISA##_LANES_##DATAWIDTH(ISA##_CMP_I##DATAWIDTH( \
+                        (OP), ISA##_XOR(v, unsigned_bias), unsigned_lo, unsigned_hi)), k, (DATAWIDTH)/8); \
+            } \
+            signed_mask &= aligned; \
+            if (same_compare) \
+                unsigned_mask = signed_mask; \
+            unsigned_mask &= aligned; \
+            if (UNLIKELY(signed_mask | unsigned_mask)) \
+                num_matches += store_block_matches(signed_mask, unsigned_mask, \
+                                                   flag_s##DATAWIDTH##b, flag_u##DATAWIDTH##b, i, \
+                                                   match_offsets + num_matches, saveflags + num_matches); \
+        } \
+        for ( ; i < count; i += stride) { \
+            match_flags flags = flags_empty; \
+            if (scan_routine_INTEGER##DATAWIDTH##_##MATCHTYPENAME##REVEND_STR( \
+                    (const mem64_t *)(buffer + i), memlength - i, NULL, user_value, &flags)) { \
+                match_offsets[num_matches] = i; \
+                saveflags[num_matches] = flags; \
+                ++num_matches; \
+            } \
+        } \
+        return num_matches; \
+    }
+
+#define DEFINE_SIMD_FLOAT_ROUTINE(ISA, DATAWIDTH, MATCHTYPENAME, OP, REVENDIAN, REVEND_STR) \
+    ISA##_TARGET static size_t scan_buffer_routine_FLOAT##DATAWIDTH##_##MATCHTYPENAME##REVEND_STR##_##ISA SCAN_BUFFER_ROUTINE_ARGUMENTS \
+    { \
+        const uservalue_t *hi_value = ((OP) == SIMD_RANGE) ? &user_value[1] : user_value; \
+        uint32_t aligned = ALIGNED_OFFSETS_MASK(stride); \
+        size_t i = 0, num_matches = 0; \
+        if (!(user_value->flags & flag_f##DATAWIDTH##b)) \
+            return 0; \
+        for ( ; i + ISA##_WIDTH <= count && i + ISA##_WIDTH + (DATAWIDTH)/8 - 1 <= memlength; \
+              i += ISA##_WIDTH) { \
+            uint32_t mask = 0; \
+            unsigned k; \
+            for (k = 0; k < (DATAWIDTH)/8; k += MIN(stride, (DATAWIDTH)/8)) { \
+                ISA##_VEC v = ISA##_LOAD(buffer + i + k); \
+                if (REVENDIAN) \
+                    v = ISA##_BSWAP_##DATAWIDTH(v); \
+                mask |= spread_lanes(ISA##_CMP_F##DATAWIDTH((OP), v, get_f##DATAWIDTH##b(user_value), \
+                                                             get_f##DATAWIDTH##b(hi_value)), \
+                                     k, (DATAWIDTH)/8); \
+            } \
+            mask &= aligned; \
+            if (UNLIKELY(mask)) \
+                num_matches += store_block_matches(mask, 0, flag_f##DATAWIDTH##b, flags_empty, i, \
+                                                   match_offsets + num_matches, saveflags + num_matches); \
+        } \
+        for ( ; i < count; i += stride) { \
+            match_flags flags = flags_empty; \
+            if (scan_routine_FLOAT##DATAWIDTH##_##MATCHTYPENAME##REVEND_STR( \
+                    (const mem64_t *)(buffer + i), memlength - i, NULL, user_value, &flags)) { \
+                match_offsets[num_matches] = i; \
+                saveflags[num_matches] = flags; \
+                ++num_matches; \
+            } \
+        } \
+        return num_matches; \
+    }
+
+#define DEFINE_SIMD_ROUTINES_FOR_ALL_MATCH_TYPES(ISA, KIND, DATAWIDTH, REVENDIAN, REVEND_STR) \
+    DEFINE_SIMD_##KIND##_ROUTINE(ISA, DATAWIDTH, EQUALTO, SIMD_EQUALTO, REVENDIAN, REVEND_STR) \
+    DEFINE_SIMD_##KIND##_ROUTINE(ISA, DATAWIDTH, GREATERTHAN, SIMD_GREATERTHAN, REVENDIAN, REVEND_STR) \
+    DEFINE_SIMD_##KIND##_ROUTINE(ISA, DATAWIDTH, LESSTHAN, SIMD_LESSTHAN, REVENDIAN, REVEND_STR) \
+    DEFINE_SIMD_##KIND##_ROUTINE(ISA, DATAWIDTH, RANGE, SIMD_RANGE, REVENDIAN, REVEND_STR)
+
+DEFINE_SIMD_ROUTINES_FOR_ALL_MATCH_TYPES(SSE2, INTEGER, 32, 0, )
+DEFINE_SIMD_INTEGER_ROUTINE(SSE2, 64, EQUALTO, SIMD_EQUALTO, 0, )
+DEFINE_SIMD_ROUTINES_FOR_ALL_MATCH_TYPES(SSE2, FLOAT, 32, 0, )
+DEFINE_SIMD_ROUTINES_FOR_ALL_MATCH_TYPES(SSE2, FLOAT, 64, 0, )
+
+DEFINE_SIMD_ROUTINES_FOR_ALL_MATCH_TYPES(AVX2, INTEGER, 32, 0, )
+DEFINE_SIMD_ROUTINES_FOR_ALL_MATCH_TYPES(AVX2, INTEGER, 32, 1, _REVENDIAN)
+DEFINE_SIMD_ROUTINES_FOR_ALL_MATCH_TYPES(AVX2, INTEGER, 64, 0, )
+DEFINE_SIMD_ROUTINES_FOR_ALL_MATCH_TYPES(AVX2, INTEGER, 64, 1, _REVENDIAN)
+DEFINE_SIMD_ROUTINES_FOR_ALL_MATCH_TYPES(AVX2, FLOAT, 32, 0, )
+DEFINE_SIMD_ROUTINES_FOR_ALL_MATCH_TYPES(AVX2, FLOAT, 32, 1, _REVENDIAN)
+DEFINE_SIMD_ROUTINES_FOR_ALL_MATCH_TYPES(AVX2, FLOAT, 64, 0, )
+DEFINE_SIMD_ROUTINES_FOR_ALL_MATCH_TYPES(AVX2, FLOAT, 64, 1, _REVENDIAN)
+
+#endif /* SCAN_SIMD_X86 */
+
+
 /***************************************************************/
 /* choose a routine according to scan_data_type and match_type */
 /***************************************************************/
@@ -650,6 +1219,7 @@ scan_routine_t sm_get_scanroutine(scan_data_type_t dt, scan_match_type_t mt, mat
 
     CHOOSE_ROUTINE(BYTEARRAY, VLT, MATCHANY, ANY)
     CHOOSE_ROUTINE(BYTEARRAY, VLT, MATCHUPDATE, UPDATE)
+    CHOOSE_ROUTINE(BYTEARRAY, VLT, MATCHGROUP, GROUP)
     CHOOSE_ROUTINE_VLT(BYTEARRAY, BYTEARRAY, MATCHEQUALTO, EQUALTO, uflags*8)
 
     CHOOSE_ROUTINE(STRING, VLT, MATCHANY, ANY)
@@ -659,6 +1229,108 @@ scan_routine_t sm_get_scanroutine(scan_data_type_t dt, scan_match_type_t mt, mat
     return NULL;
 }
 
+#define CHOOSE_BUFFER_ROUTINE(SCANDATATYPE, ROUTINEDATATYPENAME, SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    if ((dt == SCANDATATYPE) && (mt == SCANMATCHTYPE)) \
+    { \
+        return &scan_buffer_routine_##ROUTINEDATATYPENAME##_##ROUTINEMATCHTYPENAME; \
+    }
+
+#define CHOOSE_BUFFER_ROUTINE_FOR_BOTH_ENDIANS(SCANDATATYPE, ROUTINEDATATYPENAME, SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    if ((dt == SCANDATATYPE) && (mt == SCANMATCHTYPE)) { \
+        if (reverse_endianness) { \
+            return &scan_buffer_routine_##ROUTINEDATATYPENAME##_##ROUTINEMATCHTYPENAME##_REVENDIAN; \
+        } \
+        else { \
+            return &scan_buffer_routine_##ROUTINEDATATYPENAME##_##ROUTINEMATCHTYPENAME; \
+        } \
+    }
+
+#define CHOOSE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES(SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE(INTEGER8,   INTEGER8,   SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE(INTEGER16,  INTEGER16,  SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE(INTEGER32,  INTEGER32,  SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE(INTEGER64,  INTEGER64,  SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE(FLOAT32,    FLOAT32,    SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE(FLOAT64,    FLOAT64,    SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE(ANYINTEGER, ANYINTEGER, SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE(ANYFLOAT,   ANYFLOAT,   SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE(ANYNUMBER,  ANYNUMBER,  SCANMATCHTYPE, ROUTINEMATCHTYPENAME)
+
+#define CHOOSE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE(INTEGER8, INTEGER8, SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE_FOR_BOTH_ENDIANS(INTEGER16,  INTEGER16,  SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE_FOR_BOTH_ENDIANS(INTEGER32,  INTEGER32,  SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE_FOR_BOTH_ENDIANS(INTEGER64,  INTEGER64,  SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE_FOR_BOTH_ENDIANS(FLOAT32,    FLOAT32,    SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE_FOR_BOTH_ENDIANS(FLOAT64,    FLOAT64,    SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE_FOR_BOTH_ENDIANS(ANYINTEGER, ANYINTEGER, SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE_FOR_BOTH_ENDIANS(ANYFLOAT,   ANYFLOAT,   SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    CHOOSE_BUFFER_ROUTINE_FOR_BOTH_ENDIANS(ANYNUMBER,  ANYNUMBER,  SCANMATCHTYPE, ROUTINEMATCHTYPENAME)
+
+#if SCAN_SIMD_X86
+#define CHOOSE_SIMD_ROUTINE(ISA, SCANDATATYPE, ROUTINEDATATYPENAME, SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    if ((dt == SCANDATATYPE) && (mt == SCANMATCHTYPE) && !reverse_endianness) \
+    { \
+        return &scan_buffer_routine_##ROUTINEDATATYPENAME##_##ROUTINEMATCHTYPENAME##_##ISA; \
+    }
+
+#define CHOOSE_SIMD_ROUTINE_FOR_BOTH_ENDIANS(ISA, SCANDATATYPE, ROUTINEDATATYPENAME, SCANMATCHTYPE, ROUTINEMATCHTYPENAME) \
+    if ((dt == SCANDATATYPE) && (mt == SCANMATCHTYPE)) { \
+        if (reverse_endianness) { \
+            return &scan_buffer_routine_##ROUTINEDATATYPENAME##_##ROUTINEMATCHTYPENAME##_REVENDIAN_##ISA; \
+        } \
+        else { \
+            return &scan_buffer_routine_##ROUTINEDATATYPENAME##_##ROUTINEMATCHTYPENAME##_##ISA; \
+        } \
+    }
+
+#define CHOOSE_SIMD_ROUTINE_FOR_ALL_MATCH_TYPES(CHOOSER, ISA, SCANDATATYPE) \
+    CHOOSER(ISA, SCANDATATYPE, SCANDATATYPE, MATCHEQUALTO, EQUALTO) \
+    CHOOSER(ISA, SCANDATATYPE, SCANDATATYPE, MATCHGREATERTHAN, GREATERTHAN) \
+    CHOOSER(ISA, SCANDATATYPE, SCANDATATYPE, MATCHLESSTHAN, LESSTHAN) \
+    CHOOSER(ISA, SCANDATATYPE, SCANDATATYPE, MATCHRANGE, RANGE)
+
+static scan_buffer_routine_t get_simd_scanbufferroutine(scan_data_type_t dt, scan_match_type_t mt, bool reverse_endianness)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        CHOOSE_SIMD_ROUTINE_FOR_ALL_MATCH_TYPES(CHOOSE_SIMD_ROUTINE_FOR_BOTH_ENDIANS, AVX2, INTEGER32)
+        CHOOSE_SIMD_ROUTINE_FOR_ALL_MATCH_TYPES(CHOOSE_SIMD_ROUTINE_FOR_BOTH_ENDIANS, AVX2, INTEGER64)
+        CHOOSE_SIMD_ROUTINE_FOR_ALL_MATCH_TYPES(CHOOSE_SIMD_ROUTINE_FOR_BOTH_ENDIANS, AVX2, FLOAT32)
+        CHOOSE_SIMD_ROUTINE_FOR_ALL_MATCH_TYPES(CHOOSE_SIMD_ROUTINE_FOR_BOTH_ENDIANS, AVX2, FLOAT64)
+    }
+
+    CHOOSE_SIMD_ROUTINE_FOR_ALL_MATCH_TYPES(CHOOSE_SIMD_ROUTINE, SSE2, INTEGER32)
+    CHOOSE_SIMD_ROUTINE(SSE2, INTEGER64, INTEGER64, MATCHEQUALTO, EQUALTO)
+    CHOOSE_SIMD_ROUTINE_FOR_ALL_MATCH_TYPES(CHOOSE_SIMD_ROUTINE, SSE2, FLOAT32)
+    CHOOSE_SIMD_ROUTINE_FOR_ALL_MATCH_TYPES(CHOOSE_SIMD_ROUTINE, SSE2, FLOAT64)
+
+    return NULL;
+}
+#endif
+
+scan_buffer_routine_t sm_get_scanbufferroutine(scan_data_type_t dt, scan_match_type_t mt, bool reverse_endianness)
+{
+#if SCAN_SIMD_X86
+    scan_buffer_routine_t simd_routine = get_simd_scanbufferroutine(dt, mt, reverse_endianness);
+    if (simd_routine)
+        return simd_routine;
+#endif
+
+    CHOOSE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES(MATCHANY, ANY)
+    CHOOSE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(MATCHEQUALTO, EQUALTO)
+    CHOOSE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(MATCHNOTEQUALTO, NOTEQUALTO)
+    CHOOSE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(MATCHGREATERTHAN, GREATERTHAN)
+    CHOOSE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(MATCHLESSTHAN, LESSTHAN)
+    CHOOSE_BUFFER_ROUTINE_FOR_ALL_NUMBER_TYPES_AND_ENDIANS(MATCHRANGE, RANGE)
+
+    CHOOSE_BUFFER_ROUTINE(BYTEARRAY, BYTEARRAY, MATCHEQUALTO, EQUALTO)
+    CHOOSE_BUFFER_ROUTINE(STRING, STRING, MATCHEQUALTO, EQUALTO)
+
+    /* matches against old values use the per-offset routines */
+    return NULL;
+}
+
 /* Possible flags per scan data type: if an incoming uservalue has none of the
  * listed flags we're sure it's not going to be matched by the scan,
  * so we reject it without even trying */
@@ -676,6 +1348,11 @@ static match_flags possible_flags_for_scan_data_type[] = {
     [STRING]     = flags_max
 };
 
+match_flags sm_get_possible_flags(scan_data_type_t dt)
+{
+    return possible_flags_for_scan_data_type[dt];
+}
+
 bool sm_choose_scanroutine(scan_data_type_t dt, scan_match_type_t mt, const uservalue_t* uval, bool reverse_endianness)
 {
     match_flags uflags = uval ? uval->flags : flags_empty;
@@ -687,16 +1364,19 @@ bool sm_choose_scanroutine(scan_data_type_t dt, scan_match_type_t mt, const user
         mt == MATCHLESSTHAN    ||
         mt == MATCHRANGE       ||
         mt == MATCHINCREASEDBY ||
-        mt == MATCHDECREASEDBY)
+        mt == MATCHDECREASEDBY ||
+        mt == MATCHGROUP)
     {
         match_flags possible_flags = possible_flags_for_scan_data_type[dt];
         if ((possible_flags & uflags) == flags_empty) {
             /* There's no possibility to have a match, just abort */
             sm_scan_routine = NULL;
+            sm_scan_buffer_routine = NULL;
             return false;
         }
     }
 
     sm_scan_routine = sm_get_scanroutine(dt, mt, uflags, reverse_endianness);
+    sm_scan_buffer_routine = sm_scan_routine ? sm_get_scanbufferroutine(dt, mt, reverse_endianness) : NULL;
     return (sm_scan_routine != NULL);
 }
@@ -41,6 +41,25 @@ typedef enum {
     STRING
 } scan_data_type_t;
 
+/* The number of bytes a match of `flags` spans */
+static inline uint16_t flags_to_memlength(scan_data_type_t scan_data_type, match_flags flags)
+{
+    switch(scan_data_type)
+    {
+        case BYTEARRAY:
+        case STRING:
+            return flags;
+            break;
+        default: /* numbers */
+                 if (flags & flags_64b) return 8;
+            else if (flags & flags_32b) return 4;
+            else if (flags & flags_16b) return 2;
+            else if (flags & flags_8b ) return 1;
+            else    /* it can't be a variable of any size */ return 0;
+            break;
+    }
+}
+
 typedef enum {
     MATCHANY,                /* for snapshot */
     /* following: compare with a given value */
@@ -57,7 +76,9 @@ typedef enum {
     MATCHDECREASED,
     /* following: compare with both given value and old value */
     MATCHINCREASEDBY,
-    MATCHDECREASEDBY
+    MATCHDECREASEDBY,
+    /* following: compare with the members of a group, see scan_group */
+    MATCHGROUP
 } scan_match_type_t;
 
 
@@ -70,12 +91,57 @@ typedef unsigned int (*scan_routine_t)(const mem64_t *memory_ptr, size_t memleng
                                        const value_t *old_value, const uservalue_t *user_value, match_flags *saveflags);
 extern scan_routine_t sm_scan_routine;
 
+/* The most members of a group */
+#define MAX_GROUP_MEMBERS (16)
+
+/* A member of a group: a value of `data_type` matched by `routine`, a
+ * `scan_routine_t` of `match_type` with `values` (two for a range), at one
+ * of the offsets from `min_offset` to `max_offset` of the group */
+typedef struct {
+    scan_data_type_t data_type;
+    scan_match_type_t match_type;
+    uint16_t min_offset;
+    uint16_t max_offset;
+    uservalue_t values[2];
+    scan_routine_t routine;
+} scan_group_member;
+
+/* Values at given offsets or distances of each other, searched at once.
+ * A group is a bytearray of `length` bytes, from the first member, the
+ * anchor at offset 0, to the end of the last one at its furthest offset.
+ * It matches where all of its members match. */
+struct scan_group {
+    unsigned num_members;
+    uint16_t length;
+    scan_group_member members[MAX_GROUP_MEMBERS];
+};
+
+/* Matches the offsets below `count` that are multiples of `stride` (a power of two)
+ * of the memory area given by `buffer` and `memlength` (counted from the start
+ * of the buffer) against `user_value`, as a `scan_routine_t` without old value
+ * would do, called once per offset.
+ * The offsets that matched are stored into `match_offsets` and their flags into `saveflags`,
+ * both must have room for `count` entries.
+ * The match length is the width of the flags, see `flags_to_memlength()`.
+ * Returns the number of matches stored
+ */
+typedef size_t (*scan_buffer_routine_t)(const uint8_t *buffer, size_t count, size_t memlength,
+                                        size_t stride, const uservalue_t *user_value,
+                                        uint32_t *match_offsets, match_flags *saveflags);
+extern scan_buffer_routine_t sm_scan_buffer_routine;
+
 /* 
  * Choose the global scanroutine according to the given parameters, sm_scan_routine will be set.
+ * sm_scan_buffer_routine is set too, or NULL if there's none for these parameters.
  * Returns whether a proper routine has been found.
  */
 bool sm_choose_scanroutine(scan_data_type_t dt, scan_match_type_t mt, const uservalue_t* uval, bool reverse_endianness);
 
 scan_routine_t sm_get_scanroutine(scan_data_type_t dt, scan_match_type_t mt, match_flags uflags, bool reverse_endianness);
 
+scan_buffer_routine_t sm_get_scanbufferroutine(scan_data_type_t dt, scan_match_type_t mt, bool reverse_endianness);
+
+/* The flags that the matches of a scan of the given data type can have */
+match_flags sm_get_possible_flags(scan_data_type_t dt);
+
 #endif /* SCANROUTINES_H */
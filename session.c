@@ -0,0 +1,403 @@
+/*
+    Save the matches and the regions of a session to a file, and load them.
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "scanmem.h"
+#include "session.h"
+#include "show_message.h"
+
+static bool write_regions(FILE *file, const list_t *regions)
+{
+    const element_t *n;
+    uint32_t name_offset = 0;
+
+    for (n = regions->head; n; n = n->next) {
+        const region_t *r = n->data;
+        session_region saved;
+
+        memset(&saved, 0, sizeof(saved));
+        saved.start = (uintptr_t)r->start;
+        saved.size = r->size;
+        saved.load_addr = r->load_addr;
+        saved.id = r->id;
+        saved.name_offset = name_offset;
+        saved.type = r->type;
+        saved.flags = (r->flags.read ? SESSION_REGION_READ : 0) |
+                      (r->flags.write ? SESSION_REGION_WRITE : 0) |
+                      (r->flags.exec ? SESSION_REGION_EXEC : 0) |
+                      (r->flags.shared ? SESSION_REGION_SHARED : 0) |
+                      (r->flags.private ? SESSION_REGION_PRIVATE : 0);
+        name_offset += strlen(r->filename) + 1;
+        if (fwrite(&saved, sizeof(saved), 1, file) != 1)
+            return false;
+    }
+    for (n = regions->head; n; n = n->next) {
+        const region_t *r = n->data;
+
+        if (fwrite(r->filename, strlen(r->filename) + 1, 1, file) != 1)
+            return false;
+    }
+    return true;
+}
+
+bool sm_save_session(globals_t *vars, const char *path)
+{
+    session_header header;
+    const element_t *n;
+    char *tmp_path;
+    FILE *file;
+    size_t matches_size;
+    bool ret;
+
+    if (vars->matches == NULL) {
+        show_error("there are no matches to save, scan first.\n");
+        return false;
+    }
+    /* the matches of a snapshot are saved as swaths */
+    if (vars->matches->images && !materialize_snapshot(vars->matches)) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SESSION_MAGIC, sizeof(header.magic));
+    header.version = SESSION_VERSION;
+    header.pointer_size = sizeof(void *);
+    header.byte_order = SESSION_BYTE_ORDER;
+    header.scan_data_type = vars->options.scan_data_type;
+    header.encoding_shift = vars->matches->encoding.shift;
+    header.encoding_bits = vars->matches->encoding.bits;
+    header.num_matches = vars->num_matches;
+    header.num_regions = vars->regions->size;
+    for (n = vars->regions->head; n; n = n->next)
+        header.names_size += strlen(((region_t *)n->data)->filename) + 1;
+    header.matches_offset = sizeof(header) + header.num_regions * sizeof(session_region) +
+                            header.names_size;
+    header.matches_offset = (header.matches_offset + SESSION_ALIGNMENT - 1) /
+                            SESSION_ALIGNMENT * SESSION_ALIGNMENT;
+
+    /* a session loaded from `path` stays mapped from the file it was in */
+    if ((tmp_path = malloc(strlen(path) + sizeof(".tmp"))) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        return false;
+    }
+    sprintf(tmp_path, "%s.tmp", path);
+    if ((file = fopen(tmp_path, "wb")) == NULL) {
+        show_error("failed to open %s: %s\n", tmp_path, strerror(errno));
+        free(tmp_path);
+        return false;
+    }
+
+    ret = fwrite(&header, sizeof(header), 1, file) == 1 &&
+          write_regions(file, vars->regions) &&
+          fseek(file, header.matches_offset, SEEK_SET) == 0 &&
+          save_array(file, vars->matches, &matches_size) &&
+          (header.matches_size = matches_size) > 0 &&
+          fseek(file, 0, SEEK_SET) == 0 &&
+          fwrite(&header, sizeof(header), 1, file) == 1;
+    if (fclose(file) != 0)
+        ret = false;
+    if (ret && rename(tmp_path, path) != 0)
+        ret = false;
+    if (!ret) {
+        show_error("failed to write %s: %s\n", path, strerror(errno));
+        unlink(tmp_path);
+        free(tmp_path);
+        return false;
+    }
+    free(tmp_path);
+
+    show_info("saved %lu matches in %lu regions to %s.\n", vars->num_matches,
+              vars->regions->size, path);
+    return true;
+}
+
+/* Reads the header and the regions of the session file `fd` at `path`.
+ * Returns false if it is not a session file of this host. */
+static bool read_session(int fd, const char *path, session_header *header,
+                         session_region **regions, char **names)
+{
+    struct stat st;
+    off_t size;
+    size_t regions_size;
+
+    *regions = NULL;
+    *names = NULL;
+    if (fstat(fd, &st) == -1 || pread(fd, header, sizeof(*header), 0) != sizeof(*header) ||
+        memcmp(header->magic, SESSION_MAGIC, sizeof(header->magic)) != 0) {
+        show_error("%s is not a session of scanmem.\n", path);
+        return false;
+    }
+    if (header->version != SESSION_VERSION || header->pointer_size != sizeof(void *) ||
+        header->byte_order != SESSION_BYTE_ORDER) {
+        show_error("%s was saved by another version of scanmem, or on another host.\n", path);
+        return false;
+    }
+    size = st.st_size;
+    if (header->scan_data_type > STRING || header->num_regions > (uint64_t)size ||
+        header->names_size > (uint64_t)size ||
+        header->matches_offset % SESSION_ALIGNMENT != 0 ||
+        header->matches_offset < sizeof(*header) + header->num_regions * sizeof(session_region) +
+                                 header->names_size ||
+        header->matches_offset > (uint64_t)size ||
+        header->matches_size != (uint64_t)size - header->matches_offset)
+        goto invalid;
+
+    regions_size = header->num_regions * sizeof(session_region);
+    if ((*regions = malloc(regions_size + 1)) == NULL ||
+        (*names = malloc(header->names_size + 1)) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        free(*regions);
+        *regions = NULL;
+        return false;
+    }
+    if (pread(fd, *regions, regions_size, sizeof(*header)) != (ssize_t)regions_size ||
+        pread(fd, *names, header->names_size, sizeof(*header) + regions_size) !=
+            (ssize_t)header->names_size)
+        goto invalid;
+    (*names)[header->names_size] = '\0';
+
+    for (size_t i = 0; i < header->num_regions; i++) {
+        const session_region *s = &(*regions)[i];
+
+        if (s->name_offset >= header->names_size || s->start + s->size < s->start)
+            goto invalid;
+    }
+    return true;
+
+invalid:
+    show_error("%s is damaged.\n", path);
+    free(*regions);
+    free(*names);
+    *regions = NULL;
+    *names = NULL;
+    return false;
+}
+
+/* Whether the region `s` saved as `name` and the region `r` have the same
+ * place in the same mapping, e.g. the same segment of the same library */
+static bool same_mapping(const session_region *s, const char *name, const region_t *r)
+{
+    return s->type == r->type && strcmp(name, r->filename) == 0 &&
+           s->start - s->load_addr == (uintptr_t)r->start - r->load_addr;
+}
+
+/* Finds the region of `index` each of the saved regions is now, into
+ * `matched`, the position in `index`, or index->count if there is none.
+ * A region that didn't move is the one at the same address. The others are
+ * taken in order among the regions with their place in their mapping: for
+ * a library, its load address tells how much its regions moved. */
+static void match_regions(const session_header *header, const session_region *regions,
+                          const char *names, const region_index *index, size_t *matched)
+{
+    bool *used = calloc(index->count + 1, sizeof(bool));
+    size_t i, j, pos;
+
+    if (used == NULL) {
+        for (i = 0; i < header->num_regions; i++)
+            matched[i] = index->count;
+        return;
+    }
+
+    for (i = 0; i < header->num_regions; i++) {
+        const session_region *s = &regions[i];
+
+        pos = sm_find_region(index, (void *)(uintptr_t)s->start);
+        if (pos < index->count && (uintptr_t)index->regions[pos]->start == s->start &&
+            same_mapping(s, names + s->name_offset, index->regions[pos]) && !used[pos])
+            used[pos] = true;
+        else
+            pos = index->count;
+        matched[i] = pos;
+    }
+
+    for (i = 0; i < header->num_regions; i++) {
+        const session_region *s = &regions[i];
+        const char *name = names + s->name_offset;
+        size_t after = 0;
+
+        if (matched[i] != index->count)
+            continue;
+        /* after the region of the last one with the same place */
+        for (j = i; j-- > 0; ) {
+            if (matched[j] != index->count && same_mapping(s, name, index->regions[matched[j]])) {
+                after = matched[j] + 1;
+                break;
+            }
+        }
+        for (pos = after; pos < index->count; pos++)
+            if (!used[pos] && same_mapping(s, name, index->regions[pos]))
+                break;
+        if (pos < index->count)
+            used[pos] = true;
+        matched[i] = pos;
+    }
+    free(used);
+}
+
+/* Replaces the regions of `regions`, which are the ones of `index`, by the
+ * ones `matched` */
+static void keep_matched_regions(list_t *regions, const region_index *index,
+                                 const size_t *matched, size_t count)
+{
+    bool *kept = calloc(index->count + 1, sizeof(bool));
+    /* the regions are looked up before any of them is freed, `index`
+     * points to them */
+    bool *kept_elements = calloc(regions->size + 1, sizeof(bool));
+    element_t *n, *prev = NULL;
+    size_t i;
+
+    for (i = 0; kept && i < count; i++)
+        kept[matched[i]] = true;
+    for (n = regions->head, i = 0; kept && kept_elements && n; n = n->next, i++)
+        kept_elements[i] = kept[sm_find_region(index, ((region_t *)n->data)->start)];
+
+    for (n = regions->head, i = 0; n; i++) {
+        n = n->next;
+        if (kept_elements && kept_elements[i])
+            prev = prev ? prev->next : regions->head;
+        else
+            l_remove(regions, prev, NULL);
+    }
+    free(kept_elements);
+    free(kept);
+}
+
+static int compare_moves(const void *a, const void *b)
+{
+    const address_move *x = a, *y = b;
+
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+bool sm_load_session(globals_t *vars, const char *path)
+{
+    session_header header;
+    session_region *saved = NULL;
+    char *names = NULL;
+    matches_and_old_values_array *matches = NULL;
+    list_t *regions = NULL;
+    region_index *index = NULL;
+    size_t *matched = NULL;
+    address_move *moves = NULL;
+    size_t i, count = 0, lost = 0;
+    unsigned long num_matches;
+    flags_encoding encoding;
+    int fd;
+
+    if (vars->target == 0) {
+        show_error("no target specified, see `help pid`\n");
+        return false;
+    }
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        show_error("failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    if (!read_session(fd, path, &header, &saved, &names)) {
+        close(fd);
+        return false;
+    }
+
+    /* the swaths are used where they are in the file */
+    encoding = flags_encoding_for(sm_get_possible_flags(header.scan_data_type));
+    if (encoding.shift != header.encoding_shift || encoding.bits != header.encoding_bits ||
+        !(matches = map_array(fd, header.matches_offset, header.matches_size, encoding))) {
+        show_error("%s is damaged.\n", path);
+        goto fail;
+    }
+    close(fd);
+    fd = -1;
+
+    /* where the regions are now */
+    if ((regions = l_init()) == NULL ||
+        !sm_readmaps(vars->target, regions, REGION_ALL) ||
+        (index = sm_index_regions(regions)) == NULL ||
+        (matched = malloc((header.num_regions + 1) * sizeof(size_t))) == NULL ||
+        (moves = malloc((header.num_regions + 1) * sizeof(address_move))) == NULL) {
+        show_error("sorry, there was a problem getting a list of regions to search.\n");
+        goto fail;
+    }
+    match_regions(&header, saved, names, index, matched);
+
+    /* the matches follow their regions, the ones that are gone are dropped */
+    for (i = 0; i < header.num_regions; i++) {
+        const region_t *r;
+
+        if (matched[i] == index->count) {
+            lost++;
+            continue;
+        }
+        r = index->regions[matched[i]];
+        moves[count].start = (void *)(uintptr_t)saved[i].start;
+        moves[count].end = moves[count].start + MIN(saved[i].size, r->size);
+        moves[count].delta = (uintptr_t)r->start - saved[i].start;
+        count++;
+    }
+    qsort(moves, count, sizeof(address_move), compare_moves);
+    num_matches = header.num_matches;
+    if ((matches = move_matches(matches, &num_matches, moves, count)) == NULL) {
+        show_error("sorry, there was a memory allocation error.\n");
+        goto fail;
+    }
+    keep_matched_regions(regions, index, matched, header.num_regions);
+    if (lost > 0)
+        show_warn("%lu regions of the session are not mapped anymore, their matches are dropped.\n",
+                  (unsigned long)lost);
+
+    /* the session replaces the matches and the regions */
+    if (vars->matches)
+        free_array(vars->matches);
+    vars->matches = matches;
+    vars->num_matches = num_matches;
+    vars->options.scan_data_type = header.scan_data_type;
+    sm_regions_changed(vars);
+    l_destroy(vars->regions);
+    vars->regions = regions;
+
+    free(index);
+    free(matched);
+    free(moves);
+    free(saved);
+    free(names);
+    show_info("loaded %lu matches in %lu regions from %s.\n", vars->num_matches,
+              vars->regions->size, path);
+    return true;
+
+fail:
+    if (fd != -1)
+        close(fd);
+    free_array(matches);
+    l_destroy(regions);
+    free(index);
+    free(matched);
+    free(moves);
+    free(saved);
+    free(names);
+    return false;
+}
@@ -0,0 +1,76 @@
+/*
+    Save the matches and the regions of a session to a file, and load them.
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+
+/*
+ * A session file holds, at offsets from its start:
+ *   a session_header,
+ *   `num_regions` session_region, sorted by address,
+ *   `names_size` bytes of their file names, each one null-terminated,
+ *   at `matches_offset`, a multiple of SESSION_ALIGNMENT, the swaths of the
+ *   matches as save_array() saves them, which map_array() maps back.
+ * It is read by the same build of scanmem on the same host: the numbers are
+ * in the byte order of the host, and the addresses of its size.
+ */
+
+#define SESSION_MAGIC "SMSESION"
+#define SESSION_VERSION 1
+#define SESSION_BYTE_ORDER 0x0102
+/* a multiple of the page sizes */
+#define SESSION_ALIGNMENT 65536
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint16_t pointer_size;      /* sizeof(void *) */
+    uint16_t byte_order;        /* SESSION_BYTE_ORDER */
+    uint32_t scan_data_type;
+    uint8_t encoding_shift;     /* the flags_encoding of the swaths */
+    uint8_t encoding_bits;
+    uint8_t reserved[2];
+    uint64_t num_matches;
+    uint64_t num_regions;
+    uint64_t names_size;
+    uint64_t matches_offset;
+    uint64_t matches_size;
+} session_header;
+
+/* The flags of a session_region */
+#define SESSION_REGION_READ    (1 << 0)
+#define SESSION_REGION_WRITE   (1 << 1)
+#define SESSION_REGION_EXEC    (1 << 2)
+#define SESSION_REGION_SHARED  (1 << 3)
+#define SESSION_REGION_PRIVATE (1 << 4)
+
+typedef struct {
+    uint64_t start;
+    uint64_t size;
+    uint64_t load_addr;
+    uint32_t id;
+    uint32_t name_offset;       /* in the names */
+    uint8_t type;               /* a region_type_t */
+    uint8_t flags;              /* SESSION_REGION_* */
+    uint8_t reserved[6];
+} session_region;
+
+#endif /* SESSION_H */
@@ -0,0 +1,73 @@
+/*
+    Counters of the work of the scans.
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+sm_scan_stats scan_stats;
+
+/* the counters of the peek cache at the last reset, it keeps its own */
+static sm_peek_stats peek_base;
+
+static double seconds_since(const struct timespec *start, const struct timespec *now)
+{
+    return (now->tv_sec - start->tv_sec) + (now->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void phase_begin(phase_timer *timer, unsigned long matches_in)
+{
+    clock_gettime(CLOCK_MONOTONIC, &timer->wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &timer->cpu);
+    timer->matches_in = matches_in;
+}
+
+void phase_end(const phase_timer *timer, sm_scan_phase phase, unsigned long matches_out)
+{
+    sm_phase_stats *stats = &scan_stats.phases[phase];
+    struct timespec wall, cpu;
+
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+
+    stats->runs++;
+    stats->last_wall_seconds = seconds_since(&timer->wall, &wall);
+    stats->wall_seconds += stats->last_wall_seconds;
+    stats->cpu_seconds += seconds_since(&timer->cpu, &cpu);
+    stats->last_matches_in = timer->matches_in;
+    stats->last_matches_out = matches_out;
+}
+
+void sm_get_scan_stats(sm_scan_stats *stats)
+{
+    *stats = scan_stats;
+    sm_get_peek_stats(&stats->peek);
+    stats->peek.hits -= peek_base.hits;
+    stats->peek.misses -= peek_base.misses;
+    stats->peek.pages_read -= peek_base.pages_read;
+}
+
+void sm_reset_scan_stats(void)
+{
+    memset(&scan_stats, 0, sizeof(scan_stats));
+    sm_get_peek_stats(&peek_base);
+}
@@ -0,0 +1,43 @@
+/*
+    Counters of the work of the scans.
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <time.h>
+
+#include "scanmem.h"
+
+/* The counters, the scanning threads add to them at the same time */
+extern sm_scan_stats scan_stats;
+
+#define STATS_ADD(counter, n) \
+    ((void) __atomic_fetch_add(&scan_stats.counter, (n), __ATOMIC_RELAXED))
+
+/* The start of a phase, to time it */
+typedef struct {
+    struct timespec wall;
+    struct timespec cpu;
+    unsigned long matches_in;
+} phase_timer;
+
+void phase_begin(phase_timer *timer, unsigned long matches_in);
+void phase_end(const phase_timer *timer, sm_scan_phase phase, unsigned long matches_out);
+
+#endif /* STATS_H */
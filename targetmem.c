@@ -20,77 +20,601 @@
     along with this library.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "config.h"
+
 #include <string.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#if HAVE_PTHREAD
+# include <pthread.h>
+#endif
 
 #include "targetmem.h"
 #include "value.h"
+#include "show_message.h"
+#include "stats.h"
 
+/* Elements between two entries of the match index, at most */
+#define MATCH_INDEX_STRIDE (4096)
 
-matches_and_old_values_array *
-allocate_array (matches_and_old_values_array *array, size_t max_bytes)
+/* The match index: where to start looking for the nth match. There is an
+ * entry for the start of every swath, and every MATCH_INDEX_STRIDE elements
+ * into it, with the number of matches before that element. */
+typedef struct {
+    matches_and_old_values_swath *swath;
+    size_t index;
+    size_t matches_before;
+} match_index_entry;
+
+struct match_index {
+    size_t num_entries;
+    match_index_entry entries[0];
+};
+
+flags_encoding
+flags_encoding_for (match_flags possible_flags)
+{
+    flags_encoding encoding = { 0, 16 };
+    unsigned lowest, width;
+
+    if (possible_flags == flags_empty || possible_flags == flags_max)
+        return encoding;
+
+    lowest = __builtin_ctz(possible_flags);
+    width = 32 - __builtin_clz(possible_flags) - lowest;
+    if (width <= 8) {
+        encoding.shift = lowest;
+        encoding.bits = width <= 1 ? 1 : width <= 2 ? 2 : width <= 4 ? 4 : 8;
+    }
+    return encoding;
+}
+
+/* A chunk of swaths, see matches_and_old_values_array */
+struct swath_chunk {
+    struct swath_chunk *next;
+    size_t size;                /* this header included */
+    off_t offset;               /* in the chunk file, -1 for a chunk in memory */
+    uint8_t data[0];
+};
+
+/* the offset of a chunk mapped by map_array() */
+#define CHUNK_MAPPED ((off_t)-2)
+
+/* room kept at the end of every chunk for a link to the next one */
+#define CHUNK_LINK_BYTES (sizeof(matches_and_old_values_swath) + sizeof(void *))
+
+/* The unlinked temporary file with the chunks of the arrays in a file.
+ * All the chunks there are MATCHES_CHUNK_SIZE bytes, the offsets of the
+ * chunks that were freed are reused. */
+static struct {
+    int fd;
+    off_t size;
+    off_t *free_offsets;
+    size_t num_free;
+    size_t max_free;
+#if HAVE_PTHREAD
+    pthread_mutex_t lock;
+#endif
+} chunk_file = {
+    -1, 0, NULL, 0, 0,
+#if HAVE_PTHREAD
+    PTHREAD_MUTEX_INITIALIZER
+#endif
+};
+
+static void
+lock_chunk_file (void)
+{
+#if HAVE_PTHREAD
+    pthread_mutex_lock(&chunk_file.lock);
+#endif
+}
+
+static void
+unlock_chunk_file (void)
+{
+#if HAVE_PTHREAD
+    pthread_mutex_unlock(&chunk_file.lock);
+#endif
+}
+
+/* maps `size` bytes of the chunk file, from the offset of a freed chunk if
+ * they fit in one, or else from new chunks of the file, which is created if
+ * needed. Returns NULL if it fails. */
+static void *
+map_file_bytes (size_t size, off_t *offset)
+{
+    size_t file_bytes = (size + MATCHES_CHUNK_SIZE - 1) / MATCHES_CHUNK_SIZE * MATCHES_CHUNK_SIZE;
+    void *bytes;
+
+    lock_chunk_file();
+    if (chunk_file.fd == -1) {
+        const char *dir = getenv("TMPDIR");
+        char path[4096];
+
+        snprintf(path, sizeof(path), "%s/scanmem-matches-XXXXXX", dir && *dir ? dir : "/tmp");
+        if ((chunk_file.fd = mkstemp(path)) == -1) {
+            show_error("could not create a file for the matches in %s: %s\n",
+                       dir && *dir ? dir : "/tmp", strerror(errno));
+            unlock_chunk_file();
+            return NULL;
+        }
+        /* it goes away with the last mapping */
+        unlink(path);
+    }
+
+    if (file_bytes == MATCHES_CHUNK_SIZE && chunk_file.num_free > 0) {
+        *offset = chunk_file.free_offsets[--chunk_file.num_free];
+    } else {
+        if (ftruncate(chunk_file.fd, chunk_file.size + file_bytes) == -1) {
+            show_error("could not grow the file of the matches: %s\n", strerror(errno));
+            unlock_chunk_file();
+            return NULL;
+        }
+        *offset = chunk_file.size;
+        chunk_file.size += file_bytes;
+    }
+    unlock_chunk_file();
+
+    bytes = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, chunk_file.fd, *offset);
+    if (bytes == MAP_FAILED) {
+        show_error("could not map the file of the matches: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    /* the swaths and the images are written, then read, in order */
+    madvise(bytes, size, MADV_SEQUENTIAL);
+    return bytes;
+}
+
+/* unmaps the bytes mapped by map_file_bytes(), their chunks of the file
+ * can then be reused */
+static void
+unmap_file_bytes (void *bytes, size_t size, off_t offset)
+{
+    off_t end = offset + (size + MATCHES_CHUNK_SIZE - 1) / MATCHES_CHUNK_SIZE * MATCHES_CHUNK_SIZE;
+
+    munmap(bytes, size);
+
+    lock_chunk_file();
+#ifdef FALLOC_FL_PUNCH_HOLE
+    /* give the disk space back */
+    fallocate(chunk_file.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+              offset, end - offset);
+#endif
+    for ( ; offset < end; offset += MATCHES_CHUNK_SIZE) {
+        if (chunk_file.num_free == chunk_file.max_free) {
+            size_t max_free = chunk_file.max_free ? 2 * chunk_file.max_free : 64;
+            off_t *free_offsets = realloc(chunk_file.free_offsets, max_free * sizeof(off_t));
+
+            if (free_offsets) {
+                chunk_file.free_offsets = free_offsets;
+                chunk_file.max_free = max_free;
+            }
+        }
+        /* or the space is lost until the file is gone */
+        if (chunk_file.num_free < chunk_file.max_free)
+            chunk_file.free_offsets[chunk_file.num_free++] = offset;
+    }
+    unlock_chunk_file();
+}
+
+/* maps a chunk of the chunk file */
+static struct swath_chunk *
+map_chunk (void)
+{
+    off_t offset;
+    struct swath_chunk *chunk = map_file_bytes(MATCHES_CHUNK_SIZE, &offset);
+
+    if (chunk)
+        chunk->offset = offset;
+    return chunk;
+}
+
+static void
+unmap_chunk (struct swath_chunk *chunk)
+{
+    unmap_file_bytes(chunk, MATCHES_CHUNK_SIZE, chunk->offset);
+}
+
+static void
+free_chunk (struct swath_chunk *chunk)
+{
+    if (chunk->offset == -1)
+        free(chunk);
+    else if (chunk->offset == CHUNK_MAPPED)
+        munmap(chunk, chunk->size);
+    else
+        unmap_chunk(chunk);
+}
+
+/* adds an empty chunk to `array`, returns false if it can't be allocated */
+static bool
+add_chunk (matches_and_old_values_array *array)
+{
+    struct swath_chunk *chunk;
+
+    if (array->in_file) {
+        if (!(chunk = map_chunk()))
+            return false;
+    } else {
+        if (!(chunk = malloc(array->chunk_size)))
+            return false;
+        chunk->offset = -1;
+    }
+
+    chunk->next = NULL;
+    chunk->size = array->chunk_size;
+
+    if (array->last_chunk)
+        array->last_chunk->next = chunk;
+    else
+        array->first_chunk = chunk;
+    array->last_chunk = chunk;
+    array->chunk_end = (void *)chunk + chunk->size - CHUNK_LINK_BYTES;
+    array->bytes_allocated += chunk->size;
+    STATS_ADD(allocations, 1);
+    STATS_ADD(allocated_bytes, chunk->size);
+
+    return true;
+}
+
+static void
+free_image (snapshot_image *image)
+{
+    if (image->offset == -1)
+        free(image->data);
+    else
+        unmap_file_bytes(image->data, image->size, image->offset);
+}
+
+static void
+free_images (matches_and_old_values_array *array)
 {
-    /* make enough space for the array header and a null first swath */
-    size_t bytes_to_allocate =
-        sizeof(matches_and_old_values_array) +
-        sizeof(matches_and_old_values_swath);
+    size_t i;
 
-    if (!(array = realloc(array, bytes_to_allocate)))
+    for (i = 0; i < array->num_images; i++)
+        free_image(&array->images[i]);
+    free(array->images);
+    array->images = NULL;
+    array->num_images = 0;
+}
+
+static void
+free_chunks (matches_and_old_values_array *array)
+{
+    struct swath_chunk *chunk = array->first_chunk;
+
+    while (chunk) {
+        struct swath_chunk *next = chunk->next;
+
+        free_chunk(chunk);
+        chunk = next;
+    }
+    array->first_chunk = array->last_chunk = NULL;
+}
+
+matches_and_old_values_array *
+allocate_array (matches_and_old_values_array *array, size_t max_bytes,
+                flags_encoding encoding, bool in_file)
+{
+    /* the old matches are dropped */
+    if (array) {
+        invalidate_match_index(array);
+        free_images(array);
+        free_chunks(array);
+    } else if (!(array = malloc(sizeof(matches_and_old_values_array)))) {
         return NULL;
+    }
 
-    array->bytes_allocated = bytes_to_allocate;
+    array->bytes_allocated = sizeof(matches_and_old_values_array);
     array->max_needed_bytes = max_bytes;
+    array->encoding = encoding;
+    array->index = NULL;
+    array->cursor.location.swath = NULL;
+    array->in_file = in_file;
+    array->first_chunk = array->last_chunk = NULL;
+    array->images = NULL;
+    array->num_images = 0;
+    array->image_flags = flags_empty;
+    array->image_alignment = 1;
+
+    /* small arrays fit in a single chunk, the disk space of the chunks
+     * in a file is only taken when they are written */
+    array->chunk_size = sizeof(struct swath_chunk) + MAX(max_bytes, 4096) + CHUNK_LINK_BYTES;
+    array->chunk_size = MIN(array->chunk_size, MATCHES_CHUNK_SIZE);
+    if (in_file)
+        array->chunk_size = MATCHES_CHUNK_SIZE;
+
+    /* make enough space for a null first swath */
+    if (!add_chunk(array)) {
+        free(array);
+        return NULL;
+    }
+    array->swaths = (matches_and_old_values_swath *)array->first_chunk->data;
+    array->swaths->first_byte_in_child = NULL;
+    array->swaths->number_of_bytes = 0;
+    array->swaths->encoding = encoding;
 
     return array;
 }
 
+/* Ends the last chunk at `swath`, with a link to a new chunk. Returns where
+ * the next swath goes in the new chunk, or NULL after freeing the array. */
+static matches_and_old_values_swath *
+continue_in_new_chunk (matches_and_old_values_array **array,
+                       matches_and_old_values_swath *swath)
+{
+    matches_and_old_values_swath *next;
+
+#ifdef MADV_COLD
+    /* the full chunk is only read again by the next scan */
+    if ((*array)->in_file)
+        madvise((*array)->last_chunk, (*array)->chunk_size, MADV_COLD);
+#endif
+
+    if (!add_chunk(*array)) {
+        free_array(*array);
+        *array = NULL;
+        return NULL;
+    }
+
+    next = (matches_and_old_values_swath *)(*array)->last_chunk->data;
+    swath->first_byte_in_child = NULL;
+    swath->number_of_bytes = 0;
+    swath->encoding = (flags_encoding){ 0, 0 };
+    memcpy(swath->data, &next, sizeof(next));
+
+    return next;
+}
+
 matches_and_old_values_array *
 null_terminate (matches_and_old_values_array *array,
                 matches_and_old_values_swath *swath)
 {
+    struct swath_chunk *last = array->last_chunk;
+    struct swath_chunk *prev = NULL, *shrunk;
+    uintptr_t moved_from;
     size_t bytes_needed;
 
     if (swath->number_of_bytes == 0) {
         assert(swath->first_byte_in_child == NULL);
 
     } else {
-        swath = local_address_beyond_last_element(swath );
-        array = allocate_enough_to_reach(array, ((void *)swath) +
-                                         sizeof(matches_and_old_values_swath),
-                                         &swath);
+        /* there is always room for it, see CHUNK_LINK_BYTES */
+        swath = local_address_beyond_last_element(swath);
         swath->first_byte_in_child = NULL;
         swath->number_of_bytes = 0;
     }
+    swath->encoding = array->encoding;
 
-    bytes_needed = ((void *)swath + sizeof(matches_and_old_values_swath) -
-                    (void *)array);
+    /* with room for a link, should another chunk follow this one */
+    bytes_needed = (void *)swath + CHUNK_LINK_BYTES - (void *)last;
+    if (bytes_needed >= last->size || last->offset != -1)
+        return array;
 
-    if (bytes_needed < array->bytes_allocated) {
-        /* reduce array to its final size */
-        if (!(array = realloc(array, bytes_needed)))
-            return NULL;
+    /* the chunk before, that links to this one */
+    if (last != array->first_chunk)
+        for (prev = array->first_chunk; prev->next != last; prev = prev->next)
+            ;
+    moved_from = (uintptr_t)last;
+
+    /* reduce the last chunk to its final size */
+    if (!(shrunk = realloc(last, bytes_needed)))
+        return array;
 
-        array->bytes_allocated = bytes_needed;
+    array->bytes_allocated -= shrunk->size - bytes_needed;
+    shrunk->size = bytes_needed;
+    array->last_chunk = shrunk;
+    array->chunk_end = (void *)shrunk + shrunk->size;
+
+    /* fix what pointed into the chunk */
+    if ((uintptr_t)shrunk != moved_from) {
+        matches_and_old_values_swath *first = (matches_and_old_values_swath *)shrunk->data;
+
+        if (prev == NULL) {
+            array->first_chunk = shrunk;
+            array->swaths = first;
+        } else {
+            prev->next = shrunk;
+            /* the link is at the end of the previous chunk */
+            for (swath = (matches_and_old_values_swath *)prev->data;
+                 swath->encoding.bits != 0;
+                 swath = local_address_beyond_last_element(swath))
+                ;
+            memcpy(swath->data, &first, sizeof(first));
+        }
     }
 
     return array;
 }
 
+void
+free_array (matches_and_old_values_array *array)
+{
+    if (array) {
+        invalidate_match_index(array);
+        free_images(array);
+        free_chunks(array);
+    }
+    free(array);
+}
+
+uint8_t *
+add_image (matches_and_old_values_array *array, void *start, size_t size)
+{
+    snapshot_image *images = realloc(array->images, (array->num_images + 1) * sizeof(snapshot_image));
+    snapshot_image *image;
+
+    if (!images)
+        return NULL;
+    array->images = images;
+    image = &images[array->num_images];
+
+    image->start = start;
+    image->size = size;
+    if (array->in_file) {
+        image->data = map_file_bytes(size, &image->offset);
+    } else {
+        image->data = malloc(size);
+        image->offset = -1;
+    }
+    if (!image->data)
+        return NULL;
+    STATS_ADD(allocations, 1);
+    STATS_ADD(allocated_bytes, size);
+
+    array->num_images++;
+    return image->data;
+}
+
+void
+trim_image (matches_and_old_values_array *array, snapshot_image *image, size_t size)
+{
+    assert(size <= image->size);
+    if (size == image->size)
+        return;
+
+    if (size == 0) {
+        free_image(image);
+        memmove(image, image + 1, (array->images + --array->num_images - image) * sizeof(*image));
+        return;
+    }
+
+    if (image->offset == -1) {
+        uint8_t *data = realloc(image->data, size);
+
+        if (data)
+            image->data = data;
+    } else {
+        /* unmap the pages after the new end, the rest of their chunks
+         * of the file is not reused */
+        size_t page_size = sysconf(_SC_PAGESIZE);
+        size_t mapped = (image->size + page_size - 1) / page_size * page_size;
+        size_t kept = (size + page_size - 1) / page_size * page_size;
+
+        if (kept < mapped)
+            munmap(image->data + kept, mapped - kept);
+    }
+    image->size = size;
+}
+
+void *
+release_image_bytes (const snapshot_image *image, void *from, void *to)
+{
+    uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    /* only the whole pages can go */
+    uintptr_t first = ((uintptr_t)image->data + (from - image->start) + page_size - 1) & ~(page_size - 1);
+    uintptr_t last = ((uintptr_t)image->data + (to - image->start)) & ~(page_size - 1);
+
+    if (last <= first)
+        return from;
+#ifdef MADV_REMOVE
+    /* with the disk space of an image in the file */
+    if (image->offset != -1)
+        madvise((void *)first, last - first, MADV_REMOVE);
+    else
+#endif
+    madvise((void *)first, last - first, MADV_DONTNEED);
+    return image->start + (last - (uintptr_t)image->data);
+}
+
+bool
+materialize_snapshot (matches_and_old_values_array *array)
+{
+    matches_and_old_values_array *swaths;
+    matches_and_old_values_swath *swath;
+    size_t i;
+
+    if (!(swaths = allocate_array(NULL, array->max_needed_bytes, array->encoding, array->in_file)))
+        return false;
+    swath = swaths->swaths;
+    swath->first_byte_in_child = NULL;
+    swath->number_of_bytes = 0;
+
+    /* the bytes a snapshot scan would have recorded: the matches,
+     * and the bytes of their values after them */
+    for (i = 0; i < array->num_images; i++) {
+        const snapshot_image *image = &array->images[i];
+        size_t extra_bytes = 0;
+        size_t n;
+
+        for (n = 0; n < image->size; n++) {
+            match_flags flags = flags_of_image_byte(array, image, n);
+
+            if (flags == flags_empty && extra_bytes == 0)
+                continue;
+            swath = add_element(&swaths, swath, image->start + n, image->data[n], flags);
+            if (!swaths)
+                return false;
+
+            if (flags != flags_empty)
+                extra_bytes = flags & flags_64b ? 7 : flags & flags_32b ? 3 : flags & flags_16b ? 1 : 0;
+            else
+                --extra_bytes;
+        }
+    }
+    if (!(swaths = null_terminate(swaths, swath)))
+        return false;
+
+    /* the array takes the swaths */
+    free_images(array);
+    free_chunks(array);
+    *array = *swaths;
+    free(swaths);
+    return true;
+}
+
+void
+release_swaths_before (matches_and_old_values_array *array,
+                       matches_and_old_values_swath *swath)
+{
+    struct swath_chunk *chunk;
+
+    while ((chunk = array->first_chunk) != array->last_chunk &&
+           ((void *)swath < (void *)chunk || (void *)swath >= (void *)chunk + chunk->size)) {
+        array->first_chunk = chunk->next;
+        array->bytes_allocated -= chunk->size;
+        free_chunk(chunk);
+    }
+
+    /* the swaths left can only be read from `swath` */
+    array->swaths = NULL;
+    invalidate_match_index(array);
+}
+
+void
+invalidate_match_index (matches_and_old_values_array *array)
+{
+    free(array->index);
+    array->index = NULL;
+    array->cursor.location.swath = NULL;
+}
+
 void data_to_printable_string (char *buf, int buf_length,
                                matches_and_old_values_swath *swath,
                                size_t index, int string_length)
 {
-    long swath_length = swath->number_of_bytes - index;
     /* TODO: what if length is too large ? */
-    long max_length = (swath_length >= string_length) ? string_length : swath_length;
+    long max_length = elements_to_end_of_run(swath, index, string_length);
     int i;
 
-    for (i = 0; i < max_length; ++i) {
-        uint8_t byte = swath->data[index+i].old_value;
+    for (i = 0; i < max_length; ++i, ++index) {
+        uint8_t byte;
+
+        /* the string may go on in the next swath */
+        if (index >= swath->number_of_bytes) {
+            swath = next_swath(swath);
+            index = 0;
+        }
+        byte = old_value_of_nth_element(swath, index);
         buf[i] = isprint(byte) ? byte : '.';
     }
     buf[i] = 0; /* null-terminate */
@@ -102,14 +626,19 @@ void data_to_bytearray_text (char *buf, int buf_length,
 {
     int i;
     int bytes_used = 0;
-    long swath_length = swath->number_of_bytes - index;
 
     /* TODO: what if length is too large ? */
-    long max_length = (swath_length >= bytearray_length) ?
-                       bytearray_length : swath_length;
+    long max_length = elements_to_end_of_run(swath, index, bytearray_length);
 
-    for (i = 0; i < max_length; ++i) {
-        uint8_t byte = swath->data[index+i].old_value;
+    for (i = 0; i < max_length; ++i, ++index) {
+        uint8_t byte;
+
+        /* the bytearray may go on in the next swath */
+        if (index >= swath->number_of_bytes) {
+            swath = next_swath(swath);
+            index = 0;
+        }
+        byte = old_value_of_nth_element(swath, index);
 
         /* TODO: check error here */
         snprintf(buf+bytes_used, buf_length-bytes_used,
@@ -118,19 +647,84 @@ void data_to_bytearray_text (char *buf, int buf_length,
     }
 }
 
+/* builds the index of `matches`, returns false if it can't be allocated */
+static bool
+build_match_index (matches_and_old_values_array *matches)
+{
+    matches_and_old_values_swath *swath;
+    struct match_index *index;
+    size_t num_entries = 0;
+    size_t matches_before = 0;
+
+    for (swath = matches->swaths; swath->first_byte_in_child;
+         swath = next_swath(swath))
+        num_entries += 1 + (swath->number_of_bytes - 1) / MATCH_INDEX_STRIDE;
+
+    if (!(index = malloc(sizeof(struct match_index) +
+                         num_entries * sizeof(match_index_entry))))
+        return false;
+
+    index->num_entries = 0;
+    for (swath = matches->swaths; swath->first_byte_in_child;
+         swath = next_swath(swath)) {
+        size_t i;
+
+        for (i = 0; i < swath->number_of_bytes; i++) {
+            if (i % MATCH_INDEX_STRIDE == 0) {
+                match_index_entry *entry = &index->entries[index->num_entries++];
+
+                entry->swath = swath;
+                entry->index = i;
+                entry->matches_before = matches_before;
+            }
+            if (flags_of_nth_element(swath, i) != flags_empty)
+                ++matches_before;
+        }
+    }
+    assert(index->num_entries == num_entries);
+
+    matches->index = index;
+    return true;
+}
+
 match_location
 nth_match (matches_and_old_values_array *matches, size_t n)
 {
-    size_t i = 0;
+    size_t i;
     matches_and_old_values_swath *reading_swath_index;
     size_t reading_iterator = 0;
 
     assert(matches);
-    reading_swath_index = matches->swaths;
+
+    if (matches->index || build_match_index(matches)) {
+        const struct match_index *index = matches->index;
+        size_t low = 0, high = index->num_entries;
+
+        if (high == 0)
+            return (match_location){ NULL, 0 };
+
+        /* the last entry with at most n matches before it */
+        while (high - low > 1) {
+            size_t mid = low + (high - low) / 2;
+
+            if (index->entries[mid].matches_before <= n)
+                low = mid;
+            else
+                high = mid;
+        }
+        reading_swath_index = index->entries[low].swath;
+        reading_iterator = index->entries[low].index;
+        i = index->entries[low].matches_before;
+
+    } else {
+        /* without an index, count from the first match */
+        reading_swath_index = matches->swaths;
+        i = 0;
+    }
 
     while (reading_swath_index->first_byte_in_child) {
         /* only actual matches are considered */
-        if (reading_swath_index->data[reading_iterator].match_info != flags_empty) {
+        if (flags_of_nth_element(reading_swath_index, reading_iterator) != flags_empty) {
 
             if (i == n)
                 return (match_location){reading_swath_index, reading_iterator};
@@ -142,7 +736,7 @@ nth_match (matches_and_old_values_array *matches, size_t n)
         ++reading_iterator;
         if (reading_iterator >= reading_swath_index->number_of_bytes) {
             reading_swath_index =
-                local_address_beyond_last_element(reading_swath_index);
+                next_swath(reading_swath_index);
 
             reading_iterator = 0;
         }
@@ -152,62 +746,957 @@ nth_match (matches_and_old_values_array *matches, size_t n)
     return (match_location){ NULL, 0 };
 }
 
+match_location
+seek_match (matches_and_old_values_array *matches, size_t n)
+{
+    matches_and_old_values_swath *reading_swath_index = matches->cursor.location.swath;
+    size_t reading_iterator = matches->cursor.location.index;
+    size_t i = matches->cursor.n;
+    size_t steps;
+
+    /* further on, the index finds it with fewer steps */
+    if (reading_swath_index == NULL || n < i || n - i >= MATCH_INDEX_STRIDE)
+        return nth_match(matches, n);
+
+    for (steps = 0; reading_swath_index->first_byte_in_child; steps++) {
+        if (steps == MATCH_INDEX_STRIDE)
+            return nth_match(matches, n);
+
+        if (flags_of_nth_element(reading_swath_index, reading_iterator) != flags_empty) {
+            if (i == n)
+                return (match_location){reading_swath_index, reading_iterator};
+
+            ++i;
+        }
+
+        ++reading_iterator;
+        if (reading_iterator >= reading_swath_index->number_of_bytes) {
+            reading_swath_index = next_swath(reading_swath_index);
+            reading_iterator = 0;
+        }
+    }
+
+    return (match_location){ NULL, 0 };
+}
+
+void
+set_match_cursor (matches_and_old_values_array *matches, size_t n, match_location location)
+{
+    matches->cursor.n = n;
+    matches->cursor.location = location;
+}
+
+/* the first of the sorted `ranges` that ends after `address` */
+static size_t
+range_after (const address_range *ranges, size_t count, const void *address)
+{
+    size_t low = 0, high = count;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+
+        if (ranges[mid].end <= address)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+/* the bytes of an image left once the ranges are deleted, or SIZE_MAX if
+ * they don't start the image */
+static size_t
+image_bytes_kept (const snapshot_image *image, const address_range *ranges, size_t count)
+{
+    void *end = image->start + image->size;
+    size_t r = range_after(ranges, count, image->start);
+
+    if (r == count || ranges[r].start >= end)
+        return image->size;
+    if (ranges[r].end < end)
+        return SIZE_MAX;
+    return ranges[r].start <= image->start ? 0 : (size_t)(ranges[r].start - image->start);
+}
+
+/* drops the images of a snapshot in the ranges, and the ends of the images
+ * that are cut there, returns false if an image is cut elsewhere */
+static bool
+delete_images_in_address_ranges (matches_and_old_values_array *array,
+                                 unsigned long *num_matches,
+                                 const address_range *ranges, size_t count)
+{
+    size_t i;
+
+    for (i = 0; i < array->num_images; i++)
+        if (image_bytes_kept(&array->images[i], ranges, count) == SIZE_MAX)
+            return false;
+
+    *num_matches = 0;
+    for (i = 0; i < array->num_images; ) {
+        snapshot_image *image = &array->images[i];
+        size_t size = image_bytes_kept(image, ranges, count);
+
+        trim_image(array, image, size);
+        if (size > 0)
+            *num_matches += image_matches(array, &array->images[i++]);
+    }
+    return true;
+}
+
+/* the link or the null swath after the swaths of a chunk from `swath` on */
+static matches_and_old_values_swath *
+terminal_after (matches_and_old_values_swath *swath)
+{
+    while (swath->encoding.bits != 0 && swath->number_of_bytes > 0)
+        swath = local_address_beyond_last_element(swath);
+    return swath;
+}
+
+/* the address of the first element of a chunk, NULL if it is empty */
+static void *
+chunk_start (const struct swath_chunk *chunk)
+{
+    const matches_and_old_values_swath *first = (const matches_and_old_values_swath *)chunk->data;
+
+    return first->encoding.bits != 0 ? first->first_byte_in_child : NULL;
+}
+
+/* the number of matches in the swaths of a chunk */
+static unsigned long
+chunk_matches (struct swath_chunk *chunk)
+{
+    matches_and_old_values_swath *swath = (matches_and_old_values_swath *)chunk->data;
+    unsigned long matches = 0;
+    size_t i;
+
+    for (; swath->encoding.bits != 0 && swath->number_of_bytes > 0;
+         swath = local_address_beyond_last_element(swath))
+        for (i = 0; i < swath->number_of_bytes; i++)
+            if (flags_of_nth_element(swath, i) != flags_empty)
+                matches++;
+    return matches;
+}
+
+/* keeps the unused slots of the first block clear, as start_swath() does */
+static void
+clear_slots_before (matches_and_old_values_swath *swath)
+{
+    uint8_t *codes = swath->data + SWATH_BLOCK_ELEMENTS;
+    unsigned bits = swath->encoding.bits;
+    size_t slot;
+
+    for (slot = 0; slot < first_slot(swath); slot++) {
+        swath->data[slot] = 0;
+        if (bits == 16)
+            codes[2 * slot] = codes[2 * slot + 1] = 0;
+        else
+            codes[slot * bits / 8] &= ~(((1u << bits) - 1) << (slot * bits % 8));
+    }
+}
+
+/* Moves the elements from `address` on, which is in `swath` or before it,
+ * and the swaths after it in `chunk`, to a new chunk after `chunk`. Only
+ * the rest of `chunk` is copied, the other chunks stay where they are.
+ * Returns the chunk that starts at `address`, or NULL if there is not
+ * enough memory for it. */
+static struct swath_chunk *
+split_chunk (matches_and_old_values_array *array, struct swath_chunk *chunk,
+             matches_and_old_values_swath *swath, void *address)
+{
+    size_t cut = address > swath->first_byte_in_child ? address - swath->first_byte_in_child : 0;
+    matches_and_old_values_swath *terminal, *first;
+    struct swath_chunk *tail;
+    size_t terminal_bytes, slot, bytes, size;
+    uint8_t *from;
+
+    if (cut == 0 && (void *)swath == (void *)chunk->data)
+        return chunk;
+
+    terminal = terminal_after(swath);
+    terminal_bytes = terminal->encoding.bits == 0 ? CHUNK_LINK_BYTES : sizeof(matches_and_old_values_swath);
+    from = cut ? block_of_nth_element(swath, cut, &slot) : (uint8_t *)swath;
+    bytes = (void *)terminal + terminal_bytes - (void *)from;
+    if (cut)
+        bytes += sizeof(matches_and_old_values_swath);
+    size = sizeof(struct swath_chunk) + bytes + CHUNK_LINK_BYTES;
+
+    if (array->in_file && size <= MATCHES_CHUNK_SIZE) {
+        if (!(tail = map_chunk()))
+            return NULL;
+        tail->size = MATCHES_CHUNK_SIZE;
+    } else {
+        if (!(tail = malloc(size)))
+            return NULL;
+        tail->offset = -1;
+        tail->size = size;
+    }
+    STATS_ADD(allocations, 1);
+    STATS_ADD(allocated_bytes, tail->size);
+
+    first = (matches_and_old_values_swath *)tail->data;
+    if (cut) {
+        /* the blocks of the elements from `address` on are the same */
+        first->first_byte_in_child = address;
+        first->number_of_bytes = swath->number_of_bytes - cut;
+        first->encoding = swath->encoding;
+        memcpy(first->data, from, bytes - sizeof(matches_and_old_values_swath));
+        clear_slots_before(first);
+
+        truncate_swath(swath, cut);
+        swath = local_address_beyond_last_element(swath);
+    } else {
+        memcpy(first, from, bytes);
+    }
+
+    /* there is room for the link up to the end of the old terminal */
+    swath->first_byte_in_child = NULL;
+    swath->number_of_bytes = 0;
+    swath->encoding = (flags_encoding){ 0, 0 };
+    memcpy(swath->data, &first, sizeof(first));
+
+    tail->next = chunk->next;
+    chunk->next = tail;
+    if (array->last_chunk == chunk) {
+        array->last_chunk = tail;
+        array->chunk_end = (void *)tail + tail->size - CHUNK_LINK_BYTES;
+    }
+    array->bytes_allocated += tail->size;
+    invalidate_match_index(array);
+
+    return tail;
+}
+
+/* makes a chunk start at each of the sorted `addresses`, that have matches
+ * after them, returns false if there is not enough memory for it */
+static bool
+split_at_addresses (matches_and_old_values_array *array, void *const *addresses, size_t count)
+{
+    struct swath_chunk *chunk = array->first_chunk;
+    matches_and_old_values_swath *swath = (matches_and_old_values_swath *)chunk->data;
+    size_t i = 0;
+
+    while (i < count) {
+        if (swath->encoding.bits == 0) {
+            /* the chunks are in the order of their swaths */
+            chunk = chunk->next;
+            swath = (matches_and_old_values_swath *)chunk->data;
+            continue;
+        }
+        if (swath->number_of_bytes == 0)
+            break;
+        if (remote_address_of_last_element(swath) < addresses[i]) {
+            swath = local_address_beyond_last_element(swath);
+            continue;
+        }
+
+        if (!(chunk = split_chunk(array, chunk, swath, addresses[i])))
+            return false;
+        swath = (matches_and_old_values_swath *)chunk->data;
+        while (i < count && addresses[i] <= swath->first_byte_in_child)
+            i++;
+    }
+    return true;
+}
+
+/* makes the chunks from `first` on, linked by their `next`, the chunks of
+ * `array`, with their swaths linked in that order */
+static void
+link_chunks (matches_and_old_values_array *array, struct swath_chunk *first)
+{
+    struct swath_chunk *chunk;
+
+    array->first_chunk = first;
+    array->swaths = (matches_and_old_values_swath *)first->data;
+    array->bytes_allocated = sizeof(matches_and_old_values_array);
+
+    for (chunk = first; chunk; chunk = chunk->next) {
+        matches_and_old_values_swath *terminal =
+            terminal_after((matches_and_old_values_swath *)chunk->data);
+
+        terminal->first_byte_in_child = NULL;
+        terminal->number_of_bytes = 0;
+        if (chunk->next) {
+            matches_and_old_values_swath *next = (matches_and_old_values_swath *)chunk->next->data;
+
+            terminal->encoding = (flags_encoding){ 0, 0 };
+            memcpy(terminal->data, &next, sizeof(next));
+        } else {
+            terminal->encoding = array->encoding;
+            array->last_chunk = chunk;
+            array->chunk_end = (void *)chunk + chunk->size - CHUNK_LINK_BYTES;
+        }
+        array->bytes_allocated += chunk->size;
+    }
+    invalidate_match_index(array);
+}
+
 /* deletes matches in [start, end) and resizes the matches array */
 matches_and_old_values_array *
 delete_in_address_range (matches_and_old_values_array *array,
                          unsigned long *num_matches,
                          void *start_address, void *end_address)
 {
+    address_range range = { start_address, end_address };
+
+    return delete_in_address_ranges(array, num_matches, &range, 1);
+}
+
+matches_and_old_values_array *
+delete_in_address_ranges (matches_and_old_values_array *array,
+                          unsigned long *num_matches,
+                          const address_range *ranges, size_t count)
+{
+    matches_and_old_values_array *taken;
+    unsigned long taken_matches;
+
     assert(array);
 
-    size_t reading_iterator = 0;
-    matches_and_old_values_swath *reading_swath_index = array->swaths;
+    /* a snapshot keeps its images, unless one of them is cut */
+    if (array->images) {
+        if (delete_images_in_address_ranges(array, num_matches, ranges, count)) {
+            invalidate_match_index(array);
+            return array;
+        }
+        if (!materialize_snapshot(array))
+            goto fail;
+    }
+
+    /* the chunks of the matches in the ranges are dropped whole */
+    if (!(taken = take_address_ranges(array, num_matches, ranges, count, &taken_matches)))
+        goto fail;
+    free_array(taken);
+    return array;
+
+fail:
+    free_array(array);
+    *num_matches = 0;
+    return NULL;
+}
+
+matches_and_old_values_array *
+take_address_ranges (matches_and_old_values_array *array, unsigned long *num_matches,
+                     const address_range *ranges, size_t count, unsigned long *taken_matches)
+{
+    struct swath_chunk *chunk, *next;
+    struct swath_chunk *kept = NULL, **kept_end = &kept;
+    struct swath_chunk *moved = NULL, **moved_end = &moved;
+    matches_and_old_values_array *taken;
+    void **bounds;
+    size_t i;
+
+    if (!(taken = allocate_array(NULL, 0, array->encoding, array->in_file)))
+        return NULL;
+    taken->max_needed_bytes = array->max_needed_bytes;
+    *taken_matches = 0;
+
+    /* the images of a snapshot move whole, unless one of them is cut */
+    if (array->images) {
+        size_t moving = 0, kept_images = 0;
+
+        for (i = 0; i < array->num_images; i++) {
+            size_t size = image_bytes_kept(&array->images[i], ranges, count);
+
+            if (size == 0)
+                moving++;
+            else if (size != array->images[i].size)
+                break;
+        }
+        if (i < array->num_images) {
+            if (!materialize_snapshot(array))
+                goto fail;
+        } else {
+            /* the taken array is a snapshot of the same values */
+            if (!(taken->images = malloc(MAX(moving, 1) * sizeof(snapshot_image))))
+                goto fail;
+            taken->image_flags = array->image_flags;
+            taken->image_alignment = array->image_alignment;
+            for (i = 0; i < array->num_images; i++) {
+                snapshot_image *image = &array->images[i];
+
+                if (image_bytes_kept(image, ranges, count) == 0) {
+                    taken->images[taken->num_images++] = *image;
+                    *taken_matches += image_matches(array, image);
+                } else {
+                    array->images[kept_images++] = *image;
+                }
+            }
+            array->num_images = kept_images;
+            invalidate_match_index(array);
+            *num_matches -= *taken_matches;
+            return taken;
+        }
+    }
+
+    /* the ranges end up in chunks of their own */
+    if (!(bounds = malloc(2 * count * sizeof(void *))))
+        goto fail;
+    for (i = 0; i < count; i++) {
+        bounds[2 * i] = ranges[i].start;
+        bounds[2 * i + 1] = ranges[i].end;
+    }
+    if (!split_at_addresses(array, bounds, 2 * count)) {
+        free(bounds);
+        goto fail;
+    }
+    free(bounds);
+
+    for (chunk = array->first_chunk; chunk; chunk = next) {
+        void *start = chunk_start(chunk);
+        size_t r = start ? range_after(ranges, count, start) : count;
+
+        next = chunk->next;
+        chunk->next = NULL;
+        if (r < count && ranges[r].start <= start) {
+            *taken_matches += chunk_matches(chunk);
+            *moved_end = chunk;
+            moved_end = &chunk->next;
+        } else {
+            *kept_end = chunk;
+            kept_end = &chunk->next;
+        }
+    }
+
+    /* an array without matches keeps a chunk with its null swath */
+    if (moved) {
+        if (kept)
+            free_chunk(taken->first_chunk);
+        else
+            kept = taken->first_chunk;
+        link_chunks(taken, moved);
+    }
+    link_chunks(array, kept);
+
+    *num_matches -= *taken_matches;
+    return taken;
+
+fail:
+    free_array(taken);
+    return NULL;
+}
+
+/* the number of chunks a splice splits, or SIZE_MAX once there are `max` of them, and with
+ * `splits`, where they split each of the arrays of `swaths` */
+static size_t
+splice_splits (matches_and_old_values_swath *swaths[2], void **splits[2], size_t counts[2], size_t max)
+{
+    matches_and_old_values_swath *a = swaths[0], *b = swaths[1];
+    size_t total = 0;
+    int last = -1;
+
+    counts[0] = counts[1] = 0;
+    while (a->number_of_bytes || b->number_of_bytes) {
+        int side = !b->number_of_bytes ||
+                   (a->number_of_bytes && a->first_byte_in_child < b->first_byte_in_child) ? 0 : 1;
+        matches_and_old_values_swath **next = side ? &b : &a;
+
+        /* the other array is split where the swaths of this one come in */
+        if (last != -1 && side != last) {
+            if (++total >= max)
+                return SIZE_MAX;
+            if (splits)
+                splits[!side][counts[!side]] = (*next)->first_byte_in_child;
+            counts[!side]++;
+        }
+        last = side;
+        *next = next_swath(*next);
+    }
+    return total;
+}
+
+/* Merges `from` into `array` by linking their chunks in address order, with
+ * the chunks split where the matches of the other array come in, and frees
+ * `from`. Returns false, with both arrays kept, if the splits copy more than
+ * merging the swaths would, or if there is not enough memory for them. */
+static bool
+splice_arrays (matches_and_old_values_array *array, matches_and_old_values_array *from)
+{
+    matches_and_old_values_swath *swaths[2] = { array->swaths, from->swaths };
+    matches_and_old_values_array *arrays[2] = { array, from };
+    /* a split copies the rest of a chunk */
+    size_t chunk_size = MAX(array->chunk_size, from->chunk_size);
+    size_t max = (array->bytes_allocated + from->bytes_allocated) / chunk_size;
+    struct swath_chunk *first = NULL, **end = &first, *chunks[2];
+    void **splits[2] = { NULL, NULL };
+    size_t counts[2];
+    bool ret = false;
+    int i;
+
+    if (splice_splits(swaths, NULL, counts, max) == SIZE_MAX)
+        return false;
+    for (i = 0; i < 2; i++)
+        if (!(splits[i] = malloc(MAX(counts[i], 1) * sizeof(void *))))
+            goto out;
+    splice_splits(swaths, splits, counts, SIZE_MAX);
+    for (i = 0; i < 2; i++)
+        if (!split_at_addresses(arrays[i], splits[i], counts[i]))
+            goto out;
+
+    /* every chunk now has the matches of a single array between two of
+     * the other one */
+    chunks[0] = array->first_chunk;
+    chunks[1] = from->first_chunk;
+    while (chunks[0] || chunks[1]) {
+        struct swath_chunk *chunk;
+
+        i = !chunks[1] || (chunks[0] && chunk_start(chunks[0]) < chunk_start(chunks[1])) ? 0 : 1;
+        chunk = chunks[i];
+        chunks[i] = chunk->next;
+        *end = chunk;
+        end = &chunk->next;
+    }
+    *end = NULL;
+
+    link_chunks(array, first);
+    array->max_needed_bytes += from->max_needed_bytes;
+    from->first_chunk = from->last_chunk = NULL;
+    free_array(from);
+    ret = true;
+
+out:
+    free(splits[0]);
+    free(splits[1]);
+    return ret;
+}
+
+static int
+compare_images (const void *a, const void *b)
+{
+    const snapshot_image *x = a, *y = b;
 
-    matches_and_old_values_swath reading_swath = *reading_swath_index;
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+matches_and_old_values_array *
+merge_arrays (matches_and_old_values_array *array, matches_and_old_values_array *from)
+{
+    matches_and_old_values_array *merged = NULL;
+    matches_and_old_values_swath *swath, *a, *b;
+
+    assert(array && from);
+    assert(array->encoding.shift == from->encoding.shift &&
+           array->encoding.bits == from->encoding.bits);
+
+    /* snapshots of the same values just share their images */
+    if (array->images && from->images && array->image_flags == from->image_flags &&
+        array->image_alignment == from->image_alignment) {
+        snapshot_image *images = realloc(array->images, (array->num_images + from->num_images) *
+                                                        sizeof(snapshot_image));
+
+        if (!images)
+            goto fail;
+        memcpy(images + array->num_images, from->images, from->num_images * sizeof(snapshot_image));
+        array->images = images;
+        array->num_images += from->num_images;
+        qsort(array->images, array->num_images, sizeof(snapshot_image), compare_images);
+        array->max_needed_bytes += from->max_needed_bytes;
+        invalidate_match_index(array);
+
+        /* the images moved */
+        free(from->images);
+        from->images = NULL;
+        from->num_images = 0;
+        free_array(from);
+        return array;
+    }
+
+    /* nothing to merge with an array without matches */
+    if (!from->images && from->swaths->number_of_bytes == 0) {
+        free_array(from);
+        return array;
+    }
+    if (!array->images && array->swaths->number_of_bytes == 0) {
+        free_array(array);
+        return from;
+    }
+
+    if ((array->images && !materialize_snapshot(array)) ||
+        (from->images && !materialize_snapshot(from)))
+        goto fail;
+    if (splice_arrays(array, from))
+        return array;
+
+    if (!(merged = allocate_array(NULL, array->max_needed_bytes + from->max_needed_bytes,
+                                  array->encoding, array->in_file)))
+        goto fail;
 
-    matches_and_old_values_swath *writing_swath_index = array->swaths;
+    swath = merged->swaths;
+    swath->first_byte_in_child = NULL;
+    swath->number_of_bytes = 0;
 
-    writing_swath_index->first_byte_in_child = NULL;
-    writing_swath_index->number_of_bytes = 0;
+    /* No swath spans the matches of the other array, as a swath only bridges
+     * gaps of a few bytes: they can be taken whole, in address order */
+    for (a = array->swaths, b = from->swaths; a->first_byte_in_child || b->first_byte_in_child; ) {
+        matches_and_old_values_swath **next =
+            !b->first_byte_in_child ||
+            (a->first_byte_in_child && a->first_byte_in_child < b->first_byte_in_child) ? &a : &b;
+
+        swath = append_swath(&merged, swath, *next);
+        if (!merged)
+            goto fail;
+        *next = next_swath(*next);
+    }
+    if (!(merged = null_terminate(merged, swath)))
+        goto fail;
+
+    free_array(array);
+    free_array(from);
+    return merged;
+
+fail:
+    free_array(merged);
+    free_array(array);
+    free_array(from);
+    return NULL;
+}
+
+typedef struct {
+    address_move move;
+    matches_and_old_values_swath *first;    /* the first swath with elements of the move */
+} located_move;
+
+static int
+compare_moved_starts (const void *a, const void *b)
+{
+    const located_move *x = a, *y = b;
+    void *start_x = x->move.start + x->move.delta, *start_y = y->move.start + y->move.delta;
+
+    return start_x < start_y ? -1 : start_x > start_y;
+}
+
+/* the position in the sorted `moves` of the move of `address`, or `count`
+ * if there is none, looking from `pos` on */
+static size_t
+move_of_address (const address_move *moves, size_t count, size_t pos, void *address)
+{
+    while (pos < count && moves[pos].end <= address)
+        pos++;
+    return pos < count && moves[pos].start <= address ? pos : count;
+}
 
+matches_and_old_values_array *
+move_matches (matches_and_old_values_array *array, unsigned long *num_matches,
+              const address_move *moves, size_t count)
+{
+    matches_and_old_values_array *moved = NULL;
+    matches_and_old_values_swath *swath, *writing_swath;
+    located_move *located = NULL;
+    bool in_place = true;
+    size_t i, m;
+
+    assert(array && !array->images);
+
+    /* The swaths can keep their blocks if each one moves whole, by a
+     * multiple of the blocks, and if they stay in address order */
+    for (i = 0; i < count; i++) {
+        if (moves[i].delta % SWATH_BLOCK_ELEMENTS != 0 ||
+            (i > 0 && moves[i].start + moves[i].delta < moves[i - 1].end + moves[i - 1].delta))
+            in_place = false;
+    }
+    for (swath = array->swaths, m = 0; in_place && swath->first_byte_in_child;
+         swath = next_swath(swath)) {
+        m = move_of_address(moves, count, m, swath->first_byte_in_child);
+        if (m == count || moves[m].end <= remote_address_of_last_element(swath))
+            in_place = false;
+    }
+    if (in_place) {
+        for (swath = array->swaths, m = 0; swath->first_byte_in_child; swath = next_swath(swath)) {
+            m = move_of_address(moves, count, m, swath->first_byte_in_child);
+            swath->first_byte_in_child += moves[m].delta;
+        }
+        invalidate_match_index(array);
+        return array;
+    }
+
+    /* Or the matches of each move are copied in the order of their new
+     * addresses, into a new array */
+    if (!(located = malloc(MAX(count, 1) * sizeof(located_move))) ||
+        !(moved = allocate_array(NULL, array->max_needed_bytes, array->encoding, array->in_file)))
+        goto fail;
+    for (i = 0, swath = array->swaths; i < count; i++) {
+        while (swath->first_byte_in_child && remote_address_of_last_element(swath) < moves[i].start)
+            swath = next_swath(swath);
+        located[i].move = moves[i];
+        located[i].first = swath;
+    }
+    qsort(located, count, sizeof(located_move), compare_moved_starts);
+
+    writing_swath = moved->swaths;
+    *num_matches = 0;
+    for (i = 0; i < count; i++) {
+        const address_move *move = &located[i].move;
+
+        for (swath = located[i].first;
+             swath->first_byte_in_child && swath->first_byte_in_child < move->end;
+             swath = next_swath(swath)) {
+            size_t n;
+
+            for (n = 0; n < swath->number_of_bytes; n++) {
+                void *address = remote_address_of_nth_element(swath, n);
+                match_flags flags = flags_of_nth_element(swath, n);
+
+                if (address < move->start || address >= move->end)
+                    continue;
+                if (flags != flags_empty)
+                    ++(*num_matches);
+                writing_swath = add_element(&moved, writing_swath, address + move->delta,
+                                            old_value_of_nth_element(swath, n), flags);
+                if (!moved)
+                    goto fail;
+            }
+        }
+    }
+
+    free(located);
+    free_array(array);
+    return null_terminate(moved, writing_swath);
+
+fail:
+    free(located);
+    free_array(moved);
+    free_array(array);
     *num_matches = 0;
+    return NULL;
+}
+
+bool
+save_array (FILE *file, matches_and_old_values_array *array, size_t *size)
+{
+    static const uint8_t link[CHUNK_LINK_BYTES];
+    struct swath_chunk chunk = { NULL, sizeof(struct swath_chunk), CHUNK_MAPPED };
+    matches_and_old_values_swath null_swath = { NULL, 0, array->encoding };
+    matches_and_old_values_swath *swath;
+
+    assert(!array->images);
+
+    /* the chunk holds all the swaths, the null one, and room for a link */
+    for (swath = array->swaths; swath->first_byte_in_child; swath = next_swath(swath))
+        chunk.size += local_address_beyond_last_element(swath) - (void *)swath;
+    chunk.size += sizeof(null_swath) + CHUNK_LINK_BYTES;
+
+    if (fwrite(&chunk, sizeof(chunk), 1, file) != 1)
+        return false;
+    for (swath = array->swaths; swath->first_byte_in_child; swath = next_swath(swath))
+        if (fwrite(swath, local_address_beyond_last_element(swath) - (void *)swath, 1, file) != 1)
+            return false;
+    if (fwrite(&null_swath, sizeof(null_swath), 1, file) != 1 ||
+        fwrite(link, sizeof(link), 1, file) != 1)
+        return false;
+
+    *size = chunk.size;
+    return true;
+}
+
+matches_and_old_values_array *
+map_array (int fd, off_t offset, size_t size, flags_encoding encoding)
+{
+    matches_and_old_values_array *array;
+    matches_and_old_values_swath *swath;
+    struct swath_chunk *chunk;
+    void *end, *last = NULL;
+
+    if (size < sizeof(struct swath_chunk) + sizeof(matches_and_old_values_swath) + CHUNK_LINK_BYTES)
+        return NULL;
+    chunk = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, offset);
+    if (chunk == MAP_FAILED)
+        return NULL;
+    end = (void *)chunk + size - CHUNK_LINK_BYTES;
+
+    /* the swaths must stay in the chunk, in address order, and end with
+     * the null swath: only their headers are read */
+    for (swath = (matches_and_old_values_swath *)chunk->data; ;
+         swath = local_address_beyond_last_element(swath)) {
+        if ((void *)swath + sizeof(matches_and_old_values_swath) > end)
+            goto invalid;
+        if (swath->first_byte_in_child == NULL && swath->number_of_bytes == 0)
+            break;
+        if (swath->encoding.shift != encoding.shift || swath->encoding.bits != encoding.bits ||
+            swath->number_of_bytes == 0 || swath->number_of_bytes > size ||
+            (last && swath->first_byte_in_child <= last) ||
+            (uintptr_t)swath->first_byte_in_child + swath->number_of_bytes <
+                (uintptr_t)swath->first_byte_in_child ||
+            local_address_beyond_last_element(swath) > end)
+            goto invalid;
+        last = remote_address_of_last_element(swath);
+    }
+
+    if (!(array = malloc(sizeof(matches_and_old_values_array))))
+        goto invalid;
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->offset = CHUNK_MAPPED;
+
+    array->bytes_allocated = sizeof(matches_and_old_values_array) + size;
+    array->max_needed_bytes = size;
+    array->encoding = encoding;
+    array->index = NULL;
+    array->cursor.location.swath = NULL;
+    array->in_file = false;
+    array->chunk_size = size;
+    array->first_chunk = array->last_chunk = chunk;
+    array->chunk_end = end;
+    array->swaths = (matches_and_old_values_swath *)chunk->data;
+    array->images = NULL;
+    array->num_images = 0;
+    array->image_flags = flags_empty;
+    array->image_alignment = 1;
+    return array;
+
+invalid:
+    munmap(chunk, size);
+    return NULL;
+}
 
-    while (reading_swath.first_byte_in_child) {
-        void *address = reading_swath.first_byte_in_child + reading_iterator;
+/* starts a new swath at `swath`, with a first (empty) block */
+static matches_and_old_values_swath *
+start_swath (matches_and_old_values_array **array,
+             matches_and_old_values_swath *swath,
+             void *remote_address)
+{
+    size_t block_bytes = swath_block_bytes((*array)->encoding);
+
+    if ((void *)swath + sizeof(matches_and_old_values_swath) + block_bytes > (*array)->chunk_end &&
+        !(swath = continue_in_new_chunk(array, swath)))
+        return NULL;
+
+    swath->first_byte_in_child = remote_address;
+    swath->number_of_bytes = 0;
+    swath->encoding = (*array)->encoding;
+    memset(swath->data, 0, block_bytes);
+
+    return swath;
+}
+
+matches_and_old_values_swath *
+make_room_for_element (matches_and_old_values_array **array,
+                       matches_and_old_values_swath *swath,
+                       void *remote_address)
+{
+    if (swath->number_of_bytes == 0) {
+        assert(swath->first_byte_in_child == NULL);
+
+        /* we have to overwrite this as a new swath */
+        return start_swath(array, swath, remote_address);
+
+    } else {
+        size_t local_index_excess =
+            remote_address - remote_address_of_last_element(swath);
 
-        if (address < start_address || address >= end_address) {
-            old_value_and_match_info old_byte;
+        /* the blocks the intervening space would take */
+        size_t excess_blocks =
+            blocks_of_elements(swath, swath->number_of_bytes + local_index_excess) -
+            blocks_of_elements(swath, swath->number_of_bytes);
 
-            old_byte = reading_swath_index->data[reading_iterator];
+        size_t block_bytes = swath_block_bytes(swath->encoding);
 
-            /* Still a candidate. Write data.
-                (We can get away with overwriting in the same array because
-                 it is guaranteed to take up the same number of bytes or fewer,
-                 and because we copied out the reading swath metadata already.)
-                (We can get away with assuming that the pointers will stay
-                 valid, because as we never add more data to the array than
-                 there was before, it will not reallocate.) */
-            writing_swath_index = add_element(&array,
-                                      writing_swath_index, address,
-                                      old_byte.old_value, old_byte.match_info);
+        if (excess_blocks * block_bytes >=
+            sizeof(matches_and_old_values_swath) + block_bytes) {
+            /* It is more memory-efficient to start a new swath.
+             * The equal case is decided for a new swath, so that
+             * later we don't needlessly iterate through a bunch
+             * of empty values */
+            return start_swath(array, local_address_beyond_last_element(swath),
+                               remote_address);
 
-            /* actual matches are recorded */
-            if (old_byte.match_info != flags_empty)
-                ++(*num_matches);
+        } else if (excess_blocks > 0) {
+            /* It is more memory-efficient to write over the intervening
+               space with null values, the new blocks are cleared */
+            void *old_end = local_address_beyond_last_element(swath);
+
+            /* a new swath in the next chunk, if they don't fit */
+            if (old_end + excess_blocks * block_bytes > (*array)->chunk_end)
+                return start_swath(array, old_end, remote_address);
+
+            memset(old_end, 0, excess_blocks * block_bytes);
         }
 
-        /* go on to the next one... */
-        ++reading_iterator;
-        if (reading_iterator >= reading_swath.number_of_bytes) {
+        /* the intervening space is cleared in the last blocks */
+        swath->number_of_bytes += local_index_excess - 1;
+        return swath;
+    }
+}
 
-            reading_swath_index = (matches_and_old_values_swath *)
-                (&reading_swath_index->data[reading_swath.number_of_bytes]);
+matches_and_old_values_swath *
+truncate_from_address (matches_and_old_values_array *array,
+                       matches_and_old_values_swath *swath,
+                       void *address)
+{
+    struct swath_chunk *chunk;
 
-            reading_swath = *reading_swath_index;
+    while (swath->number_of_bytes && remote_address_of_last_element(swath) < address)
+        swath = next_swath(swath);
+    assert(swath->number_of_bytes > 0);
 
-            reading_iterator = 0;
+    if (swath->first_byte_in_child < address) {
+        truncate_swath(swath, address - swath->first_byte_in_child);
+    } else {
+        /* nothing is left of this swath, the next one goes here */
+        swath->first_byte_in_child = NULL;
+        swath->number_of_bytes = 0;
+    }
+
+    /* the chunks after the one of `swath` are dropped */
+    for (chunk = array->first_chunk;
+         (void *)swath < (void *)chunk || (void *)swath >= (void *)chunk + chunk->size;
+         chunk = chunk->next)
+        ;
+    while (chunk != array->last_chunk) {
+        struct swath_chunk *next = chunk->next->next;
+
+        array->bytes_allocated -= chunk->next->size;
+        free_chunk(chunk->next);
+        chunk->next = next;
+        if (next == NULL)
+            array->last_chunk = chunk;
+    }
+    array->chunk_end = (void *)chunk + chunk->size - CHUNK_LINK_BYTES;
+
+    return swath;
+}
+
+matches_and_old_values_swath *
+append_swath (matches_and_old_values_array **array,
+              matches_and_old_values_swath *swath,
+              const matches_and_old_values_swath *from)
+{
+    size_t block_bytes = swath_block_bytes(from->encoding);
+    const uint8_t *blocks;
+    size_t i;
+
+    assert(from->number_of_bytes > 0);
+    assert(from->encoding.shift == (*array)->encoding.shift &&
+           from->encoding.bits == (*array)->encoding.bits);
+
+    /* the elements of the first block decide if `swath` is continued */
+    for (i = 0; i < from->number_of_bytes && (i == 0 || blocks_of_elements(from, i + 1) == 1); i++) {
+        swath = add_element(array, swath, from->first_byte_in_child + i,
+                            old_value_of_nth_element(from, i), flags_of_nth_element(from, i));
+        if (!*array)
+            return NULL;
+    }
+    if (i == from->number_of_bytes)
+        return swath;
+
+    /* the next blocks are the same in both swaths, as the last element
+     * of `swath` now fills its last block */
+    blocks = from->data + block_bytes;
+    while (i < from->number_of_bytes) {
+        void *end = local_address_beyond_last_element(swath);
+        size_t count = MIN(((*array)->chunk_end - end) / block_bytes,
+                           blocks_of_elements(from, from->number_of_bytes) - (blocks - from->data) / block_bytes);
+        size_t elements = MIN(count * SWATH_BLOCK_ELEMENTS, from->number_of_bytes - i);
+
+        /* the chunk is full, go on in a new swath */
+        if (count == 0) {
+            if (!(swath = start_swath(array, end, from->first_byte_in_child + i)))
+                return NULL;
+            continue;
         }
+
+        memcpy(end, blocks, count * block_bytes);
+        swath->number_of_bytes += elements;
+        blocks += count * block_bytes;
+        i += elements;
     }
 
-    return null_terminate(array, writing_swath_index);
+    return swath;
 }
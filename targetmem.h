@@ -29,37 +29,56 @@
 #include <stdlib.h>
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <sys/types.h>
 
+#include "common.h"
 #include "value.h"
 #include "show_message.h"
 
 /* Public structs */
 
-/* Single match struct */
+/* How the flags of the matches are stored. A scan data type can only give a few
+   of the flags, e.g. only flag_s32b and flag_u32b for INTEGER32, so they are
+   stored as `bits` wide codes: the flags shifted down by `shift`.
+   16 bits store the flags as they are (e.g. for the lengths of VLT matches). */
 typedef struct {
-    uint8_t old_value;
-    match_flags match_info;
-} old_value_and_match_info;
+    uint8_t shift;
+    uint8_t bits;       /* 1, 2, 4, 8 or 16 */
+} flags_encoding;
+
+/* Number of elements in a block of swath data */
+#define SWATH_BLOCK_ELEMENTS (8)
 
 /* Array that contains a consecutive (in memory) sequence of matches (= swath).
    - the first_byte_in_child pointer refers to locations in the child,
      it cannot be followed except using ptrace()
    - the number_of_bytes refers to the number of bytes in the child
      process's memory that are covered, not the number of bytes the struct
-     takes up. It's the length of data. */
-typedef struct __attribute__((packed,aligned(sizeof(old_value_and_match_info)))) {
+     takes up. It's the length of data.
+   - data is made of blocks, each one has the old values of
+     SWATH_BLOCK_ELEMENTS addresses, followed by their flags in `encoding`.
+     The element at an address is at the slot of the address modulo
+     SWATH_BLOCK_ELEMENTS in its block, so that the swaths covering the
+     same addresses have the same blocks, some slots of the first and the
+     last block can be unused. */
+typedef struct __attribute__((packed)) {
     void *first_byte_in_child;
     size_t number_of_bytes;
-    old_value_and_match_info data[0];
+    flags_encoding encoding;
+    uint8_t data[0];
 } matches_and_old_values_swath;
 
-/* Master matches array, smartly resized, contains swaths.
-   Both `bytes` values refer to real struct bytes this time. */
+/* Size of the chunks holding the swaths of an array, at most */
+#define MATCHES_CHUNK_SIZE (4 * 1024 * 1024)
+
+/* The memory of a region as a snapshot read it, see matches_and_old_values_array */
 typedef struct {
-    size_t bytes_allocated;
-    size_t max_needed_bytes;
-    matches_and_old_values_swath swaths[0];
-} matches_and_old_values_array;
+    void *start;
+    size_t size;                /* the bytes that could be read */
+    off_t offset;               /* in the temporary file, -1 for an image in memory */
+    uint8_t *data;
+} snapshot_image;
 
 /* Location of a match in a matches_and_old_values_array */
 typedef struct {
@@ -67,15 +86,95 @@ typedef struct {
     size_t index;
 } match_location;
 
+/* Where the last listing of the matches stopped: the next one resumes
+   there instead of looking for its first match. It is dropped with the
+   match index, when the matches change. */
+typedef struct {
+    size_t n;                   /* number of the match at `location` */
+    match_location location;    /* no swath if there is no listing */
+} match_cursor;
+
+/* Master matches array, contains swaths.
+   - the swaths are in a list of chunks, that are added as the array grows;
+     a swath doesn't straddle two chunks, the elements that don't fit go
+     into a new swath, which continues it from the next address.
+   - a full chunk ends with a link: a swath header with no encoding, its
+     data is a pointer to the first swath of the next chunk. Use
+     next_swath() to go through the swaths.
+   - the last swath is null (no address and no bytes).
+   - after a snapshot, the swaths are empty and the matches are the bytes of
+     the images instead: every aligned byte is a match with the flags of
+     `image_flags` that fit before the end of its image. materialize_snapshot()
+     turns them into swaths for the code that needs them.
+   Both `bytes` values refer to real struct bytes this time. */
+typedef struct {
+    size_t bytes_allocated;     /* for all the chunks */
+    size_t max_needed_bytes;    /* the chunks are sized for it */
+    flags_encoding encoding;    /* of the swaths added to the array */
+    struct match_index *index;  /* built by nth_match() when needed */
+    match_cursor cursor;        /* set by set_match_cursor() */
+    bool in_file;               /* the chunks are mapped from a temporary file */
+    size_t chunk_size;
+    struct swath_chunk *first_chunk;
+    struct swath_chunk *last_chunk;
+    void *chunk_end;            /* where the swaths of the last chunk must end */
+    matches_and_old_values_swath *swaths;
+    snapshot_image *images;     /* NULL if not a snapshot */
+    size_t num_images;
+    match_flags image_flags;    /* what the bytes of the images can be */
+    size_t image_alignment;     /* only its multiples are matches */
+} matches_and_old_values_array;
+
+/* The addresses [start, end) of the target */
+typedef struct {
+    void *start;
+    void *end;
+} address_range;
+
 
 /* Public functions */
 
+/* the encoding for matches that can only have some of the `possible_flags` */
+flags_encoding flags_encoding_for (match_flags possible_flags);
+
+/* With `in_file`, the chunks of the array are in a temporary file, which
+   the kernel can write them to instead of keeping them in memory */
 matches_and_old_values_array *allocate_array (matches_and_old_values_array *array,
-                                              size_t max_bytes);
+                                              size_t max_bytes, flags_encoding encoding,
+                                              bool in_file);
 
 matches_and_old_values_array *null_terminate (matches_and_old_values_array *array,
                                               matches_and_old_values_swath *swath);
 
+/* adds an image of `size` bytes from `start` to the snapshot `array`,
+   returns where to read them or NULL */
+uint8_t *add_image (matches_and_old_values_array *array, void *start, size_t size);
+
+/* drops the bytes of an image after the first `size`, or the whole image
+   if none of them: the images after it move down */
+void trim_image (matches_and_old_values_array *array, snapshot_image *image, size_t size);
+
+/* releases the memory of the bytes of an image in [from, to), for a snapshot
+   that is freed once it has been read up to there. Returns where the bytes
+   that were left start, for the next call. */
+void *release_image_bytes (const snapshot_image *image, void *from, void *to);
+
+/* puts the matches of the images of a snapshot into swaths,
+   returns false if there is not enough memory for them */
+bool materialize_snapshot (matches_and_old_values_array *array);
+
+/* frees the array, with its match index */
+void free_array (matches_and_old_values_array *array);
+
+/* frees the chunks before the one of `swath`, for an array that is freed
+   once it has been read up to there */
+void release_swaths_before (matches_and_old_values_array *array,
+                            matches_and_old_values_swath *swath);
+
+/* to be called after the flags of some elements were changed in place,
+   it drops the cursor as well */
+void invalidate_match_index (matches_and_old_values_array *array);
+
 /* for printable text representation */
 void data_to_printable_string (char *buf, int buf_length,
                                matches_and_old_values_swath *swath,
@@ -88,15 +187,125 @@ void data_to_bytearray_text (char *buf, int buf_length,
 
 match_location nth_match (matches_and_old_values_array *matches, size_t n);
 
+/* the same, from the cursor if match `n` is at it or a little after it */
+match_location seek_match (matches_and_old_values_array *matches, size_t n);
+
+/* records that match `n` is at `location`, for the next seek_match() */
+void set_match_cursor (matches_and_old_values_array *matches, size_t n,
+                       match_location location);
+
 /* deletes matches in [start, end) and resizes the matches array */
 matches_and_old_values_array *
 delete_in_address_range (matches_and_old_values_array *array,
                          unsigned long *num_matches,
                          void *start_address, void *end_address);
 
+/* the same for the sorted and disjoint `ranges`, in a single pass. The
+   chunks of the matches left are kept, only the chunks cut by the ranges
+   are copied, and the matches in the ranges are counted */
+matches_and_old_values_array *
+delete_in_address_ranges (matches_and_old_values_array *array,
+                          unsigned long *num_matches,
+                          const address_range *ranges, size_t count);
+
+/* moves the matches in the sorted and disjoint `ranges` of `array` to a new
+   array, for `*taken_matches` of the `*num_matches`, splitting the chunks
+   at the ends of the ranges: the other chunks just move. The images of a
+   snapshot move whole, unless the ranges cut one of them: then the snapshot
+   is materialized. Returns the new array, or NULL if there is not enough
+   memory for it, with `array` holding all the matches still. */
+matches_and_old_values_array *
+take_address_ranges (matches_and_old_values_array *array, unsigned long *num_matches,
+                     const address_range *ranges, size_t count, unsigned long *taken_matches);
+
+/* moves the matches of `from` into `array`, and frees `from`. The matches
+   must be at addresses of their own, pages away from the ones of the other
+   array. When they come in few runs, the chunks of both arrays are linked
+   together instead of copied. Returns the array of all the matches, or NULL
+   if there is not enough memory for it, with both arrays freed. */
+matches_and_old_values_array *
+merge_arrays (matches_and_old_values_array *array, matches_and_old_values_array *from);
+
+/* A move of the matches in [start, end) of the target by `delta` bytes */
+typedef struct {
+    void *start;
+    void *end;
+    intptr_t delta;
+} address_move;
+
+/* moves the matches in each of the sorted and disjoint `moves`, and drops
+   the others, for an array that is not a snapshot. Returns the array of the
+   moved matches, which is `array` if its swaths could move in place, or NULL
+   if there is not enough memory for it, with `array` freed. */
+matches_and_old_values_array *
+move_matches (matches_and_old_values_array *array, unsigned long *num_matches,
+              const address_move *moves, size_t count);
+
+/* writes the swaths of `array`, which is not a snapshot, to `file` as a
+   single chunk that map_array() maps back, and its size to `*size`.
+   Returns false if the file can't be written. */
+bool save_array (FILE *file, matches_and_old_values_array *array, size_t *size);
+
+/* maps the `size` bytes at `offset` of `fd` written by save_array(), at a
+   multiple of the page size, as the array of matches in `encoding`. The
+   mapping is private, changes to the array don't go to the file, and the
+   file must not be truncated while it is mapped. Returns NULL if the bytes
+   are not such an array, or if they can't be mapped. */
+matches_and_old_values_array *
+map_array (int fd, off_t offset, size_t size, flags_encoding encoding);
+
+/* makes `remote_address` the next element of `swath`, or of a new swath
+   started after it, and returns the swath to add the element to */
+matches_and_old_values_swath *
+make_room_for_element (matches_and_old_values_array **array,
+                       matches_and_old_values_swath *swath,
+                       void *remote_address);
+
+/* drops the elements at `address` and after it, which are in `swath` or the
+   swaths after it, returns the swath to add the next elements to */
+matches_and_old_values_swath *
+truncate_from_address (matches_and_old_values_array *array,
+                       matches_and_old_values_swath *swath,
+                       void *address);
+
+/* appends the elements of `from` to `swath`, as `add_element()` would one by one */
+matches_and_old_values_swath *
+append_swath (matches_and_old_values_array **array,
+              matches_and_old_values_swath *swath,
+              const matches_and_old_values_swath *from);
+
 /* The following functions are called in the hot scanning path and were moved
    to this header from the .c file so that they could be inlined */
 
+static inline size_t
+swath_block_bytes (flags_encoding encoding)
+{
+    /* SWATH_BLOCK_ELEMENTS values, then as many codes */
+    return SWATH_BLOCK_ELEMENTS + SWATH_BLOCK_ELEMENTS * encoding.bits / 8;
+}
+
+/* slot of the first element in the first block */
+static inline size_t
+first_slot (const matches_and_old_values_swath *swath)
+{
+    return (uintptr_t)swath->first_byte_in_child % SWATH_BLOCK_ELEMENTS;
+}
+
+/* number of blocks taken by the first `n` elements */
+static inline size_t
+blocks_of_elements (const matches_and_old_values_swath *swath, size_t n)
+{
+    return n ? (first_slot(swath) + n + SWATH_BLOCK_ELEMENTS - 1) / SWATH_BLOCK_ELEMENTS : 0;
+}
+
+/* the most bytes that a swath covering `n` bytes can take */
+static inline size_t
+swath_bytes_bound (size_t n, flags_encoding encoding)
+{
+    return sizeof(matches_and_old_values_swath) +
+           (n / SWATH_BLOCK_ELEMENTS + 2) * swath_block_bytes(encoding);
+}
+
 static inline size_t
 index_of_last_element (matches_and_old_values_swath *swath)
 {
@@ -115,62 +324,148 @@ remote_address_of_last_element (matches_and_old_values_swath *swath)
     return (remote_address_of_nth_element(swath, index_of_last_element(swath)));
 }
 
-static inline void *
-local_address_beyond_nth_element (matches_and_old_values_swath *swath, size_t n)
+/* the block holding the nth element, with the slot of the element in it */
+static inline uint8_t *
+block_of_nth_element (const matches_and_old_values_swath *swath, size_t n, size_t *slot)
+{
+    size_t element = first_slot(swath) + n;
+
+    *slot = element % SWATH_BLOCK_ELEMENTS;
+    return (uint8_t *)swath->data +
+           element / SWATH_BLOCK_ELEMENTS * swath_block_bytes(swath->encoding);
+}
+
+static inline uint8_t
+old_value_of_nth_element (const matches_and_old_values_swath *swath, size_t n)
+{
+    size_t slot;
+    const uint8_t *block = block_of_nth_element(swath, n, &slot);
+
+    return block[slot];
+}
+
+static inline match_flags
+flags_of_nth_element (const matches_and_old_values_swath *swath, size_t n)
+{
+    size_t slot;
+    const uint8_t *codes = block_of_nth_element(swath, n, &slot) + SWATH_BLOCK_ELEMENTS;
+    unsigned bits = swath->encoding.bits;
+    unsigned code;
+
+    if (bits == 16) {
+        code = codes[2 * slot] | (codes[2 * slot + 1] << 8);
+    } else {
+        size_t pos = slot * bits;
+        code = (codes[pos / 8] >> (pos % 8)) & ((1u << bits) - 1);
+    }
+    return (match_flags)(code << swath->encoding.shift);
+}
+
+static inline void
+set_nth_element (matches_and_old_values_swath *swath, size_t n,
+                 uint8_t old_value, match_flags flags)
 {
-    return &(swath->data[n + 1]);
+    size_t slot;
+    uint8_t *block = block_of_nth_element(swath, n, &slot);
+    uint8_t *codes = block + SWATH_BLOCK_ELEMENTS;
+    unsigned bits = swath->encoding.bits;
+    unsigned code = flags >> swath->encoding.shift;
+
+    /* the encoding must be able to hold the flags */
+    assert((match_flags)(code << swath->encoding.shift) == flags);
+
+    block[slot] = old_value;
+    if (bits == 16) {
+        codes[2 * slot] = code & 0xff;
+        codes[2 * slot + 1] = code >> 8;
+    } else {
+        size_t pos = slot * bits;
+        uint8_t mask = ((1u << bits) - 1) << (pos % 8);
+
+        assert(code < (1u << bits));
+        codes[pos / 8] = (codes[pos / 8] & ~mask) | (code << (pos % 8));
+    }
 }
 
+static inline void
+set_flags_of_nth_element (matches_and_old_values_swath *swath, size_t n, match_flags flags)
+{
+    set_nth_element(swath, n, old_value_of_nth_element(swath, n), flags);
+}
+
+/* where the swath after this one starts */
 static inline void *
 local_address_beyond_last_element (matches_and_old_values_swath *swath)
 {
-    return (local_address_beyond_nth_element(swath, index_of_last_element(swath)));
+    return swath->data +
+           blocks_of_elements(swath, swath->number_of_bytes) * swath_block_bytes(swath->encoding);
 }
 
-static inline matches_and_old_values_array *
-allocate_enough_to_reach (matches_and_old_values_array *array,
-                          void *last_byte_to_reach_plus_one,
-                          matches_and_old_values_swath **swath_pointer_to_correct)
+/* the swath after this one, or the null swath at the end of the array */
+static inline matches_and_old_values_swath *
+next_swath (matches_and_old_values_swath *swath)
 {
-    size_t bytes_needed = last_byte_to_reach_plus_one - (void *)array;
+    matches_and_old_values_swath *next = local_address_beyond_last_element(swath);
 
-    if (bytes_needed <= array->bytes_allocated) {
-        return array;
+    /* a link to the next chunk */
+    if (next->encoding.bits == 0)
+        memcpy(&next, next->data, sizeof(next));
+    return next;
+}
 
-    } else {
-        matches_and_old_values_array *original_location = array;
+/* whether the next swath starts right after this one, as the elements
+   of this swath didn't fit in its chunk */
+static inline bool
+swath_is_continued (matches_and_old_values_swath *swath)
+{
+    matches_and_old_values_swath *next = next_swath(swath);
 
-        /* allocate twice as much each time,
-           so we don't have to do it too often */
-        size_t bytes_to_allocate = array->bytes_allocated;
-        while (bytes_to_allocate < bytes_needed)
-            bytes_to_allocate *= 2;
+    return next->number_of_bytes > 0 &&
+           next->first_byte_in_child == swath->first_byte_in_child + swath->number_of_bytes;
+}
 
-        show_debug("to_allocate %ld, max %ld\n", bytes_to_allocate,
-                   array->max_needed_bytes);
+/* the number of elements from the nth one to the end of the swath and the
+   swaths continuing it, at most `limit` */
+static inline size_t
+elements_to_end_of_run (matches_and_old_values_swath *swath, size_t n, size_t limit)
+{
+    size_t count = swath->number_of_bytes - n;
 
-        /* sometimes we know an absolute max that we will need */
-        if (array->max_needed_bytes < bytes_to_allocate) {
-            assert(array->max_needed_bytes >= bytes_needed);
-            bytes_to_allocate = array->max_needed_bytes;
-        }
+    while (count < limit && swath_is_continued(swath)) {
+        swath = next_swath(swath);
+        count += swath->number_of_bytes;
+    }
+    return MIN(count, limit);
+}
 
-        if (!(array = realloc(array, bytes_to_allocate)))
-            return NULL;
+/* copies the old values of `count` elements from the nth one, they can be
+   in the swaths continuing this one, returns the number of values copied */
+static inline size_t
+old_values_of_elements (matches_and_old_values_swath *swath, size_t n,
+                        uint8_t *values, size_t count)
+{
+    size_t i;
 
-        array->bytes_allocated = bytes_to_allocate;
+    for (i = 0; i < count; ) {
+        size_t slot;
+        const uint8_t *block;
+        size_t run;
 
-        /* Put the swath pointer back where it should be, if needed.
-           We cast everything to void pointers in this line to make
-           sure the math works out. */
-        if (swath_pointer_to_correct) {
-            (*swath_pointer_to_correct) = (matches_and_old_values_swath *)
-                (((void *)(*swath_pointer_to_correct)) +
-                 ((void *)array - (void *)original_location));
+        if (n >= swath->number_of_bytes) {
+            if (!swath_is_continued(swath))
+                break;
+            swath = next_swath(swath);
+            n = 0;
         }
 
-        return array;
+        /* the old values are contiguous up to the end of each block */
+        block = block_of_nth_element(swath, n, &slot);
+        run = MIN(MIN(count - i, SWATH_BLOCK_ELEMENTS - slot), swath->number_of_bytes - n);
+        memcpy(&values[i], block + slot, run);
+        i += run;
+        n += run;
     }
+    return i;
 }
 
 /* returns a pointer to the swath to which the element was added -
@@ -182,111 +477,108 @@ add_element (matches_and_old_values_array **array,
              uint8_t new_byte,
              match_flags new_flags)
 {
-    if (swath->number_of_bytes == 0) {
-        assert(swath->first_byte_in_child == NULL);
-
-        /* we have to overwrite this as a new swath */
-        *array = allocate_enough_to_reach(*array, (void *)swath +
-            sizeof(matches_and_old_values_swath) +
-            sizeof(old_value_and_match_info), &swath);
-
-        swath->first_byte_in_child = remote_address;
-
-    } else {
-        size_t local_index_excess =
-            remote_address - remote_address_of_last_element(swath);
-
-        size_t local_address_excess =
-            local_index_excess * sizeof(old_value_and_match_info);
-
-        size_t needed_size_for_a_new_swath =
-            sizeof(matches_and_old_values_swath) +
-            sizeof(old_value_and_match_info);
-
-        if (local_address_excess >= needed_size_for_a_new_swath) {
-            /* It is more memory-efficient to start a new swath.
-             * The equal case is decided for a new swath, so that
-             * later we don't needlessly iterate through a bunch
-             * of empty values */
-            *array = allocate_enough_to_reach(*array,
-                local_address_beyond_last_element(swath) +
-                needed_size_for_a_new_swath, &swath);
-
-            swath = local_address_beyond_last_element(swath);
-            swath->first_byte_in_child = remote_address;
-            swath->number_of_bytes = 0;
-
-        } else {
-            /* It is more memory-efficient to write over the intervening
-               space with null values */
-            *array = allocate_enough_to_reach(*array,
-                local_address_beyond_last_element(swath) +
-                local_address_excess, &swath);
-
-            switch (local_index_excess) {
-            case 1:
-                /* do nothing, the new value is right after the old */
-                break;
-            case 2:
-                memset(local_address_beyond_last_element(swath), 0,
-                       sizeof(old_value_and_match_info));
-                break;
-            default:
-                /* slow due to unknown size to be zeroed */
-                memset(local_address_beyond_last_element(swath), 0,
-                       local_address_excess - sizeof(old_value_and_match_info));
-                break;
-            }
-            swath->number_of_bytes += local_index_excess - 1;
-        }
+    /* the common case is the next slot of the last block, the others
+     * may need a new block or swath */
+    if (swath->number_of_bytes == 0 ||
+        remote_address != remote_address_of_last_element(swath) + 1 ||
+        (uintptr_t)remote_address % SWATH_BLOCK_ELEMENTS == 0) {
+        swath = make_room_for_element(array, swath, remote_address);
+        if (!*array)
+            return NULL;
     }
 
     /* add me */
-    old_value_and_match_info *dataptr = local_address_beyond_last_element(swath);
-    dataptr->old_value = new_byte;
-    dataptr->match_info = new_flags;
+    set_nth_element(swath, swath->number_of_bytes, new_byte, new_flags);
     ++swath->number_of_bytes;
 
     return swath;
 }
 
+/* drops the elements of `swath` after the first `n` (at least one),
+   it must be the last swath of the array */
+static inline void
+truncate_swath (matches_and_old_values_swath *swath, size_t n)
+{
+    size_t i;
+
+    assert(n > 0 && n <= swath->number_of_bytes);
+
+    /* keep the unused slots of the new last block clear */
+    for (i = n; i < swath->number_of_bytes &&
+                blocks_of_elements(swath, i + 1) == blocks_of_elements(swath, n); i++)
+        set_nth_element(swath, i, 0, flags_empty);
+    swath->number_of_bytes = n;
+}
+
+/* the flags of `flags` that a value of `length` bytes can have */
+static inline match_flags
+flags_fitting (match_flags flags, size_t length)
+{
+    /* NOTE: This does the right thing for VLT because the flags are in
+     * the same order as the number representation (for both endians), so
+     * that the zeroing of a flag does not change useful bits of `length`. */
+    if (length < 8) flags &= ~flags_64b;
+    if (length < 4) flags &= ~flags_32b;
+    if (length < 2) flags &= ~flags_16b;
+    if (length < 1) flags = flags_empty;
+    return flags;
+}
+
+/* the flags of the nth byte of an image of the snapshot `array` */
+static inline match_flags
+flags_of_image_byte (const matches_and_old_values_array *array,
+                     const snapshot_image *image, size_t n)
+{
+    if ((uintptr_t)(image->start + n) % array->image_alignment != 0)
+        return flags_empty;
+    return flags_fitting(array->image_flags, image->size - n);
+}
+
+/* the number of matches in an image of the snapshot `array` */
+static inline size_t
+image_matches (const matches_and_old_values_array *array, const snapshot_image *image)
+{
+    /* the first and the last byte that the smallest value fits after */
+    unsigned lowest = array->image_flags & -array->image_flags;
+    size_t width = lowest & flags_8b ? 1 : lowest & flags_16b ? 2 : lowest & flags_32b ? 4 : 8;
+    uintptr_t first = ((uintptr_t)image->start + array->image_alignment - 1) /
+                      array->image_alignment * array->image_alignment;
+    uintptr_t last = (uintptr_t)image->start + image->size - width;
+
+    if (image->size < width || first > last)
+        return 0;
+    return (last - first) / array->image_alignment + 1;
+}
+
 /* only at most sizeof(int64_t) bytes will be read,
    if more bytes are needed (e.g. bytearray),
    read them separately (for performance) */
 static inline value_t
-data_to_val_aux (const matches_and_old_values_swath *swath,
+data_to_val_aux (matches_and_old_values_swath *swath,
                  size_t index, size_t swath_length)
 {
-    unsigned int i;
     value_t val;
     size_t max_bytes = swath_length - index;
 
+    /* the value can go on in the swath continuing this one */
+    if (max_bytes < 8 && swath_length == swath->number_of_bytes)
+        max_bytes = elements_to_end_of_run(swath, index, 8);
+
     /* Init all possible flags in a single go.
      * Also init length to the maximum possible value */
-    val.flags = 0xffffu;
-
-    /* NOTE: This does the right thing for VLT because the flags are in
-     * the same order as the number representation (for both endians), so
-     * that the zeroing of a flag does not change useful bits of `length`. */
     if (max_bytes > 8) max_bytes = 8;
-    if (max_bytes < 8) val.flags &= ~flags_64b;
-    if (max_bytes < 4) val.flags &= ~flags_32b;
-    if (max_bytes < 2) val.flags &= ~flags_16b;
-    if (max_bytes < 1) val.flags = flags_empty;
-
-    for (i = 0; i < max_bytes; ++i) {
-        /* Both uint8_t, no explicit casting needed */
-        val.bytes[i] = swath->data[index + i].old_value;
-    }
+    val.flags = flags_fitting(0xffffu, max_bytes);
+
+    old_values_of_elements(swath, index, val.bytes, max_bytes);
 
     /* Truncate to the old flags, which are stored with the first matched byte */
-    val.flags &= swath->data[index].match_info;
+    val.flags &= flags_of_nth_element(swath, index);
 
     return val;
 }
 
 static inline value_t
-data_to_val (const matches_and_old_values_swath *swath, size_t index)
+data_to_val (matches_and_old_values_swath *swath, size_t index)
 {
     return data_to_val_aux(swath, index, swath->number_of_bytes);
 }
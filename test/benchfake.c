@@ -0,0 +1,232 @@
+/*
+    Provide a reproducible program for the benchmarks to scan
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The memory is a number of anonymous regions, kept apart by unmapped pages
+ * so that they show up as separate maps. They are made of 8 byte slots, each
+ * one random, or by `density` a needle: the value BENCH_NEEDLE as an int64,
+ * as two int32, as two float32 or as a float64, in turn. One more region
+ * holds text: 64 byte records, the `density` of them starting with the string
+ * BENCH_STRING, the others lowercase letters.
+ *
+ * "ready" is written to the standard output once the memory is filled. Each
+ * SIGUSR1 then mutates the `mutation` of the slots, the needles are
+ * incremented and the random ones rewritten, and "mutated" is written.
+ * Everything depends on the seed only.
+ */
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define BENCH_NEEDLE 100
+#define BENCH_STRING "benchmark needle"
+#define TEXT_RECORD 64
+
+enum { SLOT_RANDOM, SLOT_INT64, SLOT_INT32, SLOT_FLOAT32, SLOT_FLOAT64 };
+
+static uint64_t seed = 1;
+static double density = 0.01, mutation = 0.1;
+
+static uint64_t splitmix64(uint64_t x)
+{
+    x += UINT64_C(0x9e3779b97f4a7c15);
+    x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return x ^ (x >> 31);
+}
+
+/* A number in [0, 1) */
+static double unit(uint64_t x)
+{
+    return (x >> 11) * (1.0 / (UINT64_C(1) << 53));
+}
+
+/* What slot `n` of all the regions holds, the same on every pass */
+static int slot_kind(size_t n)
+{
+    if (unit(splitmix64(seed ^ (n * 2))) >= density)
+        return SLOT_RANDOM;
+    return SLOT_INT64 + n % 4;
+}
+
+static void fill_slot(uint64_t *slot, int kind, uint64_t random)
+{
+    int32_t i32[2] = { BENCH_NEEDLE, BENCH_NEEDLE };
+    float f32[2] = { BENCH_NEEDLE, BENCH_NEEDLE };
+    double f64 = BENCH_NEEDLE;
+
+    switch (kind) {
+    case SLOT_RANDOM:
+        *slot = random;
+        break;
+    case SLOT_INT64:
+        *slot = BENCH_NEEDLE;
+        break;
+    case SLOT_INT32:
+        memcpy(slot, i32, sizeof(i32));
+        break;
+    case SLOT_FLOAT32:
+        memcpy(slot, f32, sizeof(f32));
+        break;
+    case SLOT_FLOAT64:
+        memcpy(slot, &f64, sizeof(f64));
+        break;
+    }
+}
+
+static void bump_slot(uint64_t *slot, int kind, uint64_t random)
+{
+    int32_t i32[2];
+    float f32[2];
+    double f64;
+
+    switch (kind) {
+    case SLOT_RANDOM:
+        *slot = random;
+        break;
+    case SLOT_INT64:
+        (*slot)++;
+        break;
+    case SLOT_INT32:
+        memcpy(i32, slot, sizeof(i32));
+        i32[0]++, i32[1]++;
+        memcpy(slot, i32, sizeof(i32));
+        break;
+    case SLOT_FLOAT32:
+        memcpy(f32, slot, sizeof(f32));
+        f32[0]++, f32[1]++;
+        memcpy(slot, f32, sizeof(f32));
+        break;
+    case SLOT_FLOAT64:
+        memcpy(&f64, slot, sizeof(f64));
+        f64++;
+        memcpy(slot, &f64, sizeof(f64));
+        break;
+    }
+}
+
+static void fill_text(char *text, size_t size)
+{
+    size_t record, i;
+
+    for (record = 0; record + TEXT_RECORD <= size; record += TEXT_RECORD) {
+        uint64_t r = splitmix64(~seed ^ record);
+        char *p = text + record;
+
+        i = 0;
+        if (unit(r) < density) {
+            i = snprintf(p, TEXT_RECORD, "%s %06u", BENCH_STRING,
+                         (unsigned) (record / TEXT_RECORD % 1000000));
+            p[i++] = '\0';
+        }
+        for ( ; i < TEXT_RECORD; i++) {
+            r = splitmix64(r);
+            p[i] = 'a' + r % 26;
+        }
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-r regions] [-s KiB per region] [-d density %%] "
+            "[-m mutation %%] [-t KiB of text] [-x seed]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    size_t num_regions = 16, region_kib = 4096, text_kib = 256;
+    size_t page = sysconf(_SC_PAGESIZE), region_size, text_size, slots, reserved, n, pass = 0;
+    uint8_t *memory;
+    sigset_t usr1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:s:d:m:t:x:")) != -1) {
+        switch (opt) {
+        case 'r': num_regions = strtoul(optarg, NULL, 0); break;
+        case 's': region_kib = strtoul(optarg, NULL, 0); break;
+        case 'd': density = strtod(optarg, NULL) / 100; break;
+        case 'm': mutation = strtod(optarg, NULL) / 100; break;
+        case 't': text_kib = strtoul(optarg, NULL, 0); break;
+        case 'x': seed = strtoull(optarg, NULL, 0); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc || num_regions == 0 || region_kib == 0)
+        usage(argv[0]);
+
+    /* the regions and the text, a page apart */
+    region_size = (region_kib * 1024 + page - 1) / page * page;
+    slots = region_size / sizeof(uint64_t);
+    text_size = (text_kib * 1024 + page - 1) / page * page;
+    reserved = num_regions * (region_size + page) + text_size;
+    if ((memory = mmap(NULL, reserved, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1, 0)) == MAP_FAILED) {
+        perror("mmap");
+        return EXIT_FAILURE;
+    }
+    for (n = 0; n <= num_regions; n++) {
+        size_t size = n < num_regions ? region_size : text_size;
+
+        if (size > 0 && mprotect(memory + n * (region_size + page), size,
+                                 PROT_READ | PROT_WRITE) == -1) {
+            perror("mprotect");
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (n = 0; n < num_regions * slots; n++) {
+        uint64_t *slot = (uint64_t *) (memory + n / slots * (region_size + page)) + n % slots;
+
+        fill_slot(slot, slot_kind(n), splitmix64(seed ^ (n * 2 + 1)));
+    }
+    fill_text((char *) memory + num_regions * (region_size + page), text_size);
+
+    sigemptyset(&usr1);
+    sigaddset(&usr1, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &usr1, NULL);
+    printf("ready\n");
+    fflush(stdout);
+
+    for (;;) {
+        int sig;
+
+        if (sigwait(&usr1, &sig) != 0)
+            continue;
+
+        pass++;
+        for (n = 0; n < num_regions * slots; n++) {
+            uint64_t r = splitmix64(seed ^ (n * 2 + 1) ^ (pass << 48));
+            uint64_t *slot;
+
+            if (unit(r) >= mutation)
+                continue;
+            slot = (uint64_t *) (memory + n / slots * (region_size + page)) + n % slots;
+            bump_slot(slot, slot_kind(n), splitmix64(r));
+        }
+        printf("mutated\n");
+        fflush(stdout);
+    }
+
+    return 0;
+}
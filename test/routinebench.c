@@ -0,0 +1,368 @@
+/*
+    Time the scan routines on buffers, without a target
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Runs the routines of sm_get_scanroutine() and sm_get_scanbufferroutine()
+ * over a buffer of random bytes with needles, for each data type, match
+ * type, endianness and alignment, and for patterns of each length. A line
+ * gives the ns per byte of the per-offset routine, called as the scans call
+ * it, and of the buffer routine, SIMD or not, if there is one. The matches
+ * of the buffer routine must be the ones of the per-offset routine, which
+ * is the reference: the exit status is 1 if they differ.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "scanroutines.h"
+#include "value.h"
+
+#define NEEDLE "100"
+#define NEEDLE_SPACING 64       /* bytes between needles, on average */
+
+static const char *data_type_names[] = {
+    [ANYNUMBER] = "number", [ANYINTEGER] = "int", [ANYFLOAT] = "float",
+    [INTEGER8] = "int8", [INTEGER16] = "int16", [INTEGER32] = "int32",
+    [INTEGER64] = "int64", [FLOAT32] = "float32", [FLOAT64] = "float64",
+    [BYTEARRAY] = "bytearray", [STRING] = "string",
+};
+
+static const char *match_type_names[] = {
+    [MATCHANY] = "any", [MATCHEQUALTO] = "=", [MATCHNOTEQUALTO] = "!=",
+    [MATCHGREATERTHAN] = ">", [MATCHLESSTHAN] = "<", [MATCHRANGE] = "range",
+    [MATCHUPDATE] = "update", [MATCHNOTCHANGED] = "unchanged",
+    [MATCHCHANGED] = "changed", [MATCHINCREASED] = "increased",
+    [MATCHDECREASED] = "decreased", [MATCHINCREASEDBY] = "+=",
+    [MATCHDECREASEDBY] = "-=",
+};
+
+static const scan_data_type_t number_types[] = {
+    INTEGER8, INTEGER16, INTEGER32, INTEGER64, FLOAT32, FLOAT64,
+    ANYINTEGER, ANYFLOAT, ANYNUMBER,
+};
+
+/* the ones of the first scans, with a buffer routine */
+static const scan_match_type_t value_match_types[] = {
+    MATCHANY, MATCHEQUALTO, MATCHNOTEQUALTO, MATCHGREATERTHAN, MATCHLESSTHAN, MATCHRANGE,
+};
+
+/* the ones against old values */
+static const scan_match_type_t old_match_types[] = {
+    MATCHUPDATE, MATCHNOTCHANGED, MATCHCHANGED, MATCHINCREASED, MATCHDECREASED,
+    MATCHINCREASEDBY, MATCHDECREASEDBY,
+};
+
+static const size_t pattern_lengths[] = { 1, 2, 3, 4, 8, 16, 32, 64, 255 };
+
+static size_t buffer_size = 1024 * 1024;
+static double min_seconds = 0.01;
+static uint8_t *buffer;         /* the memory scanned */
+static value_t *old_values;     /* of each offset, for the checks */
+static uint32_t *offsets[2];    /* the matches of the reference and of the tested routine */
+static match_flags *flags[2];
+static unsigned failures;
+
+/* Reproducible random bytes */
+static uint64_t next_random(void)
+{
+    static uint64_t state = 1;
+    uint64_t x = (state += UINT64_C(0x9e3779b97f4a7c15));
+
+    x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+    return x ^ (x >> 31);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Random bytes, with `needle` of `length` bytes here and there */
+static void fill_buffer(const void *needle, size_t length)
+{
+    size_t i;
+
+    for (i = 0; i < buffer_size; i += sizeof(uint64_t)) {
+        uint64_t r = next_random();
+
+        memcpy(buffer + i, &r, MIN(sizeof(r), buffer_size - i));
+    }
+    for (i = 0; i + length <= buffer_size; i += 1 + next_random() % (2 * NEEDLE_SPACING))
+        memcpy(buffer + i, needle, length);
+}
+
+/* The old values: the memory, with a change at some offsets */
+static void fill_old_values(scan_data_type_t data_type)
+{
+    match_flags possible = sm_get_possible_flags(data_type);
+    size_t i;
+
+    for (i = 0; i < buffer_size; i++) {
+        zero_value(&old_values[i]);
+        memcpy(old_values[i].bytes, buffer + i, MIN(sizeof(old_values[i].bytes), buffer_size - i));
+        if (next_random() % 4 == 0)
+            old_values[i].bytes[0] += next_random() % 2 ? 1 : -1;
+        old_values[i].flags = possible;
+    }
+}
+
+/* The matches of the per-offset routine, as the scans call it */
+static size_t scan_offsets(scan_routine_t routine, size_t stride, bool with_old,
+                           const uservalue_t *user_value, uint32_t *match_offsets,
+                           match_flags *saveflags)
+{
+    size_t i, num_matches = 0;
+
+    for (i = 0; i < buffer_size; i += stride) {
+        match_flags f = flags_empty;
+
+        if (routine((const mem64_t *)(buffer + i), buffer_size - i,
+                    with_old ? &old_values[i] : NULL, user_value, &f)) {
+            match_offsets[num_matches] = i;
+            saveflags[num_matches] = f;
+            num_matches++;
+        }
+    }
+    return num_matches;
+}
+
+/* Nanoseconds per byte of `routine` or `buffer_routine`, over `min_seconds` */
+static double time_routine(scan_routine_t routine, scan_buffer_routine_t buffer_routine,
+                           size_t stride, bool with_old, const uservalue_t *user_value,
+                           size_t *num_matches)
+{
+    double start = now(), elapsed;
+    unsigned long runs = 0;
+
+    do {
+        if (buffer_routine)
+            *num_matches = buffer_routine(buffer, buffer_size, buffer_size, stride,
+                                          user_value, offsets[1], flags[1]);
+        else
+            *num_matches = scan_offsets(routine, stride, with_old, user_value,
+                                        offsets[0], flags[0]);
+        runs++;
+    } while ((elapsed = now() - start) < min_seconds);
+
+    return elapsed * 1e9 / ((double) runs * buffer_size);
+}
+
+static void bench(scan_data_type_t data_type, scan_match_type_t match_type,
+                  bool reverse_endianness, size_t stride, size_t length,
+                  const uservalue_t *user_value)
+{
+    match_flags uflags = user_value ? user_value->flags : flags_empty;
+    scan_routine_t routine = sm_get_scanroutine(data_type, match_type, uflags, reverse_endianness);
+    scan_buffer_routine_t buffer_routine = NULL;
+    bool with_old = match_type >= MATCHUPDATE;
+    size_t reference = 0, tested = 0;
+    double per_offset, per_buffer = 0;
+    const char *agree = "-";
+
+    if (routine == NULL)
+        return;
+    if (!with_old)
+        buffer_routine = sm_get_scanbufferroutine(data_type, match_type, reverse_endianness);
+
+    per_offset = time_routine(routine, NULL, stride, with_old, user_value, &reference);
+    if (buffer_routine) {
+        per_buffer = time_routine(routine, buffer_routine, stride, false, user_value, &tested);
+        agree = "yes";
+        if (tested != reference ||
+            memcmp(offsets[0], offsets[1], reference * sizeof(*offsets[0])) != 0 ||
+            memcmp(flags[0], flags[1], reference * sizeof(*flags[0])) != 0) {
+            agree = "NO";
+            failures++;
+        }
+    }
+
+    printf("%-10s %-10s %-7s %6zu %6zu %10.3f ", data_type_names[data_type],
+           match_type_names[match_type], reverse_endianness ? "reverse" : "native",
+           length, stride, per_offset);
+    if (buffer_routine)
+        printf("%10.3f %7.2f", per_buffer, per_buffer > 0 ? per_offset / per_buffer : 0);
+    else
+        printf("%10s %7s", "-", "-");
+    printf(" %10zu %5s\n", reference, agree);
+    fflush(stdout);
+}
+
+/* The bytes of NEEDLE in the memory, for a data type */
+static size_t needle_bytes(scan_data_type_t data_type, bool reverse_endianness, uint8_t *bytes)
+{
+    int8_t i8 = atoi(NEEDLE);
+    int16_t i16 = i8;
+    int32_t i32 = i8;
+    int64_t i64 = i8;
+    float f32 = i8;
+    double f64 = i8;
+    size_t length = 0, i;
+
+    switch (data_type) {
+    case INTEGER8: memcpy(bytes, &i8, length = sizeof(i8)); break;
+    case INTEGER16: memcpy(bytes, &i16, length = sizeof(i16)); break;
+    case INTEGER32: case ANYINTEGER: case ANYNUMBER: memcpy(bytes, &i32, length = sizeof(i32)); break;
+    case INTEGER64: memcpy(bytes, &i64, length = sizeof(i64)); break;
+    case FLOAT32: case ANYFLOAT: memcpy(bytes, &f32, length = sizeof(f32)); break;
+    case FLOAT64: memcpy(bytes, &f64, length = sizeof(f64)); break;
+    default: break;
+    }
+    for (i = 0; reverse_endianness && i < length / 2; i++) {
+        uint8_t b = bytes[i];
+
+        bytes[i] = bytes[length - 1 - i];
+        bytes[length - 1 - i] = b;
+    }
+    return length;
+}
+
+static void bench_numbers(const char *only)
+{
+    unsigned t, m, e;
+
+    for (t = 0; t < sizeof(number_types) / sizeof(*number_types); t++) {
+        scan_data_type_t data_type = number_types[t];
+        size_t width = flags_to_memlength(ANYNUMBER, sm_get_possible_flags(data_type));
+        uservalue_t values[2], delta;
+
+        if (only && strcmp(only, data_type_names[data_type]) != 0)
+            continue;
+
+        zero_uservalue(&values[0]);
+        zero_uservalue(&values[1]);
+        parse_uservalue_number(NEEDLE, &values[0]);
+        parse_uservalue_number(NEEDLE, &values[1]);
+        /* the old values differ by 1 here and there */
+        zero_uservalue(&delta);
+        parse_uservalue_number("1", &delta);
+
+        for (e = 0; e < 2; e++) {
+            /* unaligned, and aligned to the width of the type if it has one */
+            size_t strides[] = { 1, width }, s;
+            uint8_t needle[sizeof(uint64_t)];
+
+            fill_buffer(needle, needle_bytes(data_type, e, needle));
+            fill_old_values(data_type);
+
+            for (s = 0; s < (width > 1 ? 2 : 1); s++) {
+                for (m = 0; m < sizeof(value_match_types) / sizeof(*value_match_types); m++) {
+                    scan_match_type_t match_type = value_match_types[m];
+
+                    /* the matches of any value don't depend on the endianness */
+                    if (e && match_type == MATCHANY)
+                        continue;
+                    bench(data_type, match_type, e, strides[s], width,
+                          match_type == MATCHANY ? NULL : values);
+                }
+                for (m = 0; !e && m < sizeof(old_match_types) / sizeof(*old_match_types); m++)
+                    bench(data_type, old_match_types[m], false, strides[s], width,
+                          old_match_types[m] >= MATCHINCREASEDBY ? &delta : values);
+            }
+        }
+    }
+}
+
+static void bench_patterns(const char *only)
+{
+    static char text[256];
+    static uint8_t bytes[256];
+    static wildcard_t wildcards[256];
+    unsigned l;
+
+    for (l = 0; l < sizeof(pattern_lengths) / sizeof(*pattern_lengths); l++) {
+        size_t length = pattern_lengths[l], i;
+        uservalue_t value;
+
+        for (i = 0; i < length; i++) {
+            text[i] = 'a' + next_random() % 26;
+            /* the bytearrays have a wildcard every 8 bytes, its byte is 0 */
+            wildcards[i] = i % 8 == 7 ? WILDCARD : FIXED;
+            bytes[i] = text[i] & wildcards[i];
+        }
+        text[length] = '\0';
+        fill_buffer(text, length);
+
+        if (only == NULL || strcmp(only, "string") == 0) {
+            zero_uservalue(&value);
+            value.string_value = text;
+            value.flags = length;
+            bench(STRING, MATCHEQUALTO, false, 1, length, &value);
+        }
+
+        if (only == NULL || strcmp(only, "bytearray") == 0) {
+            zero_uservalue(&value);
+            value.bytearray_value = bytes;
+            value.wildcard_value = wildcards;
+            value.flags = length;
+            bench(BYTEARRAY, MATCHEQUALTO, false, 1, length, &value);
+        }
+    }
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-s KiB of buffer] [-t ms per routine] [-o data type]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    const char *only = NULL;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "s:t:o:")) != -1) {
+        switch (opt) {
+        case 's': buffer_size = strtoul(optarg, NULL, 0) * 1024; break;
+        case 't': min_seconds = strtod(optarg, NULL) / 1000; break;
+        case 'o': only = optarg; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc || buffer_size == 0)
+        usage(argv[0]);
+
+    buffer = malloc(buffer_size);
+    old_values = malloc(buffer_size * sizeof(value_t));
+    for (i = 0; i < 2; i++) {
+        offsets[i] = malloc(buffer_size * sizeof(uint32_t));
+        flags[i] = malloc(buffer_size * sizeof(match_flags));
+    }
+    if (!buffer || !old_values || !offsets[0] || !offsets[1] || !flags[0] || !flags[1]) {
+        fprintf(stderr, "out of memory.\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("# %zu KiB buffer, ns per byte\n", buffer_size / 1024);
+    printf("# %-8s %-10s %-7s %6s %6s %10s %10s %7s %10s %5s\n", "type", "match", "endian",
+           "length", "stride", "per_offset", "buffer", "speedup", "matches", "agree");
+    bench_numbers(only);
+    bench_patterns(only);
+
+    if (failures)
+        printf("# %u buffer routines disagree with the per-offset ones\n", failures);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
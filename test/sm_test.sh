@@ -4,6 +4,7 @@ set -ev
 # Start memfake
 ./memfake 4 1 &
 memfake_pid=$!
+session_file=$(mktemp)
 
 # Test runs
 
@@ -11,15 +12,47 @@ test_sm () {
     ../scanmem -p $memfake_pid -e -c "$1"
 }
 
+# the matches after each scan of the commands
+test_sm_matches () {
+    test_sm "$1" 2>&1 | sed -n 's/^info: we currently have \([0-9]*\) matches\.$/\1/p'
+}
+
 test_sm "option scan_data_type int8;0;exit"
 test_sm "option scan_data_type int8;snapshot;exit"
 
 test_sm "option scan_data_type int8;snapshot;1;exit"
 test_sm "option scan_data_type int8;1;delete 0;1;exit"
+test_sm "option scan_data_type int8;snapshot;set 5000..5010=1;delete 1;set 5000..5010=2;exit"
+test_sm "option scan_data_type int8;snapshot;set 5000..5010=1/10ms 5020=3/0.5;freeze;freeze stop 0;freeze stop;exit"
+test_sm "option scan_data_type int8;snapshot;watch 5000..5010/1ms;watch;watch log 5;watch drain;watch stop;exit"
 
 test_sm "option scan_data_type int;1;exit"
 test_sm "option scan_data_type float;1;exit"
 test_sm "option scan_data_type number;1;exit"
+# memfake doesn't change its memory, the checks keep all the matches
+matches=$(test_sm_matches "option scan_data_type number;0..100;=;=;exit")
+test $(echo "$matches" | wc -l) -eq 3 -a $(echo "$matches" | uniq | wc -l) -eq 1
+# the scan threads find and check the same matches as a single one
+for scan in "option scan_data_type number;1;exit" "option scan_data_type int8;0;exit" \
+            "option scan_data_type int16;0..100;=;> 10;exit" "option scan_data_type int8;snapshot;=;> 0;exit"; do
+    test "$(test_sm_matches "option scan_threads 4;${scan}")" = "$(test_sm_matches "option scan_threads 1;${scan}")"
+done
+test_sm "option alignment 4;option scan_data_type int32;1;exit"
+test_sm "option alignment 2;option scan_data_type number;snapshot;1;exit"
+test_sm "option matches_in_file 1;option scan_data_type int8;snapshot;1;delete 0;exit"
+test_sm "option scan_data_type int16;option alignment 2;snapshot;update;dregion 1;list 1;=;exit"
+test_sm "option scan_data_type int8;snapshot;dregion 0;reset keep;1;dregion 0;reset keep;=;exit"
+test_sm "option scan_data_type int32;reset keep;1;dregion 1;reset keep;=;exit"
+test_sm "option scan_data_type int8;1;dregion 0,1;list 5;dregion 1;exit"
+test_sm "option scan_data_type int8;1;list 0 3;list 3 3;list 1 2;delete 2;list 3 3;exit"
+test_sm "option scan_data_type int8;snapshot;option scan_regions 1;1;option scan_window 0..ffffffff;=;option scan_regions all;=;dregion 2;exit"
+test_sm "pointers;pointers map;pointers;pointers 5000 2;pointers clear;pointers 5000;exit"
+test_sm "option scan_data_type int8;stats;snapshot;1;stats;stats reset;stats;exit"
+test_sm "option scan_data_type int8;1;save ${session_file};reset;load ${session_file};list 2;=;snapshot;save ${session_file};load ${session_file};exit"
+test_sm "option scan_data_type int8;1;dregion 1;save ${session_file};load ${session_file};list 2;=;exit"
+# the loaded matches are the saved ones
+matches=$(test_sm_matches "option scan_data_type int8;1;save ${session_file};reset;load ${session_file};=;exit")
+test $(echo "$matches" | wc -l) -eq 2 -a $(echo "$matches" | uniq | wc -l) -eq 1
 
 huge_bytearray=""
 huge_string=""
@@ -31,6 +64,9 @@ done
 
 test_sm "option scan_data_type bytearray;${huge_bytearray};exit"
 test_sm "option scan_data_type string;\" ${huge_string};exit"
+test_sm "option scan_data_type bytearray;group int8 0 ~4 int16 0..10 +8 number 0;group int8 0;list 2;exit"
+test_sm "option scan_data_type bytearray;?? 45 4c ?? ??;reset;option scan_data_type string;option alignment 2;\" ELF;exit"
 
 # Clean up
 kill $memfake_pid
+rm -f "${session_file}"
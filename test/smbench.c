@@ -0,0 +1,281 @@
+/*
+    Time the scans of libscanmem on benchfake
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Starts benchfake with the options it doesn't take itself, and runs each
+ * scenario on it: the commands of scanmem, with a mutation of the target
+ * between the scans. Each scan prints one line, the columns of the header,
+ * with the bytes read from the target per second of the scan and the peak
+ * RSS of the scan (of the whole run if the kernel can't reset it).
+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#if defined(__linux__)
+# include <sys/prctl.h>
+#endif
+
+#include "commands.h"
+#include "scanmem.h"
+
+#define MUTATE NULL             /* between the commands of a scenario */
+#define MAX_STEPS 8
+
+typedef struct {
+    const char *name;
+    const char *scan_data_type;
+    const char *steps[MAX_STEPS]; /* ended by an empty string */
+} scenario;
+
+#define NEEDLE "100"
+#define STRING "\" benchmark needle"
+#define BYTES "62 65 6e ?? 68 6d 61 72 6b"
+
+static const scenario scenarios[] = {
+    { "int8",            "int8",      { NEEDLE, MUTATE, "=", MUTATE, "+", "" } },
+    { "int16",           "int16",     { NEEDLE, MUTATE, "=", MUTATE, "+", "" } },
+    { "int32",           "int32",     { NEEDLE, MUTATE, "=", MUTATE, "+", "" } },
+    { "int64",           "int64",     { NEEDLE, MUTATE, "=", MUTATE, "+", "" } },
+    { "float32",         "float32",   { NEEDLE, MUTATE, "=", MUTATE, "+", "" } },
+    { "float64",         "float64",   { NEEDLE, MUTATE, "=", MUTATE, "+", "" } },
+    { "number",          "number",    { NEEDLE, MUTATE, "=", MUTATE, "+", "" } },
+    { "int32-range",     "int32",     { "90..110", MUTATE, "!=", "" } },
+    { "int32-snapshot",  "int32",     { "snapshot", MUTATE, "!=", MUTATE, "=", "" } },
+    { "number-snapshot", "number",    { "snapshot", MUTATE, "=", "" } },
+    { "string",          "string",    { STRING, MUTATE, STRING, "" } },
+    { "bytearray",       "bytearray", { BYTES, MUTATE, BYTES, "" } },
+};
+
+static pid_t fake;
+static FILE *fake_output;
+static int quiet_stderr = -1, saved_stderr = -1;
+
+/* Waits for benchfake to write `line` */
+static bool expect(const char *line)
+{
+    char buf[64];
+
+    if (fgets(buf, sizeof(buf), fake_output) == NULL) {
+        fprintf(stderr, "benchfake exited, expecting \"%s\".\n", line);
+        return false;
+    }
+    buf[strcspn(buf, "\n")] = '\0';
+    if (strcmp(buf, line) != 0) {
+        fprintf(stderr, "benchfake wrote \"%s\", expecting \"%s\".\n", buf, line);
+        return false;
+    }
+    return true;
+}
+
+static bool start_fake(char **argv)
+{
+    int out[2];
+
+    if (pipe(out) == -1 || (fake = fork()) == -1) {
+        perror("starting benchfake");
+        return false;
+    }
+    if (fake == 0) {
+#if defined(__linux__)
+        /* not left behind if the benchmark crashes */
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+        dup2(out[1], STDOUT_FILENO);
+        close(out[0]);
+        close(out[1]);
+        execv(argv[0], argv);
+        perror(argv[0]);
+        _exit(EXIT_FAILURE);
+    }
+    close(out[1]);
+    fake_output = fdopen(out[0], "r");
+    return fake_output && expect("ready");
+}
+
+static void stop_fake(void)
+{
+    if (fake > 0) {
+        kill(fake, SIGTERM);
+        waitpid(fake, NULL, 0);
+    }
+}
+
+/* The peak RSS is reset through clear_refs, from Linux 4.0 on */
+static void reset_peak_rss(void)
+{
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+
+    /* without it the peak is of the whole run */
+    if (fd != -1) {
+        ssize_t written = write(fd, "5", 1);
+
+        (void) written;
+        close(fd);
+    }
+}
+
+static long peak_rss_kib(void)
+{
+    FILE *status = fopen("/proc/self/status", "r");
+    struct rusage usage;
+    char line[128];
+    long kib = -1;
+
+    if (status) {
+        while (fgets(line, sizeof(line), status))
+            if (sscanf(line, "VmHWM: %ld", &kib) == 1)
+                break;
+        fclose(status);
+    }
+    if (kib == -1 && getrusage(RUSAGE_SELF, &usage) == 0)
+        kib = usage.ru_maxrss;
+    return kib;
+}
+
+/* Runs `command`, without the messages of scanmem unless verbose */
+static bool run_command(const char *command)
+{
+    bool ret;
+
+    if (quiet_stderr != -1) {
+        fflush(stderr);
+        dup2(quiet_stderr, STDERR_FILENO);
+    }
+    ret = sm_execcommand(&sm_globals, command);
+    if (quiet_stderr != -1) {
+        fflush(stderr);
+        dup2(saved_stderr, STDERR_FILENO);
+    }
+    if (!ret)
+        fprintf(stderr, "`%s` failed, -v shows why.\n", command);
+    return ret;
+}
+
+static bool run_scenario(const scenario *s)
+{
+    static const char *phase_names[] = SM_PHASE_NAMES;
+    char option[64];
+    unsigned i;
+
+    snprintf(option, sizeof(option), "option scan_data_type %s", s->scan_data_type);
+    if (!run_command(option) || !run_command("reset"))
+        return false;
+
+    for (i = 0; i < MAX_STEPS && (s->steps[i] == MUTATE || s->steps[i][0]); i++) {
+        sm_scan_stats before, after;
+        const sm_phase_stats *p = NULL;
+        unsigned phase;
+        double mib;
+
+        if (s->steps[i] == MUTATE) {
+            if (kill(fake, SIGUSR1) == -1 || !expect("mutated"))
+                return false;
+            continue;
+        }
+
+        sm_get_scan_stats(&before);
+        reset_peak_rss();
+        if (!run_command(s->steps[i]))
+            return false;
+        sm_get_scan_stats(&after);
+
+        for (phase = 0; phase < SM_PHASES; phase++)
+            if (after.phases[phase].runs != before.phases[phase].runs)
+                break;
+        if (phase == SM_PHASES) {
+            fprintf(stderr, "`%s` didn't scan.\n", s->steps[i]);
+            return false;
+        }
+        p = &after.phases[phase];
+        mib = (after.bytes_read - before.bytes_read) / (1024.0 * 1024.0);
+
+        printf("%-16s %-28s %-8s %10.1f %9.4f %10.1f %12lu %12lu %10ld\n",
+               s->name, s->steps[i], phase_names[phase], mib, p->last_wall_seconds,
+               p->last_wall_seconds > 0 ? mib / p->last_wall_seconds : 0.0,
+               p->last_matches_in, p->last_matches_out, peak_rss_kib());
+        fflush(stdout);
+    }
+    return true;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-v] [-f benchfake] [-o scenario] "
+            "[the options of benchfake]\n", name);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    static char flags[16][3];
+    char *fake_argv[2 * 16 + 2] = { "./benchfake" };
+    const char *only = NULL;
+    unsigned fake_argc = 1, i;
+    bool verbose = false, ok = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "vf:o:r:s:d:m:t:x:")) != -1) {
+        switch (opt) {
+        case 'v': verbose = true; break;
+        case 'f': fake_argv[0] = optarg; break;
+        case 'o': only = optarg; break;
+        case '?': usage(argv[0]); break;
+        default:
+            /* the options of benchfake, as they are */
+            if (fake_argc / 2 >= sizeof(flags) / sizeof(*flags))
+                usage(argv[0]);
+            snprintf(flags[fake_argc / 2], sizeof(*flags), "-%c", opt);
+            fake_argv[fake_argc] = flags[fake_argc / 2];
+            fake_argv[fake_argc + 1] = optarg;
+            fake_argc += 2;
+        }
+    }
+    if (optind != argc)
+        usage(argv[0]);
+
+    if (!verbose) {
+        saved_stderr = dup(STDERR_FILENO);
+        quiet_stderr = open("/dev/null", O_WRONLY);
+    }
+    sm_globals.options.backend = 1;
+    if (!sm_init() || !start_fake(fake_argv)) {
+        stop_fake();
+        return EXIT_FAILURE;
+    }
+    sm_globals.target = fake;
+
+    printf("# %s", fake_argv[0]);
+    for (i = 1; i < fake_argc; i++)
+        printf(" %s", fake_argv[i]);
+    printf("\n# %-14s %-28s %-8s %10s %9s %10s %12s %12s %10s\n", "scenario", "scan",
+           "phase", "MiB", "seconds", "MiB/s", "matches_in", "matches_out", "rss_KiB");
+
+    for (i = 0; ok && i < sizeof(scenarios) / sizeof(*scenarios); i++)
+        if (only == NULL || strcmp(only, scenarios[i].name) == 0)
+            ok = run_scenario(&scenarios[i]);
+
+    sm_cleanup();
+    stop_fake();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
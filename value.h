@@ -124,6 +124,8 @@ typedef enum __attribute__ ((__packed__)) {
     WILDCARD = 0x00u,
 } wildcard_t;
 
+struct scan_group;
+
 /* this struct describes values provided by users */
 typedef struct {
     int8_t int8_value;
@@ -142,6 +144,8 @@ typedef struct {
 
     const char *string_value;
 
+    const struct scan_group *group_value;   /* for MATCHGROUP */
+
     match_flags flags;
 } uservalue_t;
 
@@ -0,0 +1,354 @@
+/*
+    Sample values in the background, and log their changes.
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#if HAVE_PTHREAD
+# include <pthread.h>
+#endif
+
+#include "common.h"
+#include "scanmem.h"
+#include "scanroutines.h"
+#include "show_message.h"
+#include "watch.h"
+
+#if HAVE_PTHREAD
+
+/* The sampling thread, its values and the log. The values and buffers are
+ * only touched by the thread while it runs, the rest is guarded by `lock`. */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        /* signalled when asked to quit */
+    pthread_t thread;
+    bool running;               /* `thread` was started and isn't joined yet */
+    bool quit;                  /* asks `thread` to return, or it gave up */
+    pid_t target;
+    int procmem_fd;
+    bool vm_readv_usable;       /* false once `process_vm_readv()` was refused */
+    unsigned long interval_us;
+
+    watched_value *values;      /* sorted by address */
+    size_t *offsets;            /* of each value in the buffers */
+    size_t num_values;
+    struct iovec *runs;         /* the target memory read on each sample */
+    size_t num_runs;
+    uint8_t *current, *previous; /* the bytes of `runs`, back to back */
+    size_t size;
+    unsigned long samples;
+
+    watch_change log[WATCH_LOG_SIZE];
+    size_t log_next;            /* where the next change goes */
+    size_t logged;
+    unsigned long dropped;
+} watch = { .lock = PTHREAD_MUTEX_INITIALIZER, .procmem_fd = -1 };
+
+static int compare_values(const void *a, const void *b)
+{
+    const watched_value *x = a, *y = b;
+
+    return x->address < y->address ? -1 : x->address > y->address;
+}
+
+static void free_values(void)
+{
+    free(watch.values);
+    free(watch.offsets);
+    free(watch.runs);
+    free(watch.current);
+    free(watch.previous);
+    watch.values = NULL;
+    watch.offsets = NULL;
+    watch.runs = NULL;
+    watch.current = watch.previous = NULL;
+    watch.num_values = watch.num_runs = watch.size = 0;
+}
+
+/* Sorts the values and merges the ones that touch into runs */
+static bool prepare_values(const watched_value *values, size_t count)
+{
+    size_t i, run_offset = 0;
+
+    if ((watch.values = malloc(count * sizeof(watched_value))) == NULL
+        || (watch.offsets = malloc(count * sizeof(size_t))) == NULL
+        || (watch.runs = malloc(count * sizeof(struct iovec))) == NULL)
+        goto error;
+    memcpy(watch.values, values, count * sizeof(watched_value));
+    qsort(watch.values, count, sizeof(watched_value), compare_values);
+    watch.num_values = count;
+
+    for (i = 0; i < count; i++) {
+        uint8_t *start = watch.values[i].address;
+        uint8_t *end = start + flags_to_memlength(ANYNUMBER, watch.values[i].flags);
+        struct iovec *run = watch.num_runs > 0 ? &watch.runs[watch.num_runs - 1] : NULL;
+
+        if (run && start <= (uint8_t *) run->iov_base + run->iov_len) {
+            if (end > (uint8_t *) run->iov_base + run->iov_len)
+                run->iov_len = end - (uint8_t *) run->iov_base;
+        } else {
+            if (run)
+                run_offset += run->iov_len;
+            run = &watch.runs[watch.num_runs++];
+            run->iov_base = start;
+            run->iov_len = end - start;
+        }
+        watch.offsets[i] = run_offset + (start - (uint8_t *) run->iov_base);
+    }
+    watch.size = run_offset + watch.runs[watch.num_runs - 1].iov_len;
+
+    if ((watch.current = calloc(1, watch.size)) == NULL
+        || (watch.previous = calloc(1, watch.size)) == NULL)
+        goto error;
+    return true;
+
+error:
+    free_values();
+    return false;
+}
+
+/* Reads all the runs into `current`, false if the target is gone. A run that
+ * can't be read keeps its previous bytes. */
+static bool read_values(void)
+{
+    memcpy(watch.current, watch.previous, watch.size);
+    return sm_read_runs(watch.target, watch.procmem_fd, &watch.vm_readv_usable,
+                        watch.runs, watch.num_runs, watch.current) == 0
+           || !sm_process_is_dead(watch.target);
+}
+
+/* Logs the values that changed since the previous sample */
+static void log_changes(const struct timespec *time)
+{
+    size_t i;
+
+    for (i = 0; i < watch.num_values; i++) {
+        size_t length = flags_to_memlength(ANYNUMBER, watch.values[i].flags);
+        const uint8_t *now = watch.current + watch.offsets[i];
+        watch_change *change;
+
+        if (memcmp(now, watch.previous + watch.offsets[i], length) == 0)
+            continue;
+
+        change = &watch.log[watch.log_next];
+        change->time = *time;
+        change->address = watch.values[i].address;
+        zero_value(&change->value);
+        memcpy(change->value.bytes, now, length);
+        change->value.flags = watch.values[i].flags;
+
+        watch.log_next = (watch.log_next + 1) % WATCH_LOG_SIZE;
+        if (watch.logged < WATCH_LOG_SIZE)
+            watch.logged++;
+        else
+            watch.dropped++;
+    }
+}
+
+/* The thread that samples the values */
+static void *run_watch(void *arg)
+{
+    struct timespec due;
+
+    (void) arg;
+
+    clock_gettime(CLOCK_MONOTONIC, &due);
+
+    pthread_mutex_lock(&watch.lock);
+    while (!watch.quit) {
+        struct timespec now, time;
+        bool alive;
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (timespec_before(&now, &due)) {
+            pthread_cond_timedwait(&watch.wake, &watch.lock, &due);
+            continue;
+        }
+
+        /* the log can be read meanwhile */
+        pthread_mutex_unlock(&watch.lock);
+        alive = read_values();
+        clock_gettime(CLOCK_REALTIME, &time);
+        pthread_mutex_lock(&watch.lock);
+
+        if (!alive) {
+            show_info("target process died, stopping the watch.\n");
+            watch.quit = true;
+            break;
+        }
+
+        /* the first sample is what the changes start from */
+        if (watch.samples++ > 0)
+            log_changes(&time);
+        memcpy(watch.previous, watch.current, watch.size);
+
+        /* samples missed while the target was busy aren't caught up */
+        timespec_add_us(&due, watch.interval_us);
+        if (timespec_before(&due, &now)) {
+            due = now;
+            timespec_add_us(&due, watch.interval_us);
+        }
+    }
+    pthread_mutex_unlock(&watch.lock);
+
+    return NULL;
+}
+
+/* Joins the thread, keeping the log */
+void watch_stop(void)
+{
+    if (watch.running) {
+        pthread_mutex_lock(&watch.lock);
+        watch.quit = true;
+        pthread_cond_signal(&watch.wake);
+        pthread_mutex_unlock(&watch.lock);
+
+        pthread_join(watch.thread, NULL);
+        pthread_cond_destroy(&watch.wake);
+        watch.running = false;
+    }
+
+    free_values();
+    if (watch.procmem_fd != -1)
+        close(watch.procmem_fd);
+    watch.procmem_fd = -1;
+}
+
+bool watch_start(pid_t target, const watched_value *values, size_t count,
+                 unsigned long interval_us)
+{
+    pthread_condattr_t attr;
+
+#if !HAVE_PROCESS_VM_READV && !HAVE_PROCMEM
+    show_error("cannot read the target without process_vm_readv() or /proc/pid/mem.\n");
+    return false;
+#endif
+
+    watch_stop();
+    watch.log_next = watch.logged = 0;
+    watch.dropped = 0;
+    watch.samples = 0;
+
+    if (!prepare_values(values, count)) {
+        show_error("memory allocation error while starting the watch.\n");
+        return false;
+    }
+    watch.target = target;
+    watch.interval_us = interval_us;
+    watch.quit = false;
+#if HAVE_PROCESS_VM_READV
+    watch.vm_readv_usable = true;
+#endif
+#if HAVE_PROCMEM
+    {
+        char mem[32];
+
+        snprintf(mem, sizeof(mem), "/proc/%d/mem", target);
+        watch.procmem_fd = open(mem, O_RDONLY);
+# if !HAVE_PROCESS_VM_READV
+        if (watch.procmem_fd == -1) {
+            show_error("unable to open %s.\n", mem);
+            free_values();
+            return false;
+        }
+# endif
+    }
+#endif
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&watch.wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (pthread_create(&watch.thread, NULL, run_watch, NULL) != 0) {
+        show_error("failed to start the watch thread.\n");
+        pthread_cond_destroy(&watch.wake);
+        watch_stop();
+        return false;
+    }
+    watch.running = true;
+    return true;
+}
+
+void watch_get_info(watch_info *info)
+{
+    pthread_mutex_lock(&watch.lock);
+    info->num_values = watch.num_values;
+    info->interval_us = watch.interval_us;
+    info->samples = watch.samples;
+    info->logged = watch.logged;
+    info->dropped = watch.dropped;
+    info->running = watch.running && !watch.quit;
+    pthread_mutex_unlock(&watch.lock);
+}
+
+size_t watch_read_log(watch_change *changes, size_t max, bool drain,
+                      unsigned long *dropped)
+{
+    size_t n, first, i;
+
+    pthread_mutex_lock(&watch.lock);
+    n = MIN(max, watch.logged);
+    first = (watch.log_next + WATCH_LOG_SIZE - n) % WATCH_LOG_SIZE;
+    for (i = 0; i < n; i++)
+        changes[i] = watch.log[(first + i) % WATCH_LOG_SIZE];
+    *dropped = watch.dropped;
+    if (drain) {
+        watch.logged = 0;
+        watch.dropped = 0;
+    }
+    pthread_mutex_unlock(&watch.lock);
+
+    return n;
+}
+
+#else /* !HAVE_PTHREAD */
+
+bool watch_start(pid_t target, const watched_value *values, size_t count,
+                 unsigned long interval_us)
+{
+    (void) target; (void) values; (void) count; (void) interval_us;
+
+    show_error("`watch` needs threads, which this build lacks.\n");
+    return false;
+}
+
+void watch_stop(void)
+{
+}
+
+void watch_get_info(watch_info *info)
+{
+    memset(info, 0, sizeof(*info));
+}
+
+size_t watch_read_log(watch_change *changes, size_t max, bool drain,
+                      unsigned long *dropped)
+{
+    (void) changes; (void) max; (void) drain;
+    *dropped = 0;
+    return 0;
+}
+
+#endif /* HAVE_PTHREAD */
@@ -0,0 +1,75 @@
+/*
+    Sample values in the background, and log their changes.
+
+    This file is part of libscanmem.
+
+    This library is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published
+    by the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "value.h"
+
+/* The number of changes the log keeps, older ones are dropped */
+#define WATCH_LOG_SIZE 8192
+
+/* A location to watch, its changes are shown as the types of `flags` */
+typedef struct {
+    void *address;
+    match_flags flags;
+} watched_value;
+
+/* A change seen by the watch, `value` holds the bytes in target order */
+typedef struct {
+    struct timespec time;       /* CLOCK_REALTIME of the sample */
+    void *address;
+    value_t value;
+} watch_change;
+
+typedef struct {
+    size_t num_values;
+    unsigned long interval_us;
+    unsigned long samples;      /* taken so far */
+    size_t logged;              /* changes in the log */
+    unsigned long dropped;      /* changes the log lost before they were read */
+    bool running;               /* false once stopped, or the target died */
+} watch_info;
+
+/*
+ * The watch reads its values from `target` every `interval_us` microseconds,
+ * from a thread of its own. Adjacent values are merged, so that a sample takes
+ * a single `process_vm_readv()` (or a `pread()` per run of bytes), without
+ * stopping the target. The changes between samples go into a log of the last
+ * WATCH_LOG_SIZE changes, read with watch_read_log().
+ * There is a single watch, starting one stops the previous one and clears
+ * the log. Stopping keeps the log until the next start.
+ */
+bool watch_start(pid_t target, const watched_value *values, size_t count,
+                 unsigned long interval_us);
+void watch_stop(void);
+void watch_get_info(watch_info *info);
+
+/* Copies up to `max` of the latest changes into `changes`, oldest first, and
+ * with `drain` removes all changes from the log. `dropped` gets the number of
+ * changes lost since the last drain. Returns the number of changes copied. */
+size_t watch_read_log(watch_change *changes, size_t max, bool drain,
+                      unsigned long *dropped);
+
+#endif /* WATCH_H */